@@ -0,0 +1,44 @@
+#ifndef ALLOCATIONCOUNTER
+#define ALLOCATIONCOUNTER
+
+#include <string>
+#include <cstdint>
+
+namespace Renderer
+{
+
+    struct FrameAllocationStats
+    {
+        // false without COUNT_ALLOCATIONS, everything else is then 0
+        bool counting = false;
+        // by the last frame
+        uint64_t last = 0;
+        // past warm up, frames that allocated and the most any did
+        uint64_t allocatingFrames = 0;
+        uint64_t peak = 0;
+
+        std::string report() const;
+    };
+
+    /*
+        Built with COUNT_ALLOCATIONS (cmake -DCOUNT_ALLOCATIONS=On) the
+        global operator new is replaced with one that counts calls per
+        thread, e.g.
+
+            uint64_t before = threadAllocations();
+            renderFrame();
+            uint64_t made = threadAllocations() - before;
+
+        Only operator new is seen, not malloc from C code or the
+        driver, nor over aligned new. Without COUNT_ALLOCATIONS
+        threadAllocations is always 0.
+    */
+
+    // true if built with COUNT_ALLOCATIONS
+    bool countingAllocations();
+
+    // operator new calls made by the calling thread so far
+    uint64_t threadAllocations();
+}
+
+#endif /* ALLOCATIONCOUNTER */
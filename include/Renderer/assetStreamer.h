@@ -0,0 +1,217 @@
+#ifndef ASSETSTREAMER
+#define ASSETSTREAMER
+
+#include <Renderer/textures.h>
+#include <Renderer/ktx.h>
+#include <Renderer/memoryBudget.h>
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+
+namespace Renderer
+{
+
+    typedef uint32_t AssetId;
+
+    const AssetId INVALID_ASSET = UINT32_MAX;
+
+    struct AssetStats
+    {
+        uint32_t requested = 0;
+        uint32_t resident = 0;
+        uint32_t failed = 0;
+        // waiting to be read, decoded or uploaded
+        uint32_t inFlight = 0;
+        // to stay under the memory budget, reloaded when next used
+        uint64_t evictions = 0;
+        uint64_t bytesRead = 0;
+        // update calls that created at least one texture
+        uint64_t uploadBatches = 0;
+        bool ioUring = false;
+
+        std::string report() const;
+    };
+
+    /*
+        Loads textures in the background so nothing waits on disk, e.g.
+
+            AssetId bricks = streamer.requestTexture("bricks.ktx2", 10);
+            ...
+            // once per frame, before TextureManager::flush
+            streamer.update(frameNumber);
+
+            // a placeholder until the texture is resident
+            draw.constants.texture = textures.get(streamer.use(bricks, frameNumber)).handle;
+
+        An I/O thread reads files highest priority first, keeping up
+        to queueDepth reads in flight with io_uring where the kernel
+        allows it, else one at a time with pread. Decoder threads turn
+        what was read into texels (PNM, or KTX2 decoded on the CPU if
+        the device cannot sample its format). update creates textures
+        for at most uploadBytes of decoded data per frame, which the
+        texture manager then uploads in one batch, so the cost of a
+        frame does not grow with the number of assets.
+
+        Resident textures are evictable through the memory budget,
+        least recently used first; use marks one used by a frame, and
+        reads it again if it was evicted.
+    */
+    class AssetStreamer
+    {
+
+    public:
+
+        // decoders 0 picks from the hardware concurrency
+        AssetStreamer
+        (
+            TextureManager & textures,
+            MemoryBudget & budget,
+            unsigned decoders = 0,
+            VkDeviceSize uploadBytes = 32 * 1024 * 1024,
+            unsigned queueDepth = 8
+        );
+
+        AssetStreamer(const AssetStreamer &) = delete;
+        AssetStreamer & operator=(const AssetStreamer &) = delete;
+
+        // joins the threads, abandoning what is still queued
+        ~AssetStreamer();
+
+        // .ktx2 or a PNM image, larger priorities are read first
+        AssetId requestTexture
+        (
+            const std::string & path,
+            int priority = 0,
+            const SamplerDescription & sampler = SamplerDescription(),
+            bool mipmaps = true
+        );
+
+        // reorders a read that has not started
+        void setPriority(AssetId id, int priority);
+
+        // create textures for what has been decoded, as used by frame, render thread only
+        void update(uint64_t frame);
+
+        // the placeholder until resident, and if loading failed
+        TextureId getTexture(AssetId id) const;
+        bool isResident(AssetId id) const;
+
+        // getTexture for a frame that samples it, keeping it from eviction, render thread only
+        TextureId use(AssetId id, uint64_t frame);
+
+        TextureId getPlaceholder() const { return placeholder; }
+
+        AssetStats getStats() const;
+
+    private:
+
+        struct Asset
+        {
+            std::string path;
+            int priority;
+            SamplerDescription sampler;
+            bool mipmaps;
+            TextureId texture = INVALID_TEXTURE;
+            EvictableId evictable = INVALID_EVICTABLE;
+            bool failed = false;
+            // not yet read again
+            bool evicted = false;
+        };
+
+        struct Request
+        {
+            int priority;
+            // earlier requests first at equal priority
+            uint64_t sequence;
+            AssetId id;
+            std::string path;
+
+            bool operator<(const Request & other) const
+            {
+                return priority != other.priority ? priority < other.priority : sequence > other.sequence;
+            }
+        };
+
+        struct Read
+        {
+            int priority;
+            uint64_t sequence;
+            AssetId id;
+            std::string path;
+            std::vector<uint8_t> bytes;
+
+            bool operator<(const Read & other) const
+            {
+                return priority != other.priority ? priority < other.priority : sequence > other.sequence;
+            }
+        };
+
+        struct Decoded
+        {
+            int priority;
+            AssetId id;
+            VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+            uint32_t width = 0, height = 0;
+            // a KTX2 file the device samples as stored, levels point into it
+            std::unique_ptr<Ktx2File> ktx;
+            // or decoded texels, one per level
+            std::vector<TextureData> pixels;
+            std::vector<TextureLevel> levels;
+            // else generate them from the one level
+            bool prebuiltLevels = false;
+            VkDeviceSize bytes = 0;
+            std::string error;
+        };
+
+        TextureManager & textures;
+        MemoryBudget & budget;
+        VkDeviceSize uploadBytes;
+        unsigned queueDepth;
+
+        TextureId placeholder;
+
+        // render thread only
+        std::vector<Asset> assets;
+
+        mutable std::mutex mutex;
+        std::condition_variable readWork, decodeWork;
+        std::priority_queue<Request> requests;
+        uint64_t sequence = 0;
+        // by asset, requests at another priority are stale
+        std::vector<int> priorities;
+        std::vector<bool> started;
+        std::priority_queue<Read> reads;
+        std::vector<Decoded> decoded;
+        bool stopping = false;
+
+        AssetStats stats;
+        // evicted and not requested again, neither resident nor in flight
+        uint32_t unloaded = 0;
+
+        std::thread io;
+        std::vector<std::thread> decoders;
+
+        void reader();
+        void decoder();
+
+        // a request to read if there is one, blocking for one only if wait
+        bool nextRequest(Request & request, bool wait, bool & stop);
+        void readComplete(const Request & request, std::vector<uint8_t> && bytes);
+        void readFailed(const Request & request, const std::string & error);
+
+        Decoded decode(Read & read);
+
+        // from MemoryBudget::update
+        void evict(AssetId id, uint64_t lastUsed);
+    };
+}
+
+#endif /* ASSETSTREAMER */
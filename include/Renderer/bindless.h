@@ -0,0 +1,143 @@
+#ifndef BINDLESS
+#define BINDLESS
+
+#include <Renderer/descriptors.h>
+
+#include <vulkan/vulkan.h>
+
+#include <stdexcept>
+#include <vector>
+#include <array>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+
+namespace Renderer
+{
+
+    typedef uint32_t BindlessHandle;
+
+    const BindlessHandle INVALID_BINDLESS_HANDLE = UINT32_MAX;
+
+    /*
+        Per draw indices into the bindless table, must match the
+        push_constant block in any shader using the table, e.g.
+
+            layout(push_constant) uniform DrawConstants
+            {
+                uint texture;
+                uint buffer;
+                uvec2 padding;
+                mat4 model;
+            } draw;
+
+            layout(set = 1, binding = 0) uniform sampler2D textures[];
+            layout(set = 1, binding = 1) buffer Buffers { float data[]; } buffers[];
+
+            texture(textures[nonuniformEXT(draw.texture)], uv);
+    */
+    struct DrawPushConstants
+    {
+        BindlessHandle texture = INVALID_BINDLESS_HANDLE;
+        BindlessHandle buffer = INVALID_BINDLESS_HANDLE;
+        uint32_t padding[2] = {0, 0};
+        // column major object transform, applied before the frame's ubo.model
+        float model[16] = {1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1};
+    };
+
+    /*
+        One global descriptor set holding large arrays of sampled
+        images and storage buffers, bound once per frame.
+
+        Uses VK_EXT_descriptor_indexing so that
+
+            - entries may be written while the set is bound (update after bind)
+            - unused entries need not be valid (partially bound)
+
+        Resources are addressed by integer handles passed in push constants.
+    */
+    class BindlessTable
+    {
+
+    public:
+
+        static const uint32_t TEXTURE_BINDING = 0;
+        static const uint32_t BUFFER_BINDING = 1;
+
+        // of a stage's update after bind resources, left for the other sets and attachments
+        static const uint32_t RESERVED_RESOURCES = 64;
+
+        // requested sizes are clamped to the device's update after bind limits,
+        //  textures and buffers together to what a stage can access less RESERVED_RESOURCES
+        BindlessTable
+        (
+            VkPhysicalDevice physicalDevice,
+            VkDevice d,
+            DescriptorLayoutCache & layoutCache,
+            uint32_t framesInFlight,
+            uint32_t maxTextures = 16384,
+            uint32_t maxBuffers = 16384
+        );
+
+        BindlessTable(const BindlessTable &) = delete;
+        BindlessTable & operator=(const BindlessTable &) = delete;
+
+        ~BindlessTable();
+
+        // true if the device has the descriptor indexing features the table needs
+        static bool supported(VkPhysicalDevice physicalDevice);
+
+        // fill in the feature struct to chain into VkDeviceCreateInfo
+        static VkPhysicalDeviceDescriptorIndexingFeaturesEXT requiredFeatures();
+
+        BindlessHandle addTexture
+        (
+            VkImageView view,
+            VkSampler sampler,
+            VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+        );
+
+        BindlessHandle addBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+
+        // handles are recycled once the frames that may reference them retire
+        void removeTexture(BindlessHandle handle);
+        void removeBuffer(BindlessHandle handle);
+
+        // call once per frame, after that frame slot's fence has signalled
+        void beginFrame(uint32_t frame);
+
+        void bind(VkCommandBuffer commandBuffer, VkPipelineLayout layout, uint32_t setIndex) const;
+
+        VkDescriptorSetLayout getLayout() const { return layout; }
+        VkDescriptorSet getSet() const { return set; }
+
+        uint32_t textureCapacity() const { return maxTextures; }
+        uint32_t bufferCapacity() const { return maxBuffers; }
+
+    private:
+
+        struct HandlePool
+        {
+            uint32_t next = 0;
+            std::vector<BindlessHandle> free;
+            // handles released during frame i, returned to free when i comes round again
+            std::vector<std::vector<BindlessHandle>> retired;
+
+            BindlessHandle take(uint32_t capacity);
+        };
+
+        VkDevice device;
+
+        uint32_t maxTextures, maxBuffers;
+
+        uint32_t currentFrame;
+
+        VkDescriptorSetLayout layout;
+        VkDescriptorPool pool;
+        VkDescriptorSet set;
+
+        HandlePool textures, buffers;
+    };
+}
+
+#endif /* BINDLESS */
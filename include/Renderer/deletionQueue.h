@@ -0,0 +1,62 @@
+#ifndef DELETIONQUEUE
+#define DELETIONQUEUE
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <cstdint>
+
+namespace Renderer
+{
+
+    /*
+        Defers destruction of GPU resources until the frame that last
+        used them has finished, i.e. its fence has signalled.
+
+            deletionQueue.push(frameNumber, [=]() { vkDestroyBuffer(device, buffer, nullptr); });
+
+            ...
+
+            // every frame before framesCompleted is done on the gpu
+            deletionQueue.flush(framesCompleted);
+
+        Callbacks run in push order. Safe to push from any thread,
+        flush from the render thread.
+    */
+    class DeletionQueue
+    {
+
+    public:
+
+        DeletionQueue() = default;
+
+        DeletionQueue(const DeletionQueue &) = delete;
+        DeletionQueue & operator=(const DeletionQueue &) = delete;
+
+        // destroy runs once frame lastUsed has completed
+        void push(uint64_t lastUsed, std::function<void()> destroy);
+
+        // run callbacks for every frame < framesCompleted
+        void flush(uint64_t framesCompleted);
+
+        // run everything, the device must be idle
+        void flushAll();
+
+        size_t size() const;
+
+    private:
+
+        struct Entry
+        {
+            uint64_t lastUsed;
+            std::function<void()> destroy;
+        };
+
+        mutable std::mutex mutex;
+
+        // non decreasing in lastUsed, so flushing only looks at the front
+        std::deque<Entry> entries;
+    };
+}
+
+#endif /* DELETIONQUEUE */
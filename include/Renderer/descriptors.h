@@ -0,0 +1,186 @@
+#ifndef DESCRIPTORS
+#define DESCRIPTORS
+
+#include <vulkan/vulkan.h>
+
+#include <stdexcept>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+#include <functional>
+
+namespace Renderer
+{
+
+    /*
+        Descriptors per set each pool is sized for, as a multiple
+        of the pool's set count, e.g. 2.0 uniform buffers per set
+    */
+    struct DescriptorPoolSizes
+    {
+        std::vector<std::pair<VkDescriptorType, float>> sizes =
+        {
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.0f},
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.0f},
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f}
+        };
+    };
+
+    /*
+        Hands out descriptor sets from a list of pools, growing
+        with a new (larger) pool whenever the current one is full.
+
+        Sets are never freed individually, instead reset() recycles
+        every pool at once, so one allocator per frame in flight can
+        be reset as soon as that frame's fence signals.
+    */
+    class DescriptorAllocator
+    {
+
+    public:
+
+        DescriptorAllocator(VkDevice d, uint32_t initialSets = 16, DescriptorPoolSizes s = DescriptorPoolSizes())
+        : device(d), setsPerPool(initialSets), poolSizes(s), currentPool(VK_NULL_HANDLE)
+        {}
+
+        DescriptorAllocator(const DescriptorAllocator &) = delete;
+        DescriptorAllocator & operator=(const DescriptorAllocator &) = delete;
+
+        ~DescriptorAllocator();
+
+        VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+
+        // return all pools to the free list, invalidating every set handed out
+        void reset();
+
+        size_t poolCount() const { return usedPools.size() + freePools.size(); }
+
+    private:
+
+        // pools double in size as they are created, up to this many sets
+        static const uint32_t MAX_SETS_PER_POOL = 4096;
+
+        VkDevice device;
+
+        uint32_t setsPerPool;
+
+        DescriptorPoolSizes poolSizes;
+
+        VkDescriptorPool currentPool;
+        std::vector<VkDescriptorPool> usedPools, freePools;
+
+        VkDescriptorPool grabPool();
+        VkDescriptorPool createPool(uint32_t sets);
+    };
+
+    /*
+        Caches VkDescriptorSetLayouts by their binding description,
+        so identical layouts requested by different pipelines or
+        materials share one handle
+    */
+    class DescriptorLayoutCache
+    {
+
+    public:
+
+        DescriptorLayoutCache(VkDevice d)
+        : device(d)
+        {}
+
+        DescriptorLayoutCache(const DescriptorLayoutCache &) = delete;
+        DescriptorLayoutCache & operator=(const DescriptorLayoutCache &) = delete;
+
+        ~DescriptorLayoutCache();
+
+        // bindingFlags, if given, must have one entry per binding (VK_EXT_descriptor_indexing)
+        VkDescriptorSetLayout get
+        (
+            std::vector<VkDescriptorSetLayoutBinding> bindings,
+            VkDescriptorSetLayoutCreateFlags flags = 0,
+            std::vector<VkDescriptorBindingFlagsEXT> bindingFlags = {}
+        );
+
+        size_t size() const { return layouts.size(); }
+
+        struct LayoutDescription
+        {
+            std::vector<VkDescriptorSetLayoutBinding> bindings;
+            VkDescriptorSetLayoutCreateFlags flags;
+            std::vector<VkDescriptorBindingFlagsEXT> bindingFlags;
+
+            bool operator==(const LayoutDescription & other) const;
+
+            size_t hash() const;
+        };
+
+    private:
+
+        struct LayoutHash
+        {
+            size_t operator()(const LayoutDescription & d) const { return d.hash(); }
+        };
+
+        VkDevice device;
+
+        std::unordered_map<LayoutDescription, VkDescriptorSetLayout, LayoutHash> layouts;
+    };
+
+    /*
+        Caches VkPipelineLayouts by their set layouts and push
+        constant ranges, pipelines with matching interfaces share
+        one layout so descriptor sets stay compatible between them
+    */
+    class PipelineLayoutCache
+    {
+
+    public:
+
+        PipelineLayoutCache(VkDevice d)
+        : device(d)
+        {}
+
+        PipelineLayoutCache(const PipelineLayoutCache &) = delete;
+        PipelineLayoutCache & operator=(const PipelineLayoutCache &) = delete;
+
+        ~PipelineLayoutCache();
+
+        VkPipelineLayout get
+        (
+            const std::vector<VkDescriptorSetLayout> & setLayouts,
+            const std::vector<VkPushConstantRange> & pushConstantRanges
+        );
+
+        size_t size() const { return layouts.size(); }
+
+    private:
+
+        struct LayoutDescription
+        {
+            std::vector<VkDescriptorSetLayout> setLayouts;
+            std::vector<VkPushConstantRange> pushConstantRanges;
+
+            bool operator==(const LayoutDescription & other) const;
+
+            size_t hash() const;
+        };
+
+        struct LayoutHash
+        {
+            size_t operator()(const LayoutDescription & d) const { return d.hash(); }
+        };
+
+        VkDevice device;
+
+        std::unordered_map<LayoutDescription, VkPipelineLayout, LayoutHash> layouts;
+    };
+
+    // boost style hash_combine
+    inline void hashCombine(size_t & seed, size_t v)
+    {
+        seed ^= v + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+    }
+}
+
+#endif /* DESCRIPTORS */
@@ -0,0 +1,101 @@
+#ifndef DYNAMICRESOLUTION
+#define DYNAMICRESOLUTION
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace Renderer
+{
+
+    /*
+        Picks a render scale (fraction of the output width and height)
+        each frame to hold GPU time near a budget.
+
+        GPU cost is roughly proportional to pixel count, i.e. scale^2,
+        so the scale that would have hit the budget is
+
+            scale * sqrt(budget / gpuTime)
+
+        The measured time is smoothed, and the scale moves only part
+        of the way there each frame, so a single slow frame does not
+        cause a visible jump. Inside the dead band nothing changes.
+    */
+    class ResolutionController
+    {
+
+    public:
+
+        ResolutionController
+        (
+            double budgetMs = 1000.0/60.0,
+            double minScale = 0.5,
+            double maxScale = 1.0
+        )
+        : budget(budgetMs), minimum(minScale), maximum(maxScale), scale(maxScale)
+        {}
+
+        void setBudget(double budgetMs) { budget = budgetMs; }
+        double getBudget() const { return budget; }
+
+        void setRange(double minScale, double maxScale)
+        {
+            minimum = minScale;
+            maximum = maxScale;
+            scale = std::clamp(scale, minimum, maximum);
+        }
+
+        // the smoothed GPU time the last update saw
+        double getGpuTime() const { return smoothed; }
+
+        double getScale() const { return scale; }
+
+        void reset() { scale = maximum; smoothed = 0.0; }
+
+        double update(double gpuMs)
+        {
+            smoothed = smoothed == 0.0 ? gpuMs : smoothed+SMOOTHING*(gpuMs-smoothed);
+
+            if (smoothed <= 0.0)
+            {
+                return scale;
+            }
+
+            // aim a little under budget, so noise does not push frames over
+            double ratio = (budget*HEADROOM)/smoothed;
+
+            if (std::abs(ratio-1.0) < DEAD_BAND)
+            {
+                return scale;
+            }
+
+            double ideal = std::clamp(scale*std::sqrt(ratio), minimum, maximum);
+            scale = std::clamp(scale+RESPONSE*(ideal-scale), minimum, maximum);
+
+            return scale;
+        }
+
+        // at least 1x1 and no larger than the maximum size
+        VkExtent2D extent(VkExtent2D full) const
+        {
+            return
+            {
+                std::clamp(uint32_t(std::lround(full.width*scale)), 1u, full.width),
+                std::clamp(uint32_t(std::lround(full.height*scale)), 1u, full.height)
+            };
+        }
+
+    private:
+
+        static constexpr double SMOOTHING = 0.1;
+        static constexpr double RESPONSE = 0.25;
+        static constexpr double HEADROOM = 0.9;
+        static constexpr double DEAD_BAND = 0.05;
+
+        double budget, minimum, maximum, scale;
+        double smoothed = 0.0;
+    };
+}
+
+#endif /* DYNAMICRESOLUTION */
@@ -0,0 +1,58 @@
+#ifndef FRAGMENTCOUNTER
+#define FRAGMENTCOUNTER
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+#include <optional>
+#include <cstdint>
+
+namespace Renderer
+{
+
+    /*
+        Counts fragment shader invocations per frame in flight with a
+        pipeline statistics query, for overdraw, i.e.
+
+            invocations / pixels covered
+
+        1 means every pixel was shaded once, early depth testing of
+        front to back draws pushes it towards 1.
+
+        Needs the pipelineStatisticsQuery device feature, else does
+        nothing.
+    */
+    class FragmentCounter
+    {
+
+    public:
+
+        FragmentCounter(VkDevice device, bool supported, unsigned framesInFlight);
+
+        FragmentCounter(const FragmentCounter &) = delete;
+        FragmentCounter & operator=(const FragmentCounter &) = delete;
+
+        ~FragmentCounter();
+
+        bool supported() const { return pool != VK_NULL_HANDLE; }
+
+        // reset, outside a render pass
+        void reset(VkCommandBuffer commandBuffer, unsigned frame);
+
+        // around the draws
+        void begin(VkCommandBuffer commandBuffer, unsigned frame);
+        void end(VkCommandBuffer commandBuffer, unsigned frame);
+
+        // once the frame's fence has signalled, never stalls
+        std::optional<uint64_t> read(unsigned frame);
+
+    private:
+
+        VkDevice device;
+        VkQueryPool pool = VK_NULL_HANDLE;
+
+        std::vector<bool> written;
+    };
+}
+
+#endif /* FRAGMENTCOUNTER */
@@ -0,0 +1,98 @@
+#ifndef FRAMEPACING
+#define FRAMEPACING
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <cstddef>
+
+namespace Renderer
+{
+
+    typedef std::chrono::steady_clock PacingClock;
+
+    /*
+        Holds the last WINDOW frame times for reporting, e.g.
+
+            frame 16.67 ms (60.0 fps) sd 0.21 ms min 16.20 max 17.31 p99 17.10
+
+        A small standard deviation matters more than the mean for
+        perceived smoothness, a steady 30 fps looks better than
+        an average of 50 jumping between 30 and 60.
+    */
+    class FrameTimes
+    {
+
+    public:
+
+        static const size_t WINDOW = 240;
+
+        FrameTimes() : times(WINDOW, 0.0) {}
+
+        void record(double milliseconds);
+
+        size_t count() const { return samples; }
+
+        double mean() const;
+        double variance() const;
+        double standardDeviation() const;
+        double min() const;
+        double max() const;
+        // e.g. 0.99 for the 99th percentile
+        double percentile(double p) const;
+
+        std::string report() const;
+
+    private:
+
+        std::vector<double> times;
+        size_t next = 0;
+        size_t samples = 0;
+    };
+
+    /*
+        CPU side frame limiter. wait() is called once a frame and
+        returns at the next multiple of the target period.
+
+        OS sleeps overshoot by up to a scheduler quantum (often
+        1-2 ms, worse on Windows), so wait() sleeps until shortly
+        before the deadline and spins the rest. The spin margin
+        tracks the observed oversleep, so it stays small on a
+        system with a fine timer.
+
+        A target of 0 disables limiting.
+    */
+    class FrameLimiter
+    {
+
+    public:
+
+        FrameLimiter(double targetFps = 0.0) { setTarget(targetFps); }
+
+        void setTarget(double targetFps);
+        double getTarget() const { return fps; }
+
+        bool enabled() const { return fps > 0.0; }
+
+        // returns the time since the previous wait() returned, in ms
+        double wait();
+
+    private:
+
+        // never sleep closer to the deadline than this
+        static constexpr double MIN_SPIN_MS = 0.2;
+        // nor trust the sleep less than this
+        static constexpr double MAX_SPIN_MS = 4.0;
+
+        double fps = 0.0;
+        PacingClock::duration period = PacingClock::duration::zero();
+
+        PacingClock::time_point deadline;
+        PacingClock::time_point last;
+        bool started = false;
+
+        double spinMargin = 1.0;
+    };
+}
+
+#endif /* FRAMEPACING */
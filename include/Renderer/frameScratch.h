@@ -0,0 +1,128 @@
+#ifndef FRAMESCRATCH
+#define FRAMESCRATCH
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace Renderer
+{
+
+    struct FrameScratchStats
+    {
+        // per frame
+        size_t capacity = 0;
+        // by the last frame, and the most any frame used
+        size_t used = 0;
+        size_t peak = 0;
+        // heap blocks taken because a frame outgrew its region, folded in on its next begin
+        uint64_t overflows = 0;
+
+        std::string report() const;
+    };
+
+    /*
+        Linear allocator for CPU data that lives no longer than a frame
+        (barrier arrays, attachment lists, sorting keys), split into a
+        region per frame in flight, e.g.
+
+            // once the frame's fence has signalled
+            scratch.begin(currentFrame);
+
+            VkImageMemoryBarrier * barriers = scratch.allocate<VkImageMemoryBarrier>(count);
+
+            ScratchVector<VkImageView> views(scratch);
+            views.reserve(attachments);
+
+        Allocation is a pointer bump, nothing is freed until the frame
+        index comes round again, and nothing is destructed, so only
+        trivially destructible types belong in it. A frame that outgrows
+        its region takes heap blocks, the region is grown to cover them
+        on its next begin so steady state frames make no heap
+        allocations. Render thread only.
+    */
+    class FrameScratch
+    {
+
+    public:
+
+        FrameScratch(unsigned framesInFlight, size_t bytesPerFrame = 64 * 1024);
+
+        FrameScratch(const FrameScratch &) = delete;
+        FrameScratch & operator=(const FrameScratch &) = delete;
+
+        // starts the frame's region over, nothing may still point into it
+        void begin(unsigned frame);
+
+        // alignment is a power of two
+        void * allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+        // uninitialised
+        template <class T>
+        T * allocate(size_t count)
+        {
+            return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+        }
+
+        const FrameScratchStats & getStats() const { return stats; }
+
+    private:
+
+        struct Region
+        {
+            std::unique_ptr<uint8_t[]> block;
+            size_t size = 0;
+            size_t used = 0;
+            // this frame's overflow, and what it adds up to
+            std::vector<std::unique_ptr<uint8_t[]>> overflow;
+            size_t overflowBytes = 0;
+        };
+
+        std::vector<Region> regions;
+        unsigned frame = 0;
+
+        FrameScratchStats stats;
+    };
+
+    // for standard containers, deallocate does nothing so reserve up front
+    template <class T>
+    class ScratchAllocator
+    {
+
+    public:
+
+        typedef T value_type;
+
+        ScratchAllocator(FrameScratch & scratch)
+        : scratch(&scratch)
+        {}
+
+        template <class U>
+        ScratchAllocator(const ScratchAllocator<U> & other)
+        : scratch(other.scratch)
+        {}
+
+        T * allocate(size_t n) { return scratch->allocate<T>(n); }
+        void deallocate(T *, size_t) {}
+
+        template <class U>
+        bool operator==(const ScratchAllocator<U> & other) const { return scratch == other.scratch; }
+
+        template <class U>
+        bool operator!=(const ScratchAllocator<U> & other) const { return scratch != other.scratch; }
+
+    private:
+
+        template <class U>
+        friend class ScratchAllocator;
+
+        FrameScratch * scratch;
+    };
+
+    template <class T>
+    using ScratchVector = std::vector<T, ScratchAllocator<T>>;
+}
+
+#endif /* FRAMESCRATCH */
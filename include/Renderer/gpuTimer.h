@@ -0,0 +1,71 @@
+#ifndef GPUTIMER
+#define GPUTIMER
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+#include <optional>
+#include <cstdint>
+
+namespace Renderer
+{
+
+    /*
+        Measures GPU time per frame in flight with a pair of
+        timestamp queries, e.g.
+
+            timer.begin(commandBuffer, currentFrame);
+                ... render ...
+            timer.end(commandBuffer, currentFrame);
+
+            ...
+
+            // once the frame's fence has signalled
+            std::optional<double> ms = timer.read(currentFrame);
+
+        Reading never stalls, results not yet available (or never
+        written) give nullopt. Does nothing if the queue does not
+        support timestamps.
+    */
+    class GpuTimer
+    {
+
+    public:
+
+        GpuTimer
+        (
+            VkPhysicalDevice physicalDevice,
+            VkDevice device,
+            uint32_t queueFamily,
+            unsigned framesInFlight
+        );
+
+        GpuTimer(const GpuTimer &) = delete;
+        GpuTimer & operator=(const GpuTimer &) = delete;
+
+        ~GpuTimer();
+
+        bool supported() const { return pool != VK_NULL_HANDLE; }
+
+        // outside a render pass
+        void begin(VkCommandBuffer commandBuffer, unsigned frame);
+        void end(VkCommandBuffer commandBuffer, unsigned frame);
+
+        // milliseconds between begin and end
+        std::optional<double> read(unsigned frame);
+
+    private:
+
+        VkDevice device;
+        VkQueryPool pool = VK_NULL_HANDLE;
+
+        // nanoseconds per tick
+        double period = 1.0;
+        // bits of the timestamps that are valid, the rest is garbage
+        uint64_t mask = ~uint64_t(0);
+
+        std::vector<bool> written;
+    };
+}
+
+#endif /* GPUTIMER */
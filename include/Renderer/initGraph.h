@@ -0,0 +1,86 @@
+#ifndef INITGRAPH
+#define INITGRAPH
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+
+namespace Renderer
+{
+
+    struct InitTiming
+    {
+        std::string name;
+        // ms since run began
+        double start = 0.0;
+        double end = 0.0;
+        // 0 is the calling thread
+        unsigned thread = 0;
+    };
+
+    struct InitTimeline
+    {
+        std::vector<InitTiming> steps;
+        // wall time of the whole run, and the sum of its steps'
+        double total = 0.0;
+        double work = 0.0;
+        unsigned threads = 1;
+
+        // one line per step, in start order
+        std::string report() const;
+    };
+
+    /*
+        Initialisation as named steps and what each must come after,
+        run in parallel wherever the dependencies allow, e.g.
+
+            InitGraph graph;
+            graph.add("device", [&]() { createLogicalDevice(); });
+            graph.add("swapChain", [&]() { createSwapChain(); }, {"device"});
+            graph.add("shaders", [&]() { compileShaders(); }, {"device"});
+            graph.run(4);
+
+            std::cout << graph.getTimeline().report();
+
+        Steps that share something externally synchronised (a queue,
+        a command pool) must be ordered by a dependency even when one
+        does not need the other's result. If a step throws nothing new
+        is started, the running steps finish, then run rethrows.
+    */
+    class InitGraph
+    {
+
+    public:
+
+        InitGraph() = default;
+
+        InitGraph(const InitGraph &) = delete;
+        InitGraph & operator=(const InitGraph &) = delete;
+
+        // after names steps already added
+        void add(const std::string & name, std::function<void()> step, const std::vector<std::string> & after = {});
+
+        // once, threads includes the caller, 0 picks from the hardware concurrency
+        void run(unsigned threads = 0);
+
+        const InitTimeline & getTimeline() const { return timeline; }
+
+    private:
+
+        struct Step
+        {
+            std::string name;
+            std::function<void()> run;
+            std::vector<size_t> dependents;
+            size_t waitingOn = 0;
+        };
+
+        std::vector<Step> steps;
+
+        InitTimeline timeline;
+    };
+}
+
+#endif /* INITGRAPH */
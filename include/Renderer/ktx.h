@@ -0,0 +1,122 @@
+#ifndef KTX
+#define KTX
+
+#include <Renderer/textures.h>
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace Renderer
+{
+
+    /*
+        A read only view of a whole file, mapped where the platform
+        allows so level data can be copied straight into staging
+        without first being read into a buffer.
+    */
+    class MappedFile
+    {
+
+    public:
+
+        // throws if the file cannot be opened
+        MappedFile(const std::string & path);
+
+        // a file already read into memory
+        explicit MappedFile(std::vector<uint8_t> && contents);
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile & operator=(const MappedFile &) = delete;
+
+        ~MappedFile();
+
+        const uint8_t * data() const { return bytes; }
+        size_t size() const { return length; }
+
+    private:
+
+        const uint8_t * bytes = nullptr;
+        size_t length = 0;
+
+        // read into memory where mapping is unavailable, or given
+        std::vector<uint8_t> contents;
+    };
+
+    // texel block dimensions and size of a (possibly) block compressed format
+    struct BlockFormat
+    {
+        uint32_t width = 1;
+        uint32_t height = 1;
+        uint32_t bytes = 0;
+
+        // of a width by height image
+        size_t size(uint32_t width, uint32_t height) const;
+    };
+
+    // bytes 0 if the format is not a BC, ETC2/EAC, ASTC or 8 bit RGBA format
+    BlockFormat blockFormat(VkFormat format);
+
+    /*
+        A KTX2 file (https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html)
+        holding one 2D image with pre-built mip levels, e.g. as written by
+
+            toktx --t2 --encode uastc ...   (not supercompressed)
+            ktx create --format BC7_SRGB_BLOCK --generate-mipmap ...
+
+        Supercompressed (Basis, zstd), array, cube map and 3D textures
+        are rejected. Level data points into the mapped file.
+    */
+    class Ktx2File
+    {
+
+    public:
+
+        // throws if the file is not a supported KTX2 texture
+        Ktx2File(const std::string & path);
+
+        // from a file already read, name is for errors
+        Ktx2File(std::vector<uint8_t> && contents, const std::string & name);
+
+        VkFormat getFormat() const { return format; }
+        uint32_t getWidth() const { return width; }
+        uint32_t getHeight() const { return height; }
+
+        // level 0 is the full size image
+        const std::vector<TextureLevel> & getLevels() const { return levels; }
+
+    private:
+
+        MappedFile file;
+
+        VkFormat format;
+        uint32_t width, height;
+
+        std::vector<TextureLevel> levels;
+
+        void parse(const std::string & path);
+    };
+
+    // true if decodeBlocks can transcode the format to 8 bit RGBA
+    bool canDecode(VkFormat format);
+
+    // the RGBA format decoded texels are in, sRGB or snorm if the source was
+    VkFormat decodedFormat(VkFormat format);
+
+    // e.g. VK_FORMAT_ASTC_4x4_SRGB_BLOCK, for errors
+    std::string formatName(VkFormat format);
+
+    /*
+        Decode a BC1-BC5 (unorm, snorm or srgb) image to 8 bit RGBA on
+        the CPU, for devices that cannot sample the format. Single and
+        two channel formats fill the rest with 0 and alpha with 1.0,
+        as sampling them would. ETC2, EAC, ASTC, BC6H and BC7 have no
+        decoder.
+    */
+    TextureData decodeBlocks(VkFormat format, const uint8_t * data, size_t bytes, uint32_t width, uint32_t height);
+}
+
+#endif /* KTX */
@@ -0,0 +1,216 @@
+#ifndef MEMORYBUDGET
+#define MEMORYBUDGET
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
+#include <cstdint>
+
+namespace Renderer
+{
+
+    struct HeapBudget
+    {
+        VkDeviceSize size = 0;
+        // what the driver says the process can use, or a share of size without VK_EXT_memory_budget
+        VkDeviceSize budget = 0;
+        // by the whole process with the extension, else what was allocated here
+        VkDeviceSize usage = 0;
+        // allocated through the budget
+        VkDeviceSize allocated = 0;
+        uint32_t allocations = 0;
+        bool deviceLocal = false;
+    };
+
+    struct MemoryBudgetStats
+    {
+        std::vector<HeapBudget> heaps;
+        bool extension = false;
+        uint64_t evictions = 0;
+        VkDeviceSize evictedBytes = 0;
+        // placed on another heap than the best match as it was over budget
+        uint64_t fallbacks = 0;
+        uint64_t failures = 0;
+        // integrated, all memory is device local
+        bool unified = false;
+        // device local and host visible beyond the 256 MiB BAR window
+        bool resizableBar = false;
+
+        std::string report() const;
+    };
+
+    typedef uint32_t EvictableId;
+
+    const EvictableId INVALID_EVICTABLE = UINT32_MAX;
+
+    /*
+        Accounts for device memory per heap, and chooses memory types
+        and evicts streamable resources with it, e.g.
+
+            VkDeviceMemory memory = budget.allocate(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, 0, "texture bricks");
+            ...
+            budget.free(memory);
+
+        With VK_EXT_memory_budget usage and budget come from the driver
+        (refreshed by update, plus what has been allocated since), else
+        usage is what was allocated here against a share of each heap.
+
+        Memory types must have every required flag. Among those the
+        one missing the fewest preferred flags and having the fewest
+        avoided flags is picked, then one whose heap has room below the
+        high water mark, then the driver's order, e.g. for buffers the
+        CPU writes and the GPU reads
+            required HOST_VISIBLE, preferred DEVICE_LOCAL, avoided HOST_CACHED
+        and for staging
+            required HOST_VISIBLE | HOST_COHERENT, avoided DEVICE_LOCAL
+        so it does not take BAR memory. Allocations that fail say which
+        heap, how full it was and what they were for.
+
+        directWrites is true on integrated (UMA) devices and with a
+        resizable BAR, where buffers can be written in device local
+        memory instead of staged and copied.
+
+        Resources that can be reloaded (streamed textures) register as
+        evictable and are touched whenever a frame uses them. Once a
+        heap passes the high water mark update evicts the least
+        recently used, if no frame in flight uses it, until the heap is
+        below the low water mark. evict is called with the last frame
+        that used it, the entry is already removed, and the owner frees
+        the memory once that frame has completed.
+    */
+    class MemoryBudget
+    {
+
+    public:
+
+        static bool extensionSupported(VkPhysicalDevice physicalDevice);
+
+        // fractions of each heap's budget
+        MemoryBudget
+        (
+            VkPhysicalDevice physicalDevice,
+            VkDevice device,
+            bool extension,
+            float highWater = 0.9f,
+            float lowWater = 0.8f
+        );
+
+        MemoryBudget(const MemoryBudget &) = delete;
+        MemoryBudget & operator=(const MemoryBudget &) = delete;
+
+        // types allowed by typeFilter with every required flag, throws if there are none
+        uint32_t findMemoryType
+        (
+            uint32_t typeFilter,
+            VkMemoryPropertyFlags required,
+            VkMemoryPropertyFlags preferred = 0,
+            VkMemoryPropertyFlags avoided = 0,
+            VkDeviceSize size = 0
+        );
+
+        // throws, naming what and the heap, if the memory cannot be allocated
+        VkDeviceMemory allocate
+        (
+            const VkMemoryRequirements & requirements,
+            VkMemoryPropertyFlags required,
+            VkMemoryPropertyFlags preferred,
+            VkMemoryPropertyFlags avoided,
+            const std::string & what
+        );
+
+        VkDeviceMemory allocate(VkDeviceSize size, uint32_t typeIndex, const std::string & what);
+
+        // frees immediately, defer it until no frame uses the memory
+        void free(VkDeviceMemory memory);
+
+        VkMemoryPropertyFlags properties(uint32_t typeIndex) const { return memoryProperties.memoryTypes[typeIndex].propertyFlags; }
+        // of the type an allocation was made in
+        VkMemoryPropertyFlags properties(VkDeviceMemory memory) const;
+
+        bool unified() const { return stats.unified; }
+        bool resizableBar() const { return stats.resizableBar; }
+        // device local memory the CPU can write to, worth skipping a staging copy for
+        bool directWrites() const { return stats.unified || stats.resizableBar; }
+
+        // evict may be called from update, on the render thread
+        EvictableId addEvictable(VkDeviceMemory memory, std::function<void(uint64_t lastUsed)> evict);
+        void touch(EvictableId id, uint64_t frame);
+        void removeEvictable(EvictableId id);
+
+        // once a frame, refresh the budget and evict what is over it
+        void update(uint64_t framesCompleted);
+
+        MemoryBudgetStats getStats() const;
+
+    private:
+
+        struct Allocation
+        {
+            uint32_t type;
+            uint32_t heap;
+            VkDeviceSize size;
+            EvictableId evictable;
+            // evicted, freed once its last frame completes
+            bool evicted;
+        };
+
+        struct Evictable
+        {
+            VkDeviceMemory memory;
+            uint32_t heap;
+            VkDeviceSize size;
+            uint64_t lastUsed;
+            std::function<void(uint64_t)> evict;
+            std::list<EvictableId>::iterator lru;
+        };
+
+        VkPhysicalDevice physicalDevice;
+        VkDevice device;
+        bool extension;
+        float highWater, lowWater;
+
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+
+        mutable std::mutex mutex;
+
+        std::vector<HeapBudget> heaps;
+        // allocated by the time of the last refresh, usage since is estimated from it
+        std::vector<VkDeviceSize> allocatedAtRefresh;
+        // evicted, not yet freed
+        std::vector<VkDeviceSize> evicting;
+
+        std::unordered_map<VkDeviceMemory, Allocation> allocations;
+
+        std::unordered_map<EvictableId, Evictable> evictables;
+        EvictableId nextEvictable = 0;
+        // most recently used at the front
+        std::list<EvictableId> lru;
+
+        MemoryBudgetStats stats;
+
+        void refresh();
+
+        uint32_t choose
+        (
+            uint32_t typeFilter,
+            VkMemoryPropertyFlags required,
+            VkMemoryPropertyFlags preferred,
+            VkMemoryPropertyFlags avoided,
+            VkDeviceSize size,
+            bool & fellBack
+        );
+
+        // usage as of now, less what is being evicted
+        VkDeviceSize usage(uint32_t heap) const;
+
+        // the usage a heap may reach before eviction or falling back
+        VkDeviceSize limit(uint32_t heap, float water) const;
+    };
+}
+
+#endif /* MEMORYBUDGET */
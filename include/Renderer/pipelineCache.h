@@ -0,0 +1,236 @@
+#ifndef PIPELINECACHE
+#define PIPELINECACHE
+
+#include <Renderer/deletionQueue.h>
+#include <Shader/variants.h>
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+
+namespace Renderer
+{
+
+    /*
+        Everything a graphics pipeline is built from. Viewport and
+        scissor are dynamic, the pipeline layout is the shader's.
+    */
+    struct PipelineDescription
+    {
+        // registered with PipelineCache::setShader
+        std::string shader;
+
+        // binding 0, per vertex
+        uint32_t vertexStride = 0;
+        std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+
+        VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+        VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+        VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+        bool depthTest = true;
+        bool depthWrite = true;
+        VkCompareOp depthCompare = VK_COMPARE_OP_LESS;
+
+        // src alpha, one minus src alpha
+        bool alphaBlend = false;
+
+        VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+        // 0 shades once per pixel
+        float minSampleShading = 0.0f;
+
+        VkFormat colourFormat = VK_FORMAT_UNDEFINED;
+        VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+
+        // any render pass compatible with the formats and samples, null for
+        //  dynamic rendering. Not hashed, compared or recorded
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+
+        size_t hash() const;
+
+        // pipelines that can stand in for each other, same layout, vertex input and targets
+        size_t compatibilityHash(VkPipelineLayout layout) const;
+
+        bool operator==(const PipelineDescription & other) const;
+
+        // one line, for recorded pipeline lists
+        std::string serialise() const;
+        static PipelineDescription parse(const std::string & line);
+    };
+
+    struct PipelineLookup
+    {
+        // null if nothing usable is ready
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        // to bind descriptor sets and push constants with
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        // false if a fallback stands in whilst the real pipeline compiles
+        bool exact = false;
+    };
+
+    struct PipelineCacheStats
+    {
+        uint64_t hits = 0;
+        uint64_t fallbacks = 0;
+        // lookups with nothing to draw with
+        uint64_t misses = 0;
+        uint64_t compiled = 0;
+        uint64_t failed = 0;
+        // queued or compiling
+        uint32_t pending = 0;
+        double compileMs = 0.0;
+
+        std::string report() const;
+    };
+
+    /*
+        Graphics pipelines keyed by a hash of their description.
+
+            cache.setShader("lit", shader.shaderStage(), specialisation, layout);
+
+            PipelineDescription d;
+            d.shader = "lit";
+            ...
+            PipelineLookup found = cache.get(d);
+
+        A lookup never blocks. A miss is queued to compile on a worker
+        thread (through one VkPipelineCache, saved between runs) and
+        a fallback is returned meanwhile, either the pipeline the
+        description last had or any ready one that is compatible (same
+        layout, vertex input, formats and samples). compile blocks
+        instead, e.g. when nothing could stand in.
+
+        setShader again (e.g. a hot reload) makes its pipelines stale,
+        they are recompiled on their next lookup and serve as their own
+        fallback until then. Replaced pipelines are retired through the
+        deletion queue by update.
+
+        Every description is recorded, saveList and loadList let the
+        next run prewarm them at startup.
+    */
+    class PipelineCache
+    {
+
+    public:
+
+        // cacheFile may not exist yet, incompatible data is ignored by the driver
+        PipelineCache(VkDevice device, DeletionQueue & deletionQueue, const std::string & cacheFile = "", unsigned threads = 1);
+
+        PipelineCache(const PipelineCache &) = delete;
+        PipelineCache & operator=(const PipelineCache &) = delete;
+
+        // joins the workers, the device must be idle
+        ~PipelineCache();
+
+        /*
+            Shader stages for descriptions naming this shader, the
+            specialisation is copied. The modules must stay valid until
+            retireShader or another setShader for the name returns.
+        */
+        void setShader
+        (
+            const std::string & name,
+            const std::vector<VkPipelineShaderStageCreateInfo> & stages,
+            const Specialisation & specialisation,
+            VkPipelineLayout layout
+        );
+
+        // waits for compiles using the shader, its pipelines stay usable
+        void retireShader(const std::string & name);
+
+        // never blocks, queues a compile if the pipeline is missing or stale
+        PipelineLookup get(const PipelineDescription & description);
+
+        // compiles on this thread if not ready
+        PipelineLookup compile(const PipelineDescription & description);
+
+        // queue compiles for descriptions not yet cached
+        void prewarm(const std::vector<PipelineDescription> & descriptions);
+
+        // once per frame, retires pipelines replaced since the last call
+        void update(uint64_t frame);
+
+        // false if the file cannot be written
+        bool saveCache(const std::string & cacheFile);
+        bool saveList(const std::string & listFile);
+        // empty if the file cannot be read, unparsable lines are skipped
+        static std::vector<PipelineDescription> loadList(const std::string & listFile);
+
+        PipelineCacheStats getStats();
+
+    private:
+
+        struct ShaderEntry
+        {
+            std::vector<VkPipelineShaderStageCreateInfo> stages;
+            Specialisation specialisation;
+            VkPipelineLayout layout;
+            uint64_t generation;
+            // compiles using these stages
+            unsigned inFlight = 0;
+        };
+
+        struct DescriptionHash
+        {
+            size_t operator()(const PipelineDescription & d) const { return d.hash(); }
+        };
+
+        struct Entry
+        {
+            PipelineDescription description;
+            VkPipeline pipeline = VK_NULL_HANDLE;
+            VkPipelineLayout layout = VK_NULL_HANDLE;
+            // of the shader the pipeline was built from
+            uint64_t generation = 0;
+            uint64_t failedGeneration = 0;
+            // queued or compiling
+            bool pending = false;
+        };
+
+        VkDevice device;
+        DeletionQueue & deletionQueue;
+        VkPipelineCache vkCache;
+
+        std::mutex mutex;
+        std::condition_variable shaderIdle, work;
+
+        std::unordered_map<std::string, std::shared_ptr<ShaderEntry>> shaders;
+        uint64_t nextGeneration = 1;
+
+        // never erased, so entries keep their address
+        std::unordered_map<PipelineDescription, Entry, DescriptionHash> entries;
+        // a ready entry per compatibility hash
+        std::unordered_map<size_t, const Entry *> compatible;
+
+        std::deque<Entry *> jobs;
+        std::vector<std::thread> workers;
+        bool stopping = false;
+
+        std::vector<VkPipeline> replaced;
+
+        PipelineCacheStats stats;
+
+        // with mutex held
+        Entry & entry(const PipelineDescription & description);
+        bool needsCompile(const Entry & e) const;
+        PipelineLookup lookup(const PipelineDescription & description, const Entry & e);
+
+        void worker();
+
+        // builds on the calling thread and stores the result, mutex not held
+        void build(Entry & e, const PipelineDescription & description, std::shared_ptr<ShaderEntry> shader);
+
+        VkPipeline createPipeline(const PipelineDescription & description, const ShaderEntry & shader);
+    };
+}
+
+#endif /* PIPELINECACHE */
@@ -0,0 +1,55 @@
+#ifndef RADIXSORT
+#define RADIXSORT
+
+#include <vector>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Renderer
+{
+
+    // reused between sorts to avoid allocating each frame
+    struct RadixSortScratch
+    {
+        std::vector<uint64_t> keys;
+        std::vector<uint32_t> values;
+        // a digit histogram per thread
+        std::vector<std::array<size_t, 256>> histograms;
+    };
+
+    /*
+        Least significant digit radix sort of 64 bit keys, carrying a
+        32 bit value (e.g. an index) with each, one byte per pass.
+        Stable, O(n) and branch free in the inner loop, which beats
+        std::sort for the thousands of keys a frame has.
+
+        Passes where every key has the same byte are skipped, so
+        keys with unused bits cost less.
+
+        With threads > 1 each pass is split into contiguous chunks,
+        each thread histograms its chunk, the histograms are prefix
+        summed in chunk order (keeping the sort stable) and each
+        thread scatters its own chunk. Small inputs are sorted on
+        the calling thread, spawning costs more than it saves.
+    */
+    void radixSort
+    (
+        std::vector<uint64_t> & keys,
+        std::vector<uint32_t> & values,
+        RadixSortScratch & scratch,
+        unsigned threads = 1
+    );
+
+    // maps a float to a uint32 with the same ordering, including negatives
+    inline uint32_t orderedFloatBits(float f)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &f, sizeof(bits));
+        // negative floats sort backwards, flip all their bits, else just the sign
+        return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+    }
+}
+
+#endif /* RADIXSORT */
@@ -0,0 +1,372 @@
+#ifndef RENDERGRAPH
+#define RENDERGRAPH
+
+#include <Renderer/deletionQueue.h>
+#include <Renderer/memoryBudget.h>
+#include <Renderer/frameScratch.h>
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <array>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <optional>
+#include <memory>
+#include <cstdint>
+
+namespace Renderer
+{
+
+    // how a pass uses an image, each implies a stage, access mask, layout and usage
+    enum class RenderGraphAccess
+    {
+        COLOUR_ATTACHMENT,
+        DEPTH_ATTACHMENT,
+        SAMPLED,
+        TRANSFER_SRC,
+        TRANSFER_DST
+    };
+
+    struct RenderGraphImage
+    {
+        VkFormat format;
+        VkExtent2D extent;
+        VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+        VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    };
+
+    struct RenderGraphStats
+    {
+        uint32_t passes = 0;
+        uint32_t barriers = 0;
+        // vkCmdPipelineBarrier calls, one per pass at most plus the final transitions
+        uint32_t barrierBatches = 0;
+        uint32_t transientImages = 0;
+        uint32_t memoryBlocks = 0;
+        VkDeviceSize transientBytes = 0;
+        VkDeviceSize allocatedBytes = 0;
+        // compiles that were skipped as the graph had not changed
+        uint64_t cacheHits = 0;
+
+        std::string report() const;
+    };
+
+    /*
+        Passes declare which named images they read and write, the
+        graph works out the rest, e.g.
+
+            graph.clear();
+            graph.addImage("depth", {depthFormat, extent, samples, VK_IMAGE_ASPECT_DEPTH_BIT});
+            graph.importImage("swapchain", image, view, {format, extent}, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+            RenderGraph::Pass & scene = graph.addPass("scene");
+            scene.colour("swapchain", clearColour);
+            scene.depth("depth", clearDepth);
+            scene.execute = [&](VkCommandBuffer commandBuffer) { ... draw ... };
+
+            graph.compile(frameNumber);
+            graph.execute(commandBuffer, frameScratch);
+
+        Compiling finds, in declaration order, the state each image is
+        left in and emits the barriers (and layout transitions) each
+        pass needs, batched into one vkCmdPipelineBarrier per pass.
+        Passes with attachments get a render pass and framebuffer, the
+        render pass does no transitions of its own.
+
+        Images added with addImage are transient, created and owned by
+        the graph. Those whose lifetimes (first to last pass using
+        them) do not overlap share memory. Those only ever used as
+        attachments within one pass are never stored, and prefer lazily
+        allocated memory.
+
+        Declarations are hashed and compared with the compiled ones, an
+        unchanged graph reuses its compiled barriers, images and render
+        passes. Imported image handles are not part of either, they are
+        resolved when executing. Pass
+        objects are reused across clears, and executing takes its
+        arrays from the frame's scratch, so redeclaring and executing
+        an unchanged graph makes no heap allocations (keep image names
+        short enough for the small string buffer).
+
+        With dynamic rendering (VK_KHR_dynamic_rendering) passes begin
+        with vkCmdBeginRenderingKHR on the image views directly, no
+        render pass or framebuffer objects are made. Pipelines are then
+        built with VkPipelineRenderingCreateInfoKHR instead, and depend
+        only on attachment formats and sample counts.
+    */
+    class RenderGraph
+    {
+
+    public:
+
+        struct Pass
+        {
+            std::string name;
+
+            void colour
+            (
+                const std::string & image,
+                std::optional<VkClearColorValue> clear = std::nullopt,
+                const std::string & resolve = ""
+            );
+
+            void depth(const std::string & image, std::optional<VkClearDepthStencilValue> clear = std::nullopt);
+
+            // use outside any render pass, e.g. transfers
+            void read(const std::string & image, RenderGraphAccess access);
+            void write(const std::string & image, RenderGraphAccess access);
+
+            // the whole image if unset
+            std::optional<VkRect2D> renderArea;
+
+            // recorded inside the pass' render pass, if it has attachments
+            std::function<void(VkCommandBuffer)> execute;
+
+        private:
+
+            friend class RenderGraph;
+
+            struct Use
+            {
+                std::string image;
+                RenderGraphAccess access;
+                bool write;
+            };
+
+            struct Attachment
+            {
+                std::string image;
+                std::string resolve;
+                std::optional<VkClearValue> clear;
+                bool depth;
+            };
+
+            std::vector<Use> uses;
+            std::vector<Attachment> attachments;
+        };
+
+        // dynamicRendering needs the extension and feature enabled on the device
+        RenderGraph(VkDevice device, DeletionQueue & deletionQueue, MemoryBudget & budget, bool dynamicRendering = false);
+
+        RenderGraph(const RenderGraph &) = delete;
+        RenderGraph & operator=(const RenderGraph &) = delete;
+
+        // the device must be idle
+        ~RenderGraph();
+
+        // drop all declarations, compiled state and pass objects are kept for reuse
+        void clear();
+
+        void addImage(const std::string & name, RenderGraphImage desc);
+
+        /*
+            An image owned elsewhere, e.g. a swap chain image. It is
+            transitioned from initialLayout on first use and to
+            finalLayout after the last pass. initialStage is what
+            the first barrier waits on, e.g. the stage a semaphore
+            is waited at, 0 for the stage of the first use.
+        */
+        void importImage
+        (
+            const std::string & name,
+            VkImage image,
+            VkImageView view,
+            RenderGraphImage desc,
+            VkImageLayout finalLayout,
+            VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            VkPipelineStageFlags initialStage = 0
+        );
+
+        // executed in declaration order
+        Pass & addPass(const std::string & name);
+
+        // recompiles only if the declarations changed since the last compile
+        void compile(uint64_t frame);
+
+        // barrier and attachment arrays come from scratch
+        void execute(VkCommandBuffer commandBuffer, FrameScratch & scratch);
+
+        // retire everything compiled, e.g. when imported views are recreated
+        void reset(uint64_t frame);
+
+        // true if the device has VK_KHR_dynamic_rendering and its feature
+        static bool dynamicRenderingSupported(VkPhysicalDevice physicalDevice);
+
+        // fill in the feature struct to chain into VkDeviceCreateInfo
+        static VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures();
+
+        bool usesDynamicRendering() const { return dynamicRendering; }
+
+        // valid after compile, for building compatible pipelines. Null with dynamic rendering
+        VkRenderPass renderPass(const std::string & pass) const;
+
+        // what a declared pass would get from compile, leaving the compiled graph
+        //  as it is, e.g. to build pipelines for new targets before switching
+        VkRenderPass declaredRenderPass(const std::string & pass);
+
+        VkImage image(const std::string & name) const;
+
+        // the first stage an image is used in, e.g. to wait on its semaphore
+        VkPipelineStageFlags firstStage(const std::string & name) const;
+
+        const RenderGraphStats & getStats() const { return stats; }
+
+    private:
+
+        struct Resource
+        {
+            std::string name;
+            RenderGraphImage desc;
+            bool imported = false;
+            VkImage image = VK_NULL_HANDLE;
+            VkImageView view = VK_NULL_HANDLE;
+            VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            VkPipelineStageFlags initialStage = 0;
+        };
+
+        struct Barrier
+        {
+            uint32_t resource;
+            VkImageLayout oldLayout, newLayout;
+            VkAccessFlags srcAccess, dstAccess;
+        };
+
+        struct BarrierBatch
+        {
+            VkPipelineStageFlags srcStages = 0, dstStages = 0;
+            std::vector<Barrier> barriers;
+        };
+
+        static const uint32_t NO_RESOLVE = UINT32_MAX;
+
+        // a subpass' colours, their resolves and depth
+        static const uint32_t MAX_ATTACHMENTS = 9;
+
+        // an attachment with load and store ops worked out from image lifetimes
+        struct CompiledAttachment
+        {
+            uint32_t resource;
+            uint32_t resolve = NO_RESOLVE;
+            VkAttachmentLoadOp loadOp;
+            VkAttachmentStoreOp storeOp;
+            VkAttachmentStoreOp resolveStoreOp;
+            VkImageLayout layout;
+            VkClearValue clear;
+        };
+
+        struct CompiledPass
+        {
+            BarrierBatch before;
+            std::vector<CompiledAttachment> colours;
+            std::optional<CompiledAttachment> depth;
+
+            // render pass path only
+            VkRenderPass renderPass = VK_NULL_HANDLE;
+            // resource per attachment, in render pass order
+            std::vector<uint32_t> attachments;
+            std::vector<VkClearValue> clearValues;
+        };
+
+        // a pass and the views it is begun with, compared whole so nothing is shared by a hash alone
+        struct FramebufferKey
+        {
+            uint32_t pass = 0;
+            uint32_t count = 0;
+            std::array<VkImageView, MAX_ATTACHMENTS> views{};
+
+            size_t hash() const;
+            bool operator==(const FramebufferKey & other) const;
+        };
+
+        struct FramebufferKeyHash
+        {
+            size_t operator()(const FramebufferKey & k) const { return k.hash(); }
+        };
+
+        // what a render pass is made from, equal keys share one
+        struct RenderPassKey
+        {
+            std::vector<VkAttachmentDescription> descriptions;
+            uint32_t colours = 0;
+            bool depth = false;
+            // attachment per colour, empty without resolves
+            std::vector<uint32_t> resolves;
+
+            size_t hash() const;
+            bool operator==(const RenderPassKey & other) const;
+        };
+
+        struct RenderPassKeyHash
+        {
+            size_t operator()(const RenderPassKey & k) const { return k.hash(); }
+        };
+
+        // a transient image and the memory it is bound to
+        struct Transient
+        {
+            VkImage image = VK_NULL_HANDLE;
+            VkImageView view = VK_NULL_HANDLE;
+            uint32_t block = 0;
+        };
+
+        VkDevice device;
+        DeletionQueue & deletionQueue;
+        MemoryBudget & budget;
+
+        bool dynamicRendering;
+        PFN_vkCmdBeginRenderingKHR beginRendering = nullptr;
+        PFN_vkCmdEndRenderingKHR endRendering = nullptr;
+
+        std::vector<Resource> resources;
+        // declared this frame, from passPool
+        std::vector<Pass *> passes;
+        // unique_ptr so references from addPass stay valid, reused by later frames
+        std::vector<std::unique_ptr<Pass>> passPool;
+
+        // compiled state
+        std::optional<size_t> compiledHash;
+        // what compiledHash was taken from, compared so a collision still recompiles
+        std::vector<Resource> compiledResources;
+        std::vector<Pass> compiledPasses;
+        std::vector<CompiledPass> compiled;
+        BarrierBatch finalTransitions;
+        std::vector<VkPipelineStageFlags> firstStages;
+        std::map<std::string, uint32_t> compiledPassIndex;
+
+        std::unordered_map<uint32_t, Transient> transients;
+        std::vector<VkDeviceMemory> memoryBlocks;
+
+        // imported views change per frame, so a framebuffer per pass and views
+        std::unordered_map<FramebufferKey, VkFramebuffer, FramebufferKeyHash> framebuffers;
+
+        // compatible render passes survive recompiles, pipelines are built against them
+        std::unordered_map<RenderPassKey, VkRenderPass, RenderPassKeyHash> renderPasses;
+
+        RenderGraphStats stats;
+
+        size_t hash() const;
+        // the declarations equal those compiled, image handles aside
+        bool unchanged() const;
+
+        uint32_t resource(const std::string & name) const;
+
+        void build();
+        void allocateTransients(const std::vector<std::pair<uint32_t, uint32_t>> & lifetimes, const std::vector<bool> & attachmentOnly);
+        void compileAttachments(const Pass & pass, CompiledPass & compiledPass, const std::vector<std::pair<uint32_t, uint32_t>> & lifetimes, uint32_t index);
+        VkRenderPass createRenderPass(const Pass & pass, CompiledPass & compiledPass);
+
+        void beginRenderPass(VkCommandBuffer commandBuffer, uint32_t index);
+        void beginDynamicRendering(VkCommandBuffer commandBuffer, uint32_t index, FrameScratch & scratch);
+
+        VkImageView view(uint32_t resource) const;
+        VkImage handle(uint32_t resource) const;
+
+        void recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch & batch, FrameScratch & scratch);
+    };
+}
+
+#endif /* RENDERGRAPH */
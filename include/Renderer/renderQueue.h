@@ -0,0 +1,221 @@
+#ifndef RENDERQUEUE
+#define RENDERQUEUE
+
+#include <Renderer/bindless.h>
+#include <Renderer/radixSort.h>
+
+#include <vulkan/vulkan.h>
+
+#include <vector>
+#include <array>
+#include <functional>
+#include <algorithm>
+#include <string>
+#include <cstdint>
+
+namespace Renderer
+{
+
+    struct DrawCommand
+    {
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        // bound at the queue's material set, none if null
+        VkDescriptorSet material = VK_NULL_HANDLE;
+        VkBuffer vertexBuffer = VK_NULL_HANDLE;
+        VkDeviceSize vertexOffset = 0;
+        uint32_t firstVertex = 0;
+        uint32_t vertexCount = 0;
+        DrawPushConstants constants;
+    };
+
+    // binds issued and avoided while recording a frame
+    struct RenderQueueStats
+    {
+        uint32_t draws = 0;
+        uint32_t pipelineBinds = 0, pipelineBindsSkipped = 0;
+        uint32_t descriptorBinds = 0, descriptorBindsSkipped = 0;
+        uint32_t vertexBufferBinds = 0, vertexBufferBindsSkipped = 0;
+
+        std::string report() const;
+    };
+
+    /*
+        Ids for handles, assigned in order of first sight, open
+        addressed so clearing only bumps a generation and nothing is
+        allocated once the table has grown to a frame's worth.
+    */
+    template <class Handle>
+    class HandleIds
+    {
+
+    public:
+
+        // the handle's id, the next one if it is new
+        uint32_t assign(Handle handle)
+        {
+            if ((count+1)*2 > slots.size())
+            {
+                grow();
+            }
+
+            size_t mask = slots.size()-1;
+            for (size_t i = index(handle, mask);; i = (i+1) & mask)
+            {
+                Slot & slot = slots[i];
+
+                if (slot.generation != generation)
+                {
+                    slot = {handle, count, generation};
+                    return count++;
+                }
+
+                if (slot.handle == handle)
+                {
+                    return slot.id;
+                }
+            }
+        }
+
+        uint32_t size() const { return count; }
+
+        void clear()
+        {
+            count = 0;
+
+            // stale slots could look current once the generation wraps
+            if (++generation == 0)
+            {
+                for (Slot & slot : slots)
+                {
+                    slot.generation = 0;
+                }
+                generation = 1;
+            }
+        }
+
+    private:
+
+        struct Slot
+        {
+            Handle handle;
+            uint32_t id;
+            // current if equal to the table's
+            uint32_t generation = 0;
+        };
+
+        std::vector<Slot> slots;
+        uint32_t count = 0;
+        uint32_t generation = 1;
+
+        static size_t index(Handle handle, size_t mask)
+        {
+            // handles are often aligned pointers, mix the high bits down
+            uint64_t h = uint64_t(std::hash<Handle>()(handle)) * 0x9E3779B97F4A7C15ull;
+            return size_t(h ^ (h >> 32)) & mask;
+        }
+
+        void grow()
+        {
+            std::vector<Slot> old(std::max<size_t>(64, slots.size()*2));
+            old.swap(slots);
+
+            size_t mask = slots.size()-1;
+            for (const Slot & slot : old)
+            {
+                if (slot.generation != generation)
+                {
+                    continue;
+                }
+
+                size_t i = index(slot.handle, mask);
+                while (slots[i].generation == generation)
+                {
+                    i = (i+1) & mask;
+                }
+                slots[i] = slot;
+            }
+        }
+    };
+
+    /*
+        Draws for a frame, ordered to minimise state changes. Each
+        draw gets a 64 bit key, most significant first
+
+            layer    (4 bits)  e.g. opaque before transparent
+            pipeline (12 bits) the most expensive bind
+            material (16 bits) descriptor set
+            depth    (32 bits) front to back, or back to front per layer
+
+        so the sort groups draws by pipeline then material, and only
+        orders by depth within a group. Pipeline and material ids are
+        assigned in submission order each frame, so handles that come
+        and go (e.g. hot reloaded pipelines) never exhaust them.
+
+            queue.submit(OPAQUE_LAYER, draw, depth);
+            ...
+            queue.sort();
+            queue.record(commandBuffer);
+
+        Recording skips binds of the pipeline, material set and
+        vertex buffer that is already bound. Global sets (per frame
+        data, bindless) are bound by the caller once beforehand.
+    */
+    class RenderQueue
+    {
+
+    public:
+
+        static const uint32_t LAYER_BITS = 4;
+        static const uint32_t PIPELINE_BITS = 12;
+        static const uint32_t MATERIAL_BITS = 16;
+
+        static const uint32_t MAX_LAYERS = 1u << LAYER_BITS;
+
+        RenderQueue(uint32_t materialSet, unsigned sortThreads = 1)
+        : materialSet(materialSet), threads(sortThreads)
+        {
+            backToFront.fill(false);
+        }
+
+        // e.g. for transparent layers
+        void setBackToFront(uint32_t layer, bool enabled) { backToFront.at(layer) = enabled; }
+
+        // throws if the layer, or the number of distinct pipelines or materials, does not fit the key
+        void submit(uint32_t layer, const DrawCommand & draw, float depth);
+
+        void sort();
+
+        // binds and draws in key order
+        void record(VkCommandBuffer commandBuffer);
+
+        // drops draws and ids, keeps buffers
+        void clear();
+
+        size_t size() const { return draws.size(); }
+
+        // of the last record
+        const RenderQueueStats & getStats() const { return stats; }
+
+    private:
+
+        uint32_t materialSet;
+        unsigned threads;
+
+        std::array<bool, MAX_LAYERS> backToFront;
+
+        std::vector<DrawCommand> draws;
+
+        HandleIds<VkPipeline> pipelineIds;
+        HandleIds<VkDescriptorSet> materialIds;
+
+        // reused every frame
+        std::vector<uint64_t> keys;
+        std::vector<uint32_t> order;
+        RadixSortScratch scratch;
+
+        RenderQueueStats stats;
+    };
+}
+
+#endif /* RENDERQUEUE */
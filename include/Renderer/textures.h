@@ -0,0 +1,308 @@
+#ifndef TEXTURES
+#define TEXTURES
+
+#include <Renderer/deletionQueue.h>
+#include <Renderer/bindless.h>
+#include <Renderer/memoryBudget.h>
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <array>
+#include <cstdint>
+
+namespace Renderer
+{
+
+    // decoded pixels, tightly packed rows of 8 bit RGBA
+    struct TextureData
+    {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint8_t> pixels;
+    };
+
+    // one mip level of pixel or block data, not owned
+    struct TextureLevel
+    {
+        const uint8_t * data;
+        size_t bytes;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    // binary PPM (P6) or PGM (P5), 8 bit, throws if the file cannot be read
+    TextureData loadImage(const std::string & path);
+
+    // loadImage's decoding of a file already in memory, name is for errors
+    TextureData decodeImage(const uint8_t * bytes, size_t size, const std::string & name);
+
+    struct SamplerDescription
+    {
+        VkFilter magFilter = VK_FILTER_LINEAR;
+        VkFilter minFilter = VK_FILTER_LINEAR;
+        VkSamplerMipmapMode mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        // 1 disables anisotropic filtering, clamped to the device limit
+        float maxAnisotropy = 1.0f;
+
+        bool operator==(const SamplerDescription & other) const;
+
+        size_t hash() const;
+    };
+
+    /*
+        Caches VkSamplers by description, every texture sampled the
+        same way shares one handle (devices allow as few as 4000)
+    */
+    class SamplerCache
+    {
+
+    public:
+
+        // anisotropy only if samplerAnisotropy was enabled on the device
+        SamplerCache(VkPhysicalDevice physicalDevice, VkDevice d, bool anisotropy);
+
+        SamplerCache(const SamplerCache &) = delete;
+        SamplerCache & operator=(const SamplerCache &) = delete;
+
+        ~SamplerCache();
+
+        VkSampler get(const SamplerDescription & description);
+
+        size_t size() const { return samplers.size(); }
+
+    private:
+
+        struct SamplerHash
+        {
+            size_t operator()(const SamplerDescription & d) const { return d.hash(); }
+        };
+
+        VkDevice device;
+
+        bool anisotropySupported;
+        float maxAnisotropy;
+
+        std::unordered_map<SamplerDescription, VkSampler, SamplerHash> samplers;
+    };
+
+    typedef uint32_t TextureId;
+
+    const TextureId INVALID_TEXTURE = UINT32_MAX;
+
+    struct Texture
+    {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkSampler sampler = VK_NULL_HANDLE;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t mipLevels = 1;
+        // INVALID_BINDLESS_HANDLE without a bindless table
+        BindlessHandle handle = INVALID_BINDLESS_HANDLE;
+    };
+
+    struct TextureStats
+    {
+        uint32_t textures = 0;
+        uint64_t uploads = 0;
+        // one command buffer and one submit each
+        uint64_t batches = 0;
+        // KTX2 textures uploaded as stored, and those decoded on the CPU instead
+        uint64_t compressed = 0;
+        uint64_t transcoded = 0;
+        VkDeviceSize uploadedBytes = 0;
+        // waits for a staging buffer the GPU was still copying from
+        uint64_t stagingStalls = 0;
+
+        std::string report() const;
+    };
+
+    /*
+        Creates sampled textures and streams their pixels in through
+        persistently mapped staging buffers, e.g.
+
+            TextureId id = textures.load("bricks.ppm");
+            ...
+            // once per frame, before submitting work that samples them
+            textures.flush();
+
+            draw.constants.texture = textures.get(id).handle;
+
+        Uploads are batched, flush records every copy queued since
+        the last into one command buffer with one barrier per
+        transition stage, and submits it without waiting. Submission
+        order on the queue keeps later frames from sampling early.
+        Two staging buffers alternate, so the CPU fills one whilst
+        the GPU copies from the other.
+
+        Mip chains are generated on the GPU by successive halving
+        blits where the format supports linear filtering, else the
+        texture has one level.
+
+        With a bindless table textures are registered on creation and
+        sampled through the handle in DrawPushConstants.
+    */
+    class TextureManager
+    {
+
+    public:
+
+        // bindless may be null
+        TextureManager
+        (
+            VkPhysicalDevice physicalDevice,
+            VkDevice device,
+            VkQueue queue,
+            uint32_t queueFamily,
+            DeletionQueue & deletionQueue,
+            MemoryBudget & budget,
+            BindlessTable * bindless,
+            bool anisotropy,
+            VkDeviceSize stagingSize = 16 * 1024 * 1024
+        );
+
+        TextureManager(const TextureManager &) = delete;
+        TextureManager & operator=(const TextureManager &) = delete;
+
+        // the device must be idle
+        ~TextureManager();
+
+        TextureId load
+        (
+            const std::string & path,
+            const SamplerDescription & sampler = SamplerDescription(),
+            bool mipmaps = true
+        );
+
+        /*
+            A KTX2 file with pre-built levels. Formats the device can
+            sample (BC, ETC2, ASTC) are copied from the mapped file
+            into staging as they are, others are decoded to RGBA on the
+            CPU if there is a decoder (BC1-BC5), else this throws.
+        */
+        TextureId loadCompressed(const std::string & path, const SamplerDescription & sampler = SamplerDescription());
+
+        // the pixels are copied, the upload is queued until the next flush
+        TextureId create
+        (
+            const TextureData & data,
+            const SamplerDescription & sampler = SamplerDescription(),
+            bool mipmaps = true
+        );
+
+        // every level given, level 0 width by height, in a format the device samples
+        TextureId create
+        (
+            VkFormat format,
+            uint32_t width,
+            uint32_t height,
+            const std::vector<TextureLevel> & levels,
+            const SamplerDescription & sampler = SamplerDescription()
+        );
+
+        // retired once frame lastUsed completes
+        void destroy(TextureId id, uint64_t lastUsed);
+
+        // submit queued uploads, does nothing if there are none
+        void flush();
+
+        const Texture & get(TextureId id) const { return textures.at(id); }
+
+        SamplerCache & getSamplers() { return samplers; }
+
+        // sampled and copied to with optimal tiling, safe to ask from any thread
+        bool formatSupported(VkFormat format) const;
+
+        TextureStats getStats() const;
+
+    private:
+
+        static const unsigned STAGING_BUFFERS = 2;
+
+        struct Upload
+        {
+            TextureId id;
+            VkBuffer buffer;
+            // one per level copied
+            std::vector<VkBufferImageCopy> regions;
+            // blit levels after the first from it
+            bool generateMips;
+        };
+
+        struct Staging
+        {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            uint8_t * mapped = nullptr;
+            VkDeviceSize used = 0;
+
+            VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+            VkFence fence = VK_NULL_HANDLE;
+            bool submitted = false;
+
+            std::vector<Upload> uploads;
+            // one off buffers for textures larger than the staging buffer
+            std::vector<std::pair<VkBuffer, VkDeviceMemory>> oversized;
+        };
+
+        VkPhysicalDevice physicalDevice;
+        VkDevice device;
+        VkQueue queue;
+        DeletionQueue & deletionQueue;
+        MemoryBudget & budget;
+        BindlessTable * bindless;
+
+        VkDeviceSize stagingSize;
+        VkDeviceSize copyAlignment;
+
+        VkCommandPool commandPool;
+        std::array<Staging, STAGING_BUFFERS> staging;
+        unsigned current = 0;
+
+        SamplerCache samplers;
+
+        std::vector<Texture> textures;
+        std::vector<TextureId> freeIds;
+
+        TextureStats stats;
+
+        TextureId createTexture
+        (
+            VkFormat format,
+            uint32_t width,
+            uint32_t height,
+            uint32_t mipLevels,
+            bool blitMips,
+            const SamplerDescription & sampler
+        );
+
+        // copy the levels into staging, flushing first if it is full
+        void stage(TextureId id, const std::vector<TextureLevel> & levels, bool generateMips);
+
+        // waits for the slot's last submit, then frees what it used
+        void reclaim(Staging & slot);
+
+        void recordUploads(Staging & slot);
+        // every level of every texture uploaded ends in SHADER_READ_ONLY_OPTIMAL
+        void recordMips(VkCommandBuffer commandBuffer, const std::vector<Upload> & uploads);
+
+        bool linearBlitSupported(VkFormat format);
+
+        void createBuffer
+        (
+            VkDeviceSize size,
+            VkBufferUsageFlags usage,
+            VkMemoryPropertyFlags properties,
+            VkBuffer & buffer,
+            VkDeviceMemory & memory
+        );
+    };
+}
+
+#endif /* TEXTURES */
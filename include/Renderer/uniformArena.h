@@ -0,0 +1,127 @@
+#ifndef UNIFORMARENA
+#define UNIFORMARENA
+
+#include <Renderer/memoryBudget.h>
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+
+namespace Renderer
+{
+
+    // part of the arena's buffer, bind with buffer, offset and size
+    struct UniformSlice
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        // persistently mapped, write only
+        void * data = nullptr;
+    };
+
+    struct UniformArenaStats
+    {
+        // per frame
+        VkDeviceSize capacity = 0;
+        // by the last frame, and the most any frame used
+        VkDeviceSize used = 0;
+        VkDeviceSize peak = 0;
+        uint32_t slices = 0;
+        // vkFlushMappedMemoryRanges calls, none if the memory is coherent
+        uint64_t flushes = 0;
+        bool coherent = true;
+
+        std::string report() const;
+    };
+
+    /*
+        Uniform data for frames in flight in one buffer, mapped for its
+        lifetime and split into a region per frame, e.g.
+
+            // once the frame's fence has signalled
+            arena.begin(currentFrame);
+
+            UniformSlice slice = arena.push(ubo);
+            bufferInfo = {slice.buffer, slice.offset, slice.size};
+            ... as many more as the frame needs ...
+
+            // after the last write, before submitting
+            arena.flush();
+
+        Slices are carved linearly from the frame's region, aligned to
+        minUniformBufferOffsetAlignment, and are valid until the frame
+        index comes round again. Device local memory is preferred where
+        the CPU can write it (UMA, resizable BAR). If the memory is not
+        host coherent, flush makes everything written since begin
+        visible with a single vkFlushMappedMemoryRanges. Render thread
+        only.
+    */
+    class UniformArena
+    {
+
+    public:
+
+        UniformArena
+        (
+            VkPhysicalDevice physicalDevice,
+            VkDevice device,
+            MemoryBudget & budget,
+            unsigned framesInFlight,
+            VkDeviceSize bytesPerFrame = 1024 * 1024
+        );
+
+        UniformArena(const UniformArena &) = delete;
+        UniformArena & operator=(const UniformArena &) = delete;
+
+        // the device must be idle
+        ~UniformArena();
+
+        // starts the frame's region over, nothing in flight may still read it
+        void begin(unsigned frame);
+
+        // throws if the frame's region is full
+        UniformSlice allocate(VkDeviceSize size);
+
+        template <class T>
+        UniformSlice push(const T & value)
+        {
+            UniformSlice slice = allocate(sizeof(T));
+            std::memcpy(slice.data, &value, sizeof(T));
+            return slice;
+        }
+
+        // makes writes since begin visible to the device
+        void flush();
+
+        VkBuffer getBuffer() const { return buffer; }
+
+        UniformArenaStats getStats() const { return stats; }
+
+    private:
+
+        VkDevice device;
+        MemoryBudget & budget;
+
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        uint8_t * mapped = nullptr;
+
+        VkDeviceSize alignment;
+        // flushed ranges are multiples of it
+        VkDeviceSize atomSize;
+        VkDeviceSize regionSize;
+        unsigned frames;
+
+        unsigned frame = 0;
+        // from the start of the frame's region
+        VkDeviceSize used = 0;
+        VkDeviceSize flushed = 0;
+
+        UniformArenaStats stats;
+    };
+}
+
+#endif /* UNIFORMARENA */
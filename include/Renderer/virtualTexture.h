@@ -0,0 +1,307 @@
+#ifndef VIRTUALTEXTURE
+#define VIRTUALTEXTURE
+
+#include <Renderer/textures.h>
+#include <Renderer/ktx.h>
+#include <Renderer/bindless.h>
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+#include <list>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+
+namespace Renderer
+{
+
+    struct VirtualTextureStats
+    {
+        uint32_t resident = 0;
+        // physical pages, what bounds VRAM use
+        uint32_t capacity = 0;
+        // queued or being read from disk
+        uint32_t pending = 0;
+        uint64_t loaded = 0;
+        uint64_t evicted = 0;
+        // streamed pages with no page free to put them in
+        uint64_t dropped = 0;
+        VkDeviceSize residentBytes = 0;
+        bool sparse = false;
+
+        std::string report() const;
+    };
+
+    /*
+        A texture far larger than VRAM, split into square pages per
+        mip level, of which only a fixed number are resident, e.g.
+
+            // offline, from an image that does fit in memory
+            VirtualTexture::bake("huge.ppm", "huge.pages");
+
+            VirtualTexture vt(..., "huge.pages", 32);
+
+            // what is visible, from the view or from GPU feedback
+            vt.requestRegion(u0, v0, u1, v1, level);
+
+            // once per frame, before submitting work that samples it
+            vt.update(frameNumber, framesCompleted);
+
+        Requests for pages not resident go to an I/O thread that reads
+        them from the (memory mapped) page file, coarser levels first.
+        update puts what has been read into free physical pages, or
+        evicts the least recently requested page no frame in flight
+        asked for, and uploads the pages and page table entries that
+        changed, in one submit. The coarsest level is always resident
+        so there is something to fall back to.
+
+        With sparse residency (sparseResidencyImage2D and a page size
+        matching the device's sparse block) the image is one virtual
+        sized sparse image, pages are bound to blocks of one fixed
+        memory pool with vkQueueBindSparse. Otherwise pages live in
+        a physical atlas (with a border for filtering) and the page
+        table maps them. VRAM use is the pool or atlas either way, plus
+        4 bytes of page table per page.
+
+        The page table is a storage buffer (bindless buffer handle):
+
+            uint levels, pageSize, border, slotsPerRow, sparse, pad[3];
+            uvec4 level[levels];   // offset, pagesX, pagesY, width
+            uint entries[];        // bit 31 resident, slot y << 12 | slot x
+
+        Shaders walk from the level they want to coarser ones until
+        an entry is resident, then sample the atlas slot (or the sparse
+        image at that lod). Feedback is an R32_UINT image written with
+        level << 24 | page y << 12 | page x, NO_FEEDBACK where nothing
+        was sampled.
+    */
+    class VirtualTexture
+    {
+
+    public:
+
+        static const uint32_t NO_FEEDBACK = 0xFFFFFFFF;
+
+        // split an image into a mip chain of pages, border texels either side of each
+        static void bake(const std::string & image, const std::string & pageFile, uint32_t pageSize = 128, uint32_t border = 1);
+
+        // the features and a queue family that can bind sparse memory
+        static bool sparseSupported(VkPhysicalDevice physicalDevice, uint32_t queueFamily);
+
+        // bindless may be null, atlasPages squared physical pages
+        VirtualTexture
+        (
+            VkPhysicalDevice physicalDevice,
+            VkDevice device,
+            VkQueue queue,
+            uint32_t queueFamily,
+            MemoryBudget & budget,
+            BindlessTable * bindless,
+            SamplerCache & samplers,
+            const std::string & pageFile,
+            uint32_t atlasPages = 32,
+            bool allowSparse = false,
+            uint32_t uploadsPerUpdate = 16
+        );
+
+        VirtualTexture(const VirtualTexture &) = delete;
+        VirtualTexture & operator=(const VirtualTexture &) = delete;
+
+        // the device must be idle
+        ~VirtualTexture();
+
+        // also requests its coarser ancestors, keeping them from eviction
+        void request(uint32_t level, uint32_t x, uint32_t y);
+
+        // every page overlapping uv [u0, u1] x [v0, v1] at level
+        void requestRegion(float u0, float v0, float u1, float v1, uint32_t level);
+
+        // copy a feedback image (in TRANSFER_SRC_OPTIMAL) for frame slot to read back
+        void recordFeedbackCopy(VkCommandBuffer commandBuffer, VkImage feedback, VkExtent2D extent, uint32_t slot);
+
+        // request what the slot's feedback asked for, once its fence has signalled
+        void readFeedback(uint32_t slot);
+
+        // upload what has streamed in, only evicting pages last requested before framesCompleted
+        void update(uint64_t frame, uint64_t framesCompleted);
+
+        bool usesSparse() const { return sparse; }
+
+        uint32_t getWidth() const { return width; }
+        uint32_t getHeight() const { return height; }
+        uint32_t getLevels() const { return static_cast<uint32_t>(levels.size()); }
+
+        // the atlas, or the sparse image
+        VkImageView getView() const { return view; }
+        VkSampler getSampler() const { return sampler; }
+        VkBuffer getPageTable() const { return pageTable; }
+
+        // INVALID_BINDLESS_HANDLE without a bindless table
+        BindlessHandle getTextureHandle() const { return textureHandle; }
+        BindlessHandle getPageTableHandle() const { return pageTableHandle; }
+
+        VirtualTextureStats getStats() const;
+
+    private:
+
+        static const uint32_t PAGE_TABLE_HEADER = 8;
+        static const uint32_t RESIDENT = 1u << 31;
+
+        struct Level
+        {
+            uint32_t width, height;
+            uint32_t pagesX, pagesY;
+            // into the page file's pages and the page table's entries
+            uint64_t firstPage;
+        };
+
+        struct Resident
+        {
+            uint32_t slot;
+            uint64_t lastUsed;
+            bool pinned;
+            std::list<uint64_t>::iterator lru;
+        };
+
+        struct Loaded
+        {
+            uint64_t key;
+            std::vector<uint8_t> texels;
+        };
+
+        struct Feedback
+        {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            uint32_t * mapped = nullptr;
+            VkDeviceSize texels = 0;
+            bool recorded = false;
+        };
+
+        VkPhysicalDevice physicalDevice;
+        VkDevice device;
+        VkQueue queue;
+        MemoryBudget & budget;
+        BindlessTable * bindless;
+
+        MappedFile file;
+        uint32_t width, height, pageSize, border;
+        // of a page in the file and in the atlas, with its border
+        uint32_t pageStride;
+        VkDeviceSize pageBytes;
+        std::vector<Level> levels;
+
+        bool sparse = false;
+        uint32_t atlasPages;
+        uint32_t uploadsPerUpdate;
+
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkSampler sampler;
+        // the atlas, or the sparse page pool
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceMemory mipTailMemory = VK_NULL_HANDLE;
+        // levels from here on are in the sparse mip tail, bound once and pinned
+        uint32_t mipTailFirstLevel;
+        VkDeviceSize mipTailOffset = 0, mipTailSize = 0;
+        VkDeviceSize slotBytes;
+        bool imageInitialised = false;
+
+        VkBuffer pageTable = VK_NULL_HANDLE;
+        VkDeviceMemory pageTableMemory = VK_NULL_HANDLE;
+        bool pageTableInitialised = false;
+
+        BindlessHandle textureHandle = INVALID_BINDLESS_HANDLE;
+        BindlessHandle pageTableHandle = INVALID_BINDLESS_HANDLE;
+
+        VkBuffer staging = VK_NULL_HANDLE;
+        VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+        uint8_t * stagingMapped = nullptr;
+        VkDeviceSize stagingSize;
+        // pages staging holds, the page table entries and header follow them
+        uint32_t stagingPages;
+
+        VkCommandPool commandPool;
+        VkCommandBuffer commandBuffer;
+        VkFence fence;
+        bool submitted = false;
+        VkSemaphore bound;
+
+        std::vector<Feedback> feedback;
+
+        // render thread state
+        uint64_t currentFrame = 0;
+        std::unordered_map<uint64_t, Resident> resident;
+        // most recently used at the front
+        std::list<uint64_t> lru;
+        std::vector<uint32_t> freeSlots;
+        // pinned pages read at startup, uploaded by the first update
+        std::vector<Loaded> initial;
+
+        // shared with the I/O thread
+        mutable std::mutex mutex;
+        std::condition_variable work;
+        // coarser levels first, then oldest request
+        std::priority_queue<std::pair<uint64_t, uint64_t>> requests;
+        uint64_t requestSequence = 0;
+        std::unordered_set<uint64_t> pending;
+        std::vector<Loaded> loaded;
+        bool stopping = false;
+
+        std::thread io;
+
+        VirtualTextureStats stats;
+
+        static uint64_t key(uint32_t level, uint32_t x, uint32_t y)
+        {
+            return (uint64_t(level) << 48) | (uint64_t(y) << 24) | x;
+        }
+
+        static uint32_t keyLevel(uint64_t k) { return uint32_t(k >> 48); }
+        static uint32_t keyY(uint64_t k) { return uint32_t(k >> 24) & 0xFFFFFF; }
+        static uint32_t keyX(uint64_t k) { return uint32_t(k) & 0xFFFFFF; }
+
+        const uint8_t * pageData(uint64_t k) const;
+
+        void reader();
+
+        void createImage();
+        // false, creating nothing, if the device's sparse blocks do not fit the pages
+        bool createSparseImage();
+        void createPageTable();
+
+        // read the pinned pages into initial
+        void loadPinned();
+
+        // a free slot, evicting if needed (clearing its entry), false if every page is in use
+        bool takeSlot
+        (
+            uint32_t & slot,
+            std::vector<std::pair<uint64_t, uint32_t>> & entries,
+            std::vector<VkSparseImageMemoryBind> & unbinds,
+            uint64_t framesCompleted
+        );
+
+        VkSparseImageMemoryBind pageBind(uint64_t k, VkDeviceMemory memory, VkDeviceSize offset) const;
+
+        void createBuffer
+        (
+            VkDeviceSize size,
+            VkBufferUsageFlags usage,
+            VkMemoryPropertyFlags properties,
+            VkBuffer & buffer,
+            VkDeviceMemory & memory,
+            VkMemoryPropertyFlags preferred = 0,
+            VkMemoryPropertyFlags avoided = 0
+        );
+    };
+}
+
+#endif /* VIRTUALTEXTURE */
@@ -14,7 +14,28 @@
 
 
 #include <Renderer/renderer.h>
+#include <Renderer/descriptors.h>
+#include <Renderer/bindless.h>
+#include <Renderer/deletionQueue.h>
+#include <Renderer/memoryBudget.h>
+#include <Renderer/uniformArena.h>
+#include <Renderer/frameScratch.h>
+#include <Renderer/allocationCounter.h>
+#include <Renderer/vulkanHandle.h>
+#include <Renderer/framePacing.h>
+#include <Renderer/gpuTimer.h>
+#include <Renderer/dynamicResolution.h>
+#include <Renderer/renderQueue.h>
+#include <Renderer/fragmentCounter.h>
+#include <Renderer/renderGraph.h>
+#include <Renderer/pipelineCache.h>
+#include <Renderer/textures.h>
+#include <Renderer/virtualTexture.h>
+#include <Renderer/assetStreamer.h>
+#include <Renderer/initGraph.h>
 #include <Shader/shader.h>
+#include <Shader/variants.h>
+#include <Shader/watcher.h>
 
 #include <stdexcept>
 #include <vector>
@@ -27,9 +48,39 @@
 #include <algorithm>
 #include <array>
 #include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 const int MAX_CONCURRENT_FRAMES = 2;
 
+#ifndef SHADER_PATH
+    #define SHADER_PATH "include/Shaders/"
+#endif
+
+// driver pipeline cache data and the pipelines to prewarm, both rewritten on exit
+#ifndef PIPELINE_CACHE_PATH
+    #define PIPELINE_CACHE_PATH "pipeline_cache.bin"
+#endif
+
+#ifndef PIPELINE_LIST_PATH
+    #define PIPELINE_LIST_PATH "pipelines.txt"
+#endif
+
+// per frame data (the UniformBufferObject at binding 0) lives in set 0,
+//  the bindless table in set 1
+const uint32_t FRAME_DESCRIPTOR_SET = 0;
+const uint32_t BINDLESS_DESCRIPTOR_SET = 1;
+// per draw, bound by the render queue
+const uint32_t MATERIAL_DESCRIPTOR_SET = 2;
+
+// render queue layers, drawn in this order
+const uint32_t OPAQUE_LAYER = 0;
+const uint32_t TRANSPARENT_LAYER = 1;
+
+// with COUNT_ALLOCATIONS, frames after these that allocate are reported
+const uint64_t ALLOCATION_WARM_UP_FRAMES = 120;
+
 const std::vector<const char *> validationLayers = 
 {
     "VK_LAYER_KHRONOS_validation"
@@ -136,6 +187,17 @@ namespace Renderer
         std::vector<VkPresentModeKHR> presentModes;
     };
 
+    // e.g. "mailbox" for VK_PRESENT_MODE_MAILBOX_KHR
+    const char * presentModeName(VkPresentModeKHR mode);
+
+    // what a pipeline built from reflected shaders needs bound
+    struct PipelineInterface
+    {
+        VkPipelineLayout layout;
+        VkDescriptorSetLayout frameSetLayout;
+        bool usesFrameUniforms;
+    };
+
     class VulkanRenderer : public AbstractRenderer
     {
 
@@ -145,76 +207,278 @@ namespace Renderer
 
             ~VulkanRenderer();
 
+            // renders, presents, then waits on the frame limiter
             void drawFrame();
 
             void finish(){ vkDeviceWaitIdle(device); }
 
-            void setExtent(uint32_t w, uint32_t h) { width = w; height = h; recreateSwapChain(); }
+            // cheap, the swap chain is rebuilt once at the start of the next frame
+            void setExtent(uint32_t w, uint32_t h) { width = w; height = h; framebufferResized = true; }
+
+            // also rebuilds the swap chain at the start of the next frame,
+            //  falls back to the nearest supported mode
+            void setPresentMode(VkPresentModeKHR mode) { requestedPresentMode = mode; framebufferResized = true; }
+            VkPresentModeKHR getPresentMode() const { return presentMode; }
+            std::vector<VkPresentModeKHR> supportedPresentModes();
+
+            // applied at the start of the next frame, clamped to what the device supports.
+            //  minSampleShading in [0, 1], 0 shades once per pixel, 1 once per sample
+            void setMsaa(VkSampleCountFlagBits samples, float minSampleShading = 0.0f);
+            VkSampleCountFlagBits getMsaaSamples() const { return msaaSamples; }
+            float getSampleShading() const { return sampleShading; }
+
+            // render to a scaled region of a full size target and upscale into the
+            //  swap chain, the scale tracks GPU time to hold budgetMs
+            void setDynamicResolution(bool enabled, double budgetMs = 1000.0/60.0, double minScale = 0.5);
+            bool getDynamicResolution() const { return dynamicResolution; }
+            double getRenderScale() const { return dynamicResolution ? resolution.getScale() : 1.0; }
+
+            // of the most recently completed frame, 0 if timestamps are unsupported
+            double getGpuTime() const { return gpuTime; }
+
+            // binds made and skipped by the last recorded frame
+            const RenderQueueStats & getRenderQueueStats() const { return renderQueue->getStats(); }
+
+            // when each construction step ran, and on which thread
+            const InitTimeline & getStartupTimeline() const { return startupTimeline; }
+
+            // barriers and transient memory of the last compiled frame graph
+            const RenderGraphStats & getRenderGraphStats() const { return renderGraph->getStats(); }
+
+            // uploaded with the next frame, sampled through its bindless handle
+            TextureId loadTexture(const std::string & path) { return textures->load(path); }
+            // KTX2, block compressed where the device samples the format
+            TextureId loadCompressedTexture(const std::string & path) { return textures->loadCompressed(path); }
+            const Texture & getTexture(TextureId id) const { return textures->get(id); }
+            TextureStats getTextureStats() const { return textures->getStats(); }
+
+            // returns at once, getStreamedTexture is a placeholder until it is resident
+            AssetId streamTexture(const std::string & path, int priority = 0) { return assets->requestTexture(path, priority); }
+            TextureId getStreamedTexture(AssetId id) const { return assets->getTexture(id); }
+            // for a texture the next frame samples, so it is kept in memory or reloaded
+            TextureId useStreamedTexture(AssetId id) { return assets->use(id, frameNumber); }
+            AssetStats getAssetStats() const { return assets->getStats(); }
+
+            // per heap usage against budget, evictions and failed allocations
+            MemoryBudgetStats getMemoryStats() const { return memoryBudget->getStats(); }
+
+            // uniform arena use by the last frame
+            UniformArenaStats getUniformStats() const { return uniformArena->getStats(); }
+
+            // transient CPU memory for recording, used by the last frame
+            const FrameScratchStats & getScratchStats() const { return frameScratch->getStats(); }
+
+            // heap allocations made in drawFrame, counted with COUNT_ALLOCATIONS
+            const FrameAllocationStats & getFrameAllocationStats() const { return allocationStats; }
+
+            // a baked page file (VirtualTexture::bake), updated every frame until the renderer goes
+            VirtualTexture * openVirtualTexture(const std::string & pageFile, uint32_t atlasPages = 32);
+
+            // lookups, fallbacks and background compiles so far
+            PipelineCacheStats getPipelineCacheStats() { return pipelineCache->getStats(); }
+
+            // fragment shader invocations per pixel rendered, 0 if pipeline statistics are unsupported
+            double getOverdraw() const { return overdraw; }
+
+            // 0 for no limit
+            void setFrameLimit(double fps) { frameLimiter.setTarget(fps); }
+            double getFrameLimit() const { return frameLimiter.getTarget(); }
+
+            // time between successive presents, including any limiter wait
+            const FrameTimes & getFrameTimes() const { return frameTimes; }
 
         private:
 
-            VkInstance instance;
+            // destroyed explicitly, in order, by ~VulkanRenderer, the wrappers
+            //  clean up if construction throws part way
+            UniqueInstance instance;
 
             VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-            VkDevice device;
+            UniqueDevice device;
 
             VkQueue graphicsQueue, presentQueue;
 
-            VkSurfaceKHR surface;
+            UniqueSurface surface;
 
             VkViewport viewport;
             VkRect2D scissor;
 
+            // the scene pass' render pass, owned by the render graph, pipelines are built against it.
+            //  Null with dynamic rendering
             VkRenderPass renderPass;
 
+            // every device allocation goes through it
+            std::unique_ptr<MemoryBudget> memoryBudget;
+            // VK_EXT_memory_budget, else heaps are budgeted a share of their size
+            bool memoryBudgetSupported = false;
+
+            // declared again every frame, recompiled only when the declarations change
+            std::unique_ptr<RenderGraph> renderGraph;
+
+            // owns every VkDescriptorSetLayout, descriptorSetLayout is a cached handle
+            std::unique_ptr<DescriptorLayoutCache> descriptorLayoutCache;
             VkDescriptorSetLayout descriptorSetLayout;
-            VkDescriptorPool descriptorPool;
+            // one allocator per frame in flight, reset when the frame's fence signals
+            std::vector<std::unique_ptr<DescriptorAllocator>> descriptorAllocators;
             std::vector<VkDescriptorSet> descriptorSets;
 
-            VkPipelineLayout pipelineLayout;
-            VkPipeline pipeline;
+            // global texture/buffer table, null if descriptor indexing is unsupported
+            std::unique_ptr<BindlessTable> bindless;
+            bool bindlessSupported = false;
+
+            std::unique_ptr<TextureManager> textures;
+            bool samplerAnisotropySupported = false;
+
+            // loads files in the background into textures
+            std::unique_ptr<AssetStreamer> assets;
+
+            std::vector<std::unique_ptr<VirtualTexture>> virtualTextures;
+            // sparse binding on the graphics queue and sparseResidencyImage2D
+            bool sparseResidencySupported = false;
+
+            // VK_KHR_dynamic_rendering, else render passes and framebuffers
+            bool dynamicRenderingSupported = false;
+
+            // owns every VkPipelineLayout, pipelineLayout is a cached handle
+            std::unique_ptr<PipelineLayoutCache> pipelineLayoutCache;
+            VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+            // owned by pipelineCache, null whilst nothing can be drawn with
+            VkPipeline pipeline = VK_NULL_HANDLE;
+
+            std::unique_ptr<PipelineCache> pipelineCache;
+            // looked up every frame
+            PipelineDescription sceneDescription;
+
+            // guards swapping in a reloaded trigProgram, never held over a compile
+            std::mutex programMutex;
+            std::unique_ptr<ShaderProgram> trigProgram;
+            // set before the reload thread starts, read only after
+            Specialisation trigSpecialisation;
+
+            // layout caches are also used from the reload thread
+            std::mutex layoutMutex;
+            // by pipeline layout, for whichever pipeline the cache hands out
+            std::map<VkPipelineLayout, PipelineInterface> pipelineInterfaces;
+
+            // vertex input of a reloaded shader, picked up at the start of a frame
+            std::mutex reloadedMutex;
+            std::optional<std::vector<VkVertexInputAttributeDescription>> reloadedAttributes;
 
-            VkBuffer vertexBuffer;
+            std::unique_ptr<ShaderWatcher> shaderWatcher;
+            // false if the shaders do not read the frame's UniformBufferObject
+            bool usesFrameUniforms = true;
+
+            UniqueBuffer vertexBuffer;
             VkDeviceMemory vertexBufferMemory;
 
-            std::vector<VkBuffer> uniformBuffers;
-            std::vector<VkDeviceMemory> uniformBuffersMemory;
-            std::vector<void*> uniformBuffersMapped;
+            // per frame uniform data, the frame's UniformBufferObject is its first slice
+            std::unique_ptr<UniformArena> uniformArena;
+            UniformSlice frameUniforms;
+
+            // transient CPU arrays for recording, reset when the frame's fence has signalled
+            std::unique_ptr<FrameScratch> frameScratch;
+
+            FrameAllocationStats allocationStats;
+            bool allocationsWarned = false;
 
-            VkCommandPool commandPool;
+            UniqueCommandPool commandPool;
             std::vector<VkCommandBuffer> commandBuffers;
 
-            std::vector<VkSemaphore> imageAvailableSemaphores, renderFinsihedSemaphores;
-            std::vector<VkFence> framesFinished;
+            std::vector<UniqueSemaphore> imageAvailableSemaphores, renderFinsihedSemaphores;
+            std::vector<UniqueFence> framesFinished;
 
             VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
-            VkImage colourImage;
-            VkDeviceMemory colourImageMemory;
-            VkImageView colourImageView;
+            // 0 disables sample shading
+            float sampleShading = 0.0f;
+            bool sampleRateShadingSupported = false;
+
+            VkSampleCountFlagBits requestedMsaaSamples = VK_SAMPLE_COUNT_4_BIT;
+            float requestedSampleShading = 0.0f;
+            bool renderTargetsChanged = false;
+
+            bool dynamicResolution = false;
+            bool requestedDynamicResolution = false;
+            ResolutionController resolution;
+
+            // targets waiting on their scene pipeline to compile
+            struct PendingTargets
+            {
+                VkSampleCountFlagBits samples;
+                float sampleShading;
+                bool scaling;
+                PipelineDescription description;
+            };
+            std::optional<PendingTargets> pendingTargets;
+
+            std::unique_ptr<GpuTimer> gpuTimer;
+            double gpuTime = 0.0;
+
+            InitTimeline startupTimeline;
+
+            std::unique_ptr<FragmentCounter> fragmentCounter;
+            bool pipelineStatisticsSupported = false;
+            // pixels rendered by the frame last submitted in each slot
+            std::vector<uint64_t> slotPixels;
+            double overdraw = 0.0;
+
+            VkFormat depthFormat;
+
+            // draws with no pipeline or buffers, those are filled in each frame
+            std::vector<DrawCommand> sceneDraws;
+            // rebuilt and sorted each frame
+            std::unique_ptr<RenderQueue> renderQueue;
+            glm::mat4 frameModelView;
+            // the scene pass' viewport and scissor, members so its execute captures only this
+            VkViewport frameViewport;
+            VkRect2D frameScissor;
 
             unsigned currentFrame = 0;
+            // total frames drawn
+            uint64_t frameNumber = 0;
+            // every frame before this has finished on the gpu
+            uint64_t framesCompleted = 0;
+            // the frameNumber last submitted in each frame slot
+            std::vector<std::optional<uint64_t>> slotFrames;
+
+            // resources that may still be in use by frames in flight
+            DeletionQueue deletionQueue;
 
-            VkSwapchainKHR swapChain;
+            UniqueSwapchain swapChain;
             std::vector<VkImage> swapChainImages;
             VkFormat swapChainImageFormat;
             VkExtent2D swapChainExtent;
+            bool swapChainTransferDst = false;
 
             uint32_t width, height;
 
-            std::vector<VkImageView> swapChainImageViews;
-            std::vector<VkFramebuffer> swapChainFramebuffers;
+            std::vector<UniqueImageView> swapChainImageViews;
+
+            // resize (or present mode) changes since the last frame, coalesced into one rebuild
+            bool framebufferResized = false;
+
+            // mailbox if available, else fifo (always supported)
+            VkPresentModeKHR requestedPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+            VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+
+            FrameLimiter frameLimiter;
+            FrameTimes frameTimes;
 
-            VkDebugUtilsMessengerEXT debugMessenger;
+            UniqueDebugMessenger debugMessenger;
 
             std::vector<VkLayerProperties> availableLayers;
             std::vector<const char *> extensions;
+            // deviceExtensions plus any optional ones the device supports
+            std::vector<const char *> enabledDeviceExtensions;
 
+            void createInstance();
             void createSurface(GLFWwindow * window);
 
-            VkSampleCountFlagBits getMaxUsableSampleCount();
+            // the largest supported count no greater than limit
+            VkSampleCountFlagBits getMaxUsableSampleCount(VkSampleCountFlagBits limit = VK_SAMPLE_COUNT_64_BIT);
             void pickPhysicalDevice();
             bool isSuitableDevice(VkPhysicalDevice physicalDevice);
             void createLogicalDevice();
+            void createMemoryBudget();
 
             QueueFamilyIndices findQueueFamilies(VkPhysicalDevice physicalDevice);
 
@@ -224,20 +488,76 @@ namespace Renderer
             bool checkDeviceExtensionSupport(VkPhysicalDevice physicalDevice);
             void getRequiredExtensions();
 
-            void createSwapChain();
+            void createSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE);
+            // does not wait for the device, the old swap chain is retired not destroyed
             void recreateSwapChain();
             void cleanupSwapChain();
+            void updateViewport();
             SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice physicalDevice);
             VkSurfaceFormatKHR chooseSwapChainSurfaceFormat(const std::vector<VkSurfaceFormatKHR> & availableFormats);
             VkPresentModeKHR chooseSwapChainPresentMode(const std::vector<VkPresentModeKHR> & availablePresentModes);
+            // false if nothing was presented
+            bool renderFrame();
+
+            // queues the scene pipeline for the requested targets, see selectPipeline
+            void applyRenderTargetSettings();
+
+            // redeclare the graph and scene description for new targets
+            void switchRenderTargets(VkSampleCountFlagBits samples, float shading, bool scaling);
+
+            bool canBlitScene();
+            void createGpuTimer();
+            void createFragmentCounter();
+            // read the finished frame's GPU time and overdraw, and feed the resolution controller
+            void readFrameStatistics();
+
+            VkFormat findDepthFormat();
+            void createRenderQueue();
+            void createFrameScratch();
+            // warns once if a frame past warm up allocated
+            void checkFrameAllocations(uint64_t allocations);
+            void createScene();
+            void buildRenderQueue();
+            // upscale the scene target into the swap chain image, the graph does the transitions
+            void blitScene(VkCommandBuffer commandBuffer, uint32_t imageIndex, VkExtent2D extent);
             VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR & capabilities);
             void createImageViews();
 
-            void createRenderPass();
+            void createRenderGraph();
+            // the scene pass, then with dynamic resolution the upscale, into swap chain image imageIndex
+            void declareRenderGraph(uint32_t imageIndex, VkExtent2D extent, VkSampleCountFlagBits samples, bool scaling);
+
+            void createShaderPrograms();
+
+            void createPipelineCache();
 
             void createGraphicsPipeline();
 
-            void createFramebuffers();
+            // queue compiles for the pipelines recorded last run that fit the current targets
+            void prewarmPipelines();
+
+            std::unique_ptr<ShaderProgram> createTrigProgram(const std::string & vert, const std::string & frag);
+
+            // compiles the program's default variant for the pipeline cache,
+            //  returns the vertex input the shader reads
+            std::vector<VkVertexInputAttributeDescription> registerTrigShader(ShaderProgram & program);
+
+            PipelineDescription describeScenePipeline(const std::vector<VkVertexInputAttributeDescription> & attributes);
+
+            // draw with what the cache returned, nothing if it is null
+            void applyPipeline(const PipelineLookup & found);
+
+            void createShaderWatcher();
+
+            // called from the watcher thread
+            void reloadShaders();
+
+            // non blocking, the cache compiles anything missing in the background,
+            //  switches to pending targets once their pipeline is ready
+            void selectPipeline();
+
+            // advance framesCompleted from signalled fences and flush the deletion queue
+            void retireCompletedFrames();
 
             void createVertexBuffer();
 
@@ -245,10 +565,19 @@ namespace Renderer
 
             void updateUniformBuffer();
 
-            void createDescriptorSetLayout();
+            void createLayoutCaches();
 
-            void createDescriptorPool();
-            void createDescriptorSets();
+            PipelineInterface createPipelineInterface(const ShaderReflection & reflection);
+
+            std::vector<VkVertexInputAttributeDescription> vertexInputAttributes(const ShaderReflection & reflection);
+
+            void createBindlessTable();
+
+            void createTextureManager();
+            void createAssetStreamer();
+
+            void createDescriptorAllocators();
+            void allocateDescriptorSets();
 
             void createCommandPool();
             void createCommandBuffers();
@@ -305,56 +634,21 @@ namespace Renderer
                 }
             }
 
-            // proxy to destroy a debug messenger
-
-            static void destroyDebugUtilsMessengerEXT
-            (
-                VkInstance instance, 
-                VkDebugUtilsMessengerEXT debugMessenger, 
-                const VkAllocationCallbacks* pAllocator
-            ) 
-            {
-                auto func = (PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
-                if (func != nullptr) {
-                    func(instance, debugMessenger, pAllocator);
-                }
-            }
-
             void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT & createInfo);
 
-            uint32_t findMemoryType(uint32_t typeFiller, VkMemoryPropertyFlags properties);
-
             void createBuffer
             (
                 VkDeviceSize size, 
                 VkBufferUsageFlags usage, 
                 VkMemoryPropertyFlags properties,
-                VkBuffer & buffer, VkDeviceMemory & bufferMemory
+                UniqueBuffer & buffer, VkDeviceMemory & bufferMemory,
+                const std::string & what,
+                VkMemoryPropertyFlags preferred = 0,
+                VkMemoryPropertyFlags avoided = 0
             );
 
             void copyBuffer(VkBuffer src, VkBuffer dst, VkDeviceSize size);
 
-            void createColorResources() 
-            {
-                VkFormat colorFormat = swapChainImageFormat;
-
-                createImage
-                (
-                    swapChainExtent.width, 
-                    swapChainExtent.height, 
-                    1, 
-                    msaaSamples, 
-                    colorFormat, 
-                    VK_IMAGE_TILING_OPTIMAL, 
-                    VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 
-                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
-                    colourImage, 
-                    colourImageMemory
-                );
-
-                colourImageView = createImageView(colourImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
-            }
-
             void createImage
             (
                 uint32_t width, 
@@ -366,7 +660,8 @@ namespace Renderer
                 VkImageUsageFlags usage, 
                 VkMemoryPropertyFlags properties, 
                 VkImage & image, 
-                VkDeviceMemory & imageMemory
+                VkDeviceMemory & imageMemory,
+                VkMemoryPropertyFlags preferredProperties = 0
             )
             {
                 VkImageCreateInfo imageInfo{};
@@ -392,15 +687,7 @@ namespace Renderer
                 VkMemoryRequirements memRequirements;
                 vkGetImageMemoryRequirements(device, image, &memRequirements);
 
-                VkMemoryAllocateInfo allocInfo{};
-                allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-                allocInfo.allocationSize = memRequirements.size;
-                allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-                if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) 
-                {
-                    throw std::runtime_error("failed to allocate image memory");
-                }
+                imageMemory = memoryBudget->allocate(memRequirements, properties, preferredProperties, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, "image");
 
                 vkBindImageMemory(device, image, imageMemory, 0);
             }
@@ -0,0 +1,213 @@
+#ifndef VULKANHANDLE
+#define VULKANHANDLE
+
+#include <Renderer/deletionQueue.h>
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+
+namespace Renderer
+{
+
+    /*
+        Owns a Vulkan handle, destroyed with Destroy(owner, handle, nullptr)
+        when it goes out of scope, is reset or is assigned over, e.g.
+
+            UniqueBuffer buffer;
+            if (vkCreateBuffer(device, &bufferInfo, nullptr, buffer.put(device)) != VK_SUCCESS) { ... }
+
+            vkBindBufferMemory(device, buffer, memory, 0);
+
+            // or once no frame in flight can still use it
+            buffer.retire(deletionQueue, frameNumber);
+
+        Move only, so a handle has exactly one owner as it passes into
+        caches, pools and containers, and a moved from handle destroys
+        nothing. It converts to the raw handle for Vulkan calls, address
+        gives a pointer for those taking an array of one.
+
+        retire is the deferred policy, ownership passes to the deletion
+        queue instead of destroying now. std::function needs copyable
+        callbacks, so the raw handle goes with it, not the wrapper.
+    */
+    template <class Handle, class Owner, void (VKAPI_PTR * Destroy)(Owner, Handle, const VkAllocationCallbacks *)>
+    class UniqueHandle
+    {
+
+    public:
+
+        UniqueHandle() = default;
+
+        UniqueHandle(Owner owner, Handle handle)
+        : owner(owner), handle(handle)
+        {}
+
+        UniqueHandle(const UniqueHandle &) = delete;
+        UniqueHandle & operator=(const UniqueHandle &) = delete;
+
+        UniqueHandle(UniqueHandle && other) noexcept
+        : owner(other.owner), handle(other.release())
+        {}
+
+        UniqueHandle & operator=(UniqueHandle && other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                owner = other.owner;
+                handle = other.release();
+            }
+            return *this;
+        }
+
+        ~UniqueHandle() { reset(); }
+
+        Handle get() const { return handle; }
+        operator Handle() const { return handle; }
+
+        const Handle * address() const { return &handle; }
+
+        // destroys what is held, for a create call to write the new handle into
+        Handle * put(Owner newOwner)
+        {
+            reset();
+            owner = newOwner;
+            return &handle;
+        }
+
+        // the caller destroys it
+        Handle release()
+        {
+            Handle released = handle;
+            handle = VK_NULL_HANDLE;
+            return released;
+        }
+
+        void reset()
+        {
+            if (handle != VK_NULL_HANDLE)
+            {
+                Destroy(owner, handle, nullptr);
+                handle = VK_NULL_HANDLE;
+            }
+        }
+
+        // destroyed once frame lastUsed completes
+        void retire(DeletionQueue & deletionQueue, uint64_t lastUsed)
+        {
+            if (handle == VK_NULL_HANDLE)
+            {
+                return;
+            }
+
+            Owner o = owner;
+            Handle h = release();
+            deletionQueue.push(lastUsed, [o, h]() { Destroy(o, h, nullptr); });
+        }
+
+    private:
+
+        Owner owner = VK_NULL_HANDLE;
+        Handle handle = VK_NULL_HANDLE;
+    };
+
+    // the instance and device, which have no owner
+    template <class Handle, void (VKAPI_PTR * Destroy)(Handle, const VkAllocationCallbacks *)>
+    class UniqueRoot
+    {
+
+    public:
+
+        UniqueRoot() = default;
+
+        UniqueRoot(const UniqueRoot &) = delete;
+        UniqueRoot & operator=(const UniqueRoot &) = delete;
+
+        UniqueRoot(UniqueRoot && other) noexcept
+        : handle(other.release())
+        {}
+
+        UniqueRoot & operator=(UniqueRoot && other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                handle = other.release();
+            }
+            return *this;
+        }
+
+        ~UniqueRoot() { reset(); }
+
+        Handle get() const { return handle; }
+        operator Handle() const { return handle; }
+
+        Handle * put()
+        {
+            reset();
+            return &handle;
+        }
+
+        Handle release()
+        {
+            Handle released = handle;
+            handle = VK_NULL_HANDLE;
+            return released;
+        }
+
+        // everything created from it must already be destroyed
+        void reset()
+        {
+            if (handle != VK_NULL_HANDLE)
+            {
+                Destroy(handle, nullptr);
+                handle = VK_NULL_HANDLE;
+            }
+        }
+
+    private:
+
+        Handle handle = VK_NULL_HANDLE;
+    };
+
+    // loaded at runtime, so proxied to fit UniqueHandle
+    inline void VKAPI_CALL destroyDebugUtilsMessengerEXT
+    (
+        VkInstance instance,
+        VkDebugUtilsMessengerEXT debugMessenger,
+        const VkAllocationCallbacks * pAllocator
+    )
+    {
+        auto func = (PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+        if (func != nullptr)
+        {
+            func(instance, debugMessenger, pAllocator);
+        }
+    }
+
+    typedef UniqueRoot<VkInstance, vkDestroyInstance> UniqueInstance;
+    typedef UniqueRoot<VkDevice, vkDestroyDevice> UniqueDevice;
+
+    typedef UniqueHandle<VkSurfaceKHR, VkInstance, vkDestroySurfaceKHR> UniqueSurface;
+    typedef UniqueHandle<VkDebugUtilsMessengerEXT, VkInstance, destroyDebugUtilsMessengerEXT> UniqueDebugMessenger;
+
+    typedef UniqueHandle<VkSwapchainKHR, VkDevice, vkDestroySwapchainKHR> UniqueSwapchain;
+    typedef UniqueHandle<VkImage, VkDevice, vkDestroyImage> UniqueImage;
+    typedef UniqueHandle<VkImageView, VkDevice, vkDestroyImageView> UniqueImageView;
+    typedef UniqueHandle<VkBuffer, VkDevice, vkDestroyBuffer> UniqueBuffer;
+    typedef UniqueHandle<VkSampler, VkDevice, vkDestroySampler> UniqueSampler;
+    typedef UniqueHandle<VkShaderModule, VkDevice, vkDestroyShaderModule> UniqueShaderModule;
+    typedef UniqueHandle<VkPipeline, VkDevice, vkDestroyPipeline> UniquePipeline;
+    typedef UniqueHandle<VkPipelineLayout, VkDevice, vkDestroyPipelineLayout> UniquePipelineLayout;
+    typedef UniqueHandle<VkRenderPass, VkDevice, vkDestroyRenderPass> UniqueRenderPass;
+    typedef UniqueHandle<VkFramebuffer, VkDevice, vkDestroyFramebuffer> UniqueFramebuffer;
+    typedef UniqueHandle<VkDescriptorPool, VkDevice, vkDestroyDescriptorPool> UniqueDescriptorPool;
+    typedef UniqueHandle<VkDescriptorSetLayout, VkDevice, vkDestroyDescriptorSetLayout> UniqueDescriptorSetLayout;
+    typedef UniqueHandle<VkCommandPool, VkDevice, vkDestroyCommandPool> UniqueCommandPool;
+    typedef UniqueHandle<VkSemaphore, VkDevice, vkDestroySemaphore> UniqueSemaphore;
+    typedef UniqueHandle<VkFence, VkDevice, vkDestroyFence> UniqueFence;
+    typedef UniqueHandle<VkQueryPool, VkDevice, vkDestroyQueryPool> UniqueQueryPool;
+}
+
+#endif /* VULKANHANDLE */
@@ -0,0 +1,164 @@
+#ifndef REFLECTION
+#define REFLECTION
+
+#include <vulkan/vulkan.h>
+
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <cstdint>
+
+namespace Renderer
+{
+
+    struct ReflectedBinding
+    {
+        uint32_t set;
+        uint32_t binding;
+        VkDescriptorType type;
+        // 0 for a runtime sized array, e.g. sampler2D textures[]
+        uint32_t count;
+        VkShaderStageFlags stages;
+        std::string name;
+    };
+
+    // a stage input or output variable at a location
+    struct ReflectedVariable
+    {
+        uint32_t location;
+        VkFormat format;
+        std::string name;
+    };
+
+    /*
+        Minimal reflection over a SPIR-V module, enough to build
+        descriptor set layouts, push constant ranges and vertex
+        input state without writing them out by hand.
+
+        Only the instructions needed for that are parsed, see
+        https://registry.khronos.org/SPIR-V/specs/unified1/SPIRV.html
+    */
+    class ShaderReflection
+    {
+
+    public:
+
+        ShaderReflection()
+        : stages(0), pushConstantSize(0)
+        {}
+
+        // throws if the words are not a valid SPIR-V module
+        static ShaderReflection reflect(const std::vector<uint32_t> & spirv);
+
+        // combine with another stage, throws on conflicting bindings
+        void merge(const ShaderReflection & other);
+
+        // descriptor set indices in use, ascending
+        std::vector<uint32_t> sets() const;
+
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings(uint32_t set) const;
+
+        // throws unless every input of next is written by an output here
+        void checkInterface(const ShaderReflection & next) const;
+
+        VkShaderStageFlags stages;
+
+        std::vector<ReflectedBinding> bindings;
+
+        std::vector<ReflectedVariable> inputs, outputs;
+
+        uint32_t pushConstantSize;
+
+        // constant_id of each specialisation constant, ascending
+        std::vector<uint32_t> specialisationConstants;
+
+    private:
+
+        // SPIR-V enumerants used below
+        enum Op : uint16_t
+        {
+            OpName = 5,
+            OpEntryPoint = 15,
+            OpTypeInt = 21,
+            OpTypeFloat = 22,
+            OpTypeVector = 23,
+            OpTypeMatrix = 24,
+            OpTypeImage = 25,
+            OpTypeSampler = 26,
+            OpTypeSampledImage = 27,
+            OpTypeArray = 28,
+            OpTypeRuntimeArray = 29,
+            OpTypeStruct = 30,
+            OpTypePointer = 32,
+            OpConstant = 43,
+            OpSpecConstantTrue = 48,
+            OpSpecConstantFalse = 49,
+            OpSpecConstant = 50,
+            OpVariable = 59,
+            OpDecorate = 71,
+            OpMemberDecorate = 72,
+            OpTypeAccelerationStructureKHR = 5341
+        };
+
+        enum Decoration : uint32_t
+        {
+            SpecId = 1,
+            Block = 2,
+            BufferBlock = 3,
+            ArrayStride = 6,
+            MatrixStride = 7,
+            BuiltIn = 11,
+            Location = 30,
+            Binding = 33,
+            DescriptorSet = 34,
+            Offset = 35
+        };
+
+        enum StorageClass : uint32_t
+        {
+            UniformConstant = 0,
+            Input = 1,
+            Uniform = 2,
+            Output = 3,
+            PushConstant = 9,
+            StorageBuffer = 12
+        };
+
+        struct Type
+        {
+            uint16_t op = 0;
+            // int/float width, vector/matrix/array element count
+            uint32_t width = 0, count = 0;
+            bool isSigned = false;
+            // vector, matrix, array, pointer element type, image dimension
+            uint32_t element = 0;
+            uint32_t storage = 0;
+            // image sampled field, 1 sampled, 2 storage
+            uint32_t sampled = 0;
+            std::vector<uint32_t> members;
+        };
+
+        struct Decorations
+        {
+            std::map<uint32_t, uint32_t> values;
+            std::map<uint32_t, std::map<uint32_t, uint32_t>> members;
+            bool has(uint32_t d) const { return values.find(d) != values.end(); }
+        };
+
+        struct Module
+        {
+            std::unordered_map<uint32_t, Type> types;
+            std::unordered_map<uint32_t, uint32_t> constants;
+            std::unordered_map<uint32_t, Decorations> decorations;
+            std::unordered_map<uint32_t, std::string> names;
+        };
+
+        static VkFormat format(const Module & module, uint32_t typeId);
+        static uint32_t size(const Module & module, uint32_t typeId);
+        static VkDescriptorType descriptorType(const Module & module, uint32_t typeId, uint32_t storage, uint32_t & count);
+    };
+}
+
+#endif /* REFLECTION */
@@ -4,10 +4,14 @@
 #include <vulkan/vulkan.h>
 #include <shaderc/shaderc.hpp>
 
+#include <Shader/reflection.h>
+#include <Renderer/vulkanHandle.h>
+
 #include <fstream>
 #include <string>
 #include <cstring>
 #include <vector>
+#include <map>
 #include <iostream>
 
 namespace Renderer
@@ -22,6 +26,8 @@ namespace Renderer
                 // Like -DMY_DEFINE=1
                 options.AddMacroDefinition("MY_DEFINE", "1");
 
+            see ShaderProgram for compiling variants on demand
+
         */
 
     public:
@@ -30,77 +36,93 @@ namespace Renderer
         : device(VK_NULL_HANDLE)
         {}
 
-        Shader(const VkDevice & d, std::string programName)
+        Shader(VkDevice d, std::string programName)
+        : Shader(d, programName, vert, frag)
+        {}
+
+        // compile a program from GLSL with the given -DNAME=VALUE macros
+        Shader
+        (
+            VkDevice d,
+            std::string programName,
+            const std::string & vertexGlsl,
+            const std::string & fragmentGlsl,
+            const std::map<std::string, std::string> & macros = {}
+        )
         : device(d)
         {
-            
-            shaderc::CompileOptions options;
-
-            auto preprocessedVert = preprocessShader
-            (
-                "shader_src", 
-                shaderc_glsl_vertex_shader, 
-                vert, 
-                options
-            );
-            std::cout << "Compiled a vertex shader resulting in preprocessed text:"
-                      << std::endl
-                      << preprocessedVert << std::endl;
-
-            vertexSource = compileSPIRV
-            (
-                "shader_src", 
-                shaderc_glsl_vertex_shader, 
-                preprocessedVert, 
-                options,
-                true
-            );
-
-            std::cout << "Compiled to a binary module with " << vertexSource.size()
-                      << " words." << std::endl;
-
-            auto preprocessedFrag = preprocessShader
-            (
-                "shader_src", 
-                shaderc_glsl_fragment_shader, 
-                frag, 
-                options
-            );
-            std::cout << "Compiled a fragment shader resulting in preprocessed text:"
-                      << std::endl
-                      << preprocessedFrag << std::endl;
-
-            fragmentSource = compileSPIRV
-            (
-                "shader_src", 
-                shaderc_glsl_fragment_shader, 
-                preprocessedFrag, 
-                options,
-                true
-            );
-
-            std::cout << "Compiled to a binary module with " << fragmentSource.size()
-                      << " words." << std::endl;
-
-
-            createShaderModules(device);
-
+            compile(programName, vertexGlsl, fragmentGlsl, macros);
+            createShaderModules();
         }
 
-        ~Shader();
+        // move only, the modules are destroyed with it
+        Shader(Shader &&) = default;
+        Shader & operator=(Shader &&) = default;
+
+        // specialisation, if given, must outlive pipeline creation
+        std::vector<VkPipelineShaderStageCreateInfo> shaderStage(const VkSpecializationInfo * specialisation = nullptr);
 
-        std::vector<VkPipelineShaderStageCreateInfo> shaderStage();
+        // descriptor bindings, push constants and vertex inputs of all stages
+        const ShaderReflection & getReflection() const { return reflection; }
+
+        // read GLSL source from disk, false if the file cannot be opened
+        static bool readGlsl(const std::string & filename, std::string & source);
+
+        // built in triangle program
+
+        static constexpr const char * frag = "#version 450\n"
+            "layout(constant_id = 0) const float ALPHA = 1.0;\n"
+            "layout(location = 0) in vec3 fragColour;\n"
+            "layout(location = 0) out vec4 outColour;\n"
+            "void main()\n"
+            "{\n"
+            "    outColour = vec4(fragColour, ALPHA);\n"
+            "}\n";
+
+        static constexpr const char * vert = "#version 450\n"
+            "layout(binding = 0) uniform UniformBufferObject\n"
+            "{\n"
+            "    mat4 model;\n"
+            "    mat4 view;\n"
+            "    mat4 proj;\n"
+            "} ubo;\n"
+            "layout(push_constant) uniform DrawConstants\n"
+            "{\n"
+            "    uint texture;\n"
+            "    uint buffer;\n"
+            "    uvec2 padding;\n"
+            "    mat4 model;\n"
+            "} draw;\n"
+            "layout(location = 0) in vec2 a_position;\n"
+            "layout(location = 1) in vec3 a_colour;\n"
+            "layout(location = 0) out vec3 fragColour;\n"
+            "void main()\n"
+            "{\n"
+            "    gl_Position = ubo.proj * ubo.view * ubo.model * draw.model * vec4(a_position, 0.0, 1.0);\n"
+            "    fragColour = a_colour;\n"
+            "}";
 
     private:
 
-        const VkDevice & device;
+        // by value, a reference could outlive what it refers to
+        VkDevice device;
 
-        VkShaderModule vertexModule, fragmentModule;
+        UniqueShaderModule vertexModule, fragmentModule;
 
         std::vector<uint32_t> vertexSource, fragmentSource;
 
+        ShaderReflection reflection;
+
         std::vector<char> readSPIRV(const std::string & filename);
-        void createShaderModules(const VkDevice & device);
+        void createShaderModules();
+
+        void compile
+        (
+            const std::string & programName,
+            const std::string & vertexGlsl,
+            const std::string & fragmentGlsl,
+            const std::map<std::string, std::string> & macros
+        );
 
         // Returns GLSL shader source text after preprocessing.
         std::string preprocessShader
@@ -133,30 +155,6 @@ namespace Renderer
             shaderc::CompileOptions options,
             bool optimize = false
         );
-
-        const char * frag = "#version 450\n"
-            "layout(location = 0) in vec3 fragColour;\n"
-            "layout(location = 0) out vec4 outColour;\n"
-            "void main()\n"
-            "{\n"
-            "    outColour = vec4(fragColour, 1.0);\n"
-            "}\n";
-
-        const char * vert = "#version 450\n"
-            "layout(binding = 0) uniform UniformBufferObject\n"
-            "{\n"
-            "    mat4 model;\n"
-            "    mat4 view;\n"
-            "    mat4 proj;\n"
-            "} ubo;\n"
-            "layout(location = 0) in vec2 a_position;\n"
-            "layout(location = 1) in vec3 a_colour;\n"
-            "layout(location = 0) out vec3 fragColour;\n"
-            "void main()\n"
-            "{\n"
-            "    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(a_position, 0.0, 1.0);\n"
-            "    fragColour = a_colour;\n"
-            "}";
     };
 }
 
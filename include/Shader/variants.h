@@ -0,0 +1,167 @@
+#ifndef VARIANTS
+#define VARIANTS
+
+#include <Shader/shader.h>
+
+#include <vulkan/vulkan.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+
+namespace Renderer
+{
+
+    /*
+        Values for specialisation constants, e.g.
+
+            layout(constant_id = 0) const float ALPHA = 1.0;
+
+        are set by id. These are baked into the pipeline by the driver
+        so a toggle costs no branching at runtime, yet needs only one
+        shader module for all values.
+    */
+    class Specialisation
+    {
+
+    public:
+
+        Specialisation() = default;
+
+        // the info points into this object, so copies rebuild it
+        Specialisation(const Specialisation & other)
+        : entries(other.entries), data(other.data)
+        {}
+
+        Specialisation & operator=(const Specialisation & other)
+        {
+            entries = other.entries;
+            data = other.data;
+            return *this;
+        }
+
+        // bool, int, uint and float constants are all 32 bit
+        void set(uint32_t id, uint32_t value);
+        void set(uint32_t id, int32_t value) { set(id, static_cast<uint32_t>(value)); }
+        void set(uint32_t id, bool value) { set(id, static_cast<uint32_t>(value ? VK_TRUE : VK_FALSE)); }
+        void set(uint32_t id, float value)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            set(id, bits);
+        }
+
+        bool empty() const { return entries.empty(); }
+
+        const std::vector<VkSpecializationMapEntry> & getEntries() const { return entries; }
+
+        // valid until this object is next modified
+        const VkSpecializationInfo * info();
+
+        size_t hash() const;
+
+    private:
+
+        std::vector<VkSpecializationMapEntry> entries;
+        std::vector<uint32_t> data;
+
+        VkSpecializationInfo specialisationInfo;
+    };
+
+    /*
+        A shader program with variants.
+
+        Macro axes (#if FEATURE) each produce a separate SPIR-V
+        module, so are for things specialisation constants cannot
+        express, e.g. changing the interface or resource bindings.
+        Prefer specialisation constants for feature toggles, these
+        share one module per macro permutation.
+
+        Variants are compiled the first time they are requested and
+        cached by their resolved macro values.
+
+            ShaderProgram program(device, "lit", vert, frag);
+            program.addMacroAxis("SHADOWS", {"0", "1"});
+            program.addSpecialisationConstant("ALPHA", 0);
+
+            Shader & s = program.variant({{"SHADOWS", "1"}});
+            Specialisation c = program.specialise({{"ALPHA", 0.5f}});
+            auto stages = s.shaderStage(c.info());
+    */
+    class ShaderProgram
+    {
+
+    public:
+
+        ShaderProgram
+        (
+            VkDevice d,
+            std::string programName,
+            std::string vertexGlsl,
+            std::string fragmentGlsl
+        )
+        : device(d), name(programName), vertex(vertexGlsl), fragment(fragmentGlsl)
+        {}
+
+        ShaderProgram(const ShaderProgram &) = delete;
+        ShaderProgram & operator=(const ShaderProgram &) = delete;
+
+        // the first value is the default
+        void addMacroAxis(std::string macro, std::vector<std::string> values);
+
+        void addSpecialisationConstant(std::string constant, uint32_t id);
+
+        typedef std::map<std::string, std::string> MacroValues;
+
+        // axes not given take their default value, throws on unknown axes or values
+        Shader & variant(const MacroValues & macros = {});
+
+        template <class T>
+        Specialisation specialise(const std::map<std::string, T> & constants) const
+        {
+            Specialisation s;
+            for (const auto & constant : constants)
+            {
+                s.set(specialisationId(constant.first), constant.second);
+            }
+            return s;
+        }
+
+        // of the resolved macro values, e.g. to name a variant's binaries
+        size_t permutationHash(const MacroValues & macros) const;
+
+        size_t variantCount() const { return variants.size(); }
+
+        const std::string & getName() const { return name; }
+
+        const std::string & getVertexSource() const { return vertex; }
+        const std::string & getFragmentSource() const { return fragment; }
+
+        // drop compiled variants, e.g. after the source changes
+        void setSource(std::string vertexGlsl, std::string fragmentGlsl);
+
+    private:
+
+        VkDevice device;
+
+        std::string name, vertex, fragment;
+
+        // declaration order is the hashing order
+        std::vector<std::pair<std::string, std::vector<std::string>>> axes;
+
+        std::map<std::string, uint32_t> constants;
+
+        // by resolved values, so defaults and explicit defaults share one
+        std::map<MacroValues, std::unique_ptr<Shader>> variants;
+
+        uint32_t specialisationId(const std::string & constant) const;
+
+        MacroValues resolve(const MacroValues & macros) const;
+    };
+}
+
+#endif /* VARIANTS */
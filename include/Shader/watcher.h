@@ -0,0 +1,67 @@
+#ifndef WATCHER
+#define WATCHER
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <iostream>
+
+namespace Renderer
+{
+
+    /*
+        Watches files in a directory with inotify, calling onChange
+        from a background thread whenever any of them is rewritten.
+
+        Editors often write a file as several events (truncate, write,
+        rename), so events are coalesced for a short settle time and
+        onChange is called once per burst.
+
+        On platforms without inotify this does nothing.
+    */
+    class ShaderWatcher
+    {
+
+    public:
+
+        ShaderWatcher
+        (
+            std::string directory,
+            std::vector<std::string> files,
+            std::function<void()> onChange
+        );
+
+        ShaderWatcher(const ShaderWatcher &) = delete;
+        ShaderWatcher & operator=(const ShaderWatcher &) = delete;
+
+        // stops and joins the watching thread
+        ~ShaderWatcher();
+
+        bool watching() const { return fd >= 0; }
+
+    private:
+
+        // how long to wait for further events before reporting a change
+        static const int SETTLE_MS = 50;
+        // how often the thread checks whether it should exit
+        static const int POLL_MS = 100;
+
+        std::string directory;
+        std::vector<std::string> files;
+        std::function<void()> onChange;
+
+        int fd, wd;
+
+        std::atomic<bool> running;
+        std::thread thread;
+
+        void run();
+
+        // drain pending events, true if one names a watched file
+        bool readEvents();
+    };
+}
+
+#endif /* WATCHER */
@@ -1,9 +1,11 @@
 #version 450
 
+layout(constant_id = 0) const float ALPHA = 1.0;
+
 layout(location = 0) in vec3 fragColour;
 layout(location = 0) out vec4 outColour;
 
 void main()
 {
-    outColour = vec4(fragColour, 1.0);
+    outColour = vec4(fragColour, ALPHA);
 }
\ No newline at end of file
@@ -7,6 +7,14 @@ layout(binding = 0) uniform UniformBufferObject
     mat4 proj;
 } ubo;
 
+layout(push_constant) uniform DrawConstants
+{
+    uint texture;
+    uint buffer;
+    uvec2 padding;
+    mat4 model;
+} draw;
+
 layout(location = 0) in vec2 a_position;
 layout(location = 1) in vec3 a_colour;
 
@@ -14,6 +22,6 @@ layout(location = 0) out vec3 fragColour;
 
 void main()
 {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(a_position, 0.0, 1.0);
+    gl_Position = ubo.proj * ubo.view * ubo.model * draw.model * vec4(a_position, 0.0, 1.0);
     fragColour = a_colour;
 }
\ No newline at end of file
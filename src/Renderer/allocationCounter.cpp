@@ -0,0 +1,88 @@
+#include <Renderer/allocationCounter.h>
+
+#include <sstream>
+
+namespace Renderer
+{
+    std::string FrameAllocationStats::report() const
+    {
+        if (!counting)
+        {
+            return "heap allocations not counted, build with COUNT_ALLOCATIONS";
+        }
+
+        std::stringstream ss;
+        ss << last << " heap allocations last frame"
+           << ", " << allocatingFrames << " frames allocated after warm up"
+           << ", at most " << peak;
+        return ss.str();
+    }
+}
+
+#ifdef COUNT_ALLOCATIONS
+
+#include <new>
+#include <cstdlib>
+
+namespace
+{
+    // trivial, so usable from operator new before anything is constructed
+    thread_local uint64_t allocations = 0;
+
+    void * counted(std::size_t size)
+    {
+        allocations++;
+        // malloc(0) may return null
+        return std::malloc(size > 0 ? size : 1);
+    }
+}
+
+void * operator new(std::size_t size)
+{
+    void * p = counted(size);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void * operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void * operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return counted(size);
+}
+
+void * operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return counted(size);
+}
+
+void operator delete(void * p) noexcept { std::free(p); }
+void operator delete[](void * p) noexcept { std::free(p); }
+void operator delete(void * p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void * p, std::size_t) noexcept { std::free(p); }
+void operator delete(void * p, const std::nothrow_t &) noexcept { std::free(p); }
+void operator delete[](void * p, const std::nothrow_t &) noexcept { std::free(p); }
+
+namespace Renderer
+{
+    bool countingAllocations() { return true; }
+
+    uint64_t threadAllocations() { return allocations; }
+}
+
+#else
+
+namespace Renderer
+{
+    bool countingAllocations() { return false; }
+
+    uint64_t threadAllocations() { return 0; }
+}
+
+#endif
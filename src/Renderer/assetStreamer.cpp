@@ -0,0 +1,921 @@
+#include <Renderer/assetStreamer.h>
+
+#include <stdexcept>
+#include <sstream>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <iterator>
+#include <thread>
+#include <chrono>
+
+#ifndef WINDOWS
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+#if __has_include(<linux/io_uring.h>)
+#define ASSET_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace Renderer
+{
+
+    namespace
+    {
+        // the most one read asks for, larger files take several
+        const size_t READ_CHUNK = size_t(1) << 30;
+
+        bool endsWith(const std::string & s, const std::string & suffix)
+        {
+            return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+        }
+
+#ifdef ASSET_IO_URING
+        /*
+            The minimum of io_uring for reads, driven through the raw
+            system calls so there is no dependency on liburing. One
+            thread submits and reaps.
+        */
+        class IoUring
+        {
+
+        public:
+
+            IoUring() = default;
+
+            IoUring(const IoUring &) = delete;
+            IoUring & operator=(const IoUring &) = delete;
+
+            ~IoUring()
+            {
+                if (sqes != nullptr)
+                {
+                    munmap(sqes, sqesSize);
+                }
+
+                if (cqRing != nullptr && cqRing != sqRing)
+                {
+                    munmap(cqRing, cqRingSize);
+                }
+
+                if (sqRing != nullptr)
+                {
+                    munmap(sqRing, sqRingSize);
+                }
+
+                if (fd >= 0)
+                {
+                    close(fd);
+                }
+            }
+
+            // false if the kernel (or a seccomp filter) refuses
+            bool setup(unsigned entries)
+            {
+                io_uring_params params;
+                std::memset(&params, 0, sizeof(params));
+
+                fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+
+                if (fd < 0)
+                {
+                    return false;
+                }
+
+                sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+                cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+                sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+                bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+
+                if (single)
+                {
+                    sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+                }
+
+                sqRing = map(sqRingSize, IORING_OFF_SQ_RING);
+                cqRing = single ? sqRing : map(cqRingSize, IORING_OFF_CQ_RING);
+                sqes = static_cast<io_uring_sqe *>(map(sqesSize, IORING_OFF_SQES));
+
+                if (sqRing == nullptr || cqRing == nullptr || sqes == nullptr)
+                {
+                    return false;
+                }
+
+                uint8_t * sq = static_cast<uint8_t *>(sqRing);
+                sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+                sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+                sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+                sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+                sqEntries = params.sq_entries;
+
+                uint8_t * cq = static_cast<uint8_t *>(cqRing);
+                cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+                cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+                cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+                cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+                return true;
+            }
+
+            // queued until wait, false if the submission queue is full
+            bool read(int file, void * buffer, unsigned bytes, uint64_t offset, uint64_t userData)
+            {
+                unsigned tail = *sqTail;
+
+                if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+                {
+                    return false;
+                }
+
+                unsigned index = tail & sqMask;
+                io_uring_sqe & sqe = sqes[index];
+                std::memset(&sqe, 0, sizeof(sqe));
+
+                sqe.opcode = IORING_OP_READ;
+                sqe.fd = file;
+                sqe.addr = reinterpret_cast<uint64_t>(buffer);
+                sqe.len = bytes;
+                sqe.off = offset;
+                sqe.user_data = userData;
+
+                sqArray[index] = index;
+                __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+                queued++;
+
+                return true;
+            }
+
+            /*
+                Submit what is queued and block until at least one read
+                completes. Interrupted calls are retried, EAGAIN and EBUSY
+                (the completion queue is full, or the kernel is short of
+                memory) return true so the caller reaps and tries again.
+                Any other error is a hard failure, wait returns false from
+                then on, use cancelQueued and drain.
+            */
+            bool wait()
+            {
+                while (!broken)
+                {
+                    long submitted = syscall(__NR_io_uring_enter, fd, queued, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+
+                    if (submitted >= 0)
+                    {
+                        queued -= static_cast<unsigned>(submitted);
+                        inFlight += static_cast<unsigned>(submitted);
+                        return true;
+                    }
+
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+
+                    if (errno == EAGAIN || errno == EBUSY)
+                    {
+                        std::this_thread::yield();
+                        return true;
+                    }
+
+                    broken = true;
+                }
+
+                return false;
+            }
+
+            // f(userData, result) for every completed read
+            template <class F>
+            void reap(F f)
+            {
+                unsigned head = *cqHead;
+                unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+
+                while (head != tail)
+                {
+                    const io_uring_cqe & cqe = cqes[head & cqMask];
+                    inFlight -= std::min(inFlight, 1u);
+                    f(cqe.user_data, cqe.res);
+                    head++;
+                }
+
+                __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            }
+
+            // f(userData) for reads queued but never submitted, they are taken back
+            template <class F>
+            void cancelQueued(F f)
+            {
+                unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+                unsigned tail = *sqTail;
+
+                __atomic_store_n(sqTail, head, __ATOMIC_RELEASE);
+                queued = 0;
+
+                for (unsigned i = head; i != tail; i++)
+                {
+                    f(sqes[sqArray[i & sqMask]].user_data);
+                }
+            }
+
+            // reap until every submitted read has completed, the kernel owns their buffers till then
+            template <class F>
+            void drain(F f)
+            {
+                while (true)
+                {
+                    reap(f);
+
+                    if (inFlight == 0)
+                    {
+                        return;
+                    }
+
+                    // completions are still posted without io_uring_enter, poll for them
+                    if (!wait())
+                    {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+                }
+            }
+
+        private:
+
+            int fd = -1;
+
+            void * sqRing = nullptr;
+            void * cqRing = nullptr;
+            io_uring_sqe * sqes = nullptr;
+            size_t sqRingSize = 0, cqRingSize = 0, sqesSize = 0;
+
+            unsigned * sqHead, * sqTail, * sqArray;
+            unsigned sqMask, sqEntries;
+            unsigned * cqHead, * cqTail;
+            unsigned cqMask;
+            io_uring_cqe * cqes;
+
+            unsigned queued = 0;
+            // submitted, not yet reaped
+            unsigned inFlight = 0;
+            bool broken = false;
+
+            void * map(size_t size, off_t offset)
+            {
+                void * mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+                return mapped == MAP_FAILED ? nullptr : mapped;
+            }
+        };
+#endif
+
+#ifndef WINDOWS
+        // whole file, false with errno set on failure
+        bool preadAll(int fd, uint8_t * buffer, size_t size, size_t done = 0)
+        {
+            while (done < size)
+            {
+                ssize_t n = pread(fd, buffer + done, std::min(size - done, READ_CHUNK), off_t(done));
+
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+
+                if (n <= 0)
+                {
+                    errno = n == 0 ? EIO : errno;
+                    return false;
+                }
+
+                done += size_t(n);
+            }
+
+            return true;
+        }
+#endif
+    }
+
+    std::string AssetStats::report() const
+    {
+        std::stringstream ss;
+        ss << "assets " << resident << "/" << requested << " resident"
+           << ", " << inFlight << " in flight"
+           << ", " << failed << " failed"
+           << ", " << evictions << " evicted"
+           << ", " << bytesRead / (1024 * 1024) << " MiB read"
+           << (ioUring ? " (io_uring)" : " (pread)")
+           << ", " << uploadBatches << " upload batches";
+        return ss.str();
+    }
+
+    AssetStreamer::AssetStreamer
+    (
+        TextureManager & textures,
+        MemoryBudget & budget,
+        unsigned decoderCount,
+        VkDeviceSize uploadBytes,
+        unsigned queueDepth
+    )
+    : textures(textures),
+      budget(budget),
+      uploadBytes(uploadBytes),
+      queueDepth(std::max(1u, queueDepth))
+    {
+        // magenta and black, obviously not the real thing
+        const uint32_t PLACEHOLDER_SIZE = 8;
+
+        TextureData checker;
+        checker.width = checker.height = PLACEHOLDER_SIZE;
+        checker.pixels.resize(PLACEHOLDER_SIZE * PLACEHOLDER_SIZE * 4);
+
+        for (uint32_t y = 0; y < PLACEHOLDER_SIZE; y++)
+        {
+            for (uint32_t x = 0; x < PLACEHOLDER_SIZE; x++)
+            {
+                uint8_t * texel = &checker.pixels[(y * PLACEHOLDER_SIZE + x) * 4];
+                bool on = ((x / 2) + (y / 2)) % 2 == 0;
+                texel[0] = on ? 255 : 0;
+                texel[1] = 0;
+                texel[2] = on ? 255 : 0;
+                texel[3] = 255;
+            }
+        }
+
+        SamplerDescription nearest;
+        nearest.magFilter = VK_FILTER_NEAREST;
+        nearest.minFilter = VK_FILTER_NEAREST;
+        placeholder = textures.create(checker, nearest, false);
+
+        if (decoderCount == 0)
+        {
+            // leave the render and I/O threads their own cores
+            decoderCount = std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u);
+        }
+
+        io = std::thread(&AssetStreamer::reader, this);
+
+        for (unsigned i = 0; i < decoderCount; i++)
+        {
+            decoders.emplace_back(&AssetStreamer::decoder, this);
+        }
+    }
+
+    AssetStreamer::~AssetStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        readWork.notify_all();
+        decodeWork.notify_all();
+
+        io.join();
+
+        for (std::thread & decoder : decoders)
+        {
+            decoder.join();
+        }
+
+        // the textures outlive this, but not its eviction callbacks
+        for (Asset & asset : assets)
+        {
+            budget.removeEvictable(asset.evictable);
+        }
+    }
+
+    AssetId AssetStreamer::requestTexture(const std::string & path, int priority, const SamplerDescription & sampler, bool mipmaps)
+    {
+        AssetId id = static_cast<AssetId>(assets.size());
+        assets.push_back({path, priority, sampler, mipmaps});
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            priorities.push_back(priority);
+            started.push_back(false);
+            requests.push({priority, sequence++, id, path});
+            stats.requested++;
+        }
+
+        readWork.notify_one();
+
+        return id;
+    }
+
+    void AssetStreamer::setPriority(AssetId id, int priority)
+    {
+        Asset & asset = assets.at(id);
+
+        if (asset.priority == priority)
+        {
+            return;
+        }
+
+        asset.priority = priority;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (started[id])
+            {
+                return;
+            }
+
+            // the old request is skipped as stale
+            priorities[id] = priority;
+            requests.push({priority, sequence++, id, asset.path});
+        }
+
+        readWork.notify_one();
+    }
+
+    bool AssetStreamer::nextRequest(Request & request, bool wait, bool & stop)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        if (wait)
+        {
+            readWork.wait(lock, [&]() { return stopping || !requests.empty(); });
+        }
+
+        stop = stopping;
+
+        while (!stop && !requests.empty())
+        {
+            request = requests.top();
+            requests.pop();
+
+            if (started[request.id] || priorities[request.id] != request.priority)
+            {
+                continue;
+            }
+
+            started[request.id] = true;
+            return true;
+        }
+
+        return false;
+    }
+
+    void AssetStreamer::reader()
+    {
+#ifdef WINDOWS
+        Request request;
+        bool stop = false;
+
+        while (nextRequest(request, true, stop))
+        {
+            std::ifstream file(request.path, std::ios::binary | std::ios::ate);
+
+            if (!file.is_open())
+            {
+                readFailed(request, "could not open");
+                continue;
+            }
+
+            std::vector<uint8_t> bytes(size_t(file.tellg()));
+            file.seekg(0);
+            file.read(reinterpret_cast<char *>(bytes.data()), bytes.size());
+
+            if (size_t(file.gcount()) != bytes.size())
+            {
+                readFailed(request, "read failed");
+                continue;
+            }
+
+            readComplete(request, std::move(bytes));
+        }
+#else
+        struct InFlight
+        {
+            Request request;
+            int fd = -1;
+            std::vector<uint8_t> bytes;
+            size_t done = 0;
+        };
+
+        std::vector<InFlight> slots(queueDepth);
+        std::vector<size_t> freeSlots;
+
+        for (size_t i = queueDepth; i-- > 0;)
+        {
+            freeSlots.push_back(i);
+        }
+
+#ifdef ASSET_IO_URING
+        IoUring ring;
+        bool useRing = ring.setup(queueDepth);
+#else
+        bool useRing = false;
+#endif
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.ioUring = useRing;
+        }
+
+        bool stop = false;
+
+        while (true)
+        {
+            // keep the queue full while there are requests
+            while (!stop && !freeSlots.empty())
+            {
+                Request request;
+
+                if (!nextRequest(request, freeSlots.size() == slots.size(), stop))
+                {
+                    break;
+                }
+
+                int fd = open(request.path.c_str(), O_RDONLY | O_CLOEXEC);
+
+                if (fd < 0)
+                {
+                    readFailed(request, std::strerror(errno));
+                    continue;
+                }
+
+                struct stat info;
+
+                if (fstat(fd, &info) != 0)
+                {
+                    readFailed(request, std::strerror(errno));
+                    close(fd);
+                    continue;
+                }
+
+                std::vector<uint8_t> bytes(size_t(info.st_size));
+
+                if (!useRing || bytes.empty())
+                {
+                    if (preadAll(fd, bytes.data(), bytes.size()))
+                    {
+                        readComplete(request, std::move(bytes));
+                    }
+                    else
+                    {
+                        readFailed(request, std::strerror(errno));
+                    }
+
+                    close(fd);
+                    continue;
+                }
+
+#ifdef ASSET_IO_URING
+                size_t slot = freeSlots.back();
+                freeSlots.pop_back();
+
+                slots[slot] = {std::move(request), fd, std::move(bytes), 0};
+
+                InFlight & read = slots[slot];
+                ring.read(fd, read.bytes.data(), unsigned(std::min(read.bytes.size(), READ_CHUNK)), 0, slot);
+#endif
+            }
+
+            if (freeSlots.size() == slots.size())
+            {
+                if (stop)
+                {
+                    return;
+                }
+
+                continue;
+            }
+
+#ifdef ASSET_IO_URING
+            auto finish = [&](size_t slot, bool ok, const std::string & error)
+            {
+                InFlight & read = slots[slot];
+
+                if (ok)
+                {
+                    readComplete(read.request, std::move(read.bytes));
+                }
+                else
+                {
+                    readFailed(read.request, error);
+                }
+
+                close(read.fd);
+                read = InFlight();
+                freeSlots.push_back(slot);
+            };
+
+            // the rest of a read synchronously, from wherever the ring got to
+            auto finishWithPread = [&](size_t slot)
+            {
+                InFlight & read = slots[slot];
+                bool ok = preadAll(read.fd, read.bytes.data(), read.bytes.size(), read.done);
+                finish(slot, ok, ok ? "" : std::strerror(errno));
+            };
+
+            if (!ring.wait())
+            {
+                // pread from here on, starting with what the kernel never saw
+                useRing = false;
+                ring.cancelQueued(finishWithPread);
+            }
+
+            ring.reap([&](uint64_t slot, int32_t result)
+            {
+                InFlight & read = slots[slot];
+
+                if (result == -EINVAL || result == -EOPNOTSUPP)
+                {
+                    // a kernel without IORING_OP_READ
+                    useRing = false;
+                }
+                else if (result <= 0)
+                {
+                    finish(slot, false, result == 0 ? "unexpected end of file" : std::strerror(-result));
+                    return;
+                }
+                else
+                {
+                    read.done += size_t(result);
+                }
+
+                if (read.done < read.bytes.size() && useRing)
+                {
+                    size_t remaining = std::min(read.bytes.size() - read.done, READ_CHUNK);
+                    ring.read(read.fd, read.bytes.data() + read.done, unsigned(remaining), read.done, slot);
+                    return;
+                }
+
+                finishWithPread(slot);
+            });
+
+            if (!useRing)
+            {
+                // anything queued since is never submitted, then wait out the
+                //  submitted reads, the kernel still owns their buffers
+                ring.cancelQueued(finishWithPread);
+
+                ring.drain([&](uint64_t slot, int32_t result)
+                {
+                    slots[slot].done += result > 0 ? size_t(result) : 0;
+                    finishWithPread(slot);
+                });
+            }
+#endif
+        }
+#endif
+    }
+
+    void AssetStreamer::readComplete(const Request & request, std::vector<uint8_t> && bytes)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.bytesRead += bytes.size();
+            reads.push({request.priority, request.sequence, request.id, request.path, std::move(bytes)});
+        }
+
+        decodeWork.notify_one();
+    }
+
+    void AssetStreamer::readFailed(const Request & request, const std::string & error)
+    {
+        Decoded failed;
+        failed.priority = request.priority;
+        failed.id = request.id;
+        failed.error = error;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        decoded.push_back(std::move(failed));
+    }
+
+    void AssetStreamer::decoder()
+    {
+        while (true)
+        {
+            Read read;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                decodeWork.wait(lock, [&]() { return stopping || !reads.empty(); });
+
+                if (stopping)
+                {
+                    return;
+                }
+
+                // top is const, it is popped straight after
+                read = std::move(const_cast<Read &>(reads.top()));
+                reads.pop();
+            }
+
+            Decoded result = decode(read);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(std::move(result));
+        }
+    }
+
+    AssetStreamer::Decoded AssetStreamer::decode(Read & read)
+    {
+        Decoded result;
+        result.priority = read.priority;
+        result.id = read.id;
+
+        try
+        {
+            if (endsWith(read.path, ".ktx2"))
+            {
+                auto ktx = std::make_unique<Ktx2File>(std::move(read.bytes), read.path);
+
+                result.width = ktx->getWidth();
+                result.height = ktx->getHeight();
+                result.prebuiltLevels = true;
+
+                if (textures.formatSupported(ktx->getFormat()))
+                {
+                    result.format = ktx->getFormat();
+                    result.levels = ktx->getLevels();
+                    result.ktx = std::move(ktx);
+                }
+                else if (canDecode(ktx->getFormat()))
+                {
+                    result.format = decodedFormat(ktx->getFormat());
+                    result.pixels.reserve(ktx->getLevels().size());
+
+                    for (const TextureLevel & level : ktx->getLevels())
+                    {
+                        result.pixels.push_back(decodeBlocks(ktx->getFormat(), level.data, level.bytes, level.width, level.height));
+                        result.levels.push_back({result.pixels.back().pixels.data(), result.pixels.back().pixels.size(), level.width, level.height});
+                    }
+                }
+                else
+                {
+                    throw std::runtime_error("the device cannot sample "+formatName(ktx->getFormat())+" and there is no CPU decoder");
+                }
+            }
+            else
+            {
+                result.pixels.push_back(decodeImage(read.bytes.data(), read.bytes.size(), read.path));
+
+                const TextureData & image = result.pixels.back();
+                result.width = image.width;
+                result.height = image.height;
+                result.levels.push_back({image.pixels.data(), image.pixels.size(), image.width, image.height});
+            }
+        }
+        catch (const std::exception & e)
+        {
+            result.error = e.what();
+        }
+
+        for (const TextureLevel & level : result.levels)
+        {
+            result.bytes += level.bytes;
+        }
+
+        return result;
+    }
+
+    void AssetStreamer::update(uint64_t frame)
+    {
+        std::vector<Decoded> batch;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (decoded.empty())
+            {
+                return;
+            }
+
+            std::stable_sort
+            (
+                decoded.begin(),
+                decoded.end(),
+                [](const Decoded & a, const Decoded & b) { return a.priority > b.priority; }
+            );
+
+            // at least one, however large, so nothing is starved
+            VkDeviceSize bytes = 0;
+            size_t take = 0;
+
+            while (take < decoded.size() && (take == 0 || bytes + decoded[take].bytes <= uploadBytes))
+            {
+                bytes += decoded[take].bytes;
+                take++;
+            }
+
+            std::move(decoded.begin(), decoded.begin() + take, std::back_inserter(batch));
+            decoded.erase(decoded.begin(), decoded.begin() + take);
+        }
+
+        uint32_t created = 0, failed = 0;
+
+        for (Decoded & d : batch)
+        {
+            Asset & asset = assets[d.id];
+
+            if (d.error.empty())
+            {
+                try
+                {
+                    asset.texture = d.prebuiltLevels
+                                  ? textures.create(d.format, d.width, d.height, d.levels, asset.sampler)
+                                  : textures.create(d.pixels[0], asset.sampler, asset.mipmaps);
+
+                    AssetId id = d.id;
+                    asset.evictable = budget.addEvictable
+                    (
+                        textures.get(asset.texture).memory,
+                        [this, id](uint64_t lastUsed) { evict(id, lastUsed); }
+                    );
+                    // uploaded with this frame, so not evicted before it completes
+                    budget.touch(asset.evictable, frame);
+
+                    created++;
+                    continue;
+                }
+                catch (const std::runtime_error & e)
+                {
+                    d.error = e.what();
+                }
+            }
+
+            asset.failed = true;
+            failed++;
+            std::cerr << "Could not load " << asset.path << ": " << d.error << "\n";
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.resident += created;
+        stats.failed += failed;
+        stats.uploadBatches += created > 0 ? 1 : 0;
+    }
+
+    TextureId AssetStreamer::getTexture(AssetId id) const
+    {
+        const Asset & asset = assets.at(id);
+        return asset.texture != INVALID_TEXTURE ? asset.texture : placeholder;
+    }
+
+    bool AssetStreamer::isResident(AssetId id) const
+    {
+        return assets.at(id).texture != INVALID_TEXTURE;
+    }
+
+    TextureId AssetStreamer::use(AssetId id, uint64_t frame)
+    {
+        Asset & asset = assets.at(id);
+
+        if (asset.texture != INVALID_TEXTURE)
+        {
+            budget.touch(asset.evictable, frame);
+            return asset.texture;
+        }
+
+        if (asset.evicted)
+        {
+            asset.evicted = false;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                started[id] = false;
+                priorities[id] = asset.priority;
+                requests.push({asset.priority, sequence++, id, asset.path});
+                unloaded--;
+            }
+
+            readWork.notify_one();
+        }
+
+        return placeholder;
+    }
+
+    void AssetStreamer::evict(AssetId id, uint64_t lastUsed)
+    {
+        Asset & asset = assets[id];
+
+        // its memory is freed once lastUsed completes
+        textures.destroy(asset.texture, lastUsed);
+        asset.texture = INVALID_TEXTURE;
+        asset.evictable = INVALID_EVICTABLE;
+        asset.evicted = true;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.resident--;
+        stats.evictions++;
+        unloaded++;
+    }
+
+    AssetStats AssetStreamer::getStats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        AssetStats current = stats;
+        current.inFlight = current.requested - current.resident - current.failed - unloaded;
+        return current;
+    }
+}
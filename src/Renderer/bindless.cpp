@@ -0,0 +1,291 @@
+#include <Renderer/bindless.h>
+
+namespace Renderer
+{
+
+    BindlessTable::BindlessTable
+    (
+        VkPhysicalDevice physicalDevice,
+        VkDevice d,
+        DescriptorLayoutCache & layoutCache,
+        uint32_t framesInFlight,
+        uint32_t requestedTextures,
+        uint32_t requestedBuffers
+    )
+    : device(d), currentFrame(0)
+    {
+        VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties{};
+        indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &indexingProperties;
+
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+        maxTextures = std::min
+        (
+            {
+                requestedTextures,
+                indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+                indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+                indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers
+            }
+        );
+
+        maxBuffers = std::min
+        (
+            {
+                requestedBuffers,
+                indexingProperties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+                indexingProperties.maxPerStageDescriptorUpdateAfterBindStorageBuffers
+            }
+        );
+
+        // both bindings are visible to every stage, so count against one stage's total
+        uint32_t perStage = indexingProperties.maxPerStageUpdateAfterBindResources;
+        uint32_t resources = perStage > RESERVED_RESOURCES ? perStage - RESERVED_RESOURCES : 0;
+
+        if (uint64_t(maxTextures) + maxBuffers > resources)
+        {
+            // shared in proportion to what was asked for
+            uint64_t total = uint64_t(maxTextures) + maxBuffers;
+            maxTextures = static_cast<uint32_t>(uint64_t(maxTextures) * resources / total);
+            maxBuffers = std::min(maxBuffers, resources - maxTextures);
+        }
+
+        textures.retired.resize(framesInFlight);
+        buffers.retired.resize(framesInFlight);
+
+        VkDescriptorSetLayoutBinding textureBinding{};
+        textureBinding.binding = TEXTURE_BINDING;
+        textureBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        textureBinding.descriptorCount = maxTextures;
+        textureBinding.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS;
+        textureBinding.pImmutableSamplers = nullptr;
+
+        VkDescriptorSetLayoutBinding bufferBinding{};
+        bufferBinding.binding = BUFFER_BINDING;
+        bufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bufferBinding.descriptorCount = maxBuffers;
+        bufferBinding.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS;
+        bufferBinding.pImmutableSamplers = nullptr;
+
+        // entries may be written whilst bound, and those the shaders
+        //  never touch need not be valid
+        VkDescriptorBindingFlagsEXT flags =
+            VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+            VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+            VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+
+        layout = layoutCache.get
+        (
+            {textureBinding, bufferBinding},
+            VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT,
+            {flags, flags}
+        );
+
+        std::array<VkDescriptorPoolSize, 2> poolSizes =
+        {
+            VkDescriptorPoolSize {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxTextures},
+            VkDescriptorPoolSize {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, maxBuffers}
+        };
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+        poolInfo.maxSets = 1;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create bindless descriptor pool");
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = pool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &layout;
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, &set) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate bindless descriptor set");
+        }
+    }
+
+    BindlessTable::~BindlessTable()
+    {
+        // layout is owned by the cache
+        vkDestroyDescriptorPool(device, pool, nullptr);
+    }
+
+    bool BindlessTable::supported(VkPhysicalDevice physicalDevice)
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        // vkGetPhysicalDeviceFeatures2 is core from 1.1
+        if (properties.apiVersion < VK_API_VERSION_1_1)
+        {
+            return false;
+        }
+
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> extensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+
+        bool hasExtension = false;
+        for (const auto & extension : extensions)
+        {
+            if (std::string(extension.extensionName) == VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)
+            {
+                hasExtension = true;
+                break;
+            }
+        }
+
+        if (!hasExtension)
+        {
+            return false;
+        }
+
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
+        indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &indexingFeatures;
+
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+        return indexingFeatures.shaderSampledImageArrayNonUniformIndexing &&
+               indexingFeatures.shaderStorageBufferArrayNonUniformIndexing &&
+               indexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+               indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind &&
+               indexingFeatures.descriptorBindingUpdateUnusedWhilePending &&
+               indexingFeatures.descriptorBindingPartiallyBound &&
+               indexingFeatures.runtimeDescriptorArray;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT BindlessTable::requiredFeatures()
+    {
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
+        indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        indexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        indexingFeatures.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+        indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        indexingFeatures.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        indexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+        indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+        return indexingFeatures;
+    }
+
+    BindlessHandle BindlessTable::HandlePool::take(uint32_t capacity)
+    {
+        if (!free.empty())
+        {
+            BindlessHandle handle = free.back();
+            free.pop_back();
+            return handle;
+        }
+
+        if (next >= capacity)
+        {
+            throw std::runtime_error("Bindless table is full");
+        }
+
+        return next++;
+    }
+
+    BindlessHandle BindlessTable::addTexture(VkImageView view, VkSampler sampler, VkImageLayout imageLayout)
+    {
+        BindlessHandle handle = textures.take(maxTextures);
+
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageView = view;
+        imageInfo.sampler = sampler;
+        imageInfo.imageLayout = imageLayout;
+
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = set;
+        write.dstBinding = TEXTURE_BINDING;
+        write.dstArrayElement = handle;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.descriptorCount = 1;
+        write.pImageInfo = &imageInfo;
+
+        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+        return handle;
+    }
+
+    BindlessHandle BindlessTable::addBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range)
+    {
+        BindlessHandle handle = buffers.take(maxBuffers);
+
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = buffer;
+        bufferInfo.offset = offset;
+        bufferInfo.range = range;
+
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = set;
+        write.dstBinding = BUFFER_BINDING;
+        write.dstArrayElement = handle;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.descriptorCount = 1;
+        write.pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+        return handle;
+    }
+
+    void BindlessTable::removeTexture(BindlessHandle handle)
+    {
+        if (handle == INVALID_BINDLESS_HANDLE) { return; }
+        textures.retired[currentFrame].push_back(handle);
+    }
+
+    void BindlessTable::removeBuffer(BindlessHandle handle)
+    {
+        if (handle == INVALID_BINDLESS_HANDLE) { return; }
+        buffers.retired[currentFrame].push_back(handle);
+    }
+
+    void BindlessTable::beginFrame(uint32_t frame)
+    {
+        currentFrame = frame;
+
+        // anything released last time this frame slot was recorded
+        //  can no longer be referenced by the gpu
+        for (HandlePool * handles : {&textures, &buffers})
+        {
+            auto & retired = handles->retired[frame];
+            handles->free.insert(handles->free.end(), retired.begin(), retired.end());
+            retired.clear();
+        }
+    }
+
+    void BindlessTable::bind(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t setIndex) const
+    {
+        vkCmdBindDescriptorSets
+        (
+            commandBuffer,
+            VK_PIPELINE_BIND_POINT_GRAPHICS,
+            pipelineLayout,
+            setIndex,
+            1,
+            &set,
+            0,
+            nullptr
+        );
+    }
+}
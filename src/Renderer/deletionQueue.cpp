@@ -0,0 +1,72 @@
+#include <Renderer/deletionQueue.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace Renderer
+{
+
+    void DeletionQueue::push(uint64_t lastUsed, std::function<void()> destroy)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // keeping the queue ordered only ever delays a destroy, never hastens it
+        if (!entries.empty())
+        {
+            lastUsed = std::max(lastUsed, entries.back().lastUsed);
+        }
+
+        entries.push_back({lastUsed, std::move(destroy)});
+    }
+
+    void DeletionQueue::flush(uint64_t framesCompleted)
+    {
+        std::vector<std::function<void()>> ready;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            while (!entries.empty() && entries.front().lastUsed < framesCompleted)
+            {
+                ready.push_back(std::move(entries.front().destroy));
+                entries.pop_front();
+            }
+        }
+
+        // outside the lock, a callback may push more work
+        for (auto & destroy : ready)
+        {
+            destroy();
+        }
+    }
+
+    void DeletionQueue::flushAll()
+    {
+        // callbacks may push more, keep going until nothing is left
+        while (true)
+        {
+            std::deque<Entry> all;
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                all.swap(entries);
+            }
+
+            if (all.empty())
+            {
+                return;
+            }
+
+            for (auto & entry : all)
+            {
+                entry.destroy();
+            }
+        }
+    }
+
+    size_t DeletionQueue::size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+}
@@ -0,0 +1,310 @@
+#include <Renderer/descriptors.h>
+
+namespace Renderer
+{
+
+    DescriptorAllocator::~DescriptorAllocator()
+    {
+        for (auto pool : usedPools)
+        {
+            vkDestroyDescriptorPool(device, pool, nullptr);
+        }
+
+        for (auto pool : freePools)
+        {
+            vkDestroyDescriptorPool(device, pool, nullptr);
+        }
+    }
+
+    VkDescriptorPool DescriptorAllocator::createPool(uint32_t sets)
+    {
+        std::vector<VkDescriptorPoolSize> sizes;
+        sizes.reserve(poolSizes.sizes.size());
+
+        for (auto & size : poolSizes.sizes)
+        {
+            uint32_t count = std::max(1u, static_cast<uint32_t>(size.second * sets));
+            sizes.push_back({size.first, count});
+        }
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        // no VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT, sets
+        //  are only ever released by resetting the whole pool
+        poolInfo.flags = 0;
+        poolInfo.maxSets = sets;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(sizes.size());
+        poolInfo.pPoolSizes = sizes.data();
+
+        VkDescriptorPool pool;
+        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create descriptor pool");
+        }
+
+        return pool;
+    }
+
+    VkDescriptorPool DescriptorAllocator::grabPool()
+    {
+        if (!freePools.empty())
+        {
+            VkDescriptorPool pool = freePools.back();
+            freePools.pop_back();
+            return pool;
+        }
+
+        VkDescriptorPool pool = createPool(setsPerPool);
+        setsPerPool = std::min(setsPerPool*2, MAX_SETS_PER_POOL);
+        return pool;
+    }
+
+    VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout)
+    {
+        if (currentPool == VK_NULL_HANDLE)
+        {
+            currentPool = grabPool();
+            usedPools.push_back(currentPool);
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = currentPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &layout;
+
+        VkDescriptorSet set;
+        VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+
+        if (result == VK_SUCCESS)
+        {
+            return set;
+        }
+
+        if (result != VK_ERROR_FRAGMENTED_POOL && result != VK_ERROR_OUT_OF_POOL_MEMORY)
+        {
+            throw std::runtime_error("Failed to allocate descriptor set");
+        }
+
+        // current pool is full, move to a fresh one and try once more
+        currentPool = grabPool();
+        usedPools.push_back(currentPool);
+        allocInfo.descriptorPool = currentPool;
+
+        if (vkAllocateDescriptorSets(device, &allocInfo, &set) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate descriptor set from a new pool");
+        }
+
+        return set;
+    }
+
+    void DescriptorAllocator::reset()
+    {
+        for (auto pool : usedPools)
+        {
+            vkResetDescriptorPool(device, pool, 0);
+            freePools.push_back(pool);
+        }
+
+        usedPools.clear();
+        currentPool = VK_NULL_HANDLE;
+    }
+
+    DescriptorLayoutCache::~DescriptorLayoutCache()
+    {
+        for (auto & layout : layouts)
+        {
+            vkDestroyDescriptorSetLayout(device, layout.second, nullptr);
+        }
+    }
+
+    VkDescriptorSetLayout DescriptorLayoutCache::get
+    (
+        std::vector<VkDescriptorSetLayoutBinding> bindings,
+        VkDescriptorSetLayoutCreateFlags flags,
+        std::vector<VkDescriptorBindingFlagsEXT> bindingFlags
+    )
+    {
+        if (!bindingFlags.empty() && bindingFlags.size() != bindings.size())
+        {
+            throw std::runtime_error("Descriptor binding flags do not match binding count");
+        }
+
+        // binding order should not matter for equality, keep flags paired
+        std::vector<size_t> order(bindings.size());
+        for (size_t i = 0; i < order.size(); i++) { order[i] = i; }
+
+        std::sort
+        (
+            order.begin(),
+            order.end(),
+            [&bindings](size_t a, size_t b)
+            {
+                return bindings[a].binding < bindings[b].binding;
+            }
+        );
+
+        LayoutDescription description {{}, flags, {}};
+        for (size_t i : order)
+        {
+            description.bindings.push_back(bindings[i]);
+            if (!bindingFlags.empty()) { description.bindingFlags.push_back(bindingFlags[i]); }
+        }
+
+        auto cached = layouts.find(description);
+        if (cached != layouts.end())
+        {
+            return cached->second;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.flags = flags;
+        layoutInfo.bindingCount = static_cast<uint32_t>(description.bindings.size());
+        layoutInfo.pBindings = description.bindings.data();
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo{};
+        if (!description.bindingFlags.empty())
+        {
+            bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+            bindingFlagsInfo.bindingCount = static_cast<uint32_t>(description.bindingFlags.size());
+            bindingFlagsInfo.pBindingFlags = description.bindingFlags.data();
+            layoutInfo.pNext = &bindingFlagsInfo;
+        }
+
+        VkDescriptorSetLayout layout;
+        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create descriptor set layout");
+        }
+
+        layouts[description] = layout;
+        return layout;
+    }
+
+    bool DescriptorLayoutCache::LayoutDescription::operator==(const LayoutDescription & other) const
+    {
+        if (flags != other.flags || bindings.size() != other.bindings.size() || bindingFlags != other.bindingFlags)
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < bindings.size(); i++)
+        {
+            const VkDescriptorSetLayoutBinding & a = bindings[i];
+            const VkDescriptorSetLayoutBinding & b = other.bindings[i];
+
+            if
+            (
+                a.binding != b.binding ||
+                a.descriptorType != b.descriptorType ||
+                a.descriptorCount != b.descriptorCount ||
+                a.stageFlags != b.stageFlags ||
+                a.pImmutableSamplers != b.pImmutableSamplers
+            )
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    size_t DescriptorLayoutCache::LayoutDescription::hash() const
+    {
+        size_t seed = std::hash<size_t>()(bindings.size());
+        hashCombine(seed, flags);
+
+        for (auto & b : bindings)
+        {
+            // pack the small fields into one word
+            size_t packed = b.binding | (b.descriptorType << 8) | (size_t(b.stageFlags) << 16) | (size_t(b.descriptorCount) << 32);
+            hashCombine(seed, std::hash<size_t>()(packed));
+        }
+
+        for (auto f : bindingFlags)
+        {
+            hashCombine(seed, f);
+        }
+
+        return seed;
+    }
+
+    PipelineLayoutCache::~PipelineLayoutCache()
+    {
+        for (auto & layout : layouts)
+        {
+            vkDestroyPipelineLayout(device, layout.second, nullptr);
+        }
+    }
+
+    VkPipelineLayout PipelineLayoutCache::get
+    (
+        const std::vector<VkDescriptorSetLayout> & setLayouts,
+        const std::vector<VkPushConstantRange> & pushConstantRanges
+    )
+    {
+        LayoutDescription description {setLayouts, pushConstantRanges};
+
+        auto cached = layouts.find(description);
+        if (cached != layouts.end())
+        {
+            return cached->second;
+        }
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+        pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+        pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+        pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
+
+        VkPipelineLayout layout;
+        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed ot create pipeline layout");
+        }
+
+        layouts[description] = layout;
+        return layout;
+    }
+
+    bool PipelineLayoutCache::LayoutDescription::operator==(const LayoutDescription & other) const
+    {
+        if (setLayouts != other.setLayouts || pushConstantRanges.size() != other.pushConstantRanges.size())
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < pushConstantRanges.size(); i++)
+        {
+            const VkPushConstantRange & a = pushConstantRanges[i];
+            const VkPushConstantRange & b = other.pushConstantRanges[i];
+
+            if (a.stageFlags != b.stageFlags || a.offset != b.offset || a.size != b.size)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    size_t PipelineLayoutCache::LayoutDescription::hash() const
+    {
+        size_t seed = std::hash<size_t>()(setLayouts.size());
+
+        for (auto layout : setLayouts)
+        {
+            hashCombine(seed, std::hash<VkDescriptorSetLayout>()(layout));
+        }
+
+        for (auto & range : pushConstantRanges)
+        {
+            hashCombine(seed, range.stageFlags | (size_t(range.offset) << 16) | (size_t(range.size) << 40));
+        }
+
+        return seed;
+    }
+}
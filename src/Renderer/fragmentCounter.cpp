@@ -0,0 +1,96 @@
+#include <Renderer/fragmentCounter.h>
+
+#include <stdexcept>
+
+namespace Renderer
+{
+
+    FragmentCounter::FragmentCounter(VkDevice d, bool supported, unsigned framesInFlight)
+    : device(d), written(framesInFlight, false)
+    {
+        if (!supported)
+        {
+            return;
+        }
+
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        poolInfo.queryCount = framesInFlight;
+        poolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+        if (vkCreateQueryPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create pipeline statistics query pool");
+        }
+    }
+
+    FragmentCounter::~FragmentCounter()
+    {
+        if (pool != VK_NULL_HANDLE)
+        {
+            vkDestroyQueryPool(device, pool, nullptr);
+        }
+    }
+
+    void FragmentCounter::reset(VkCommandBuffer commandBuffer, unsigned frame)
+    {
+        if (!supported())
+        {
+            return;
+        }
+
+        vkCmdResetQueryPool(commandBuffer, pool, frame, 1);
+    }
+
+    void FragmentCounter::begin(VkCommandBuffer commandBuffer, unsigned frame)
+    {
+        if (!supported())
+        {
+            return;
+        }
+
+        vkCmdBeginQuery(commandBuffer, pool, frame, 0);
+    }
+
+    void FragmentCounter::end(VkCommandBuffer commandBuffer, unsigned frame)
+    {
+        if (!supported())
+        {
+            return;
+        }
+
+        vkCmdEndQuery(commandBuffer, pool, frame);
+        written[frame] = true;
+    }
+
+    std::optional<uint64_t> FragmentCounter::read(unsigned frame)
+    {
+        if (!supported() || !written[frame])
+        {
+            return std::nullopt;
+        }
+
+        // value, availability
+        uint64_t results[2];
+
+        VkResult result = vkGetQueryPoolResults
+        (
+            device,
+            pool,
+            frame,
+            1,
+            sizeof(results),
+            results,
+            sizeof(results),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+        );
+
+        if ((result != VK_SUCCESS && result != VK_NOT_READY) || results[1] == 0)
+        {
+            return std::nullopt;
+        }
+
+        return results[0];
+    }
+}
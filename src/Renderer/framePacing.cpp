@@ -0,0 +1,161 @@
+#include <Renderer/framePacing.h>
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+
+namespace Renderer
+{
+
+    void FrameTimes::record(double milliseconds)
+    {
+        times[next] = milliseconds;
+        next = (next+1)%WINDOW;
+        samples = std::min(samples+1, WINDOW);
+    }
+
+    double FrameTimes::mean() const
+    {
+        if (samples == 0)
+        {
+            return 0.0;
+        }
+
+        double sum = 0.0;
+        for (size_t i = 0; i < samples; i++)
+        {
+            sum += times[i];
+        }
+        return sum / samples;
+    }
+
+    double FrameTimes::variance() const
+    {
+        if (samples < 2)
+        {
+            return 0.0;
+        }
+
+        double m = mean();
+        double sum = 0.0;
+        for (size_t i = 0; i < samples; i++)
+        {
+            double d = times[i]-m;
+            sum += d*d;
+        }
+        return sum / (samples-1);
+    }
+
+    double FrameTimes::standardDeviation() const
+    {
+        return std::sqrt(variance());
+    }
+
+    double FrameTimes::min() const
+    {
+        if (samples == 0)
+        {
+            return 0.0;
+        }
+        return *std::min_element(times.begin(), times.begin()+samples);
+    }
+
+    double FrameTimes::max() const
+    {
+        if (samples == 0)
+        {
+            return 0.0;
+        }
+        return *std::max_element(times.begin(), times.begin()+samples);
+    }
+
+    double FrameTimes::percentile(double p) const
+    {
+        if (samples == 0)
+        {
+            return 0.0;
+        }
+
+        std::vector<double> sorted(times.begin(), times.begin()+samples);
+        size_t k = std::min(samples-1, static_cast<size_t>(p*(samples-1)+0.5));
+        std::nth_element(sorted.begin(), sorted.begin()+k, sorted.end());
+        return sorted[k];
+    }
+
+    std::string FrameTimes::report() const
+    {
+        double m = mean();
+
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(2)
+           << "frame " << m << " ms (" << std::setprecision(1) << (m > 0.0 ? 1000.0/m : 0.0) << " fps)"
+           << std::setprecision(2)
+           << " sd " << standardDeviation() << " ms"
+           << " min " << min()
+           << " max " << max()
+           << " p99 " << percentile(0.99);
+        return ss.str();
+    }
+
+    void FrameLimiter::setTarget(double targetFps)
+    {
+        fps = std::max(targetFps, 0.0);
+
+        if (enabled())
+        {
+            period = std::chrono::duration_cast<PacingClock::duration>(std::chrono::duration<double>(1.0/fps));
+        }
+        else
+        {
+            period = PacingClock::duration::zero();
+        }
+
+        // start the new cadence from the next frame
+        deadline = PacingClock::now()+period;
+    }
+
+    double FrameLimiter::wait()
+    {
+        if (enabled())
+        {
+            auto wake = deadline-std::chrono::duration_cast<PacingClock::duration>
+            (
+                std::chrono::duration<double, std::milli>(spinMargin)
+            );
+
+            if (PacingClock::now() < wake)
+            {
+                std::this_thread::sleep_until(wake);
+
+                // how late the sleep was, the margin decays slowly so one good sleep does not undo it
+                double late = std::chrono::duration<double, std::milli>(PacingClock::now()-wake).count();
+                spinMargin = std::clamp(std::max(late*1.5, spinMargin*0.99), MIN_SPIN_MS, MAX_SPIN_MS);
+            }
+
+            while (PacingClock::now() < deadline)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        auto now = PacingClock::now();
+
+        if (enabled())
+        {
+            deadline += period;
+            // too far behind, do not burst to catch up
+            if (deadline < now)
+            {
+                deadline = now+period;
+            }
+        }
+
+        double elapsed = started ? std::chrono::duration<double, std::milli>(now-last).count() : 0.0;
+        last = now;
+        started = true;
+
+        return elapsed;
+    }
+}
@@ -0,0 +1,84 @@
+#include <Renderer/frameScratch.h>
+
+#include <sstream>
+#include <algorithm>
+
+namespace Renderer
+{
+
+    namespace
+    {
+        // alignment is a power of two
+        size_t alignUp(size_t value, size_t alignment)
+        {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+    }
+
+    std::string FrameScratchStats::report() const
+    {
+        std::stringstream ss;
+        ss << "scratch " << used / 1024 << "/" << capacity / 1024 << " KiB"
+           << ", peak " << peak / 1024 << " KiB"
+           << ", " << overflows << " overflows";
+        return ss.str();
+    }
+
+    FrameScratch::FrameScratch(unsigned framesInFlight, size_t bytesPerFrame)
+    : regions(std::max(1u, framesInFlight))
+    {
+        for (Region & region : regions)
+        {
+            region.size = alignUp(std::max(bytesPerFrame, size_t(1)), alignof(std::max_align_t));
+            region.block = std::make_unique<uint8_t[]>(region.size);
+        }
+
+        stats.capacity = regions[0].size;
+    }
+
+    void FrameScratch::begin(unsigned frameIndex)
+    {
+        frame = frameIndex % regions.size();
+        Region & region = regions[frame];
+
+        if (!region.overflow.empty())
+        {
+            // one block large enough for everything the frame needed last time
+            region.size = alignUp(region.size + region.overflowBytes, alignof(std::max_align_t));
+            region.block = std::make_unique<uint8_t[]>(region.size);
+            region.overflow.clear();
+            region.overflowBytes = 0;
+
+            stats.capacity = std::max(stats.capacity, region.size);
+        }
+
+        region.used = 0;
+        stats.used = 0;
+    }
+
+    void * FrameScratch::allocate(size_t bytes, size_t alignment)
+    {
+        Region & region = regions[frame];
+
+        uintptr_t base = reinterpret_cast<uintptr_t>(region.block.get());
+        size_t offset = alignUp(base + region.used, alignment) - base;
+
+        stats.used += bytes;
+        stats.peak = std::max(stats.peak, stats.used);
+
+        if (offset + bytes <= region.size)
+        {
+            region.used = offset + bytes;
+            return region.block.get() + offset;
+        }
+
+        // room for the padding, the region grows by it on the next begin
+        size_t size = bytes + alignment;
+        region.overflow.push_back(std::make_unique<uint8_t[]>(size));
+        region.overflowBytes += size;
+        stats.overflows++;
+
+        uintptr_t overflow = reinterpret_cast<uintptr_t>(region.overflow.back().get());
+        return reinterpret_cast<void *>(alignUp(overflow, alignment));
+    }
+}
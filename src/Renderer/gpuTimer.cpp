@@ -0,0 +1,107 @@
+#include <Renderer/gpuTimer.h>
+
+#include <stdexcept>
+
+namespace Renderer
+{
+
+    GpuTimer::GpuTimer
+    (
+        VkPhysicalDevice physicalDevice,
+        VkDevice d,
+        uint32_t queueFamily,
+        unsigned framesInFlight
+    )
+    : device(d), written(framesInFlight, false)
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        uint32_t count;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &count, nullptr);
+        std::vector<VkQueueFamilyProperties> families(count);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &count, families.data());
+
+        uint32_t validBits = queueFamily < count ? families[queueFamily].timestampValidBits : 0;
+
+        if (validBits == 0 || properties.limits.timestampPeriod == 0.0f)
+        {
+            return;
+        }
+
+        period = properties.limits.timestampPeriod;
+        mask = validBits >= 64 ? ~uint64_t(0) : (uint64_t(1) << validBits)-1;
+
+        VkQueryPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = 2*framesInFlight;
+
+        if (vkCreateQueryPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create timestamp query pool");
+        }
+    }
+
+    GpuTimer::~GpuTimer()
+    {
+        if (pool != VK_NULL_HANDLE)
+        {
+            vkDestroyQueryPool(device, pool, nullptr);
+        }
+    }
+
+    void GpuTimer::begin(VkCommandBuffer commandBuffer, unsigned frame)
+    {
+        if (!supported())
+        {
+            return;
+        }
+
+        vkCmdResetQueryPool(commandBuffer, pool, 2*frame, 2);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pool, 2*frame);
+    }
+
+    void GpuTimer::end(VkCommandBuffer commandBuffer, unsigned frame)
+    {
+        if (!supported())
+        {
+            return;
+        }
+
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pool, 2*frame+1);
+        written[frame] = true;
+    }
+
+    std::optional<double> GpuTimer::read(unsigned frame)
+    {
+        if (!supported() || !written[frame])
+        {
+            return std::nullopt;
+        }
+
+        // value, availability pairs
+        uint64_t results[4];
+
+        VkResult result = vkGetQueryPoolResults
+        (
+            device,
+            pool,
+            2*frame,
+            2,
+            sizeof(results),
+            results,
+            2*sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+        );
+
+        if ((result != VK_SUCCESS && result != VK_NOT_READY) || results[1] == 0 || results[3] == 0)
+        {
+            return std::nullopt;
+        }
+
+        uint64_t ticks = ((results[2] & mask)-(results[0] & mask)) & mask;
+
+        return double(ticks)*period*1e-6;
+    }
+}
@@ -0,0 +1,198 @@
+#include <Renderer/initGraph.h>
+
+#include <stdexcept>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+
+namespace Renderer
+{
+
+    std::string InitTimeline::report() const
+    {
+        std::vector<InitTiming> ordered = steps;
+        std::sort
+        (
+            ordered.begin(),
+            ordered.end(),
+            [](const InitTiming & a, const InitTiming & b) { return a.start < b.start; }
+        );
+
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(1)
+           << "startup " << total << " ms, " << work << " ms of steps on " << threads << " threads\n";
+
+        for (const InitTiming & step : ordered)
+        {
+            ss << std::setw(8) << step.start << " +" << std::setw(7) << step.end - step.start << " ms"
+               << "  [" << step.thread << "] " << step.name << "\n";
+        }
+
+        return ss.str();
+    }
+
+    void InitGraph::add(const std::string & name, std::function<void()> step, const std::vector<std::string> & after)
+    {
+        size_t index = steps.size();
+
+        Step added;
+        added.name = name;
+        added.run = std::move(step);
+
+        for (const std::string & dependency : after)
+        {
+            auto found = std::find_if(steps.begin(), steps.end(), [&](const Step & s) { return s.name == dependency; });
+
+            // only earlier steps, so the graph cannot have cycles
+            if (found == steps.end())
+            {
+                throw std::runtime_error("Init step "+name+" is after unknown step "+dependency);
+            }
+
+            found->dependents.push_back(index);
+            added.waitingOn++;
+        }
+
+        steps.push_back(std::move(added));
+    }
+
+    void InitGraph::run(unsigned threads)
+    {
+        if (threads == 0)
+        {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        threads = std::max(1u, std::min(threads, static_cast<unsigned>(steps.size())));
+
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<size_t> ready;
+        size_t remaining = steps.size();
+        size_t running = 0;
+        std::exception_ptr failure;
+
+        timeline = InitTimeline();
+        timeline.threads = threads;
+        timeline.steps.resize(steps.size());
+
+        for (size_t i = 0; i < steps.size(); i++)
+        {
+            if (steps[i].waitingOn == 0)
+            {
+                ready.push_back(i);
+            }
+        }
+
+        auto began = std::chrono::steady_clock::now();
+
+        auto since = [&]()
+        {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - began).count();
+        };
+
+        auto worker = [&](unsigned thread)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            while (true)
+            {
+                // after a failure only the running steps are waited for
+                changed.wait(lock, [&]() { return !ready.empty() || remaining == 0 || (failure && running == 0); });
+
+                if (remaining == 0 || failure)
+                {
+                    return;
+                }
+
+                size_t index = ready.front();
+                ready.pop_front();
+                running++;
+
+                lock.unlock();
+
+                InitTiming & timing = timeline.steps[index];
+                timing.name = steps[index].name;
+                timing.thread = thread;
+                timing.start = since();
+
+                std::exception_ptr error;
+
+                try
+                {
+                    steps[index].run();
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                }
+
+                timing.end = since();
+
+                lock.lock();
+                running--;
+
+                if (error)
+                {
+                    if (!failure)
+                    {
+                        failure = error;
+                    }
+
+                    changed.notify_all();
+                    continue;
+                }
+
+                remaining--;
+
+                for (size_t dependent : steps[index].dependents)
+                {
+                    if (--steps[dependent].waitingOn == 0)
+                    {
+                        ready.push_back(dependent);
+                    }
+                }
+
+                changed.notify_all();
+            }
+        };
+
+        std::vector<std::thread> helpers;
+
+        for (unsigned i = 1; i < threads; i++)
+        {
+            helpers.emplace_back(worker, i);
+        }
+
+        worker(0);
+
+        for (std::thread & helper : helpers)
+        {
+            helper.join();
+        }
+
+        timeline.total = since();
+
+        // those never started after a failure
+        timeline.steps.erase
+        (
+            std::remove_if(timeline.steps.begin(), timeline.steps.end(), [](const InitTiming & t) { return t.name.empty(); }),
+            timeline.steps.end()
+        );
+
+        for (const InitTiming & timing : timeline.steps)
+        {
+            timeline.work += timing.end - timing.start;
+        }
+
+        if (failure)
+        {
+            std::rethrow_exception(failure);
+        }
+    }
+}
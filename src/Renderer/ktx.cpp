@@ -0,0 +1,535 @@
+#include <Renderer/ktx.h>
+
+#include <vulkan/vk_enum_string_helper.h>
+
+#include <stdexcept>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+#ifndef WINDOWS
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Renderer
+{
+
+    MappedFile::MappedFile(const std::string & path)
+    {
+#ifndef WINDOWS
+        int fd = open(path.c_str(), O_RDONLY);
+
+        if (fd < 0)
+        {
+            throw std::runtime_error("Could not open "+path);
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Could not stat "+path);
+        }
+
+        length = static_cast<size_t>(info.st_size);
+
+        if (length > 0)
+        {
+            void * mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (mapped == MAP_FAILED)
+            {
+                close(fd);
+                throw std::runtime_error("Could not map "+path);
+            }
+
+            // read front to back into staging
+            madvise(mapped, length, MADV_SEQUENTIAL);
+            bytes = static_cast<const uint8_t *>(mapped);
+        }
+
+        // the mapping outlives the descriptor
+        close(fd);
+#else
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Could not open "+path);
+        }
+
+        contents.resize(size_t(file.tellg()));
+        file.seekg(0);
+        file.read(reinterpret_cast<char *>(contents.data()), contents.size());
+
+        bytes = contents.data();
+        length = contents.size();
+#endif
+    }
+
+    MappedFile::~MappedFile()
+    {
+#ifndef WINDOWS
+        if (bytes != nullptr && contents.empty())
+        {
+            munmap(const_cast<uint8_t *>(bytes), length);
+        }
+#endif
+    }
+
+    size_t BlockFormat::size(uint32_t w, uint32_t h) const
+    {
+        size_t blocksX = (w + width - 1) / width;
+        size_t blocksY = (h + height - 1) / height;
+        return blocksX * blocksY * bytes;
+    }
+
+    BlockFormat blockFormat(VkFormat format)
+    {
+        switch (format)
+        {
+            case VK_FORMAT_R8G8B8A8_UNORM:
+            case VK_FORMAT_R8G8B8A8_SRGB:
+                return {1, 1, 4};
+
+            case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+            case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+            case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            case VK_FORMAT_BC4_UNORM_BLOCK:
+            case VK_FORMAT_BC4_SNORM_BLOCK:
+            case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+            case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+            case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+            case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+            case VK_FORMAT_EAC_R11_UNORM_BLOCK:
+            case VK_FORMAT_EAC_R11_SNORM_BLOCK:
+                return {4, 4, 8};
+
+            case VK_FORMAT_BC2_UNORM_BLOCK:
+            case VK_FORMAT_BC2_SRGB_BLOCK:
+            case VK_FORMAT_BC3_UNORM_BLOCK:
+            case VK_FORMAT_BC3_SRGB_BLOCK:
+            case VK_FORMAT_BC5_UNORM_BLOCK:
+            case VK_FORMAT_BC5_SNORM_BLOCK:
+            case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+            case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+            case VK_FORMAT_BC7_UNORM_BLOCK:
+            case VK_FORMAT_BC7_SRGB_BLOCK:
+            case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+            case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+            case VK_FORMAT_EAC_R11G11_UNORM_BLOCK:
+            case VK_FORMAT_EAC_R11G11_SNORM_BLOCK:
+                return {4, 4, 16};
+
+            default:
+                break;
+        }
+
+        // unorm and srgb pairs of each footprint, in enum order
+        if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK)
+        {
+            static const uint32_t footprints[][2] =
+            {
+                {4, 4}, {5, 4}, {5, 5}, {6, 5}, {6, 6}, {8, 5}, {8, 6},
+                {8, 8}, {10, 5}, {10, 6}, {10, 8}, {10, 10}, {12, 10}, {12, 12}
+            };
+
+            const uint32_t * footprint = footprints[(format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2];
+            return {footprint[0], footprint[1], 16};
+        }
+
+        return {1, 1, 0};
+    }
+
+    namespace
+    {
+        const uint8_t KTX2_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+        // identifier, then the fixed header and index
+        const size_t KTX2_HEADER_BYTES = 80;
+        const size_t KTX2_LEVEL_BYTES = 24;
+
+        // the format is little endian, as is everything this runs on
+        template <class T>
+        T read(const uint8_t * at)
+        {
+            T value;
+            std::memcpy(&value, at, sizeof(T));
+            return value;
+        }
+    }
+
+    MappedFile::MappedFile(std::vector<uint8_t> && contents)
+    : contents(std::move(contents))
+    {
+        bytes = this->contents.data();
+        length = this->contents.size();
+    }
+
+    Ktx2File::Ktx2File(const std::string & path)
+    : file(path)
+    {
+        parse(path);
+    }
+
+    Ktx2File::Ktx2File(std::vector<uint8_t> && contents, const std::string & name)
+    : file(std::move(contents))
+    {
+        parse(name);
+    }
+
+    void Ktx2File::parse(const std::string & path)
+    {
+        const uint8_t * data = file.data();
+        size_t size = file.size();
+
+        if (size < KTX2_HEADER_BYTES || std::memcmp(data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0)
+        {
+            throw std::runtime_error(path+" is not a KTX2 file");
+        }
+
+        format = VkFormat(read<uint32_t>(data + 12));
+        width = read<uint32_t>(data + 20);
+        height = read<uint32_t>(data + 24);
+        uint32_t depth = read<uint32_t>(data + 28);
+        uint32_t layers = read<uint32_t>(data + 32);
+        uint32_t faces = read<uint32_t>(data + 36);
+        // 0 asks the loader to generate levels
+        uint32_t levelCount = std::max(1u, read<uint32_t>(data + 40));
+        uint32_t supercompression = read<uint32_t>(data + 44);
+
+        BlockFormat block = blockFormat(format);
+
+        if (block.bytes == 0)
+        {
+            throw std::runtime_error(path+" has unsupported format "+formatName(format));
+        }
+
+        if (supercompression != 0)
+        {
+            throw std::runtime_error(path+" is supercompressed, only raw block data is supported");
+        }
+
+        if (width == 0 || height == 0 || depth > 1 || layers > 1 || faces != 1)
+        {
+            throw std::runtime_error(path+" is not a single 2D image");
+        }
+
+        if (levelCount > 32 || size < KTX2_HEADER_BYTES + levelCount * KTX2_LEVEL_BYTES)
+        {
+            throw std::runtime_error(path+" has a truncated level index");
+        }
+
+        for (uint32_t i = 0; i < levelCount; i++)
+        {
+            const uint8_t * entry = data + KTX2_HEADER_BYTES + i * KTX2_LEVEL_BYTES;
+            uint64_t offset = read<uint64_t>(entry);
+            uint64_t bytes = read<uint64_t>(entry + 8);
+
+            uint32_t levelWidth = std::max(1u, width >> i);
+            uint32_t levelHeight = std::max(1u, height >> i);
+
+            if (offset > size || bytes > size - offset || bytes != block.size(levelWidth, levelHeight))
+            {
+                throw std::runtime_error(path+" level "+std::to_string(i)+" is out of bounds or the wrong size");
+            }
+
+            levels.push_back({data + offset, static_cast<size_t>(bytes), levelWidth, levelHeight});
+        }
+    }
+
+    bool canDecode(VkFormat format)
+    {
+        switch (format)
+        {
+            case VK_FORMAT_R8G8B8A8_UNORM:
+            case VK_FORMAT_R8G8B8A8_SRGB:
+            case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+            case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+            case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            case VK_FORMAT_BC2_UNORM_BLOCK:
+            case VK_FORMAT_BC2_SRGB_BLOCK:
+            case VK_FORMAT_BC3_UNORM_BLOCK:
+            case VK_FORMAT_BC3_SRGB_BLOCK:
+            case VK_FORMAT_BC4_UNORM_BLOCK:
+            case VK_FORMAT_BC4_SNORM_BLOCK:
+            case VK_FORMAT_BC5_UNORM_BLOCK:
+            case VK_FORMAT_BC5_SNORM_BLOCK:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    VkFormat decodedFormat(VkFormat format)
+    {
+        switch (format)
+        {
+            case VK_FORMAT_R8G8B8A8_SRGB:
+            case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            case VK_FORMAT_BC2_SRGB_BLOCK:
+            case VK_FORMAT_BC3_SRGB_BLOCK:
+                return VK_FORMAT_R8G8B8A8_SRGB;
+            case VK_FORMAT_BC4_SNORM_BLOCK:
+            case VK_FORMAT_BC5_SNORM_BLOCK:
+                return VK_FORMAT_R8G8B8A8_SNORM;
+            default:
+                return VK_FORMAT_R8G8B8A8_UNORM;
+        }
+    }
+
+    std::string formatName(VkFormat format)
+    {
+        return string_VkFormat(format);
+    }
+
+    namespace
+    {
+        // 16 RGBA texels, row major
+        typedef uint8_t Block[16][4];
+
+        void unpack565(uint16_t colour, uint8_t * rgb)
+        {
+            uint32_t r = (colour >> 11) & 31;
+            uint32_t g = (colour >> 5) & 63;
+            uint32_t b = colour & 31;
+            rgb[0] = static_cast<uint8_t>((r << 3) | (r >> 2));
+            rgb[1] = static_cast<uint8_t>((g << 2) | (g >> 4));
+            rgb[2] = static_cast<uint8_t>((b << 3) | (b >> 2));
+        }
+
+        // BC2 and BC3 colour always interpolates four colours
+        void decodeColour(const uint8_t * src, Block & out, bool punchThrough)
+        {
+            uint16_t c0 = read<uint16_t>(src);
+            uint16_t c1 = read<uint16_t>(src + 2);
+            uint32_t indices = read<uint32_t>(src + 4);
+
+            uint8_t palette[4][4];
+            unpack565(c0, palette[0]);
+            unpack565(c1, palette[1]);
+            palette[0][3] = palette[1][3] = 255;
+
+            bool fourColour = !punchThrough || c0 > c1;
+
+            for (int c = 0; c < 3; c++)
+            {
+                if (fourColour)
+                {
+                    palette[2][c] = static_cast<uint8_t>((2 * palette[0][c] + palette[1][c]) / 3);
+                    palette[3][c] = static_cast<uint8_t>((palette[0][c] + 2 * palette[1][c]) / 3);
+                }
+                else
+                {
+                    palette[2][c] = static_cast<uint8_t>((palette[0][c] + palette[1][c]) / 2);
+                    palette[3][c] = 0;
+                }
+            }
+
+            palette[2][3] = 255;
+            // transparent black in three colour mode
+            palette[3][3] = fourColour ? 255 : 0;
+
+            for (int i = 0; i < 16; i++)
+            {
+                std::memcpy(out[i], palette[(indices >> (2 * i)) & 3], 4);
+            }
+        }
+
+        // a BC4 block, also BC3 alpha and each BC5 channel
+        void decodeChannel(const uint8_t * src, Block & out, int channel)
+        {
+            uint8_t r0 = src[0];
+            uint8_t r1 = src[1];
+
+            uint8_t values[8] = {r0, r1};
+
+            if (r0 > r1)
+            {
+                for (int i = 1; i < 7; i++)
+                {
+                    values[i+1] = static_cast<uint8_t>(((7 - i) * r0 + i * r1) / 7);
+                }
+            }
+            else
+            {
+                for (int i = 1; i < 5; i++)
+                {
+                    values[i+1] = static_cast<uint8_t>(((5 - i) * r0 + i * r1) / 5);
+                }
+
+                values[6] = 0;
+                values[7] = 255;
+            }
+
+            // 48 bits of 3 bit indices
+            uint64_t indices = 0;
+            for (int i = 0; i < 6; i++)
+            {
+                indices |= uint64_t(src[2 + i]) << (8 * i);
+            }
+
+            for (int i = 0; i < 16; i++)
+            {
+                out[i][channel] = values[(indices >> (3 * i)) & 7];
+            }
+        }
+
+        // a signed BC4 block or BC5 channel, as two's complement bytes
+        void decodeSignedChannel(const uint8_t * src, Block & out, int channel)
+        {
+            // -128 is also -1
+            int r0 = std::max(int(int8_t(src[0])), -127);
+            int r1 = std::max(int(int8_t(src[1])), -127);
+
+            int values[8] = {r0, r1};
+
+            if (r0 > r1)
+            {
+                for (int i = 1; i < 7; i++)
+                {
+                    values[i+1] = ((7 - i) * r0 + i * r1) / 7;
+                }
+            }
+            else
+            {
+                for (int i = 1; i < 5; i++)
+                {
+                    values[i+1] = ((5 - i) * r0 + i * r1) / 5;
+                }
+
+                values[6] = -127;
+                values[7] = 127;
+            }
+
+            uint64_t indices = 0;
+            for (int i = 0; i < 6; i++)
+            {
+                indices |= uint64_t(src[2 + i]) << (8 * i);
+            }
+
+            for (int i = 0; i < 16; i++)
+            {
+                out[i][channel] = static_cast<uint8_t>(int8_t(values[(indices >> (3 * i)) & 7]));
+            }
+        }
+
+        void decodeBlock(VkFormat format, const uint8_t * src, Block & out)
+        {
+            switch (format)
+            {
+                case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+                case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+                    decodeColour(src, out, true);
+                    // no alpha, the punch through texel is black
+                    for (int i = 0; i < 16; i++) { out[i][3] = 255; }
+                    break;
+
+                case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+                case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+                    decodeColour(src, out, true);
+                    break;
+
+                case VK_FORMAT_BC2_UNORM_BLOCK:
+                case VK_FORMAT_BC2_SRGB_BLOCK:
+                    decodeColour(src + 8, out, false);
+                    for (int i = 0; i < 16; i++)
+                    {
+                        uint8_t a = (src[i / 2] >> (4 * (i % 2))) & 15;
+                        out[i][3] = static_cast<uint8_t>(a * 17);
+                    }
+                    break;
+
+                case VK_FORMAT_BC3_UNORM_BLOCK:
+                case VK_FORMAT_BC3_SRGB_BLOCK:
+                    decodeColour(src + 8, out, false);
+                    decodeChannel(src, out, 3);
+                    break;
+
+                case VK_FORMAT_BC4_UNORM_BLOCK:
+                    std::memset(out, 0, sizeof(Block));
+                    decodeChannel(src, out, 0);
+                    for (int i = 0; i < 16; i++) { out[i][3] = 255; }
+                    break;
+
+                case VK_FORMAT_BC5_UNORM_BLOCK:
+                    std::memset(out, 0, sizeof(Block));
+                    decodeChannel(src, out, 0);
+                    decodeChannel(src + 8, out, 1);
+                    for (int i = 0; i < 16; i++) { out[i][3] = 255; }
+                    break;
+
+                // snorm 1.0 alpha
+                case VK_FORMAT_BC4_SNORM_BLOCK:
+                    std::memset(out, 0, sizeof(Block));
+                    decodeSignedChannel(src, out, 0);
+                    for (int i = 0; i < 16; i++) { out[i][3] = 127; }
+                    break;
+
+                case VK_FORMAT_BC5_SNORM_BLOCK:
+                    std::memset(out, 0, sizeof(Block));
+                    decodeSignedChannel(src, out, 0);
+                    decodeSignedChannel(src + 8, out, 1);
+                    for (int i = 0; i < 16; i++) { out[i][3] = 127; }
+                    break;
+
+                default:
+                    throw std::runtime_error("No CPU decoder for "+formatName(format));
+            }
+        }
+    }
+
+    TextureData decodeBlocks(VkFormat format, const uint8_t * data, size_t bytes, uint32_t width, uint32_t height)
+    {
+        BlockFormat block = blockFormat(format);
+
+        if (!canDecode(format) || bytes != block.size(width, height))
+        {
+            throw std::runtime_error("Cannot decode "+formatName(format));
+        }
+
+        TextureData decoded;
+        decoded.width = width;
+        decoded.height = height;
+
+        if (block.width == 1)
+        {
+            // already RGBA
+            decoded.pixels.assign(data, data + bytes);
+            return decoded;
+        }
+
+        decoded.pixels.resize(size_t(width) * height * 4);
+
+        uint32_t blocksX = (width + 3) / 4;
+        uint32_t blocksY = (height + 3) / 4;
+
+        Block texels;
+
+        for (uint32_t by = 0; by < blocksY; by++)
+        {
+            for (uint32_t bx = 0; bx < blocksX; bx++)
+            {
+                decodeBlock(format, data + (size_t(by) * blocksX + bx) * block.bytes, texels);
+
+                // edge blocks are partly outside the image
+                uint32_t rows = std::min(4u, height - by * 4);
+                uint32_t columns = std::min(4u, width - bx * 4);
+
+                for (uint32_t y = 0; y < rows; y++)
+                {
+                    uint8_t * row = decoded.pixels.data() + ((size_t(by) * 4 + y) * width + bx * 4) * 4;
+                    std::memcpy(row, texels[y * 4], columns * 4);
+                }
+            }
+        }
+
+        return decoded;
+    }
+}
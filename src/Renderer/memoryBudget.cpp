@@ -0,0 +1,483 @@
+#include <Renderer/memoryBudget.h>
+
+#include <stdexcept>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+namespace Renderer
+{
+
+    namespace
+    {
+        // of a heap's size usable without the extension, as drivers leave room for others
+        const float DEFAULT_BUDGET = 0.8f;
+
+        // the device local memory the CPU can map without a resizable BAR
+        const VkDeviceSize BAR_WINDOW = VkDeviceSize(256) * 1024 * 1024;
+
+        uint32_t bitCount(uint32_t bits)
+        {
+            uint32_t count = 0;
+
+            for (; bits != 0; bits &= bits - 1)
+            {
+                count++;
+            }
+
+            return count;
+        }
+
+        std::string mib(VkDeviceSize bytes)
+        {
+            std::stringstream ss;
+            ss << bytes / (1024 * 1024) << " MiB";
+            return ss.str();
+        }
+    }
+
+    std::string MemoryBudgetStats::report() const
+    {
+        std::stringstream ss;
+        ss << "memory" << (extension ? " (VK_EXT_memory_budget)" : "")
+           << (unified ? ", unified" : resizableBar ? ", resizable BAR" : "");
+
+        for (size_t i = 0; i < heaps.size(); i++)
+        {
+            const HeapBudget & heap = heaps[i];
+
+            if (heap.allocations == 0 && !heap.deviceLocal)
+            {
+                continue;
+            }
+
+            ss << ", heap " << i << (heap.deviceLocal ? " device " : " host ")
+               << mib(heap.usage) << "/" << mib(heap.budget)
+               << " (" << heap.allocations << " allocations, " << mib(heap.allocated) << ")";
+        }
+
+        ss << ", " << evictions << " evicted (" << mib(evictedBytes) << ")"
+           << ", " << fallbacks << " fallbacks"
+           << ", " << failures << " failures";
+
+        return ss.str();
+    }
+
+    bool MemoryBudget::extensionSupported(VkPhysicalDevice physicalDevice)
+    {
+        uint32_t count;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &count, nullptr);
+
+        std::vector<VkExtensionProperties> extensions(count);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &count, extensions.data());
+
+        for (const VkExtensionProperties & e : extensions)
+        {
+            if (std::strcmp(e.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    MemoryBudget::MemoryBudget
+    (
+        VkPhysicalDevice physicalDevice,
+        VkDevice device,
+        bool extension,
+        float highWater,
+        float lowWater
+    )
+    : physicalDevice(physicalDevice),
+      device(device),
+      extension(extension),
+      highWater(highWater),
+      lowWater(std::min(lowWater, highWater))
+    {
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+        heaps.resize(memoryProperties.memoryHeapCount);
+        allocatedAtRefresh.assign(heaps.size(), 0);
+        evicting.assign(heaps.size(), 0);
+
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+        {
+            heaps[i].size = memoryProperties.memoryHeaps[i].size;
+            heaps[i].deviceLocal = memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+        }
+
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+        stats.extension = extension;
+        stats.unified = deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU
+                     || deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU;
+
+        const VkMemoryPropertyFlags mappableDeviceMemory = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount && !stats.unified; i++)
+        {
+            const VkMemoryType & type = memoryProperties.memoryTypes[i];
+
+            if ((type.propertyFlags & mappableDeviceMemory) == mappableDeviceMemory && heaps[type.heapIndex].size > BAR_WINDOW)
+            {
+                stats.resizableBar = true;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        refresh();
+    }
+
+    void MemoryBudget::refresh()
+    {
+        if (!extension)
+        {
+            for (HeapBudget & heap : heaps)
+            {
+                heap.budget = VkDeviceSize(heap.size * DEFAULT_BUDGET);
+                heap.usage = heap.allocated;
+            }
+
+            return;
+        }
+
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+        budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+        VkPhysicalDeviceMemoryProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        properties.pNext = &budgetProperties;
+
+        vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
+
+        for (uint32_t i = 0; i < heaps.size(); i++)
+        {
+            heaps[i].budget = std::min(budgetProperties.heapBudget[i], heaps[i].size);
+            heaps[i].usage = budgetProperties.heapUsage[i];
+            allocatedAtRefresh[i] = heaps[i].allocated;
+        }
+    }
+
+    VkDeviceSize MemoryBudget::usage(uint32_t heap) const
+    {
+        // the driver's figure is as of the last refresh, allocations since are added on
+        int64_t current = extension
+                        ? int64_t(heaps[heap].usage) + int64_t(heaps[heap].allocated) - int64_t(allocatedAtRefresh[heap])
+                        : int64_t(heaps[heap].allocated);
+
+        return VkDeviceSize(std::max<int64_t>(0, current - int64_t(evicting[heap])));
+    }
+
+    VkDeviceSize MemoryBudget::limit(uint32_t heap, float water) const
+    {
+        return VkDeviceSize(heaps[heap].budget * water);
+    }
+
+    uint32_t MemoryBudget::findMemoryType
+    (
+        uint32_t typeFilter,
+        VkMemoryPropertyFlags required,
+        VkMemoryPropertyFlags preferred,
+        VkMemoryPropertyFlags avoided,
+        VkDeviceSize size
+    )
+    {
+        bool fellBack;
+        return choose(typeFilter, required, preferred, avoided, size, fellBack);
+    }
+
+    uint32_t MemoryBudget::choose
+    (
+        uint32_t typeFilter,
+        VkMemoryPropertyFlags required,
+        VkMemoryPropertyFlags preferred,
+        VkMemoryPropertyFlags avoided,
+        VkDeviceSize size,
+        bool & fellBack
+    )
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // best of: room in the heap, then fewest preferred flags missing and avoided flags present,
+        //  then the driver's order
+        uint32_t best = UINT32_MAX;
+        uint32_t bestCost = UINT32_MAX;
+        bool bestFits = false;
+        // regardless of room
+        uint32_t cheapest = UINT32_MAX;
+        uint32_t cheapestCost = UINT32_MAX;
+
+        for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+        {
+            VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[i].propertyFlags;
+
+            if (!(typeFilter & (1u << i)) || (flags & required) != required)
+            {
+                continue;
+            }
+
+            uint32_t heap = memoryProperties.memoryTypes[i].heapIndex;
+            bool fits = usage(heap) + size <= limit(heap, highWater);
+            uint32_t cost = bitCount(preferred & ~flags) + bitCount(avoided & flags);
+
+            if (cost < cheapestCost)
+            {
+                cheapest = i;
+                cheapestCost = cost;
+            }
+
+            if ((fits && !bestFits) || (fits == bestFits && cost < bestCost))
+            {
+                best = i;
+                bestCost = cost;
+                bestFits = fits;
+            }
+        }
+
+        if (best == UINT32_MAX)
+        {
+            throw std::runtime_error("Failed to find suitable memory type");
+        }
+
+        // the best match's heap was over budget
+        fellBack = memoryProperties.memoryTypes[cheapest].heapIndex != memoryProperties.memoryTypes[best].heapIndex;
+
+        if (fellBack)
+        {
+            stats.fallbacks++;
+        }
+
+        return best;
+    }
+
+    VkDeviceMemory MemoryBudget::allocate
+    (
+        const VkMemoryRequirements & requirements,
+        VkMemoryPropertyFlags required,
+        VkMemoryPropertyFlags preferred,
+        VkMemoryPropertyFlags avoided,
+        const std::string & what
+    )
+    {
+        bool fellBack = false;
+        uint32_t typeIndex = choose(requirements.memoryTypeBits, required, preferred, avoided, requirements.size, fellBack);
+
+        if (fellBack)
+        {
+            std::cerr << what << " (" << mib(requirements.size) << ") placed on heap "
+                      << memoryProperties.memoryTypes[typeIndex].heapIndex << ", the preferred heap is over budget\n";
+        }
+
+        return allocate(requirements.size, typeIndex, what);
+    }
+
+    VkDeviceMemory MemoryBudget::allocate(VkDeviceSize size, uint32_t typeIndex, const std::string & what)
+    {
+        uint32_t heap = memoryProperties.memoryTypes[typeIndex].heapIndex;
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = size;
+        allocInfo.memoryTypeIndex = typeIndex;
+
+        VkDeviceMemory memory;
+        VkResult result = vkAllocateMemory(device, &allocInfo, nullptr, &memory);
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (result != VK_SUCCESS)
+        {
+            stats.failures++;
+
+            std::stringstream ss;
+            ss << "Failed to allocate " << mib(size) << " for " << what
+               << " in memory type " << typeIndex << " on heap " << heap
+               << " (" << mib(usage(heap)) << " of a " << mib(heaps[heap].budget) << " budget used)"
+               << (result == VK_ERROR_OUT_OF_DEVICE_MEMORY ? ": out of device memory" :
+                   result == VK_ERROR_OUT_OF_HOST_MEMORY ? ": out of host memory" : "");
+
+            throw std::runtime_error(ss.str());
+        }
+
+        if (usage(heap) + size > heaps[heap].budget)
+        {
+            std::cerr << what << " (" << mib(size) << ") puts heap " << heap << " over its budget\n";
+        }
+
+        heaps[heap].allocated += size;
+        heaps[heap].allocations++;
+        allocations[memory] = {typeIndex, heap, size, INVALID_EVICTABLE, false};
+
+        return memory;
+    }
+
+    void MemoryBudget::free(VkDeviceMemory memory)
+    {
+        if (memory == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        {
+            // the record goes first, once freed the driver may hand the same
+            //  handle to an allocate on another thread
+            std::lock_guard<std::mutex> lock(mutex);
+
+            auto found = allocations.find(memory);
+
+            if (found != allocations.end())
+            {
+                Allocation & allocation = found->second;
+                heaps[allocation.heap].allocated -= allocation.size;
+                heaps[allocation.heap].allocations--;
+
+                if (allocation.evicted)
+                {
+                    evicting[allocation.heap] -= std::min(evicting[allocation.heap], allocation.size);
+                }
+
+                if (allocation.evictable != INVALID_EVICTABLE)
+                {
+                    // freed by its owner without being evicted
+                    auto evictable = evictables.find(allocation.evictable);
+                    if (evictable != evictables.end())
+                    {
+                        lru.erase(evictable->second.lru);
+                        evictables.erase(evictable);
+                    }
+                }
+
+                allocations.erase(found);
+            }
+        }
+
+        vkFreeMemory(device, memory, nullptr);
+    }
+
+    VkMemoryPropertyFlags MemoryBudget::properties(VkDeviceMemory memory) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return memoryProperties.memoryTypes[allocations.at(memory).type].propertyFlags;
+    }
+
+    EvictableId MemoryBudget::addEvictable(VkDeviceMemory memory, std::function<void(uint64_t lastUsed)> evict)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        Allocation & allocation = allocations.at(memory);
+
+        EvictableId id = nextEvictable++;
+        lru.push_front(id);
+        evictables[id] = {memory, allocation.heap, allocation.size, 0, std::move(evict), lru.begin()};
+        allocation.evictable = id;
+
+        return id;
+    }
+
+    void MemoryBudget::touch(EvictableId id, uint64_t frame)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto found = evictables.find(id);
+
+        if (found == evictables.end())
+        {
+            return;
+        }
+
+        found->second.lastUsed = std::max(found->second.lastUsed, frame);
+        lru.splice(lru.begin(), lru, found->second.lru);
+    }
+
+    void MemoryBudget::removeEvictable(EvictableId id)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto found = evictables.find(id);
+
+        if (found == evictables.end())
+        {
+            return;
+        }
+
+        allocations.at(found->second.memory).evictable = INVALID_EVICTABLE;
+        lru.erase(found->second.lru);
+        evictables.erase(found);
+    }
+
+    void MemoryBudget::update(uint64_t framesCompleted)
+    {
+        std::vector<std::pair<std::function<void(uint64_t)>, uint64_t>> victims;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            refresh();
+
+            for (uint32_t heap = 0; heap < heaps.size(); heap++)
+            {
+                if (usage(heap) <= limit(heap, highWater))
+                {
+                    continue;
+                }
+
+                // oldest first, stopping at anything a frame in flight may use
+                for (auto it = lru.rbegin(); it != lru.rend() && usage(heap) > limit(heap, lowWater);)
+                {
+                    Evictable & e = evictables.at(*it);
+
+                    if (e.lastUsed >= framesCompleted)
+                    {
+                        break;
+                    }
+
+                    if (e.heap != heap)
+                    {
+                        ++it;
+                        continue;
+                    }
+
+                    Allocation & allocation = allocations.at(e.memory);
+                    allocation.evictable = INVALID_EVICTABLE;
+                    allocation.evicted = true;
+                    evicting[heap] += e.size;
+
+                    stats.evictions++;
+                    stats.evictedBytes += e.size;
+
+                    victims.push_back({std::move(e.evict), e.lastUsed});
+
+                    EvictableId id = *it;
+                    // erasing through a reverse iterator, it then points at the next older
+                    it = std::list<EvictableId>::reverse_iterator(lru.erase(std::next(it).base()));
+                    evictables.erase(id);
+                }
+            }
+        }
+
+        // the owners may free or allocate through the budget
+        for (auto & victim : victims)
+        {
+            victim.first(victim.second);
+        }
+    }
+
+    MemoryBudgetStats MemoryBudget::getStats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        MemoryBudgetStats current = stats;
+        current.heaps = heaps;
+
+        for (uint32_t i = 0; i < heaps.size(); i++)
+        {
+            current.heaps[i].usage = usage(i);
+        }
+
+        return current;
+    }
+}
@@ -0,0 +1,758 @@
+#include <Renderer/pipelineCache.h>
+#include <Renderer/descriptors.h>
+
+#include <stdexcept>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+namespace Renderer
+{
+
+    size_t PipelineDescription::hash() const
+    {
+        size_t h = std::hash<std::string>()(shader);
+
+        hashCombine(h, vertexStride);
+        for (const VkVertexInputAttributeDescription & a : vertexAttributes)
+        {
+            hashCombine(h, a.location);
+            hashCombine(h, a.format);
+            hashCombine(h, a.offset);
+        }
+
+        hashCombine(h, topology);
+        hashCombine(h, polygonMode);
+        hashCombine(h, cullMode);
+        hashCombine(h, frontFace);
+        hashCombine(h, depthTest);
+        hashCombine(h, depthWrite);
+        hashCombine(h, depthCompare);
+        hashCombine(h, alphaBlend);
+        hashCombine(h, samples);
+        hashCombine(h, std::hash<float>()(minSampleShading));
+        hashCombine(h, colourFormat);
+        hashCombine(h, depthFormat);
+
+        return h;
+    }
+
+    size_t PipelineDescription::compatibilityHash(VkPipelineLayout layout) const
+    {
+        size_t h = std::hash<VkPipelineLayout>()(layout);
+
+        hashCombine(h, vertexStride);
+        for (const VkVertexInputAttributeDescription & a : vertexAttributes)
+        {
+            hashCombine(h, a.location);
+            hashCombine(h, a.format);
+            hashCombine(h, a.offset);
+        }
+
+        hashCombine(h, samples);
+        hashCombine(h, colourFormat);
+        hashCombine(h, depthFormat);
+
+        return h;
+    }
+
+    bool PipelineDescription::operator==(const PipelineDescription & other) const
+    {
+        if (vertexAttributes.size() != other.vertexAttributes.size())
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < vertexAttributes.size(); i++)
+        {
+            const VkVertexInputAttributeDescription & a = vertexAttributes[i];
+            const VkVertexInputAttributeDescription & b = other.vertexAttributes[i];
+
+            if (a.location != b.location || a.format != b.format || a.offset != b.offset)
+            {
+                return false;
+            }
+        }
+
+        return shader == other.shader
+            && vertexStride == other.vertexStride
+            && topology == other.topology
+            && polygonMode == other.polygonMode
+            && cullMode == other.cullMode
+            && frontFace == other.frontFace
+            && depthTest == other.depthTest
+            && depthWrite == other.depthWrite
+            && depthCompare == other.depthCompare
+            && alphaBlend == other.alphaBlend
+            && samples == other.samples
+            && minSampleShading == other.minSampleShading
+            && colourFormat == other.colourFormat
+            && depthFormat == other.depthFormat;
+    }
+
+    std::string PipelineDescription::serialise() const
+    {
+        std::stringstream ss;
+        ss << shader << " "
+           << vertexStride << " "
+           << topology << " "
+           << polygonMode << " "
+           << cullMode << " "
+           << frontFace << " "
+           << depthTest << " "
+           << depthWrite << " "
+           << depthCompare << " "
+           << alphaBlend << " "
+           << samples << " "
+           << minSampleShading << " "
+           << colourFormat << " "
+           << depthFormat << " "
+           << vertexAttributes.size();
+
+        for (const VkVertexInputAttributeDescription & a : vertexAttributes)
+        {
+            ss << " " << a.location << " " << a.format << " " << a.offset;
+        }
+
+        return ss.str();
+    }
+
+    PipelineDescription PipelineDescription::parse(const std::string & line)
+    {
+        std::stringstream ss(line);
+        PipelineDescription d;
+
+        // enums are read through their integer values
+        int topology, polygonMode, frontFace, depthCompare, samples, colourFormat, depthFormat;
+        size_t attributeCount;
+
+        ss >> d.shader
+           >> d.vertexStride
+           >> topology
+           >> polygonMode
+           >> d.cullMode
+           >> frontFace
+           >> d.depthTest
+           >> d.depthWrite
+           >> depthCompare
+           >> d.alphaBlend
+           >> samples
+           >> d.minSampleShading
+           >> colourFormat
+           >> depthFormat
+           >> attributeCount;
+
+        d.topology = VkPrimitiveTopology(topology);
+        d.polygonMode = VkPolygonMode(polygonMode);
+        d.frontFace = VkFrontFace(frontFace);
+        d.depthCompare = VkCompareOp(depthCompare);
+        d.samples = VkSampleCountFlagBits(samples);
+        d.colourFormat = VkFormat(colourFormat);
+        d.depthFormat = VkFormat(depthFormat);
+
+        for (size_t i = 0; ss && i < attributeCount; i++)
+        {
+            int format;
+            VkVertexInputAttributeDescription a{};
+            ss >> a.location >> format >> a.offset;
+            a.binding = 0;
+            a.format = VkFormat(format);
+            d.vertexAttributes.push_back(a);
+        }
+
+        if (!ss)
+        {
+            throw std::runtime_error("Could not parse pipeline description: "+line);
+        }
+
+        return d;
+    }
+
+    std::string PipelineCacheStats::report() const
+    {
+        std::stringstream ss;
+        ss << "pipelines " << hits << " hits"
+           << ", " << fallbacks << " fallbacks"
+           << ", " << misses << " misses"
+           << ", " << compiled << " compiled (" << (compiled > 0 ? compileMs/compiled : 0.0) << " ms mean)"
+           << ", " << failed << " failed"
+           << ", " << pending << " pending";
+        return ss.str();
+    }
+
+    PipelineCache::PipelineCache(VkDevice device, DeletionQueue & deletionQueue, const std::string & cacheFile, unsigned threads)
+    : device(device), deletionQueue(deletionQueue)
+    {
+        std::vector<char> data;
+
+        if (!cacheFile.empty())
+        {
+            std::ifstream file(cacheFile, std::ios::binary | std::ios::ate);
+            if (file.is_open())
+            {
+                data.resize(size_t(file.tellg()));
+                file.seekg(0);
+                file.read(data.data(), data.size());
+            }
+        }
+
+        VkPipelineCacheCreateInfo cacheInfo{};
+        cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        cacheInfo.initialDataSize = data.size();
+        cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+        if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &vkCache) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create pipeline cache");
+        }
+
+        for (unsigned t = 0; t < std::max(threads, 1u); t++)
+        {
+            workers.emplace_back(&PipelineCache::worker, this);
+        }
+    }
+
+    PipelineCache::~PipelineCache()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            jobs.clear();
+        }
+
+        work.notify_all();
+
+        for (auto & thread : workers)
+        {
+            thread.join();
+        }
+
+        for (auto & e : entries)
+        {
+            vkDestroyPipeline(device, e.second.pipeline, nullptr);
+        }
+
+        for (VkPipeline pipeline : replaced)
+        {
+            vkDestroyPipeline(device, pipeline, nullptr);
+        }
+
+        vkDestroyPipelineCache(device, vkCache, nullptr);
+    }
+
+    void PipelineCache::setShader
+    (
+        const std::string & name,
+        const std::vector<VkPipelineShaderStageCreateInfo> & stages,
+        const Specialisation & specialisation,
+        VkPipelineLayout layout
+    )
+    {
+        auto shader = std::make_shared<ShaderEntry>();
+        shader->specialisation = specialisation;
+        shader->stages = stages;
+        shader->layout = layout;
+
+        // point at the copy, which lives as long as any compile using it
+        const VkSpecializationInfo * info = shader->specialisation.info();
+        for (VkPipelineShaderStageCreateInfo & stage : shader->stages)
+        {
+            stage.pSpecializationInfo = info;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+
+        auto found = shaders.find(name);
+        if (found != shaders.end())
+        {
+            std::shared_ptr<ShaderEntry> old = found->second;
+            shaderIdle.wait(lock, [&]() { return old->inFlight == 0; });
+        }
+
+        shader->generation = nextGeneration++;
+        shaders[name] = shader;
+    }
+
+    void PipelineCache::retireShader(const std::string & name)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        auto found = shaders.find(name);
+        if (found == shaders.end())
+        {
+            return;
+        }
+
+        // queued compiles find no shader and are dropped
+        std::shared_ptr<ShaderEntry> old = found->second;
+        shaders.erase(found);
+
+        shaderIdle.wait(lock, [&]() { return old->inFlight == 0; });
+    }
+
+    PipelineCache::Entry & PipelineCache::entry(const PipelineDescription & description)
+    {
+        auto found = entries.find(description);
+        if (found != entries.end())
+        {
+            // any render pass compatible with the description will do
+            found->second.description.renderPass = description.renderPass;
+            return found->second;
+        }
+
+        Entry & e = entries[description];
+        e.description = description;
+        return e;
+    }
+
+    bool PipelineCache::needsCompile(const Entry & e) const
+    {
+        auto shader = shaders.find(e.description.shader);
+
+        if (e.pending || shader == shaders.end())
+        {
+            return false;
+        }
+
+        uint64_t generation = shader->second->generation;
+
+        return e.generation != generation && e.failedGeneration != generation;
+    }
+
+    PipelineLookup PipelineCache::lookup(const PipelineDescription & description, const Entry & e)
+    {
+        auto shader = shaders.find(description.shader);
+
+        if (e.pipeline != VK_NULL_HANDLE)
+        {
+            // stale if the shader was set again since
+            bool exact = shader == shaders.end() || shader->second->generation == e.generation;
+            exact ? stats.hits++ : stats.fallbacks++;
+            return {e.pipeline, e.layout, exact};
+        }
+
+        if (shader != shaders.end())
+        {
+            VkPipelineLayout layout = shader->second->layout;
+            auto other = compatible.find(description.compatibilityHash(layout));
+
+            if (other != compatible.end())
+            {
+                const Entry & fallback = *other->second;
+
+                if (fallback.pipeline != VK_NULL_HANDLE && fallback.layout == layout)
+                {
+                    stats.fallbacks++;
+                    return {fallback.pipeline, fallback.layout, false};
+                }
+            }
+        }
+
+        stats.misses++;
+        return {};
+    }
+
+    PipelineLookup PipelineCache::get(const PipelineDescription & description)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        Entry & e = entry(description);
+
+        if (needsCompile(e))
+        {
+            e.pending = true;
+            jobs.push_back(&e);
+            work.notify_one();
+        }
+
+        return lookup(description, e);
+    }
+
+    PipelineLookup PipelineCache::compile(const PipelineDescription & description)
+    {
+        Entry * e;
+        std::shared_ptr<ShaderEntry> shader;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            e = &entry(description);
+            auto found = shaders.find(description.shader);
+
+            bool ready = found == shaders.end()
+                      || e->generation == found->second->generation
+                      || e->failedGeneration == found->second->generation;
+
+            if (ready)
+            {
+                return lookup(description, *e);
+            }
+
+            // a worker may be compiling it too, the later result is dropped
+            shader = found->second;
+            shader->inFlight++;
+        }
+
+        build(*e, description, shader);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        return lookup(description, *e);
+    }
+
+    void PipelineCache::prewarm(const std::vector<PipelineDescription> & descriptions)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (const PipelineDescription & description : descriptions)
+        {
+            Entry & e = entry(description);
+
+            if (needsCompile(e))
+            {
+                e.pending = true;
+                jobs.push_back(&e);
+            }
+        }
+
+        work.notify_all();
+    }
+
+    void PipelineCache::worker()
+    {
+        while (true)
+        {
+            Entry * e;
+            PipelineDescription description;
+            std::shared_ptr<ShaderEntry> shader;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                work.wait(lock, [&]() { return stopping || !jobs.empty(); });
+
+                if (stopping)
+                {
+                    return;
+                }
+
+                e = jobs.front();
+                jobs.pop_front();
+
+                auto found = shaders.find(e->description.shader);
+
+                // retired whilst queued, the next lookup queues it again
+                if (found == shaders.end())
+                {
+                    e->pending = false;
+                    continue;
+                }
+
+                shader = found->second;
+                shader->inFlight++;
+                description = e->description;
+            }
+
+            build(*e, description, shader);
+        }
+    }
+
+    void PipelineCache::build(Entry & e, const PipelineDescription & description, std::shared_ptr<ShaderEntry> shader)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        VkPipeline pipeline = VK_NULL_HANDLE;
+
+        try
+        {
+            pipeline = createPipeline(description, *shader);
+        }
+        catch (const std::exception & error)
+        {
+            std::cerr << error.what() << ": " << description.serialise() << "\n";
+        }
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count();
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        shader->inFlight--;
+        shaderIdle.notify_all();
+
+        e.pending = false;
+
+        if (pipeline == VK_NULL_HANDLE)
+        {
+            // not retried until the shader changes
+            e.failedGeneration = shader->generation;
+            stats.failed++;
+            return;
+        }
+
+        stats.compiled++;
+        stats.compileMs += ms;
+
+        if (e.pipeline != VK_NULL_HANDLE && e.generation >= shader->generation)
+        {
+            // compiled twice, never handed out
+            replaced.push_back(pipeline);
+            return;
+        }
+
+        if (e.pipeline != VK_NULL_HANDLE)
+        {
+            replaced.push_back(e.pipeline);
+        }
+
+        e.pipeline = pipeline;
+        e.layout = shader->layout;
+        e.generation = shader->generation;
+
+        compatible[description.compatibilityHash(shader->layout)] = &e;
+    }
+
+    void PipelineCache::update(uint64_t frame)
+    {
+        std::vector<VkPipeline> retiring;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            retiring.swap(replaced);
+        }
+
+        if (retiring.empty())
+        {
+            return;
+        }
+
+        // handed out by lookups up to this frame
+        VkDevice d = device;
+        deletionQueue.push
+        (
+            frame,
+            [d, retiring]()
+            {
+                for (VkPipeline pipeline : retiring)
+                {
+                    vkDestroyPipeline(d, pipeline, nullptr);
+                }
+            }
+        );
+    }
+
+    bool PipelineCache::saveCache(const std::string & cacheFile)
+    {
+        size_t size = 0;
+        vkGetPipelineCacheData(device, vkCache, &size, nullptr);
+
+        std::vector<char> data(size);
+        if (size > 0 && vkGetPipelineCacheData(device, vkCache, &size, data.data()) != VK_SUCCESS)
+        {
+            return false;
+        }
+
+        std::ofstream file(cacheFile, std::ios::binary);
+        if (!file.is_open())
+        {
+            return false;
+        }
+
+        file.write(data.data(), size);
+        return file.good();
+    }
+
+    bool PipelineCache::saveList(const std::string & listFile)
+    {
+        std::ofstream file(listFile);
+        if (!file.is_open())
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (const auto & e : entries)
+        {
+            file << e.second.description.serialise() << "\n";
+        }
+
+        return file.good();
+    }
+
+    std::vector<PipelineDescription> PipelineCache::loadList(const std::string & listFile)
+    {
+        std::vector<PipelineDescription> descriptions;
+
+        std::ifstream file(listFile);
+        std::string line;
+
+        while (std::getline(file, line))
+        {
+            if (line.empty())
+            {
+                continue;
+            }
+
+            try
+            {
+                descriptions.push_back(PipelineDescription::parse(line));
+            }
+            catch (const std::exception & e)
+            {
+                std::cerr << e.what() << "\n";
+            }
+        }
+
+        return descriptions;
+    }
+
+    PipelineCacheStats PipelineCache::getStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        PipelineCacheStats current = stats;
+        current.pending = 0;
+
+        for (const auto & e : entries)
+        {
+            current.pending += e.second.pending ? 1 : 0;
+        }
+
+        return current;
+    }
+
+    VkPipeline PipelineCache::createPipeline(const PipelineDescription & description, const ShaderEntry & shader)
+    {
+        VkVertexInputBindingDescription bindingDescription{};
+        bindingDescription.binding = 0;
+        bindingDescription.stride = description.vertexStride;
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo {};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.vertexBindingDescriptionCount = description.vertexAttributes.empty() ? 0 : 1;
+        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(description.vertexAttributes.size());
+        vertexInputInfo.pVertexAttributeDescriptions = description.vertexAttributes.data();
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly {};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = description.topology;
+        // if true can break up line or triangle strips
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        // for dynamic scissor and viewport
+        //  can be changed without rebuilding
+        //  pipeline
+        std::vector<VkDynamicState> dynamicStates =
+        {
+            VK_DYNAMIC_STATE_VIEWPORT,
+            VK_DYNAMIC_STATE_SCISSOR
+        };
+
+        VkPipelineDynamicStateCreateInfo dynamicState{};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+        dynamicState.pDynamicStates = dynamicStates.data();
+
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.scissorCount = 1;
+
+        VkPipelineRasterizationStateCreateInfo rasterInfo{};
+        rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterInfo.depthClampEnable = VK_FALSE;
+        // true disables framebuffer output
+        rasterInfo.rasterizerDiscardEnable = VK_FALSE;
+        rasterInfo.polygonMode = description.polygonMode;
+        // 1.0f requires wideLines enabled
+        rasterInfo.lineWidth = 1.0f;
+        rasterInfo.cullMode = description.cullMode;
+        rasterInfo.frontFace = description.frontFace;
+        rasterInfo.depthBiasEnable = VK_FALSE;
+
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        // shading per sample rather than per pixel smooths shader aliasing
+        //  but runs the fragment shader up to samples times per pixel
+        bool sampleShadingEnabled = description.minSampleShading > 0.0f && description.samples != VK_SAMPLE_COUNT_1_BIT;
+        multisampling.sampleShadingEnable = sampleShadingEnabled ? VK_TRUE : VK_FALSE;
+        multisampling.minSampleShading = sampleShadingEnabled ? description.minSampleShading : 0.0f;
+        multisampling.rasterizationSamples = description.samples;
+        multisampling.pSampleMask = nullptr;
+        multisampling.alphaToCoverageEnable = VK_FALSE;
+        multisampling.alphaToOneEnable = VK_FALSE;
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = description.depthTest ? VK_TRUE : VK_FALSE;
+        depthStencil.depthWriteEnable = description.depthWrite ? VK_TRUE : VK_FALSE;
+        depthStencil.depthCompareOp = description.depthCompare;
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.stencilTestEnable = VK_FALSE;
+
+        VkPipelineColorBlendAttachmentState colourBlendAttachment{};
+        colourBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        colourBlendAttachment.blendEnable = description.alphaBlend ? VK_TRUE : VK_FALSE;
+        colourBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+        colourBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        colourBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+        colourBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+        colourBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+        colourBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+        VkPipelineColorBlendStateCreateInfo colourBlending{};
+        colourBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colourBlending.logicOpEnable = VK_FALSE;
+        colourBlending.logicOp = VK_LOGIC_OP_COPY;
+        colourBlending.attachmentCount = 1;
+        colourBlending.pAttachments = &colourBlendAttachment;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = static_cast<uint32_t>(shader.stages.size());
+        // shaders
+        pipelineInfo.pStages = shader.stages.data();
+        // fixed functions
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterInfo;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = &depthStencil;
+        pipelineInfo.pColorBlendState = &colourBlending;
+        pipelineInfo.pDynamicState = &dynamicState;
+
+        pipelineInfo.layout = shader.layout;
+
+        // null with dynamic rendering, the attachment formats are given instead
+        pipelineInfo.renderPass = description.renderPass;
+        pipelineInfo.subpass = 0;
+
+        VkPipelineRenderingCreateInfoKHR renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+        renderingInfo.colorAttachmentCount = 1;
+        renderingInfo.pColorAttachmentFormats = &description.colourFormat;
+        renderingInfo.depthAttachmentFormat = description.depthFormat;
+
+        if (description.renderPass == VK_NULL_HANDLE)
+        {
+            pipelineInfo.pNext = &renderingInfo;
+        }
+
+        // inheritance
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineIndex = -1;
+
+        // the cache is internally synchronised, shared by every worker
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(device, vkCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create graphics pipline");
+        }
+
+        return pipeline;
+    }
+}
@@ -0,0 +1,180 @@
+#include <Renderer/radixSort.h>
+
+#include <array>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstddef>
+
+namespace Renderer
+{
+
+    namespace
+    {
+        // below this many keys per thread the threads are not worth starting
+        const size_t MIN_KEYS_PER_THREAD = 8192;
+
+        typedef std::array<size_t, 256> Histogram;
+
+        // reusable, every thread waits until all have arrived
+        class Barrier
+        {
+
+        public:
+
+            Barrier(unsigned count) : count(count), waiting(0), generation(0) {}
+
+            void wait()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                unsigned arrived = generation;
+
+                if (++waiting == count)
+                {
+                    waiting = 0;
+                    generation++;
+                    condition.notify_all();
+                    return;
+                }
+
+                condition.wait(lock, [&]() { return generation != arrived; });
+            }
+
+        private:
+
+            std::mutex mutex;
+            std::condition_variable condition;
+            unsigned count, waiting, generation;
+        };
+    }
+
+    void radixSort
+    (
+        std::vector<uint64_t> & keys,
+        std::vector<uint32_t> & values,
+        RadixSortScratch & scratch,
+        unsigned threads
+    )
+    {
+        const size_t n = keys.size();
+
+        if (n < 2)
+        {
+            return;
+        }
+
+        scratch.keys.resize(n);
+        scratch.values.resize(n);
+
+        threads = static_cast<unsigned>(std::clamp<size_t>(n/MIN_KEYS_PER_THREAD, 1, std::max(threads, 1u)));
+
+        // the passes to run, all digits counted in one read of the keys
+        std::array<Histogram, 8> totals{};
+        for (uint64_t key : keys)
+        {
+            for (unsigned pass = 0; pass < 8; pass++)
+            {
+                totals[pass][(key >> (8*pass)) & 0xff]++;
+            }
+        }
+
+        std::array<unsigned, 8> passes;
+        unsigned passCount = 0;
+        for (unsigned pass = 0; pass < 8; pass++)
+        {
+            // all keys share this byte, the pass would not move anything
+            if (totals[pass][(keys[0] >> (8*pass)) & 0xff] != n)
+            {
+                passes[passCount++] = pass;
+            }
+        }
+
+        // per thread, histogram then starting offsets for its chunk
+        std::vector<Histogram> & offsets = scratch.histograms;
+        offsets.resize(threads);
+        Barrier barrier(threads);
+
+        auto worker = [&](unsigned t)
+        {
+            size_t begin = n*t/threads;
+            size_t end = n*(t+1)/threads;
+
+            // each thread ping pongs its own copy of the pointers
+            uint64_t * srcKeys = keys.data();
+            uint32_t * srcValues = values.data();
+            uint64_t * dstKeys = scratch.keys.data();
+            uint32_t * dstValues = scratch.values.data();
+
+            for (unsigned p = 0; p < passCount; p++)
+            {
+                const unsigned shift = 8*passes[p];
+
+                Histogram & histogram = offsets[t];
+                histogram.fill(0);
+                for (size_t i = begin; i < end; i++)
+                {
+                    histogram[(srcKeys[i] >> shift) & 0xff]++;
+                }
+
+                barrier.wait();
+
+                // digits in order, and within a digit chunks in order
+                if (t == 0)
+                {
+                    size_t offset = 0;
+                    for (unsigned digit = 0; digit < 256; digit++)
+                    {
+                        for (unsigned chunk = 0; chunk < threads; chunk++)
+                        {
+                            size_t count = offsets[chunk][digit];
+                            offsets[chunk][digit] = offset;
+                            offset += count;
+                        }
+                    }
+                }
+
+                barrier.wait();
+
+                for (size_t i = begin; i < end; i++)
+                {
+                    uint64_t key = srcKeys[i];
+                    size_t j = histogram[(key >> shift) & 0xff]++;
+                    dstKeys[j] = key;
+                    dstValues[j] = srcValues[i];
+                }
+
+                // the next pass reads what every thread wrote
+                barrier.wait();
+
+                std::swap(srcKeys, dstKeys);
+                std::swap(srcValues, dstValues);
+            }
+        };
+
+        if (threads == 1)
+        {
+            worker(0);
+        }
+        else
+        {
+            std::vector<std::thread> pool;
+            for (unsigned t = 1; t < threads; t++)
+            {
+                pool.emplace_back(worker, t);
+            }
+            worker(0);
+            for (auto & thread : pool)
+            {
+                thread.join();
+            }
+        }
+
+        // an odd number of passes leaves the result in scratch
+        if (passCount % 2 == 1)
+        {
+            keys.swap(scratch.keys);
+            values.swap(scratch.values);
+        }
+    }
+}
@@ -0,0 +1,1365 @@
+#include <Renderer/renderGraph.h>
+#include <Renderer/descriptors.h>
+
+#include <stdexcept>
+#include <sstream>
+#include <algorithm>
+
+namespace Renderer
+{
+
+    namespace
+    {
+        struct AccessInfo
+        {
+            VkPipelineStageFlags stage;
+            VkAccessFlags access;
+            VkImageLayout layout;
+            VkImageUsageFlags usage;
+        };
+
+        AccessInfo accessInfo(RenderGraphAccess access)
+        {
+            switch (access)
+            {
+                case RenderGraphAccess::COLOUR_ATTACHMENT:
+                    return
+                    {
+                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                        VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+                    };
+                case RenderGraphAccess::DEPTH_ATTACHMENT:
+                    return
+                    {
+                        VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+                    };
+                case RenderGraphAccess::SAMPLED:
+                    return
+                    {
+                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                        VK_ACCESS_SHADER_READ_BIT,
+                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                        VK_IMAGE_USAGE_SAMPLED_BIT
+                    };
+                case RenderGraphAccess::TRANSFER_SRC:
+                    return
+                    {
+                        VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_ACCESS_TRANSFER_READ_BIT,
+                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                        VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+                    };
+                case RenderGraphAccess::TRANSFER_DST:
+                default:
+                    return
+                    {
+                        VK_PIPELINE_STAGE_TRANSFER_BIT,
+                        VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        VK_IMAGE_USAGE_TRANSFER_DST_BIT
+                    };
+            }
+        }
+
+        bool isAttachment(RenderGraphAccess access)
+        {
+            return access == RenderGraphAccess::COLOUR_ATTACHMENT || access == RenderGraphAccess::DEPTH_ATTACHMENT;
+        }
+
+        // layout transitions must name both aspects of combined depth stencil formats
+        VkImageAspectFlags barrierAspect(const RenderGraphImage & desc)
+        {
+            switch (desc.format)
+            {
+                case VK_FORMAT_D16_UNORM_S8_UINT:
+                case VK_FORMAT_D24_UNORM_S8_UINT:
+                case VK_FORMAT_D32_SFLOAT_S8_UINT:
+                    return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+                default:
+                    return desc.aspect;
+            }
+        }
+
+        bool overlaps(std::pair<uint32_t, uint32_t> a, std::pair<uint32_t, uint32_t> b)
+        {
+            return a.first <= b.second && b.first <= a.second;
+        }
+
+        const std::pair<uint32_t, uint32_t> UNUSED = {UINT32_MAX, 0};
+    }
+
+    std::string RenderGraphStats::report() const
+    {
+        std::stringstream ss;
+        ss << passes << " passes"
+           << ", " << barriers << " barriers in " << barrierBatches << " batches"
+           << ", " << transientImages << " transient images in " << memoryBlocks << " blocks"
+           << " (" << allocatedBytes/1024 << " of " << transientBytes/1024 << " KiB)"
+           << ", " << cacheHits << " cached compiles";
+        return ss.str();
+    }
+
+    void RenderGraph::Pass::colour
+    (
+        const std::string & image,
+        std::optional<VkClearColorValue> clear,
+        const std::string & resolve
+    )
+    {
+        uses.push_back({image, RenderGraphAccess::COLOUR_ATTACHMENT, true});
+
+        if (!resolve.empty())
+        {
+            uses.push_back({resolve, RenderGraphAccess::COLOUR_ATTACHMENT, true});
+        }
+
+        std::optional<VkClearValue> value;
+        if (clear)
+        {
+            value = VkClearValue{};
+            value->color = clear.value();
+        }
+
+        attachments.push_back({image, resolve, value, false});
+    }
+
+    void RenderGraph::Pass::depth(const std::string & image, std::optional<VkClearDepthStencilValue> clear)
+    {
+        uses.push_back({image, RenderGraphAccess::DEPTH_ATTACHMENT, true});
+
+        std::optional<VkClearValue> value;
+        if (clear)
+        {
+            value = VkClearValue{};
+            value->depthStencil = clear.value();
+        }
+
+        attachments.push_back({image, "", value, true});
+    }
+
+    void RenderGraph::Pass::read(const std::string & image, RenderGraphAccess access)
+    {
+        uses.push_back({image, access, false});
+    }
+
+    void RenderGraph::Pass::write(const std::string & image, RenderGraphAccess access)
+    {
+        uses.push_back({image, access, true});
+    }
+
+    RenderGraph::RenderGraph(VkDevice device, DeletionQueue & deletionQueue, MemoryBudget & budget, bool dynamicRendering)
+    : device(device), deletionQueue(deletionQueue), budget(budget), dynamicRendering(dynamicRendering)
+    {
+        if (dynamicRendering)
+        {
+            // extension commands are not exported by the loader
+            beginRendering = (PFN_vkCmdBeginRenderingKHR) vkGetDeviceProcAddr(device, "vkCmdBeginRenderingKHR");
+            endRendering = (PFN_vkCmdEndRenderingKHR) vkGetDeviceProcAddr(device, "vkCmdEndRenderingKHR");
+
+            if (beginRendering == nullptr || endRendering == nullptr)
+            {
+                throw std::runtime_error("VK_KHR_dynamic_rendering is not enabled on the device");
+            }
+        }
+    }
+
+    bool RenderGraph::dynamicRenderingSupported(VkPhysicalDevice physicalDevice)
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        // the extension's dependencies (depth stencil resolve, create renderpass 2) are core from 1.2
+        if (properties.apiVersion < VK_API_VERSION_1_2)
+        {
+            return false;
+        }
+
+        uint32_t extensionCount;
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+        std::vector<VkExtensionProperties> extensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+
+        bool hasExtension = false;
+        for (const auto & extension : extensions)
+        {
+            if (std::string(extension.extensionName) == VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)
+            {
+                hasExtension = true;
+                break;
+            }
+        }
+
+        if (!hasExtension)
+        {
+            return false;
+        }
+
+        VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures{};
+        dynamicRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &dynamicRenderingFeatures;
+
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+        return dynamicRenderingFeatures.dynamicRendering;
+    }
+
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR RenderGraph::dynamicRenderingFeatures()
+    {
+        VkPhysicalDeviceDynamicRenderingFeaturesKHR features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+        features.dynamicRendering = VK_TRUE;
+        return features;
+    }
+
+    RenderGraph::~RenderGraph()
+    {
+        for (auto & framebuffer : framebuffers)
+        {
+            vkDestroyFramebuffer(device, framebuffer.second, nullptr);
+        }
+
+        for (auto & transient : transients)
+        {
+            vkDestroyImageView(device, transient.second.view, nullptr);
+            vkDestroyImage(device, transient.second.image, nullptr);
+        }
+
+        for (auto memory : memoryBlocks)
+        {
+            budget.free(memory);
+        }
+
+        for (auto & renderPass : renderPasses)
+        {
+            vkDestroyRenderPass(device, renderPass.second, nullptr);
+        }
+    }
+
+    size_t RenderGraph::FramebufferKey::hash() const
+    {
+        size_t h = pass;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            hashCombine(h, std::hash<VkImageView>()(views[i]));
+        }
+        return h;
+    }
+
+    bool RenderGraph::FramebufferKey::operator==(const FramebufferKey & other) const
+    {
+        // unused views are null in both
+        return pass == other.pass && count == other.count && views == other.views;
+    }
+
+    size_t RenderGraph::RenderPassKey::hash() const
+    {
+        size_t h = 0;
+        for (const VkAttachmentDescription & d : descriptions)
+        {
+            hashCombine(h, d.format);
+            hashCombine(h, d.samples);
+            hashCombine(h, d.loadOp);
+            hashCombine(h, d.storeOp);
+            hashCombine(h, d.initialLayout);
+        }
+        hashCombine(h, colours);
+        hashCombine(h, depth);
+        for (uint32_t resolve : resolves)
+        {
+            hashCombine(h, resolve);
+        }
+        return h;
+    }
+
+    bool RenderGraph::RenderPassKey::operator==(const RenderPassKey & other) const
+    {
+        if (descriptions.size() != other.descriptions.size())
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < descriptions.size(); i++)
+        {
+            const VkAttachmentDescription & a = descriptions[i];
+            const VkAttachmentDescription & b = other.descriptions[i];
+
+            // the stencil ops are always don't care
+            bool same = a.format == b.format
+                     && a.samples == b.samples
+                     && a.loadOp == b.loadOp
+                     && a.storeOp == b.storeOp
+                     && a.initialLayout == b.initialLayout
+                     && a.finalLayout == b.finalLayout;
+
+            if (!same)
+            {
+                return false;
+            }
+        }
+
+        return colours == other.colours && depth == other.depth && resolves == other.resolves;
+    }
+
+    void RenderGraph::clear()
+    {
+        resources.clear();
+        passes.clear();
+    }
+
+    void RenderGraph::addImage(const std::string & name, RenderGraphImage desc)
+    {
+        for (const Resource & r : resources)
+        {
+            if (r.name == name)
+            {
+                throw std::runtime_error("Render graph image "+name+" declared twice");
+            }
+        }
+
+        resources.emplace_back();
+
+        Resource & r = resources.back();
+        r.name = name;
+        r.desc = desc;
+    }
+
+    void RenderGraph::importImage
+    (
+        const std::string & name,
+        VkImage image,
+        VkImageView view,
+        RenderGraphImage desc,
+        VkImageLayout finalLayout,
+        VkImageLayout initialLayout,
+        VkPipelineStageFlags initialStage
+    )
+    {
+        addImage(name, desc);
+
+        Resource & r = resources.back();
+        r.imported = true;
+        r.image = image;
+        r.view = view;
+        r.initialLayout = initialLayout;
+        r.finalLayout = finalLayout;
+        r.initialStage = initialStage;
+    }
+
+    RenderGraph::Pass & RenderGraph::addPass(const std::string & name)
+    {
+        if (passes.size() == passPool.size())
+        {
+            passPool.push_back(std::make_unique<Pass>());
+        }
+
+        // cleared, keeping what its vectors have reserved
+        Pass & pass = *passPool[passes.size()];
+        pass.name = name;
+        pass.renderArea.reset();
+        pass.execute = nullptr;
+        pass.uses.clear();
+        pass.attachments.clear();
+
+        passes.push_back(&pass);
+        return pass;
+    }
+
+    uint32_t RenderGraph::resource(const std::string & name) const
+    {
+        // a handful of images, searched without building an index each frame
+        for (uint32_t r = 0; r < resources.size(); r++)
+        {
+            if (resources[r].name == name)
+            {
+                return r;
+            }
+        }
+
+        throw std::runtime_error("Render graph has no image "+name);
+    }
+
+    size_t RenderGraph::hash() const
+    {
+        size_t h = 0;
+        std::hash<std::string> hashString;
+
+        for (const Resource & r : resources)
+        {
+            hashCombine(h, hashString(r.name));
+            hashCombine(h, r.desc.format);
+            hashCombine(h, r.desc.extent.width);
+            hashCombine(h, r.desc.extent.height);
+            hashCombine(h, r.desc.samples);
+            hashCombine(h, r.desc.aspect);
+            hashCombine(h, r.imported);
+            hashCombine(h, r.initialLayout);
+            hashCombine(h, r.finalLayout);
+            hashCombine(h, r.initialStage);
+        }
+
+        for (const auto & pass : passes)
+        {
+            hashCombine(h, hashString(pass->name));
+
+            for (const Pass::Use & use : pass->uses)
+            {
+                hashCombine(h, hashString(use.image));
+                hashCombine(h, size_t(use.access));
+                hashCombine(h, use.write);
+            }
+
+            for (const Pass::Attachment & a : pass->attachments)
+            {
+                hashCombine(h, hashString(a.image));
+                hashCombine(h, hashString(a.resolve));
+                hashCombine(h, a.clear.has_value());
+                hashCombine(h, a.depth);
+            }
+        }
+
+        return h;
+    }
+
+    void RenderGraph::compile(uint64_t frame)
+    {
+        size_t h = hash();
+
+        if (compiledHash && compiledHash.value() == h && unchanged())
+        {
+            stats.cacheHits++;
+            return;
+        }
+
+        reset(frame);
+        build();
+        compiledHash = h;
+
+        compiledResources = resources;
+        compiledPasses.resize(passes.size());
+        for (size_t p = 0; p < passes.size(); p++)
+        {
+            compiledPasses[p].name = passes[p]->name;
+            compiledPasses[p].uses = passes[p]->uses;
+            compiledPasses[p].attachments = passes[p]->attachments;
+        }
+    }
+
+    bool RenderGraph::unchanged() const
+    {
+        if (resources.size() != compiledResources.size() || passes.size() != compiledPasses.size())
+        {
+            return false;
+        }
+
+        // the fields hash() covers
+        for (size_t i = 0; i < resources.size(); i++)
+        {
+            const Resource & a = resources[i];
+            const Resource & b = compiledResources[i];
+
+            bool same = a.name == b.name
+                     && a.desc.format == b.desc.format
+                     && a.desc.extent.width == b.desc.extent.width
+                     && a.desc.extent.height == b.desc.extent.height
+                     && a.desc.samples == b.desc.samples
+                     && a.desc.aspect == b.desc.aspect
+                     && a.imported == b.imported
+                     && a.initialLayout == b.initialLayout
+                     && a.finalLayout == b.finalLayout
+                     && a.initialStage == b.initialStage;
+
+            if (!same)
+            {
+                return false;
+            }
+        }
+
+        for (size_t p = 0; p < passes.size(); p++)
+        {
+            const Pass & a = *passes[p];
+            const Pass & b = compiledPasses[p];
+
+            if (a.name != b.name || a.uses.size() != b.uses.size() || a.attachments.size() != b.attachments.size())
+            {
+                return false;
+            }
+
+            for (size_t i = 0; i < a.uses.size(); i++)
+            {
+                const Pass::Use & x = a.uses[i];
+                const Pass::Use & y = b.uses[i];
+
+                if (x.image != y.image || x.access != y.access || x.write != y.write)
+                {
+                    return false;
+                }
+            }
+
+            for (size_t i = 0; i < a.attachments.size(); i++)
+            {
+                const Pass::Attachment & x = a.attachments[i];
+                const Pass::Attachment & y = b.attachments[i];
+
+                if (x.image != y.image || x.resolve != y.resolve || x.clear.has_value() != y.clear.has_value() || x.depth != y.depth)
+                {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    void RenderGraph::reset(uint64_t frame)
+    {
+        VkDevice d = device;
+        MemoryBudget * b = &budget;
+
+        std::vector<VkFramebuffer> oldFramebuffers;
+        for (auto & framebuffer : framebuffers)
+        {
+            oldFramebuffers.push_back(framebuffer.second);
+        }
+
+        std::vector<Transient> oldTransients;
+        for (auto & transient : transients)
+        {
+            oldTransients.push_back(transient.second);
+        }
+
+        std::vector<VkDeviceMemory> oldMemory = memoryBlocks;
+
+        // frames in flight may still use these
+        deletionQueue.push
+        (
+            frame,
+            [d, b, oldFramebuffers, oldTransients, oldMemory]()
+            {
+                for (auto framebuffer : oldFramebuffers)
+                {
+                    vkDestroyFramebuffer(d, framebuffer, nullptr);
+                }
+
+                for (auto & transient : oldTransients)
+                {
+                    vkDestroyImageView(d, transient.view, nullptr);
+                    vkDestroyImage(d, transient.image, nullptr);
+                }
+
+                for (auto memory : oldMemory)
+                {
+                    b->free(memory);
+                }
+            }
+        );
+
+        framebuffers.clear();
+        transients.clear();
+        memoryBlocks.clear();
+        compiled.clear();
+        compiledPassIndex.clear();
+        finalTransitions = BarrierBatch();
+        firstStages.clear();
+        compiledHash.reset();
+    }
+
+    void RenderGraph::build()
+    {
+        const uint32_t resourceCount = static_cast<uint32_t>(resources.size());
+        const uint32_t passCount = static_cast<uint32_t>(passes.size());
+
+        uint64_t cacheHits = stats.cacheHits;
+        stats = RenderGraphStats();
+        stats.cacheHits = cacheHits;
+        stats.passes = passCount;
+
+        // first and last pass using each image
+        std::vector<std::pair<uint32_t, uint32_t>> lifetimes(resourceCount, UNUSED);
+        std::vector<bool> attachmentOnly(resourceCount, true);
+
+        for (uint32_t p = 0; p < passCount; p++)
+        {
+            std::vector<uint32_t> seen;
+
+            for (const Pass::Use & use : passes[p]->uses)
+            {
+                uint32_t r = resource(use.image);
+
+                if (std::find(seen.begin(), seen.end(), r) != seen.end())
+                {
+                    throw std::runtime_error("Render graph pass "+passes[p]->name+" uses "+use.image+" twice");
+                }
+                seen.push_back(r);
+
+                lifetimes[r].first = std::min(lifetimes[r].first, p);
+                lifetimes[r].second = std::max(lifetimes[r].second, p);
+
+                if (!isAttachment(use.access))
+                {
+                    attachmentOnly[r] = false;
+                }
+            }
+        }
+
+        for (uint32_t r = 0; r < resourceCount; r++)
+        {
+            // stored between passes, or owned elsewhere
+            if (resources[r].imported || lifetimes[r].first != lifetimes[r].second)
+            {
+                attachmentOnly[r] = false;
+            }
+        }
+
+        allocateTransients(lifetimes, attachmentOnly);
+
+        // what must be waited on before a transient's first use, covering earlier
+        //  frames and anything else aliasing its memory
+        std::vector<VkPipelineStageFlags> blockStages(memoryBlocks.size(), 0);
+        std::vector<VkAccessFlags> blockWrites(memoryBlocks.size(), 0);
+
+        for (const auto & pass : passes)
+        {
+            for (const Pass::Use & use : pass->uses)
+            {
+                auto transient = transients.find(resource(use.image));
+                if (transient != transients.end())
+                {
+                    AccessInfo info = accessInfo(use.access);
+                    blockStages[transient->second.block] |= info.stage;
+                    if (use.write)
+                    {
+                        blockWrites[transient->second.block] |= info.access;
+                    }
+                }
+            }
+        }
+
+        struct State
+        {
+            bool started = false;
+            VkImageLayout layout;
+            VkPipelineStageFlags stages;
+            VkAccessFlags writes;
+        };
+
+        std::vector<State> states(resourceCount);
+        firstStages.assign(resourceCount, 0);
+        compiled.resize(passCount);
+
+        for (uint32_t p = 0; p < passCount; p++)
+        {
+            const Pass & pass = *passes[p];
+            CompiledPass & compiledPass = compiled[p];
+            compiledPassIndex[pass.name] = p;
+
+            for (const Pass::Use & use : pass.uses)
+            {
+                uint32_t r = resource(use.image);
+                const Resource & res = resources[r];
+                AccessInfo info = accessInfo(use.access);
+                State & state = states[r];
+
+                Barrier barrier;
+                barrier.resource = r;
+                barrier.newLayout = info.layout;
+                barrier.dstAccess = info.access;
+
+                VkPipelineStageFlags srcStages;
+
+                if (!state.started)
+                {
+                    if (!res.imported && !use.write)
+                    {
+                        throw std::runtime_error("Render graph pass "+pass.name+" reads "+res.name+" before anything writes it");
+                    }
+
+                    firstStages[r] = info.stage;
+
+                    if (res.imported)
+                    {
+                        barrier.oldLayout = res.initialLayout;
+                        barrier.srcAccess = 0;
+                        srcStages = res.initialStage != 0 ? res.initialStage : info.stage;
+                    }
+                    else
+                    {
+                        // contents are discarded, whatever aliased the memory before must be done with it
+                        uint32_t block = transients[r].block;
+                        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                        barrier.srcAccess = blockWrites[block];
+                        srcStages = blockStages[block];
+                    }
+                }
+                else if (state.layout == info.layout && state.writes == 0 && !use.write)
+                {
+                    // read after read in the same layout, but a later write must wait for this read too
+                    state.stages |= info.stage;
+                    continue;
+                }
+                else
+                {
+                    barrier.oldLayout = state.layout;
+                    barrier.srcAccess = state.writes;
+                    srcStages = state.stages;
+                }
+
+                compiledPass.before.barriers.push_back(barrier);
+                compiledPass.before.srcStages |= srcStages;
+                compiledPass.before.dstStages |= info.stage;
+
+                state.started = true;
+                state.layout = info.layout;
+                state.stages = info.stage;
+                state.writes = use.write ? info.access : 0;
+            }
+
+            stats.barriers += compiledPass.before.barriers.size();
+            stats.barrierBatches += compiledPass.before.barriers.empty() ? 0 : 1;
+
+            compileAttachments(pass, compiledPass, lifetimes, p);
+
+            if (!pass.attachments.empty() && !dynamicRendering)
+            {
+                compiledPass.renderPass = createRenderPass(pass, compiledPass);
+            }
+        }
+
+        for (uint32_t r = 0; r < resourceCount; r++)
+        {
+            const State & state = states[r];
+
+            if (!resources[r].imported || !state.started || state.layout == resources[r].finalLayout)
+            {
+                continue;
+            }
+
+            Barrier barrier;
+            barrier.resource = r;
+            barrier.oldLayout = state.layout;
+            barrier.newLayout = resources[r].finalLayout;
+            barrier.srcAccess = state.writes;
+            barrier.dstAccess = 0;
+
+            finalTransitions.barriers.push_back(barrier);
+            finalTransitions.srcStages |= state.stages;
+            finalTransitions.dstStages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        }
+
+        stats.barriers += finalTransitions.barriers.size();
+        stats.barrierBatches += finalTransitions.barriers.empty() ? 0 : 1;
+    }
+
+    void RenderGraph::allocateTransients
+    (
+        const std::vector<std::pair<uint32_t, uint32_t>> & lifetimes,
+        const std::vector<bool> & attachmentOnly
+    )
+    {
+        struct Candidate
+        {
+            uint32_t resource;
+            VkMemoryRequirements requirements;
+        };
+
+        std::vector<Candidate> candidates;
+
+        for (uint32_t r = 0; r < resources.size(); r++)
+        {
+            const Resource & res = resources[r];
+
+            if (res.imported || lifetimes[r] == UNUSED)
+            {
+                continue;
+            }
+
+            VkImageUsageFlags usage = 0;
+            for (const auto & pass : passes)
+            {
+                for (const Pass::Use & use : pass->uses)
+                {
+                    if (use.image == res.name)
+                    {
+                        usage |= accessInfo(use.access).usage;
+                    }
+                }
+            }
+
+            if (attachmentOnly[r])
+            {
+                usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+            }
+
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.extent = {res.desc.extent.width, res.desc.extent.height, 1};
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.format = res.desc.format;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            imageInfo.usage = usage;
+            imageInfo.samples = res.desc.samples;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            Transient transient;
+            if (vkCreateImage(device, &imageInfo, nullptr, &transient.image) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create render graph image "+res.name);
+            }
+
+            transients[r] = transient;
+
+            Candidate candidate;
+            candidate.resource = r;
+            vkGetImageMemoryRequirements(device, transient.image, &candidate.requirements);
+            candidates.push_back(candidate);
+
+            stats.transientImages++;
+            stats.transientBytes += candidate.requirements.size;
+        }
+
+        // largest first, so each block is sized by its first occupant
+        std::sort
+        (
+            candidates.begin(),
+            candidates.end(),
+            [](const Candidate & a, const Candidate & b) { return a.requirements.size > b.requirements.size; }
+        );
+
+        struct Block
+        {
+            VkDeviceSize size;
+            uint32_t typeBits;
+            bool lazy;
+            std::vector<std::pair<uint32_t, uint32_t>> lifetimes;
+            std::vector<uint32_t> resources;
+        };
+
+        std::vector<Block> blocks;
+
+        for (const Candidate & candidate : candidates)
+        {
+            uint32_t r = candidate.resource;
+            Block * home = nullptr;
+
+            // lazily allocated memory has no fixed size to share
+            if (!attachmentOnly[r])
+            {
+                for (Block & block : blocks)
+                {
+                    bool free = !block.lazy
+                        && (block.typeBits & candidate.requirements.memoryTypeBits) != 0
+                        && block.size >= candidate.requirements.size
+                        && std::none_of
+                        (
+                            block.lifetimes.begin(),
+                            block.lifetimes.end(),
+                            [&](std::pair<uint32_t, uint32_t> l) { return overlaps(l, lifetimes[r]); }
+                        );
+
+                    if (free)
+                    {
+                        home = &block;
+                        break;
+                    }
+                }
+            }
+
+            if (home == nullptr)
+            {
+                blocks.push_back({candidate.requirements.size, candidate.requirements.memoryTypeBits, attachmentOnly[r], {}, {}});
+                home = &blocks.back();
+            }
+
+            home->typeBits &= candidate.requirements.memoryTypeBits;
+            home->lifetimes.push_back(lifetimes[r]);
+            home->resources.push_back(r);
+        }
+
+        for (const Block & block : blocks)
+        {
+            VkMemoryRequirements requirements{block.size, 0, block.typeBits};
+
+            VkDeviceMemory memory = budget.allocate
+            (
+                requirements,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                block.lazy ? VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT : 0,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                "render graph attachments"
+            );
+
+            uint32_t index = static_cast<uint32_t>(memoryBlocks.size());
+            memoryBlocks.push_back(memory);
+            stats.memoryBlocks++;
+            stats.allocatedBytes += block.size;
+
+            for (uint32_t r : block.resources)
+            {
+                Transient & transient = transients[r];
+                transient.block = index;
+
+                // offset 0, every occupant's alignment is satisfied
+                vkBindImageMemory(device, transient.image, memory, 0);
+
+                VkImageViewCreateInfo viewInfo{};
+                viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+                viewInfo.image = transient.image;
+                viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+                viewInfo.format = resources[r].desc.format;
+                viewInfo.subresourceRange = {resources[r].desc.aspect, 0, 1, 0, 1};
+
+                if (vkCreateImageView(device, &viewInfo, nullptr, &transient.view) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("Failed to create render graph image view "+resources[r].name);
+                }
+            }
+        }
+    }
+
+    void RenderGraph::compileAttachments
+    (
+        const Pass & pass,
+        CompiledPass & compiledPass,
+        const std::vector<std::pair<uint32_t, uint32_t>> & lifetimes,
+        uint32_t index
+    )
+    {
+        // needed only if used after this pass, or owned elsewhere
+        auto storeOp = [&](uint32_t r)
+        {
+            bool readAfter = resources[r].imported || lifetimes[r].second > index;
+            return readAfter ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        };
+
+        auto compile = [&](const Pass::Attachment & a, VkImageLayout layout)
+        {
+            uint32_t r = resource(a.image);
+            const Resource & res = resources[r];
+
+            CompiledAttachment attachment;
+            attachment.resource = r;
+            attachment.layout = layout;
+            attachment.clear = a.clear ? a.clear.value() : VkClearValue{};
+
+            bool writtenBefore = lifetimes[r].first < index || (res.imported && res.initialLayout != VK_IMAGE_LAYOUT_UNDEFINED);
+
+            if (a.clear)
+            {
+                attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            }
+            else
+            {
+                attachment.loadOp = writtenBefore ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            }
+
+            attachment.storeOp = storeOp(r);
+
+            if (!a.resolve.empty())
+            {
+                attachment.resolve = resource(a.resolve);
+                attachment.resolveStoreOp = storeOp(attachment.resolve);
+            }
+
+            return attachment;
+        };
+
+        for (const Pass::Attachment & a : pass.attachments)
+        {
+            if (!a.depth)
+            {
+                compiledPass.colours.push_back(compile(a, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL));
+            }
+            else if (compiledPass.depth)
+            {
+                throw std::runtime_error("Render graph pass "+pass.name+" has two depth attachments");
+            }
+            else
+            {
+                compiledPass.depth = compile(a, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+            }
+        }
+    }
+
+    VkRenderPass RenderGraph::createRenderPass(const Pass & pass, CompiledPass & compiledPass)
+    {
+        std::vector<VkAttachmentDescription> descriptions;
+        std::vector<VkAttachmentReference> colourRefs, resolveRefs;
+        std::optional<VkAttachmentReference> depthRef;
+
+        auto describe = [&](uint32_t r, VkAttachmentLoadOp loadOp, VkAttachmentStoreOp storeOp, VkImageLayout layout, VkClearValue clear)
+        {
+            VkAttachmentDescription description{};
+            description.format = resources[r].desc.format;
+            description.samples = resources[r].desc.samples;
+            description.loadOp = loadOp;
+            description.storeOp = storeOp;
+            description.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            description.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            // the graph's barriers do every transition
+            description.initialLayout = layout;
+            description.finalLayout = layout;
+
+            uint32_t attachment = static_cast<uint32_t>(descriptions.size());
+            descriptions.push_back(description);
+            compiledPass.attachments.push_back(r);
+            compiledPass.clearValues.push_back(clear);
+
+            return VkAttachmentReference{attachment, layout};
+        };
+
+        // colours, then depth, then resolves
+        bool anyResolve = false;
+        for (const CompiledAttachment & a : compiledPass.colours)
+        {
+            colourRefs.push_back(describe(a.resource, a.loadOp, a.storeOp, a.layout, a.clear));
+            anyResolve = anyResolve || a.resolve != NO_RESOLVE;
+        }
+
+        if (compiledPass.depth)
+        {
+            const CompiledAttachment & a = compiledPass.depth.value();
+            depthRef = describe(a.resource, a.loadOp, a.storeOp, a.layout, a.clear);
+        }
+
+        if (anyResolve)
+        {
+            for (const CompiledAttachment & a : compiledPass.colours)
+            {
+                if (a.resolve == NO_RESOLVE)
+                {
+                    resolveRefs.push_back({VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED});
+                }
+                else
+                {
+                    resolveRefs.push_back(describe(a.resolve, VK_ATTACHMENT_LOAD_OP_DONT_CARE, a.resolveStoreOp, a.layout, VkClearValue{}));
+                }
+            }
+        }
+
+        if (descriptions.size() > MAX_ATTACHMENTS)
+        {
+            throw std::runtime_error("Render graph pass "+pass.name+" has more attachments than a framebuffer key holds");
+        }
+
+        // equal descriptions give the same render pass, so pipelines stay compatible across recompiles
+        RenderPassKey key;
+        key.descriptions = descriptions;
+        key.colours = static_cast<uint32_t>(colourRefs.size());
+        key.depth = depthRef.has_value();
+        for (const VkAttachmentReference & ref : resolveRefs)
+        {
+            key.resolves.push_back(ref.attachment);
+        }
+
+        auto found = renderPasses.find(key);
+        if (found != renderPasses.end())
+        {
+            return found->second;
+        }
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = static_cast<uint32_t>(colourRefs.size());
+        subpass.pColorAttachments = colourRefs.data();
+        subpass.pResolveAttachments = anyResolve ? resolveRefs.data() : nullptr;
+        subpass.pDepthStencilAttachment = depthRef ? &depthRef.value() : nullptr;
+
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = static_cast<uint32_t>(descriptions.size());
+        renderPassInfo.pAttachments = descriptions.data();
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        // synchronised by barriers outside the render pass
+        renderPassInfo.dependencyCount = 0;
+
+        VkRenderPass renderPass;
+        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create render pass for "+pass.name);
+        }
+
+        renderPasses[key] = renderPass;
+        return renderPass;
+    }
+
+    VkImage RenderGraph::handle(uint32_t r) const
+    {
+        if (resources[r].imported)
+        {
+            return resources[r].image;
+        }
+
+        auto found = transients.find(r);
+        return found == transients.end() ? VK_NULL_HANDLE : found->second.image;
+    }
+
+    VkImageView RenderGraph::view(uint32_t r) const
+    {
+        if (resources[r].imported)
+        {
+            return resources[r].view;
+        }
+
+        auto found = transients.find(r);
+        return found == transients.end() ? VK_NULL_HANDLE : found->second.view;
+    }
+
+    void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch & batch, FrameScratch & scratch)
+    {
+        if (batch.barriers.empty())
+        {
+            return;
+        }
+
+        ScratchVector<VkImageMemoryBarrier> barriers(scratch);
+        barriers.reserve(batch.barriers.size());
+
+        for (const Barrier & b : batch.barriers)
+        {
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.oldLayout = b.oldLayout;
+            barrier.newLayout = b.newLayout;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = handle(b.resource);
+            barrier.subresourceRange = {barrierAspect(resources[b.resource].desc), 0, 1, 0, 1};
+            barrier.srcAccessMask = b.srcAccess;
+            barrier.dstAccessMask = b.dstAccess;
+            barriers.push_back(barrier);
+        }
+
+        vkCmdPipelineBarrier
+        (
+            commandBuffer,
+            batch.srcStages != 0 ? batch.srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            batch.dstStages,
+            0,
+            0, nullptr,
+            0, nullptr,
+            static_cast<uint32_t>(barriers.size()), barriers.data()
+        );
+    }
+
+    void RenderGraph::execute(VkCommandBuffer commandBuffer, FrameScratch & scratch)
+    {
+        if (!compiledHash)
+        {
+            throw std::runtime_error("Render graph executed before compiling");
+        }
+
+        for (uint32_t p = 0; p < passes.size(); p++)
+        {
+            const Pass & pass = *passes[p];
+            const CompiledPass & compiledPass = compiled[p];
+
+            recordBarriers(commandBuffer, compiledPass.before, scratch);
+
+            if (pass.attachments.empty())
+            {
+                if (pass.execute)
+                {
+                    pass.execute(commandBuffer);
+                }
+                continue;
+            }
+
+            if (dynamicRendering)
+            {
+                beginDynamicRendering(commandBuffer, p, scratch);
+            }
+            else
+            {
+                beginRenderPass(commandBuffer, p);
+            }
+
+                if (pass.execute)
+                {
+                    pass.execute(commandBuffer);
+                }
+
+            if (dynamicRendering)
+            {
+                endRendering(commandBuffer);
+            }
+            else
+            {
+                vkCmdEndRenderPass(commandBuffer);
+            }
+        }
+
+        recordBarriers(commandBuffer, finalTransitions, scratch);
+    }
+
+    void RenderGraph::beginRenderPass(VkCommandBuffer commandBuffer, uint32_t index)
+    {
+        const Pass & pass = *passes[index];
+        const CompiledPass & compiledPass = compiled[index];
+
+        // at most MAX_ATTACHMENTS, checked when the render pass was made
+        FramebufferKey key;
+        key.pass = index;
+        for (uint32_t r : compiledPass.attachments)
+        {
+            key.views[key.count++] = view(r);
+        }
+
+        VkExtent2D extent = resources[compiledPass.attachments[0]].desc.extent;
+
+        VkFramebuffer & framebuffer = framebuffers[key];
+        if (framebuffer == VK_NULL_HANDLE)
+        {
+            VkFramebufferCreateInfo framebufferInfo{};
+            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebufferInfo.renderPass = compiledPass.renderPass;
+            framebufferInfo.attachmentCount = key.count;
+            framebufferInfo.pAttachments = key.views.data();
+            framebufferInfo.width = extent.width;
+            framebufferInfo.height = extent.height;
+            framebufferInfo.layers = 1;
+
+            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create framebuffer for "+pass.name);
+            }
+        }
+
+        VkRenderPassBeginInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = compiledPass.renderPass;
+        renderPassInfo.framebuffer = framebuffer;
+        renderPassInfo.renderArea = pass.renderArea ? pass.renderArea.value() : VkRect2D{{0, 0}, extent};
+        renderPassInfo.clearValueCount = static_cast<uint32_t>(compiledPass.clearValues.size());
+        renderPassInfo.pClearValues = compiledPass.clearValues.data();
+
+        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    }
+
+    void RenderGraph::beginDynamicRendering(VkCommandBuffer commandBuffer, uint32_t index, FrameScratch & scratch)
+    {
+        const Pass & pass = *passes[index];
+        const CompiledPass & compiledPass = compiled[index];
+
+        auto info = [&](const CompiledAttachment & a)
+        {
+            VkRenderingAttachmentInfoKHR attachment{};
+            attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+            attachment.imageView = view(a.resource);
+            attachment.imageLayout = a.layout;
+            attachment.loadOp = a.loadOp;
+            attachment.storeOp = a.storeOp;
+            attachment.clearValue = a.clear;
+
+            if (a.resolve != NO_RESOLVE)
+            {
+                // the resolve has no store op of its own, it is always written
+                attachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+                attachment.resolveImageView = view(a.resolve);
+                attachment.resolveImageLayout = a.layout;
+            }
+
+            return attachment;
+        };
+
+        ScratchVector<VkRenderingAttachmentInfoKHR> colours(scratch);
+        colours.reserve(compiledPass.colours.size());
+
+        for (const CompiledAttachment & a : compiledPass.colours)
+        {
+            colours.push_back(info(a));
+        }
+
+        VkRenderingAttachmentInfoKHR depth{};
+        if (compiledPass.depth)
+        {
+            depth = info(compiledPass.depth.value());
+        }
+
+        const CompiledAttachment & first = compiledPass.colours.empty() ? compiledPass.depth.value() : compiledPass.colours[0];
+        VkExtent2D extent = resources[first.resource].desc.extent;
+
+        VkRenderingInfoKHR renderingInfo{};
+        renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+        renderingInfo.renderArea = pass.renderArea ? pass.renderArea.value() : VkRect2D{{0, 0}, extent};
+        renderingInfo.layerCount = 1;
+        renderingInfo.colorAttachmentCount = static_cast<uint32_t>(colours.size());
+        renderingInfo.pColorAttachments = colours.data();
+        renderingInfo.pDepthAttachment = compiledPass.depth ? &depth : nullptr;
+
+        beginRendering(commandBuffer, &renderingInfo);
+    }
+
+    VkRenderPass RenderGraph::renderPass(const std::string & pass) const
+    {
+        auto found = compiledPassIndex.find(pass);
+        if (found == compiledPassIndex.end() || (compiled[found->second].renderPass == VK_NULL_HANDLE && !dynamicRendering))
+        {
+            throw std::runtime_error("Render graph has no compiled render pass "+pass);
+        }
+        return compiled[found->second].renderPass;
+    }
+
+    VkRenderPass RenderGraph::declaredRenderPass(const std::string & name)
+    {
+        const uint32_t passCount = static_cast<uint32_t>(passes.size());
+
+        uint32_t index = 0;
+        while (index < passCount && passes[index]->name != name)
+        {
+            index++;
+        }
+
+        if (index == passCount || passes[index]->attachments.empty())
+        {
+            throw std::runtime_error("Render graph has no declared render pass "+name);
+        }
+
+        if (dynamicRendering)
+        {
+            return VK_NULL_HANDLE;
+        }
+
+        // load and store ops depend on the first and last pass using each image
+        std::vector<std::pair<uint32_t, uint32_t>> lifetimes(resources.size(), UNUSED);
+
+        for (uint32_t p = 0; p < passCount; p++)
+        {
+            for (const Pass::Use & use : passes[p]->uses)
+            {
+                uint32_t r = resource(use.image);
+                lifetimes[r].first = std::min(lifetimes[r].first, p);
+                lifetimes[r].second = std::max(lifetimes[r].second, p);
+            }
+        }
+
+        CompiledPass compiledPass;
+        compileAttachments(*passes[index], compiledPass, lifetimes, index);
+        return createRenderPass(*passes[index], compiledPass);
+    }
+
+    VkImage RenderGraph::image(const std::string & name) const
+    {
+        return handle(resource(name));
+    }
+
+    VkPipelineStageFlags RenderGraph::firstStage(const std::string & name) const
+    {
+        uint32_t r = resource(name);
+        if (r >= firstStages.size() || firstStages[r] == 0)
+        {
+            return VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        }
+        return firstStages[r];
+    }
+}
@@ -0,0 +1,160 @@
+#include <Renderer/renderQueue.h>
+
+#include <stdexcept>
+#include <sstream>
+
+namespace Renderer
+{
+
+    namespace
+    {
+        template <class Handle>
+        uint32_t assignId
+        (
+            HandleIds<Handle> & ids,
+            Handle handle,
+            uint32_t bits,
+            const char * what
+        )
+        {
+            uint32_t id = ids.assign(handle);
+            if (id >= (1u << bits))
+            {
+                throw std::runtime_error(std::string("Render queue out of ")+what+" ids, at most "+std::to_string(1u << bits)+" per frame");
+            }
+
+            return id;
+        }
+    }
+
+    std::string RenderQueueStats::report() const
+    {
+        std::stringstream ss;
+        ss << draws << " draws"
+           << ", pipeline binds " << pipelineBinds << " (" << pipelineBindsSkipped << " skipped)"
+           << ", descriptor binds " << descriptorBinds << " (" << descriptorBindsSkipped << " skipped)"
+           << ", vertex buffer binds " << vertexBufferBinds << " (" << vertexBufferBindsSkipped << " skipped)";
+        return ss.str();
+    }
+
+    void RenderQueue::submit(uint32_t layer, const DrawCommand & draw, float depth)
+    {
+        if (layer >= MAX_LAYERS)
+        {
+            throw std::runtime_error("Render queue layer "+std::to_string(layer)+" exceeds "+std::to_string(MAX_LAYERS-1));
+        }
+
+        uint64_t pipeline = assignId(pipelineIds, draw.pipeline, PIPELINE_BITS, "pipeline");
+        uint64_t material = assignId(materialIds, draw.material, MATERIAL_BITS, "material");
+
+        uint32_t depthBits = orderedFloatBits(depth);
+        if (backToFront[layer])
+        {
+            depthBits = ~depthBits;
+        }
+
+        uint64_t key = (uint64_t(layer) << (64-LAYER_BITS))
+                     | (pipeline << (32+MATERIAL_BITS))
+                     | (material << 32)
+                     | depthBits;
+
+        keys.push_back(key);
+        order.push_back(static_cast<uint32_t>(draws.size()));
+        draws.push_back(draw);
+    }
+
+    void RenderQueue::sort()
+    {
+        radixSort(keys, order, scratch, threads);
+    }
+
+    void RenderQueue::record(VkCommandBuffer commandBuffer)
+    {
+        stats = RenderQueueStats();
+
+        VkPipeline boundPipeline = VK_NULL_HANDLE;
+        VkPipelineLayout boundLayout = VK_NULL_HANDLE;
+        VkDescriptorSet boundMaterial = VK_NULL_HANDLE;
+        VkBuffer boundBuffer = VK_NULL_HANDLE;
+        VkDeviceSize boundOffset = 0;
+
+        for (uint32_t i : order)
+        {
+            const DrawCommand & draw = draws[i];
+
+            if (draw.pipeline != boundPipeline)
+            {
+                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, draw.pipeline);
+                boundPipeline = draw.pipeline;
+                stats.pipelineBinds++;
+            }
+            else
+            {
+                stats.pipelineBindsSkipped++;
+            }
+
+            if (draw.material != VK_NULL_HANDLE)
+            {
+                // an incompatible layout may disturb the set, so rebind on a layout change too
+                if (draw.material != boundMaterial || draw.layout != boundLayout)
+                {
+                    vkCmdBindDescriptorSets
+                    (
+                        commandBuffer,
+                        VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        draw.layout,
+                        materialSet,
+                        1,
+                        &draw.material,
+                        0,
+                        nullptr
+                    );
+                    boundMaterial = draw.material;
+                    stats.descriptorBinds++;
+                }
+                else
+                {
+                    stats.descriptorBindsSkipped++;
+                }
+            }
+
+            boundLayout = draw.layout;
+
+            if (draw.vertexBuffer != boundBuffer || draw.vertexOffset != boundOffset)
+            {
+                vkCmdBindVertexBuffers(commandBuffer, 0, 1, &draw.vertexBuffer, &draw.vertexOffset);
+                boundBuffer = draw.vertexBuffer;
+                boundOffset = draw.vertexOffset;
+                stats.vertexBufferBinds++;
+            }
+            else
+            {
+                stats.vertexBufferBindsSkipped++;
+            }
+
+            vkCmdPushConstants
+            (
+                commandBuffer,
+                draw.layout,
+                VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+                0,
+                sizeof(DrawPushConstants),
+                &draw.constants
+            );
+
+            // vertexCount, instanceCount, firstVertex, firstInstance
+            vkCmdDraw(commandBuffer, draw.vertexCount, 1, draw.firstVertex, 0);
+
+            stats.draws++;
+        }
+    }
+
+    void RenderQueue::clear()
+    {
+        draws.clear();
+        keys.clear();
+        order.clear();
+        pipelineIds.clear();
+        materialIds.clear();
+    }
+}
@@ -0,0 +1,910 @@
+#include <Renderer/textures.h>
+#include <Renderer/ktx.h>
+#include <Renderer/descriptors.h>
+
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <cctype>
+
+namespace Renderer
+{
+
+    namespace
+    {
+        // skip whitespace and # comments between PNM header fields
+        void skipPnmSpace(const uint8_t *& p, const uint8_t * end)
+        {
+            while (p < end)
+            {
+                if (*p == '#')
+                {
+                    while (p < end && *p != '\n')
+                    {
+                        p++;
+                    }
+                }
+                else if (std::isspace(*p))
+                {
+                    p++;
+                }
+                else
+                {
+                    return;
+                }
+            }
+        }
+
+        // 0 if there are no digits
+        uint32_t readPnmNumber(const uint8_t *& p, const uint8_t * end)
+        {
+            uint64_t value = 0;
+
+            while (p < end && std::isdigit(*p) && value <= UINT32_MAX)
+            {
+                value = value * 10 + (*p++ - '0');
+            }
+
+            return value > UINT32_MAX ? 0 : static_cast<uint32_t>(value);
+        }
+
+        VkDeviceSize align(VkDeviceSize offset, VkDeviceSize alignment)
+        {
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+    }
+
+    TextureData loadImage(const std::string & path)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Could not open image "+path);
+        }
+
+        std::vector<uint8_t> bytes(size_t(file.tellg()));
+        file.seekg(0);
+        file.read(reinterpret_cast<char *>(bytes.data()), bytes.size());
+
+        return decodeImage(bytes.data(), bytes.size(), path);
+    }
+
+    TextureData decodeImage(const uint8_t * bytes, size_t size, const std::string & name)
+    {
+        const uint8_t * p = bytes;
+        const uint8_t * end = bytes + size;
+
+        TextureData data;
+        std::string magic(reinterpret_cast<const char *>(bytes), std::min<size_t>(size, 2));
+        p += magic.size();
+
+        skipPnmSpace(p, end);
+        data.width = readPnmNumber(p, end);
+        skipPnmSpace(p, end);
+        data.height = readPnmNumber(p, end);
+        skipPnmSpace(p, end);
+        uint32_t maxValue = readPnmNumber(p, end);
+
+        // exactly one whitespace character before the pixels
+        bool separated = p < end && std::isspace(*p);
+
+        if (separated)
+        {
+            p++;
+        }
+
+        if (!separated || (magic != "P6" && magic != "P5") || maxValue == 0 || maxValue > 255 || data.width == 0 || data.height == 0)
+        {
+            throw std::runtime_error("Unsupported image "+name+", expected an 8 bit binary PPM or PGM");
+        }
+
+        size_t channels = magic == "P6" ? 3 : 1;
+        size_t texels = size_t(data.width) * data.height;
+
+        if (size_t(end - p) < texels * channels)
+        {
+            throw std::runtime_error("Image "+name+" is truncated");
+        }
+
+        const uint8_t * raw = p;
+        data.pixels.resize(texels * 4);
+
+        for (size_t i = 0; i < texels; i++)
+        {
+            for (size_t c = 0; c < 3; c++)
+            {
+                uint32_t value = raw[i * channels + (channels == 3 ? c : 0)];
+                data.pixels[i * 4 + c] = static_cast<uint8_t>(value * 255 / maxValue);
+            }
+
+            data.pixels[i * 4 + 3] = 255;
+        }
+
+        return data;
+    }
+
+    bool SamplerDescription::operator==(const SamplerDescription & other) const
+    {
+        return magFilter == other.magFilter
+            && minFilter == other.minFilter
+            && mipmapMode == other.mipmapMode
+            && addressMode == other.addressMode
+            && maxAnisotropy == other.maxAnisotropy;
+    }
+
+    size_t SamplerDescription::hash() const
+    {
+        // pack the small fields into one word
+        size_t packed = magFilter | (minFilter << 4) | (mipmapMode << 8) | (addressMode << 12);
+        size_t seed = std::hash<size_t>()(packed);
+        hashCombine(seed, std::hash<float>()(maxAnisotropy));
+        return seed;
+    }
+
+    SamplerCache::SamplerCache(VkPhysicalDevice physicalDevice, VkDevice d, bool anisotropy)
+    : device(d), anisotropySupported(anisotropy)
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        maxAnisotropy = properties.limits.maxSamplerAnisotropy;
+    }
+
+    SamplerCache::~SamplerCache()
+    {
+        for (auto & sampler : samplers)
+        {
+            vkDestroySampler(device, sampler.second, nullptr);
+        }
+    }
+
+    VkSampler SamplerCache::get(const SamplerDescription & description)
+    {
+        auto found = samplers.find(description);
+        if (found != samplers.end())
+        {
+            return found->second;
+        }
+
+        float anisotropy = anisotropySupported ? std::clamp(description.maxAnisotropy, 1.0f, maxAnisotropy) : 1.0f;
+
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = description.magFilter;
+        samplerInfo.minFilter = description.minFilter;
+        samplerInfo.mipmapMode = description.mipmapMode;
+        samplerInfo.addressModeU = description.addressMode;
+        samplerInfo.addressModeV = description.addressMode;
+        samplerInfo.addressModeW = description.addressMode;
+        samplerInfo.anisotropyEnable = anisotropy > 1.0f ? VK_TRUE : VK_FALSE;
+        samplerInfo.maxAnisotropy = anisotropy;
+        samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+        samplerInfo.unnormalizedCoordinates = VK_FALSE;
+        samplerInfo.compareEnable = VK_FALSE;
+        samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+        samplerInfo.mipLodBias = 0.0f;
+        samplerInfo.minLod = 0.0f;
+        // every level the image view has
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+        VkSampler sampler;
+        if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create sampler");
+        }
+
+        samplers[description] = sampler;
+        return sampler;
+    }
+
+    std::string TextureStats::report() const
+    {
+        std::stringstream ss;
+        ss << "textures " << textures
+           << ", " << uploads << " uploads in " << batches << " batches"
+           << ", " << compressed << " compressed, " << transcoded << " transcoded"
+           << ", " << uploadedBytes / (1024 * 1024) << " MiB"
+           << ", " << stagingStalls << " staging stalls";
+        return ss.str();
+    }
+
+    TextureManager::TextureManager
+    (
+        VkPhysicalDevice physicalDevice,
+        VkDevice device,
+        VkQueue queue,
+        uint32_t queueFamily,
+        DeletionQueue & deletionQueue,
+        MemoryBudget & budget,
+        BindlessTable * bindless,
+        bool anisotropy,
+        VkDeviceSize stagingSize
+    )
+    : physicalDevice(physicalDevice),
+      device(device),
+      queue(queue),
+      deletionQueue(deletionQueue),
+      budget(budget),
+      bindless(bindless),
+      stagingSize(stagingSize),
+      samplers(physicalDevice, device, anisotropy)
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        // also a multiple of every texel and block size, at most 16 bytes
+        copyAlignment = std::max(VkDeviceSize(16), properties.limits.optimalBufferCopyOffsetAlignment);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = queueFamily;
+
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create texture upload command pool");
+        }
+
+        for (Staging & slot : staging)
+        {
+            createBuffer
+            (
+                stagingSize,
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                slot.buffer,
+                slot.memory
+            );
+
+            // mapped for the manager's lifetime
+            void * mapped;
+            vkMapMemory(device, slot.memory, 0, stagingSize, 0, &mapped);
+            slot.mapped = static_cast<uint8_t *>(mapped);
+
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = commandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            allocInfo.commandBufferCount = 1;
+
+            if (vkAllocateCommandBuffers(device, &allocInfo, &slot.commandBuffer) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to allocate texture upload command buffer");
+            }
+
+            VkFenceCreateInfo fenceInfo{};
+            fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+            if (vkCreateFence(device, &fenceInfo, nullptr, &slot.fence) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create texture upload fence");
+            }
+        }
+    }
+
+    TextureManager::~TextureManager()
+    {
+        for (Staging & slot : staging)
+        {
+            if (slot.submitted)
+            {
+                vkWaitForFences(device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+            }
+
+            for (auto & buffer : slot.oversized)
+            {
+                vkDestroyBuffer(device, buffer.first, nullptr);
+                budget.free(buffer.second);
+            }
+
+            vkDestroyFence(device, slot.fence, nullptr);
+            vkDestroyBuffer(device, slot.buffer, nullptr);
+            budget.free(slot.memory);
+        }
+
+        vkDestroyCommandPool(device, commandPool, nullptr);
+
+        for (Texture & texture : textures)
+        {
+            if (texture.image == VK_NULL_HANDLE)
+            {
+                continue;
+            }
+
+            vkDestroyImageView(device, texture.view, nullptr);
+            vkDestroyImage(device, texture.image, nullptr);
+            budget.free(texture.memory);
+        }
+    }
+
+    TextureId TextureManager::load(const std::string & path, const SamplerDescription & sampler, bool mipmaps)
+    {
+        return create(loadImage(path), sampler, mipmaps);
+    }
+
+    TextureId TextureManager::loadCompressed(const std::string & path, const SamplerDescription & sampler)
+    {
+        Ktx2File file(path);
+
+        const std::vector<TextureLevel> & levels = file.getLevels();
+        VkFormat format = file.getFormat();
+
+        if (formatSupported(format))
+        {
+            // straight from the mapping into staging
+            TextureId id = create(format, file.getWidth(), file.getHeight(), levels, sampler);
+            stats.compressed++;
+            return id;
+        }
+
+        if (!canDecode(format))
+        {
+            throw std::runtime_error(path+" is in "+formatName(format)+", which the device cannot sample and has no CPU decoder");
+        }
+
+        std::vector<TextureData> decoded;
+        std::vector<TextureLevel> decodedLevels;
+        decoded.reserve(levels.size());
+
+        for (const TextureLevel & level : levels)
+        {
+            decoded.push_back(decodeBlocks(format, level.data, level.bytes, level.width, level.height));
+            decodedLevels.push_back({decoded.back().pixels.data(), decoded.back().pixels.size(), level.width, level.height});
+        }
+
+        TextureId id = create(decodedFormat(format), file.getWidth(), file.getHeight(), decodedLevels, sampler);
+        stats.transcoded++;
+        return id;
+    }
+
+    TextureId TextureManager::create(const TextureData & data, const SamplerDescription & sampler, bool mipmaps)
+    {
+        VkDeviceSize bytes = VkDeviceSize(data.width) * data.height * 4;
+
+        if (data.width == 0 || data.height == 0 || data.pixels.size() != bytes)
+        {
+            throw std::runtime_error("Texture data does not match its size");
+        }
+
+        VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+        uint32_t mipLevels = 1;
+
+        if (mipmaps && linearBlitSupported(format))
+        {
+            mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(data.width, data.height)))) + 1;
+        }
+
+        TextureId id = createTexture(format, data.width, data.height, mipLevels, mipLevels > 1, sampler);
+        stage(id, {{data.pixels.data(), data.pixels.size(), data.width, data.height}}, mipLevels > 1);
+        return id;
+    }
+
+    TextureId TextureManager::create
+    (
+        VkFormat format,
+        uint32_t width,
+        uint32_t height,
+        const std::vector<TextureLevel> & levels,
+        const SamplerDescription & sampler
+    )
+    {
+        if (levels.empty() || levels[0].width != width || levels[0].height != height)
+        {
+            throw std::runtime_error("Texture levels do not match its size");
+        }
+
+        TextureId id = createTexture(format, width, height, static_cast<uint32_t>(levels.size()), false, sampler);
+        stage(id, levels, false);
+        return id;
+    }
+
+    TextureId TextureManager::createTexture
+    (
+        VkFormat format,
+        uint32_t width,
+        uint32_t height,
+        uint32_t mipLevels,
+        bool blitMips,
+        const SamplerDescription & sampler
+    )
+    {
+        Texture texture;
+        texture.format = format;
+        texture.width = width;
+        texture.height = height;
+        texture.mipLevels = mipLevels;
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = {width, height, 1};
+        imageInfo.mipLevels = mipLevels;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = format;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        // levels are blitted from each other
+        imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
+                        | (blitMips ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0);
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateImage(device, &imageInfo, nullptr, &texture.image) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create texture image");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device, texture.image, &memRequirements);
+
+        try
+        {
+            texture.memory = budget.allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, "texture");
+        }
+        catch (...)
+        {
+            vkDestroyImage(device, texture.image, nullptr);
+            throw;
+        }
+
+        vkBindImageMemory(device, texture.image, texture.memory, 0);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = texture.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = format;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1};
+
+        if (vkCreateImageView(device, &viewInfo, nullptr, &texture.view) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create texture image view");
+        }
+
+        texture.sampler = samplers.get(sampler);
+
+        if (bindless)
+        {
+            // written now, not sampled before the upload is flushed
+            texture.handle = bindless->addTexture(texture.view, texture.sampler);
+        }
+
+        TextureId id;
+        if (!freeIds.empty())
+        {
+            id = freeIds.back();
+            freeIds.pop_back();
+            textures[id] = texture;
+        }
+        else
+        {
+            id = static_cast<TextureId>(textures.size());
+            textures.push_back(texture);
+        }
+
+        return id;
+    }
+
+    void TextureManager::stage(TextureId id, const std::vector<TextureLevel> & levels, bool generateMips)
+    {
+        // every level starts aligned for the copy
+        VkDeviceSize bytes = 0;
+        for (const TextureLevel & level : levels)
+        {
+            bytes = align(bytes, copyAlignment) + level.bytes;
+        }
+
+        Staging * slot = &staging[current];
+        if (slot->submitted)
+        {
+            reclaim(*slot);
+        }
+
+        Upload upload;
+        upload.id = id;
+        upload.generateMips = generateMips;
+
+        uint8_t * dst;
+        VkDeviceSize offset = align(slot->used, copyAlignment);
+
+        if (bytes > stagingSize)
+        {
+            VkDeviceMemory memory;
+
+            createBuffer
+            (
+                bytes,
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                upload.buffer,
+                memory
+            );
+
+            // unmapped when freed
+            void * mapped;
+            vkMapMemory(device, memory, 0, bytes, 0, &mapped);
+            dst = static_cast<uint8_t *>(mapped);
+
+            slot->oversized.push_back({upload.buffer, memory});
+            offset = 0;
+        }
+        else
+        {
+            if (offset + bytes > stagingSize)
+            {
+                // full, send what is there and fill the other
+                flush();
+
+                slot = &staging[current];
+                if (slot->submitted)
+                {
+                    reclaim(*slot);
+                }
+
+                offset = 0;
+            }
+
+            upload.buffer = slot->buffer;
+            dst = slot->mapped;
+            slot->used = offset + bytes;
+        }
+
+        for (uint32_t level = 0; level < levels.size(); level++)
+        {
+            offset = align(offset, copyAlignment);
+            std::memcpy(dst + offset, levels[level].data, levels[level].bytes);
+
+            VkBufferImageCopy region{};
+            region.bufferOffset = offset;
+            // tightly packed
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+            region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+            region.imageOffset = {0, 0, 0};
+            region.imageExtent = {levels[level].width, levels[level].height, 1};
+            upload.regions.push_back(region);
+
+            offset += levels[level].bytes;
+        }
+
+        slot->uploads.push_back(upload);
+
+        stats.uploads++;
+        stats.uploadedBytes += bytes;
+    }
+
+    void TextureManager::destroy(TextureId id, uint64_t lastUsed)
+    {
+        Texture & texture = textures.at(id);
+
+        if (texture.image == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        // never flushed, nothing to copy into
+        std::vector<Upload> & uploads = staging[current].uploads;
+        uploads.erase
+        (
+            std::remove_if(uploads.begin(), uploads.end(), [id](const Upload & u) { return u.id == id; }),
+            uploads.end()
+        );
+
+        if (bindless && texture.handle != INVALID_BINDLESS_HANDLE)
+        {
+            bindless->removeTexture(texture.handle);
+        }
+
+        VkDevice d = device;
+        MemoryBudget * b = &budget;
+        Texture retired = texture;
+        deletionQueue.push
+        (
+            lastUsed,
+            [d, b, retired]()
+            {
+                vkDestroyImageView(d, retired.view, nullptr);
+                vkDestroyImage(d, retired.image, nullptr);
+                b->free(retired.memory);
+            }
+        );
+
+        texture = Texture();
+        freeIds.push_back(id);
+    }
+
+    void TextureManager::flush()
+    {
+        Staging & slot = staging[current];
+
+        if (slot.uploads.empty())
+        {
+            return;
+        }
+
+        vkResetCommandBuffer(slot.commandBuffer, 0);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkBeginCommandBuffer(slot.commandBuffer, &beginInfo);
+
+        recordUploads(slot);
+
+        vkEndCommandBuffer(slot.commandBuffer);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &slot.commandBuffer;
+
+        if (vkQueueSubmit(queue, 1, &submitInfo, slot.fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to submit texture uploads");
+        }
+
+        slot.submitted = true;
+        slot.uploads.clear();
+        stats.batches++;
+
+        current = (current + 1) % STAGING_BUFFERS;
+    }
+
+    void TextureManager::reclaim(Staging & slot)
+    {
+        if (vkGetFenceStatus(device, slot.fence) != VK_SUCCESS)
+        {
+            stats.stagingStalls++;
+            vkWaitForFences(device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+        }
+
+        vkResetFences(device, 1, &slot.fence);
+
+        for (auto & buffer : slot.oversized)
+        {
+            vkDestroyBuffer(device, buffer.first, nullptr);
+            budget.free(buffer.second);
+        }
+
+        slot.oversized.clear();
+        slot.used = 0;
+        slot.submitted = false;
+    }
+
+    void TextureManager::recordUploads(Staging & slot)
+    {
+        VkCommandBuffer commandBuffer = slot.commandBuffer;
+
+        std::vector<VkImageMemoryBarrier> barriers;
+        barriers.reserve(slot.uploads.size());
+
+        for (const Upload & upload : slot.uploads)
+        {
+            const Texture & texture = textures[upload.id];
+
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = texture.image;
+            barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, texture.mipLevels, 0, 1};
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barriers.push_back(barrier);
+        }
+
+        vkCmdPipelineBarrier
+        (
+            commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            0, nullptr,
+            0, nullptr,
+            static_cast<uint32_t>(barriers.size()), barriers.data()
+        );
+
+        for (const Upload & upload : slot.uploads)
+        {
+            const Texture & texture = textures[upload.id];
+
+            vkCmdCopyBufferToImage
+            (
+                commandBuffer,
+                upload.buffer,
+                texture.image,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                static_cast<uint32_t>(upload.regions.size()),
+                upload.regions.data()
+            );
+        }
+
+        recordMips(commandBuffer, slot.uploads);
+    }
+
+    void TextureManager::recordMips(VkCommandBuffer commandBuffer, const std::vector<Upload> & uploads)
+    {
+        uint32_t maxLevels = 1;
+        for (const Upload & upload : uploads)
+        {
+            if (upload.generateMips)
+            {
+                maxLevels = std::max(maxLevels, textures[upload.id].mipLevels);
+            }
+        }
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+        std::vector<VkImageMemoryBarrier> barriers;
+
+        // level by level across every texture, one barrier per level
+        for (uint32_t level = 1; level < maxLevels; level++)
+        {
+            barriers.clear();
+
+            for (const Upload & upload : uploads)
+            {
+                const Texture & texture = textures[upload.id];
+                if (!upload.generateMips || level >= texture.mipLevels) { continue; }
+
+                // the level above was just written, read it
+                barrier.image = texture.image;
+                barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level-1, 1, 0, 1};
+                barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+                barriers.push_back(barrier);
+            }
+
+            vkCmdPipelineBarrier
+            (
+                commandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                0,
+                0, nullptr,
+                0, nullptr,
+                static_cast<uint32_t>(barriers.size()), barriers.data()
+            );
+
+            for (const Upload & upload : uploads)
+            {
+                const Texture & texture = textures[upload.id];
+                if (!upload.generateMips || level >= texture.mipLevels) { continue; }
+
+                int32_t srcWidth = std::max(1u, texture.width >> (level-1));
+                int32_t srcHeight = std::max(1u, texture.height >> (level-1));
+                int32_t dstWidth = std::max(1u, texture.width >> level);
+                int32_t dstHeight = std::max(1u, texture.height >> level);
+
+                VkImageBlit blit{};
+                blit.srcOffsets[0] = {0, 0, 0};
+                blit.srcOffsets[1] = {srcWidth, srcHeight, 1};
+                blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level-1, 0, 1};
+                blit.dstOffsets[0] = {0, 0, 0};
+                blit.dstOffsets[1] = {dstWidth, dstHeight, 1};
+                blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+
+                vkCmdBlitImage
+                (
+                    commandBuffer,
+                    texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                    texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    1, &blit,
+                    VK_FILTER_LINEAR
+                );
+            }
+        }
+
+        // blitted from levels are TRANSFER_SRC, the last written (or every
+        //  copied level) TRANSFER_DST
+        barriers.clear();
+
+        for (const Upload & upload : uploads)
+        {
+            const Texture & texture = textures[upload.id];
+            uint32_t last = upload.generateMips ? texture.mipLevels-1 : 0;
+
+            barrier.image = texture.image;
+            barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+            if (last > 0)
+            {
+                barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, last, 0, 1};
+                barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+                barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+                barriers.push_back(barrier);
+            }
+
+            barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, last, texture.mipLevels-last, 0, 1};
+            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barriers.push_back(barrier);
+        }
+
+        vkCmdPipelineBarrier
+        (
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0,
+            0, nullptr,
+            0, nullptr,
+            static_cast<uint32_t>(barriers.size()), barriers.data()
+        );
+    }
+
+    bool TextureManager::formatSupported(VkFormat format) const
+    {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+        VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+
+        return (properties.optimalTilingFeatures & needed) == needed;
+    }
+
+    bool TextureManager::linearBlitSupported(VkFormat format)
+    {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+        VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+        return (properties.optimalTilingFeatures & needed) == needed;
+    }
+
+    TextureStats TextureManager::getStats() const
+    {
+        TextureStats current = stats;
+        current.textures = static_cast<uint32_t>(textures.size() - freeIds.size());
+        return current;
+    }
+
+    void TextureManager::createBuffer
+    (
+        VkDeviceSize size,
+        VkBufferUsageFlags usage,
+        VkMemoryPropertyFlags properties,
+        VkBuffer & buffer,
+        VkDeviceMemory & memory
+    )
+    {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create staging buffer");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+        try
+        {
+            // out of BAR memory, the GPU reads it once
+            memory = budget.allocate(memRequirements, properties, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "texture staging");
+        }
+        catch (...)
+        {
+            vkDestroyBuffer(device, buffer, nullptr);
+            throw;
+        }
+
+        vkBindBufferMemory(device, buffer, memory, 0);
+    }
+}
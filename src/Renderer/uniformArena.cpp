@@ -0,0 +1,155 @@
+#include <Renderer/uniformArena.h>
+
+#include <stdexcept>
+#include <sstream>
+#include <algorithm>
+
+namespace Renderer
+{
+
+    namespace
+    {
+        // alignment is a power of two
+        VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+        {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+    }
+
+    std::string UniformArenaStats::report() const
+    {
+        std::stringstream ss;
+        ss << "uniforms " << used / 1024 << "/" << capacity / 1024 << " KiB in " << slices << " slices"
+           << ", peak " << peak / 1024 << " KiB"
+           << (coherent ? ", coherent" : ", " + std::to_string(flushes) + " flushes");
+        return ss.str();
+    }
+
+    UniformArena::UniformArena
+    (
+        VkPhysicalDevice physicalDevice,
+        VkDevice device,
+        MemoryBudget & budget,
+        unsigned framesInFlight,
+        VkDeviceSize bytesPerFrame
+    )
+    : device(device),
+      budget(budget),
+      frames(std::max(1u, framesInFlight))
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        alignment = std::max(VkDeviceSize(16), properties.limits.minUniformBufferOffsetAlignment);
+        atomSize = std::max(VkDeviceSize(1), properties.limits.nonCoherentAtomSize);
+
+        // every region starts on both, so its slices and flushes line up
+        regionSize = alignUp(bytesPerFrame, std::max(alignment, atomSize));
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = regionSize * frames;
+        bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create uniform arena");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+        try
+        {
+            // write combined, the CPU never reads it back
+            memory = budget.allocate
+            (
+                memRequirements,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                "uniform arena"
+            );
+        }
+        catch (...)
+        {
+            vkDestroyBuffer(device, buffer, nullptr);
+            throw;
+        }
+
+        vkBindBufferMemory(device, buffer, memory, 0);
+
+        void * data;
+        vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data);
+        mapped = static_cast<uint8_t *>(data);
+
+        stats.capacity = regionSize;
+        stats.coherent = budget.properties(memory) & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    }
+
+    UniformArena::~UniformArena()
+    {
+        vkDestroyBuffer(device, buffer, nullptr);
+        // unmapped when freed
+        budget.free(memory);
+    }
+
+    void UniformArena::begin(unsigned frameIndex)
+    {
+        frame = frameIndex % frames;
+        used = 0;
+        flushed = 0;
+        stats.slices = 0;
+    }
+
+    UniformSlice UniformArena::allocate(VkDeviceSize size)
+    {
+        VkDeviceSize offset = alignUp(used, alignment);
+
+        if (offset + size > regionSize)
+        {
+            throw std::runtime_error
+            (
+                "Uniform arena is full, "+std::to_string(size)+" bytes asked for with "
+                +std::to_string(regionSize - std::min(offset, regionSize))+" of "+std::to_string(regionSize)+" left"
+            );
+        }
+
+        used = offset + size;
+
+        stats.used = used;
+        stats.peak = std::max(stats.peak, used);
+        stats.slices++;
+
+        UniformSlice slice;
+        slice.buffer = buffer;
+        slice.offset = frame * regionSize + offset;
+        slice.size = size;
+        slice.data = mapped + slice.offset;
+        return slice;
+    }
+
+    void UniformArena::flush()
+    {
+        if (stats.coherent || used <= flushed)
+        {
+            return;
+        }
+
+        // whole atoms, within the region as it is a multiple of them
+        VkDeviceSize start = flushed & ~(atomSize - 1);
+        VkDeviceSize end = std::min(alignUp(used, atomSize), regionSize);
+
+        VkMappedMemoryRange range{};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = memory;
+        range.offset = frame * regionSize + start;
+        range.size = end - start;
+
+        vkFlushMappedMemoryRanges(device, 1, &range);
+
+        flushed = used;
+        stats.flushes++;
+    }
+}
@@ -0,0 +1,1202 @@
+#include <Renderer/virtualTexture.h>
+
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+
+namespace Renderer
+{
+
+    namespace
+    {
+        const char PAGE_FILE_MAGIC[4] = {'J', 'V', 'T', '1'};
+        // magic, width, height, page size, border, levels
+        const size_t PAGE_FILE_HEADER = 24;
+
+        const uint32_t NO_SLOT = UINT32_MAX;
+
+        // 12 bits each of slot and feedback page coordinates
+        const uint32_t MAX_COORDINATE = 4096;
+
+        const VkFormat PAGE_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+
+        VkDeviceSize align(VkDeviceSize offset, VkDeviceSize alignment)
+        {
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+
+        // 2x2 box filter, the last row or column is repeated for odd sizes
+        TextureData halve(const TextureData & src)
+        {
+            TextureData dst;
+            dst.width = std::max(1u, src.width / 2);
+            dst.height = std::max(1u, src.height / 2);
+            dst.pixels.resize(size_t(dst.width) * dst.height * 4);
+
+            for (uint32_t y = 0; y < dst.height; y++)
+            {
+                uint32_t y0 = std::min(2 * y, src.height - 1);
+                uint32_t y1 = std::min(2 * y + 1, src.height - 1);
+
+                for (uint32_t x = 0; x < dst.width; x++)
+                {
+                    uint32_t x0 = std::min(2 * x, src.width - 1);
+                    uint32_t x1 = std::min(2 * x + 1, src.width - 1);
+
+                    for (uint32_t c = 0; c < 4; c++)
+                    {
+                        uint32_t sum = src.pixels[(size_t(y0) * src.width + x0) * 4 + c]
+                                     + src.pixels[(size_t(y0) * src.width + x1) * 4 + c]
+                                     + src.pixels[(size_t(y1) * src.width + x0) * 4 + c]
+                                     + src.pixels[(size_t(y1) * src.width + x1) * 4 + c];
+
+                        dst.pixels[(size_t(y) * dst.width + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+                    }
+                }
+            }
+
+            return dst;
+        }
+    }
+
+    std::string VirtualTextureStats::report() const
+    {
+        std::stringstream ss;
+        ss << "virtual texture " << (sparse ? "sparse" : "atlas")
+           << ", " << resident << "/" << capacity << " pages resident"
+           << " (" << residentBytes / (1024 * 1024) << " MiB)"
+           << ", " << pending << " pending"
+           << ", " << loaded << " loaded"
+           << ", " << evicted << " evicted"
+           << ", " << dropped << " dropped";
+        return ss.str();
+    }
+
+    void VirtualTexture::bake(const std::string & imagePath, const std::string & pageFile, uint32_t pageSize, uint32_t border)
+    {
+        if (pageSize == 0 || border >= pageSize)
+        {
+            throw std::runtime_error("Virtual texture pages must be larger than their border");
+        }
+
+        std::vector<TextureData> chain;
+        chain.push_back(loadImage(imagePath));
+
+        // down to a level that fits in one page
+        while (chain.back().width > pageSize || chain.back().height > pageSize)
+        {
+            chain.push_back(halve(chain.back()));
+        }
+
+        std::ofstream out(pageFile, std::ios::binary);
+
+        if (!out.is_open())
+        {
+            throw std::runtime_error("Could not write "+pageFile);
+        }
+
+        uint32_t header[5] = {chain[0].width, chain[0].height, pageSize, border, static_cast<uint32_t>(chain.size())};
+        out.write(PAGE_FILE_MAGIC, sizeof(PAGE_FILE_MAGIC));
+        out.write(reinterpret_cast<const char *>(header), sizeof(header));
+
+        uint32_t stride = pageSize + 2 * border;
+        std::vector<uint8_t> page(size_t(stride) * stride * 4);
+
+        for (const TextureData & level : chain)
+        {
+            uint32_t pagesX = (level.width + pageSize - 1) / pageSize;
+            uint32_t pagesY = (level.height + pageSize - 1) / pageSize;
+
+            for (uint32_t py = 0; py < pagesY; py++)
+            {
+                for (uint32_t px = 0; px < pagesX; px++)
+                {
+                    // borders (and anything past the edge) repeat the edge texels
+                    for (uint32_t ty = 0; ty < stride; ty++)
+                    {
+                        int64_t sy = std::clamp<int64_t>(int64_t(py) * pageSize + ty - border, 0, level.height - 1);
+
+                        for (uint32_t tx = 0; tx < stride; tx++)
+                        {
+                            int64_t sx = std::clamp<int64_t>(int64_t(px) * pageSize + tx - border, 0, level.width - 1);
+                            std::memcpy(&page[(size_t(ty) * stride + tx) * 4], &level.pixels[(size_t(sy) * level.width + sx) * 4], 4);
+                        }
+                    }
+
+                    out.write(reinterpret_cast<const char *>(page.data()), page.size());
+                }
+            }
+        }
+
+        if (!out.good())
+        {
+            throw std::runtime_error("Could not write "+pageFile);
+        }
+    }
+
+    bool VirtualTexture::sparseSupported(VkPhysicalDevice physicalDevice, uint32_t queueFamily)
+    {
+        VkPhysicalDeviceFeatures features;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+
+        if (!features.sparseBinding || !features.sparseResidencyImage2D)
+        {
+            return false;
+        }
+
+        uint32_t count;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &count, nullptr);
+
+        std::vector<VkQueueFamilyProperties> families(count);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &count, families.data());
+
+        return queueFamily < count && (families[queueFamily].queueFlags & VK_QUEUE_SPARSE_BINDING_BIT);
+    }
+
+    VirtualTexture::VirtualTexture
+    (
+        VkPhysicalDevice physicalDevice,
+        VkDevice device,
+        VkQueue queue,
+        uint32_t queueFamily,
+        MemoryBudget & budget,
+        BindlessTable * bindless,
+        SamplerCache & samplers,
+        const std::string & pageFile,
+        uint32_t atlasPages,
+        bool allowSparse,
+        uint32_t uploadsPerUpdate
+    )
+    : physicalDevice(physicalDevice),
+      device(device),
+      queue(queue),
+      budget(budget),
+      bindless(bindless),
+      file(pageFile),
+      atlasPages(atlasPages),
+      uploadsPerUpdate(std::max(1u, uploadsPerUpdate))
+    {
+        const uint8_t * data = file.data();
+
+        if (file.size() < PAGE_FILE_HEADER || std::memcmp(data, PAGE_FILE_MAGIC, sizeof(PAGE_FILE_MAGIC)) != 0)
+        {
+            throw std::runtime_error(pageFile+" is not a virtual texture page file");
+        }
+
+        uint32_t header[5];
+        std::memcpy(header, data + sizeof(PAGE_FILE_MAGIC), sizeof(header));
+
+        width = header[0];
+        height = header[1];
+        pageSize = header[2];
+        border = header[3];
+        uint32_t levelCount = header[4];
+
+        if (width == 0 || height == 0 || pageSize == 0 || border >= pageSize || levelCount == 0 || levelCount > 24)
+        {
+            throw std::runtime_error(pageFile+" has an invalid header");
+        }
+
+        pageStride = pageSize + 2 * border;
+        pageBytes = VkDeviceSize(pageStride) * pageStride * 4;
+
+        uint64_t pages = 0;
+        for (uint32_t i = 0; i < levelCount; i++)
+        {
+            Level level;
+            level.width = std::max(1u, width >> i);
+            level.height = std::max(1u, height >> i);
+            level.pagesX = (level.width + pageSize - 1) / pageSize;
+            level.pagesY = (level.height + pageSize - 1) / pageSize;
+            level.firstPage = pages;
+
+            if (level.pagesX >= MAX_COORDINATE || level.pagesY >= MAX_COORDINATE)
+            {
+                throw std::runtime_error(pageFile+" has more pages per row than feedback can address");
+            }
+
+            pages += uint64_t(level.pagesX) * level.pagesY;
+            levels.push_back(level);
+        }
+
+        if (levels.back().pagesX != 1 || levels.back().pagesY != 1 || file.size() < PAGE_FILE_HEADER + pages * pageBytes)
+        {
+            throw std::runtime_error(pageFile+" is truncated or its last level is not one page");
+        }
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        // slot coordinates share the page table entry
+        uint32_t maxPages = std::min(properties.limits.maxImageDimension2D / pageStride, MAX_COORDINATE - 1);
+        this->atlasPages = std::clamp(atlasPages, 1u, maxPages);
+
+        mipTailFirstLevel = static_cast<uint32_t>(levels.size());
+
+        sparse = allowSparse && sparseSupported(physicalDevice, queueFamily) && createSparseImage();
+
+        if (!sparse)
+        {
+            createImage();
+        }
+
+        SamplerDescription samplerDescription;
+        samplerDescription.addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler = samplers.get(samplerDescription);
+
+        createPageTable();
+
+        loadPinned();
+
+        uint32_t slots = this->atlasPages * this->atlasPages;
+        for (uint32_t slot = slots; slot-- > 0;)
+        {
+            freeSlots.push_back(slot);
+        }
+
+        stats.capacity = slots;
+        stats.sparse = sparse;
+
+        // the first update stages the pinned pages as well as the usual uploads
+        stagingPages = static_cast<uint32_t>(initial.size()) + this->uploadsPerUpdate;
+
+        // pages, then the header (first update only) and page table entries (new and evicted per page)
+        VkDeviceSize tableBytes = (PAGE_TABLE_HEADER + 4 * levels.size()) * sizeof(uint32_t)
+                                + VkDeviceSize(stagingPages) * 2 * sizeof(uint32_t);
+
+        stagingSize = VkDeviceSize(stagingPages) * pageBytes + tableBytes;
+
+        createBuffer
+        (
+            stagingSize,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            staging,
+            stagingMemory,
+            0,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+        );
+
+        void * mapped;
+        vkMapMemory(device, stagingMemory, 0, stagingSize, 0, &mapped);
+        stagingMapped = static_cast<uint8_t *>(mapped);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamily;
+
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create virtual texture command pool");
+        }
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+
+        if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate virtual texture command buffer");
+        }
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        if
+        (
+            vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS ||
+            vkCreateSemaphore(device, &semaphoreInfo, nullptr, &bound) != VK_SUCCESS
+        )
+        {
+            throw std::runtime_error("Failed to create virtual texture sync objects");
+        }
+
+        if (bindless)
+        {
+            textureHandle = bindless->addTexture(view, sampler);
+            pageTableHandle = bindless->addBuffer(pageTable);
+        }
+
+        io = std::thread(&VirtualTexture::reader, this);
+    }
+
+    VirtualTexture::~VirtualTexture()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        work.notify_all();
+        io.join();
+
+        if (submitted)
+        {
+            vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+        }
+
+        if (bindless)
+        {
+            bindless->removeTexture(textureHandle);
+            bindless->removeBuffer(pageTableHandle);
+        }
+
+        for (Feedback & f : feedback)
+        {
+            vkDestroyBuffer(device, f.buffer, nullptr);
+            budget.free(f.memory);
+        }
+
+        vkDestroySemaphore(device, bound, nullptr);
+        vkDestroyFence(device, fence, nullptr);
+        vkDestroyCommandPool(device, commandPool, nullptr);
+
+        vkDestroyBuffer(device, staging, nullptr);
+        budget.free(stagingMemory);
+
+        vkDestroyBuffer(device, pageTable, nullptr);
+        budget.free(pageTableMemory);
+
+        vkDestroyImageView(device, view, nullptr);
+        // sparse bindings go with the image
+        vkDestroyImage(device, image, nullptr);
+        budget.free(memory);
+
+        budget.free(mipTailMemory);
+    }
+
+    const uint8_t * VirtualTexture::pageData(uint64_t k) const
+    {
+        const Level & level = levels[keyLevel(k)];
+        uint64_t page = level.firstPage + uint64_t(keyY(k)) * level.pagesX + keyX(k);
+        return file.data() + PAGE_FILE_HEADER + page * pageBytes;
+    }
+
+    void VirtualTexture::createImage()
+    {
+        uint32_t size = atlasPages * pageStride;
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = {size, size, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = PAGE_FORMAT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create virtual texture atlas");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+        memory = budget.allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, "virtual texture atlas");
+
+        vkBindImageMemory(device, image, memory, 0);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = PAGE_FORMAT;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+        if (vkCreateImageView(device, &viewInfo, nullptr, &view) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create virtual texture atlas view");
+        }
+
+        slotBytes = pageBytes;
+    }
+
+    bool VirtualTexture::createSparseImage()
+    {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        if (width > properties.limits.maxImageDimension2D || height > properties.limits.maxImageDimension2D)
+        {
+            return false;
+        }
+
+        VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+        uint32_t count = 0;
+        vkGetPhysicalDeviceSparseImageFormatProperties
+        (
+            physicalDevice, PAGE_FORMAT, VK_IMAGE_TYPE_2D, VK_SAMPLE_COUNT_1_BIT, usage, VK_IMAGE_TILING_OPTIMAL, &count, nullptr
+        );
+
+        std::vector<VkSparseImageFormatProperties> formats(count);
+        vkGetPhysicalDeviceSparseImageFormatProperties
+        (
+            physicalDevice, PAGE_FORMAT, VK_IMAGE_TYPE_2D, VK_SAMPLE_COUNT_1_BIT, usage, VK_IMAGE_TILING_OPTIMAL, &count, formats.data()
+        );
+
+        // a page must be exactly one sparse block
+        bool matches = count > 0
+                    && formats[0].imageGranularity.width == pageSize
+                    && formats[0].imageGranularity.height == pageSize;
+
+        if (!matches)
+        {
+            return false;
+        }
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.flags = VK_IMAGE_CREATE_SPARSE_BINDING_BIT | VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.extent = {width, height, 1};
+        imageInfo.mipLevels = static_cast<uint32_t>(levels.size());
+        imageInfo.arrayLayers = 1;
+        imageInfo.format = PAGE_FORMAT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageInfo.usage = usage;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateImage(device, &imageInfo, nullptr, &image) != VK_SUCCESS)
+        {
+            image = VK_NULL_HANDLE;
+            return false;
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+        uint32_t requirementCount = 0;
+        vkGetImageSparseMemoryRequirements(device, image, &requirementCount, nullptr);
+        std::vector<VkSparseImageMemoryRequirements> requirements(requirementCount);
+        vkGetImageSparseMemoryRequirements(device, image, &requirementCount, requirements.data());
+
+        if (requirementCount == 0)
+        {
+            vkDestroyImage(device, image, nullptr);
+            image = VK_NULL_HANDLE;
+            return false;
+        }
+
+        mipTailFirstLevel = std::min(requirements[0].imageMipTailFirstLod, static_cast<uint32_t>(levels.size()));
+        mipTailOffset = requirements[0].imageMipTailOffset;
+        mipTailSize = requirements[0].imageMipTailSize;
+
+        slotBytes = align(VkDeviceSize(pageSize) * pageSize * 4, memRequirements.alignment);
+        VkDeviceSize poolBytes = slotBytes * atlasPages * atlasPages;
+        uint32_t typeIndex = budget.findMemoryType
+        (
+            memRequirements.memoryTypeBits,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            0,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+            poolBytes
+        );
+
+        // the whole physical page pool, pages are bound into it
+        memory = budget.allocate(poolBytes, typeIndex, "virtual texture page pool");
+
+        if (mipTailFirstLevel < levels.size() && mipTailSize > 0)
+        {
+            mipTailMemory = budget.allocate(align(mipTailSize, memRequirements.alignment), typeIndex, "virtual texture mip tail");
+
+            // bound once, it holds the pinned levels
+            VkSparseMemoryBind tailBind{};
+            tailBind.resourceOffset = mipTailOffset;
+            tailBind.size = mipTailSize;
+            tailBind.memory = mipTailMemory;
+            tailBind.memoryOffset = 0;
+
+            VkSparseImageOpaqueMemoryBindInfo opaqueInfo{};
+            opaqueInfo.image = image;
+            opaqueInfo.bindCount = 1;
+            opaqueInfo.pBinds = &tailBind;
+
+            VkBindSparseInfo bindInfo{};
+            bindInfo.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO;
+            bindInfo.imageOpaqueBindCount = 1;
+            bindInfo.pImageOpaqueBinds = &opaqueInfo;
+
+            vkQueueBindSparse(queue, 1, &bindInfo, VK_NULL_HANDLE);
+            vkQueueWaitIdle(queue);
+        }
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = PAGE_FORMAT;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, static_cast<uint32_t>(levels.size()), 0, 1};
+
+        if (vkCreateImageView(device, &viewInfo, nullptr, &view) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create virtual texture view");
+        }
+
+        return true;
+    }
+
+    void VirtualTexture::createPageTable()
+    {
+        uint64_t entries = levels.back().firstPage + 1;
+        VkDeviceSize size = (PAGE_TABLE_HEADER + 4 * levels.size() + entries) * sizeof(uint32_t);
+
+        createBuffer
+        (
+            size,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            pageTable,
+            pageTableMemory,
+            0,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+        );
+    }
+
+    void VirtualTexture::loadPinned()
+    {
+        // the coarsest level, and with sparse residency every level in the mip tail
+        uint32_t first = std::min(mipTailFirstLevel, static_cast<uint32_t>(levels.size()) - 1);
+
+        for (uint32_t l = first; l < levels.size(); l++)
+        {
+            for (uint32_t y = 0; y < levels[l].pagesY; y++)
+            {
+                for (uint32_t x = 0; x < levels[l].pagesX; x++)
+                {
+                    uint64_t k = key(l, x, y);
+                    const uint8_t * data = pageData(k);
+                    initial.push_back({k, std::vector<uint8_t>(data, data + pageBytes)});
+                }
+            }
+        }
+    }
+
+    void VirtualTexture::reader()
+    {
+        while (true)
+        {
+            uint64_t k;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                work.wait(lock, [&]() { return stopping || !requests.empty(); });
+
+                if (stopping)
+                {
+                    return;
+                }
+
+                k = requests.top().second;
+                requests.pop();
+            }
+
+            // page faults on the mapping are the disk reads, taken here
+            const uint8_t * data = pageData(k);
+            Loaded page{k, std::vector<uint8_t>(data, data + pageBytes)};
+
+            std::lock_guard<std::mutex> lock(mutex);
+            loaded.push_back(std::move(page));
+        }
+    }
+
+    void VirtualTexture::request(uint32_t level, uint32_t x, uint32_t y)
+    {
+        if (level >= levels.size() || x >= levels[level].pagesX || y >= levels[level].pagesY)
+        {
+            return;
+        }
+
+        std::vector<uint64_t> missing;
+
+        for (uint32_t l = level; l < levels.size(); l++, x /= 2, y /= 2)
+        {
+            uint64_t k = key(l, x, y);
+            auto found = resident.find(k);
+
+            if (found == resident.end())
+            {
+                missing.push_back(k);
+                continue;
+            }
+
+            if (!found->second.pinned)
+            {
+                found->second.lastUsed = currentFrame;
+                lru.splice(lru.begin(), lru, found->second.lru);
+            }
+        }
+
+        if (missing.empty())
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (uint64_t k : missing)
+        {
+            if (pending.insert(k).second)
+            {
+                // larger first, coarser levels then earlier requests
+                const uint64_t SEQUENCE_MASK = (uint64_t(1) << 40) - 1;
+                uint64_t priority = (uint64_t(keyLevel(k)) << 40) | (SEQUENCE_MASK - (requestSequence++ & SEQUENCE_MASK));
+                requests.push({priority, k});
+            }
+        }
+
+        work.notify_one();
+    }
+
+    void VirtualTexture::requestRegion(float u0, float v0, float u1, float v1, uint32_t level)
+    {
+        level = std::min(level, static_cast<uint32_t>(levels.size()) - 1);
+        const Level & l = levels[level];
+
+        auto page = [&](float t, uint32_t size, uint32_t pages)
+        {
+            uint32_t texel = static_cast<uint32_t>(std::clamp(t, 0.0f, 1.0f) * size);
+            return std::min(texel / pageSize, pages - 1);
+        };
+
+        uint32_t x0 = page(std::min(u0, u1), l.width, l.pagesX);
+        uint32_t x1 = page(std::max(u0, u1), l.width, l.pagesX);
+        uint32_t y0 = page(std::min(v0, v1), l.height, l.pagesY);
+        uint32_t y1 = page(std::max(v0, v1), l.height, l.pagesY);
+
+        for (uint32_t y = y0; y <= y1; y++)
+        {
+            for (uint32_t x = x0; x <= x1; x++)
+            {
+                request(level, x, y);
+            }
+        }
+    }
+
+    void VirtualTexture::recordFeedbackCopy(VkCommandBuffer commandBuffer, VkImage feedbackImage, VkExtent2D extent, uint32_t slot)
+    {
+        if (slot >= feedback.size())
+        {
+            feedback.resize(slot + 1);
+        }
+
+        Feedback & f = feedback[slot];
+        VkDeviceSize texels = VkDeviceSize(extent.width) * extent.height;
+
+        if (f.buffer == VK_NULL_HANDLE || f.texels < texels)
+        {
+            // the slot's last copy has completed, its fence was waited on
+            if (f.buffer != VK_NULL_HANDLE)
+            {
+                vkDestroyBuffer(device, f.buffer, nullptr);
+                budget.free(f.memory);
+            }
+
+            createBuffer
+            (
+                texels * sizeof(uint32_t),
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                f.buffer,
+                f.memory,
+                // read back by the CPU, uncached reads are slow
+                VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+            );
+
+            void * mapped;
+            vkMapMemory(device, f.memory, 0, texels * sizeof(uint32_t), 0, &mapped);
+            f.mapped = static_cast<uint32_t *>(mapped);
+        }
+
+        f.texels = texels;
+
+        VkBufferImageCopy region{};
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageExtent = {extent.width, extent.height, 1};
+
+        vkCmdCopyImageToBuffer(commandBuffer, feedbackImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, f.buffer, 1, &region);
+
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = f.buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+
+        vkCmdPipelineBarrier
+        (
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT,
+            0,
+            0, nullptr,
+            1, &barrier,
+            0, nullptr
+        );
+
+        f.recorded = true;
+    }
+
+    void VirtualTexture::readFeedback(uint32_t slot)
+    {
+        if (slot >= feedback.size() || !feedback[slot].recorded)
+        {
+            return;
+        }
+
+        Feedback & f = feedback[slot];
+        f.recorded = false;
+
+        // neighbouring texels mostly ask for the same page
+        std::unordered_set<uint32_t> seen;
+        uint32_t last = NO_FEEDBACK;
+
+        for (VkDeviceSize i = 0; i < f.texels; i++)
+        {
+            uint32_t texel = f.mapped[i];
+
+            if (texel == NO_FEEDBACK || texel == last || !seen.insert(texel).second)
+            {
+                continue;
+            }
+
+            last = texel;
+            request(texel >> 24, texel & 0xFFF, (texel >> 12) & 0xFFF);
+        }
+    }
+
+    bool VirtualTexture::takeSlot
+    (
+        uint32_t & slot,
+        std::vector<std::pair<uint64_t, uint32_t>> & entries,
+        std::vector<VkSparseImageMemoryBind> & unbinds,
+        uint64_t framesCompleted
+    )
+    {
+        if (!freeSlots.empty())
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+            return true;
+        }
+
+        if (lru.empty())
+        {
+            return false;
+        }
+
+        uint64_t k = lru.back();
+        auto victim = resident.find(k);
+
+        // everything else was requested more recently still
+        if (victim->second.lastUsed >= framesCompleted)
+        {
+            return false;
+        }
+
+        slot = victim->second.slot;
+
+        const Level & level = levels[keyLevel(k)];
+        entries.push_back({level.firstPage + uint64_t(keyY(k)) * level.pagesX + keyX(k), 0});
+
+        if (sparse)
+        {
+            unbinds.push_back(pageBind(k, VK_NULL_HANDLE, 0));
+        }
+
+        lru.pop_back();
+        resident.erase(victim);
+        stats.evicted++;
+
+        return true;
+    }
+
+    VkSparseImageMemoryBind VirtualTexture::pageBind(uint64_t k, VkDeviceMemory bindMemory, VkDeviceSize offset) const
+    {
+        const Level & level = levels[keyLevel(k)];
+        uint32_t x = keyX(k) * pageSize;
+        uint32_t y = keyY(k) * pageSize;
+
+        VkSparseImageMemoryBind bind{};
+        bind.subresource = {VK_IMAGE_ASPECT_COLOR_BIT, keyLevel(k), 0};
+        bind.offset = {int32_t(x), int32_t(y), 0};
+        // edge pages stop at the edge of the level
+        bind.extent = {std::min(pageSize, level.width - x), std::min(pageSize, level.height - y), 1};
+        bind.memory = bindMemory;
+        bind.memoryOffset = offset;
+        return bind;
+    }
+
+    void VirtualTexture::update(uint64_t frame, uint64_t framesCompleted)
+    {
+        currentFrame = frame;
+
+        if (submitted)
+        {
+            // never wait, the last update's copies are picked up next frame
+            if (vkGetFenceStatus(device, fence) != VK_SUCCESS)
+            {
+                return;
+            }
+
+            vkResetFences(device, 1, &fence);
+            submitted = false;
+        }
+
+        std::vector<Loaded> batch;
+        batch.swap(initial);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            // never more pages than staging has room for, the rest wait for the next update
+            size_t room = stagingPages - std::min<size_t>(batch.size(), stagingPages);
+            size_t take = std::min<size_t>({loaded.size(), uploadsPerUpdate, room});
+            for (size_t i = 0; i < take; i++)
+            {
+                pending.erase(loaded[i].key);
+                batch.push_back(std::move(loaded[i]));
+            }
+
+            loaded.erase(loaded.begin(), loaded.begin() + take);
+        }
+
+        if (batch.empty() && pageTableInitialised)
+        {
+            return;
+        }
+
+        VkDeviceSize tableOffset = VkDeviceSize(stagingPages) * pageBytes;
+
+        std::vector<VkBufferImageCopy> copies;
+        std::vector<std::pair<uint64_t, uint32_t>> entries;
+        std::vector<VkSparseImageMemoryBind> binds, unbinds;
+
+        uint32_t staged = 0;
+
+        for (Loaded & page : batch)
+        {
+            uint64_t k = page.key;
+            uint32_t l = keyLevel(k);
+            bool pinned = l >= std::min(mipTailFirstLevel, static_cast<uint32_t>(levels.size()) - 1);
+
+            if (resident.count(k))
+            {
+                continue;
+            }
+
+            uint32_t slot = NO_SLOT;
+
+            // mip tail levels live in the tail's own memory
+            bool inTail = sparse && l >= mipTailFirstLevel;
+
+            if (!inTail && !takeSlot(slot, entries, unbinds, framesCompleted))
+            {
+                // requested again by the next feedback that still wants it
+                stats.dropped++;
+                continue;
+            }
+
+            VkDeviceSize offset = VkDeviceSize(staged++) * pageBytes;
+            std::memcpy(stagingMapped + offset, page.texels.data(), pageBytes);
+
+            const Level & level = levels[l];
+            uint32_t x = keyX(k);
+            uint32_t y = keyY(k);
+
+            VkBufferImageCopy region{};
+            region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, sparse ? l : 0, 0, 1};
+
+            if (sparse)
+            {
+                // the interior, sparse pages are filtered across by the hardware
+                region.bufferOffset = offset + (VkDeviceSize(border) * pageStride + border) * 4;
+                region.bufferRowLength = pageStride;
+                region.bufferImageHeight = pageStride;
+                region.imageOffset = {int32_t(x * pageSize), int32_t(y * pageSize), 0};
+                region.imageExtent = {std::min(pageSize, level.width - x * pageSize), std::min(pageSize, level.height - y * pageSize), 1};
+            }
+            else
+            {
+                region.bufferOffset = offset;
+                region.imageOffset = {int32_t((slot % atlasPages) * pageStride), int32_t((slot / atlasPages) * pageStride), 0};
+                region.imageExtent = {pageStride, pageStride, 1};
+            }
+
+            copies.push_back(region);
+
+            if (sparse && !inTail)
+            {
+                binds.push_back(pageBind(k, memory, VkDeviceSize(slot) * slotBytes));
+            }
+
+            uint32_t slotX = slot == NO_SLOT ? 0 : slot % atlasPages;
+            uint32_t slotY = slot == NO_SLOT ? 0 : slot / atlasPages;
+            entries.push_back({level.firstPage + uint64_t(y) * level.pagesX + x, RESIDENT | (slotY << 12) | slotX});
+
+            Resident r{slot, frame, pinned, lru.end()};
+
+            if (!pinned)
+            {
+                lru.push_front(k);
+                r.lru = lru.begin();
+            }
+
+            resident[k] = r;
+            stats.loaded++;
+        }
+
+        vkResetCommandBuffer(commandBuffer, 0);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+        // earlier frames finish reading before anything is overwritten
+        VkBufferMemoryBarrier tableBarrier{};
+        tableBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        tableBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        tableBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        tableBarrier.buffer = pageTable;
+        tableBarrier.offset = 0;
+        tableBarrier.size = VK_WHOLE_SIZE;
+        tableBarrier.srcAccessMask = 0;
+        tableBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        VkImageMemoryBarrier imageBarrier{};
+        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.image = image;
+        imageBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1};
+        imageBarrier.oldLayout = imageInitialised ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+        imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageBarrier.srcAccessMask = 0;
+        imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        vkCmdPipelineBarrier
+        (
+            commandBuffer,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            0, nullptr,
+            1, &tableBarrier,
+            1, &imageBarrier
+        );
+
+        VkDeviceSize headerBytes = (PAGE_TABLE_HEADER + 4 * levels.size()) * sizeof(uint32_t);
+
+        if (!pageTableInitialised)
+        {
+            uint32_t * header = reinterpret_cast<uint32_t *>(stagingMapped + tableOffset);
+            std::memset(header, 0, headerBytes);
+
+            header[0] = static_cast<uint32_t>(levels.size());
+            header[1] = pageSize;
+            header[2] = border;
+            header[3] = atlasPages;
+            header[4] = sparse ? 1 : 0;
+
+            for (size_t l = 0; l < levels.size(); l++)
+            {
+                uint32_t * level = header + PAGE_TABLE_HEADER + 4 * l;
+                level[0] = static_cast<uint32_t>(levels[l].firstPage);
+                level[1] = levels[l].pagesX;
+                level[2] = levels[l].pagesY;
+                level[3] = levels[l].width;
+            }
+
+            // nothing resident, then the header
+            vkCmdFillBuffer(commandBuffer, pageTable, 0, VK_WHOLE_SIZE, 0);
+
+            tableBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            tableBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+            vkCmdPipelineBarrier
+            (
+                commandBuffer,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_TRANSFER_BIT,
+                0,
+                0, nullptr,
+                1, &tableBarrier,
+                0, nullptr
+            );
+
+            VkBufferCopy headerCopy{tableOffset, 0, headerBytes};
+            vkCmdCopyBuffer(commandBuffer, staging, pageTable, 1, &headerCopy);
+
+            // entries follow the header in staging
+            tableOffset = align(tableOffset + headerBytes, sizeof(uint32_t));
+            pageTableInitialised = true;
+        }
+
+        if (!entries.empty())
+        {
+            std::vector<VkBufferCopy> entryCopies;
+            entryCopies.reserve(entries.size());
+
+            uint32_t * staged = reinterpret_cast<uint32_t *>(stagingMapped + tableOffset);
+
+            for (size_t i = 0; i < entries.size(); i++)
+            {
+                staged[i] = entries[i].second;
+                entryCopies.push_back({tableOffset + i * sizeof(uint32_t), headerBytes + entries[i].first * sizeof(uint32_t), sizeof(uint32_t)});
+            }
+
+            // in order, an evicted page's slot may be reused by a later entry
+            vkCmdCopyBuffer(commandBuffer, staging, pageTable, static_cast<uint32_t>(entryCopies.size()), entryCopies.data());
+        }
+
+        if (!copies.empty())
+        {
+            vkCmdCopyBufferToImage
+            (
+                commandBuffer,
+                staging,
+                image,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                static_cast<uint32_t>(copies.size()),
+                copies.data()
+            );
+        }
+
+        tableBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        tableBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        vkCmdPipelineBarrier
+        (
+            commandBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            0,
+            0, nullptr,
+            1, &tableBarrier,
+            1, &imageBarrier
+        );
+
+        vkEndCommandBuffer(commandBuffer);
+
+        imageInitialised = true;
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+        if (!binds.empty() || !unbinds.empty())
+        {
+            // unbinding first, a slot may move from an evicted page to a new one
+            std::vector<VkSparseImageMemoryBind> all = unbinds;
+            all.insert(all.end(), binds.begin(), binds.end());
+
+            VkSparseImageMemoryBindInfo imageBinds{};
+            imageBinds.image = image;
+            imageBinds.bindCount = static_cast<uint32_t>(all.size());
+            imageBinds.pBinds = all.data();
+
+            VkBindSparseInfo bindInfo{};
+            bindInfo.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO;
+            bindInfo.imageBindCount = 1;
+            bindInfo.pImageBinds = &imageBinds;
+            bindInfo.signalSemaphoreCount = 1;
+            bindInfo.pSignalSemaphores = &bound;
+
+            if (vkQueueBindSparse(queue, 1, &bindInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to bind virtual texture pages");
+            }
+
+            // bindings are not ordered with submits otherwise
+            submitInfo.waitSemaphoreCount = 1;
+            submitInfo.pWaitSemaphores = &bound;
+            submitInfo.pWaitDstStageMask = &waitStage;
+        }
+
+        if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to submit virtual texture pages");
+        }
+
+        submitted = true;
+    }
+
+    VirtualTextureStats VirtualTexture::getStats() const
+    {
+        VirtualTextureStats current = stats;
+        current.resident = static_cast<uint32_t>(resident.size());
+        current.residentBytes = VkDeviceSize(resident.size()) * slotBytes;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        current.pending = static_cast<uint32_t>(pending.size());
+
+        return current;
+    }
+
+    void VirtualTexture::createBuffer
+    (
+        VkDeviceSize size,
+        VkBufferUsageFlags usage,
+        VkMemoryPropertyFlags properties,
+        VkBuffer & buffer,
+        VkDeviceMemory & bufferMemory,
+        VkMemoryPropertyFlags preferred,
+        VkMemoryPropertyFlags avoided
+    )
+    {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create virtual texture buffer");
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+        try
+        {
+            bufferMemory = budget.allocate(memRequirements, properties, preferred, avoided, "virtual texture buffer");
+        }
+        catch (...)
+        {
+            vkDestroyBuffer(device, buffer, nullptr);
+            throw;
+        }
+
+        vkBindBufferMemory(device, buffer, bufferMemory, 0);
+    }
+}
@@ -3,6 +3,18 @@
 namespace Renderer
 {
 
+    const char * presentModeName(VkPresentModeKHR mode)
+    {
+        switch (mode)
+        {
+            case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+            case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+            case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+            case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "fifo relaxed";
+            default: return "unknown";
+        }
+    }
+
     VulkanRenderer::VulkanRenderer(GLFWwindow * window)
     {
 
@@ -14,6 +26,56 @@ namespace Renderer
 
         viewport = VkViewport{};
         scissor = VkRect2D{};
+
+        InitGraph init;
+
+        // each step after what it reads, or what it shares an externally synchronised object with
+        init.add("instance", [this]() { createInstance(); });
+        init.add("debugMessenger", [this]() { setupDebugMessenger(); }, {"instance"});
+        init.add("surface", [this, window]() { createSurface(window); }, {"instance"});
+        init.add("physicalDevice", [this]() { pickPhysicalDevice(); }, {"surface"});
+        init.add("device", [this]() { createLogicalDevice(); }, {"physicalDevice"});
+        init.add("memoryBudget", [this]() { createMemoryBudget(); }, {"device"});
+
+        init.add("swapChain", [this]() { createSwapChain(); }, {"device"});
+        init.add("imageViews", [this]() { createImageViews(); }, {"swapChain"});
+        init.add("commandPool", [this]() { createCommandPool(); }, {"device"});
+        init.add("gpuTimer", [this]() { createGpuTimer(); }, {"device"});
+        init.add("fragmentCounter", [this]() { createFragmentCounter(); }, {"device"});
+        init.add("renderGraph", [this]() { createRenderGraph(); }, {"imageViews", "memoryBudget"});
+        init.add("layoutCaches", [this]() { createLayoutCaches(); }, {"device"});
+        init.add("bindlessTable", [this]() { createBindlessTable(); }, {"layoutCaches"});
+        init.add("textureManager", [this]() { createTextureManager(); }, {"bindlessTable", "memoryBudget"});
+        init.add("assetStreamer", [this]() { createAssetStreamer(); }, {"textureManager"});
+        // compiling GLSL is the longest step, and needs nothing but the device
+        init.add("shaderPrograms", [this]() { createShaderPrograms(); }, {"device"});
+        init.add("pipelineCache", [this]() { createPipelineCache(); }, {"device"});
+        init.add
+        (
+            "graphicsPipeline",
+            [this]() { createGraphicsPipeline(); },
+            {"shaderPrograms", "pipelineCache", "renderGraph", "bindlessTable"}
+        );
+        init.add("prewarmPipelines", [this]() { prewarmPipelines(); }, {"graphicsPipeline"});
+        init.add("renderQueue", [this]() { createRenderQueue(); });
+        init.add("frameScratch", [this]() { createFrameScratch(); });
+        init.add("scene", [this]() { createScene(); });
+        // submits a copy on the graphics queue with the command pool
+        init.add("vertexBuffer", [this]() { createVertexBuffer(); }, {"commandPool", "memoryBudget"});
+        init.add("uniformBuffers", [this]() { createUniformBuffers(); }, {"memoryBudget"});
+        init.add("descriptorAllocators", [this]() { createDescriptorAllocators(); }, {"device"});
+        init.add("commandBuffers", [this]() { createCommandBuffers(); }, {"vertexBuffer"});
+        init.add("syncObjects", [this]() { createSyncObjects(); }, {"device"});
+        init.add("shaderWatcher", [this]() { createShaderWatcher(); }, {"graphicsPipeline"});
+
+        init.run();
+
+        startupTimeline = init.getTimeline();
+        std::cout << startupTimeline.report();
+    }
+
+    void VulkanRenderer::createInstance()
+    {
         // optional application information
         // can be used for optimisation  by driver 
         VkApplicationInfo appInfo;
@@ -23,7 +85,8 @@ namespace Renderer
         appInfo.pEngineName = "No engine";
         appInfo.engineVersion = VK_API_VERSION_1_0;
         appInfo.pNext = nullptr;
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        // 1.1 for vkGetPhysicalDeviceFeatures2 et al, 1.2 core descriptor indexing
+        appInfo.apiVersion = VK_API_VERSION_1_2;
         
         VkInstanceCreateInfo createInfo;
         createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -49,7 +112,7 @@ namespace Renderer
         createInfo.enabledExtensionCount = extensions.size();
         createInfo.ppEnabledExtensionNames = extensions.data();
 
-        if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS)
+        if (vkCreateInstance(&createInfo, nullptr, instance.put()) != VK_SUCCESS)
         {
             throw std::runtime_error("failed to create instance!");
         }
@@ -58,111 +121,94 @@ namespace Renderer
         {
             throw std::runtime_error("Validation layers are not supported");
         }
+    }
 
-        setupDebugMessenger();
-
-        createSurface(window);
-
-        pickPhysicalDevice();
-
-        createLogicalDevice();
-
-        createSwapChain();
-
-        createImageViews();
-
-        createRenderPass();
-
-        createDescriptorSetLayout();
-
-        createGraphicsPipeline();
-
-        createColorResources();
-
-        createFramebuffers();
-
-        createCommandPool();
+    VulkanRenderer::~VulkanRenderer()
+    {
+        // no more reloads once this returns
+        shaderWatcher.reset();
 
-        createVertexBuffer();
+        if (!pipelineCache->saveCache(PIPELINE_CACHE_PATH) || !pipelineCache->saveList(PIPELINE_LIST_PATH))
+        {
+            std::cerr << "Could not save the pipeline cache\n";
+        }
 
-        createUniformBuffers();
+        // joins its workers, then destroys every pipeline
+        pipelineCache.reset();
 
-        createDescriptorPool();
+        deletionQueue.flushAll();
 
-        createDescriptorSets();
+        // transient images, framebuffers and render passes
+        renderGraph.reset();
 
-        createCommandBuffers();
+        gpuTimer.reset();
 
-        createSyncObjects();
-    }
+        fragmentCounter.reset();
 
-    VulkanRenderer::~VulkanRenderer()
-    {
+        cleanupSwapChain();
 
-        vkDestroyImageView(device, colourImageView, nullptr);
-        vkDestroyImage(device, colourImage, nullptr);
-        vkFreeMemory(device, colourImageMemory, nullptr);
+        uniformArena.reset();
 
-        cleanupSwapChain();
+        descriptorAllocators.clear();
 
-        for (size_t i = 0; i < MAX_CONCURRENT_FRAMES; i++)
-        {
-            vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-            vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
-        }
+        // before the bindless table its textures are registered in
+        assets.reset();
+        virtualTextures.clear();
+        textures.reset();
 
-        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+        bindless.reset();
 
-        vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+        pipelineLayoutCache.reset();
 
-        vkDestroyBuffer(device, vertexBuffer, nullptr);
+        descriptorLayoutCache.reset();
 
-        vkFreeMemory(device, vertexBufferMemory, nullptr);
+        vertexBuffer.reset();
 
-        vkDestroyPipeline(device, pipeline, nullptr);
+        memoryBudget->free(vertexBufferMemory);
 
-        vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+        // everything allocated through it is freed
+        memoryBudget.reset();
 
-        vkDestroyRenderPass(device, renderPass, nullptr);
+        trigProgram.reset();
 
-        for (unsigned i = 0; i < MAX_CONCURRENT_FRAMES; i++)
-        {
-            vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-            vkDestroySemaphore(device, renderFinsihedSemaphores[i], nullptr);
-            vkDestroyFence(device, framesFinished[i], nullptr);
-        }
+        imageAvailableSemaphores.clear();
+        renderFinsihedSemaphores.clear();
+        framesFinished.clear();
 
         // command buffers are also freed here
-        vkDestroyCommandPool(device, commandPool, nullptr);
+        commandPool.reset();
 
-        vkDestroyDevice(device, nullptr);
+        device.reset();
 
-        if (enableValidationLayers)
-        {
-            destroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
-        }
+        // null unless validation layers are enabled
+        debugMessenger.reset();
 
-        vkDestroySurfaceKHR(instance, surface, nullptr);
+        surface.reset();
 
-        vkDestroyInstance(instance, nullptr);
+        instance.reset();
     }
 
  
     void VulkanRenderer::createSurface(GLFWwindow * window)
     {
-        if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS)
+        if (glfwCreateWindowSurface(instance, window, nullptr, surface.put(instance)) != VK_SUCCESS)
         {
             throw std::runtime_error("Failed to create window surface");
         }
     }
 
-    VkSampleCountFlagBits VulkanRenderer::getMaxUsableSampleCount()
+    VkSampleCountFlagBits VulkanRenderer::getMaxUsableSampleCount(VkSampleCountFlagBits limit)
     {
         VkPhysicalDeviceProperties physicalDeviceProperties;
 
         vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
 
-        VkSampleCountFlags counts = physicalDeviceProperties.limits.framebufferColorSampleCounts;
+        // the depth attachment is multisampled to match the colour attachment
+        VkSampleCountFlags counts = physicalDeviceProperties.limits.framebufferColorSampleCounts
+                                  & physicalDeviceProperties.limits.framebufferDepthSampleCounts;
+
+        // drop counts above the limit, the bits are the counts
+        counts &= (limit << 1)-1;
 
         if (counts & VK_SAMPLE_COUNT_64_BIT) { return VK_SAMPLE_COUNT_64_BIT; }
         if (counts & VK_SAMPLE_COUNT_32_BIT) { return VK_SAMPLE_COUNT_32_BIT; }
@@ -199,8 +245,26 @@ namespace Renderer
             if (isSuitableDevice(physicalDevice))
             {
                 this->physicalDevice = physicalDevice;
-                msaaSamples = getMaxUsableSampleCount();
-                std::cout << "Device supports " << msaaSamples << " msaa samples\n";
+                std::cout << "Device supports " << getMaxUsableSampleCount() << " msaa samples\n";
+                msaaSamples = getMaxUsableSampleCount(requestedMsaaSamples);
+
+                VkPhysicalDeviceFeatures features;
+                vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+                sampleRateShadingSupported = features.sampleRateShading == VK_TRUE;
+                pipelineStatisticsSupported = features.pipelineStatisticsQuery == VK_TRUE;
+                samplerAnisotropySupported = features.samplerAnisotropy == VK_TRUE;
+                sparseResidencySupported = VirtualTexture::sparseSupported
+                (
+                    physicalDevice,
+                    findQueueFamilies(physicalDevice).graphicsFamily.value()
+                );
+                memoryBudgetSupported = MemoryBudget::extensionSupported(physicalDevice);
+
+                bindlessSupported = BindlessTable::supported(physicalDevice);
+                std::cout << "Device " << (bindlessSupported ? "supports" : "does not support") << " bindless descriptors\n";
+
+                dynamicRenderingSupported = RenderGraph::dynamicRenderingSupported(physicalDevice);
+                std::cout << "Rendering with " << (dynamicRenderingSupported ? "dynamic rendering" : "render passes") << "\n";
                 break;
             }
         }
@@ -260,7 +324,15 @@ namespace Renderer
 
         VkPhysicalDeviceFeatures deviceFeatures{};
 
-        deviceFeatures.sampleRateShading = VK_TRUE;
+        // only used if setMsaa asks for sample shading
+        deviceFeatures.sampleRateShading = sampleRateShadingSupported ? VK_TRUE : VK_FALSE;
+        // for overdraw statistics
+        deviceFeatures.pipelineStatisticsQuery = pipelineStatisticsSupported ? VK_TRUE : VK_FALSE;
+        // texture samplers ask for it, clamped to the device limit
+        deviceFeatures.samplerAnisotropy = samplerAnisotropySupported ? VK_TRUE : VK_FALSE;
+        // virtual textures bind their pages sparsely where they can
+        deviceFeatures.sparseBinding = sparseResidencySupported ? VK_TRUE : VK_FALSE;
+        deviceFeatures.sparseResidencyImage2D = sparseResidencySupported ? VK_TRUE : VK_FALSE;
 
         VkDeviceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -268,9 +340,34 @@ namespace Renderer
         createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
         createInfo.pEnabledFeatures = &deviceFeatures;
 
+        enabledDeviceExtensions = deviceExtensions;
+
+        VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = BindlessTable::requiredFeatures();
+
+        if (bindlessSupported)
+        {
+            enabledDeviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+            indexingFeatures.pNext = const_cast<void *>(createInfo.pNext);
+            createInfo.pNext = &indexingFeatures;
+        }
+
+        if (memoryBudgetSupported)
+        {
+            enabledDeviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+
+        VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamicRenderingFeatures = RenderGraph::dynamicRenderingFeatures();
+
+        if (dynamicRenderingSupported)
+        {
+            enabledDeviceExtensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+            dynamicRenderingFeatures.pNext = const_cast<void *>(createInfo.pNext);
+            createInfo.pNext = &dynamicRenderingFeatures;
+        }
+
         // compat with older vulkan https://vulkan-tutorial.com/en/Drawing_a_triangle/Setup/Logical_device_and_queues
-        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledDeviceExtensions.size());
+        createInfo.ppEnabledExtensionNames = enabledDeviceExtensions.data();
 
 
         if (enableValidationLayers)
@@ -283,7 +380,7 @@ namespace Renderer
             createInfo.enabledLayerCount = 0;
         }
 
-        if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS)
+        if (vkCreateDevice(physicalDevice, &createInfo, nullptr, device.put()) != VK_SUCCESS)
         {
             throw std::runtime_error("Failed to create logical device");
         }
@@ -292,6 +389,13 @@ namespace Renderer
         vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
     }
 
+    void VulkanRenderer::createMemoryBudget()
+    {
+        memoryBudget = std::make_unique<MemoryBudget>(physicalDevice, device, memoryBudgetSupported);
+        std::cout << "Memory budget " << (memoryBudgetSupported ? "from VK_EXT_memory_budget" : "estimated from heap sizes")
+                  << (memoryBudget->unified() ? ", unified memory" : memoryBudget->resizableBar() ? ", resizable BAR" : "") << "\n";
+    }
+
 
     QueueFamilyIndices VulkanRenderer::findQueueFamilies(VkPhysicalDevice physicalDevice)
     {
@@ -413,11 +517,11 @@ namespace Renderer
     }
 
 
-    void VulkanRenderer::createSwapChain()
+    void VulkanRenderer::createSwapChain(VkSwapchainKHR oldSwapChain)
     {
         SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
         VkSurfaceFormatKHR surfaceFormat = chooseSwapChainSurfaceFormat(swapChainSupport.formats);
-        VkPresentModeKHR presentMode = chooseSwapChainPresentMode(swapChainSupport.presentModes);
+        VkPresentModeKHR mode = chooseSwapChainPresentMode(swapChainSupport.presentModes);
         VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
         uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
@@ -443,6 +547,11 @@ namespace Renderer
         // for direct rendering, VK_IMAGE_USAGE_TRANSFER_DST_BIT would be 
         // for saving images for post-processing
         createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        // dynamic resolution blits the scene into the swap chain image
+        if (swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+        {
+            createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        }
 
         QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
         uint32_t queueFamilyIndices[] = 
@@ -464,12 +573,13 @@ namespace Renderer
 
         createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
         createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-        createInfo.presentMode = presentMode;
+        createInfo.presentMode = mode;
         // false if want to get pixels obscured
         createInfo.clipped = VK_TRUE;
-        createInfo.oldSwapchain = VK_NULL_HANDLE;
+        // lets the driver reuse resources and keep presenting the old images
+        createInfo.oldSwapchain = oldSwapChain;
 
-        if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS)
+        if (vkCreateSwapchainKHR(device, &createInfo, nullptr, swapChain.put(device)) != VK_SUCCESS)
         {
             throw std::runtime_error("Failed to create swap chain");
         }
@@ -480,33 +590,62 @@ namespace Renderer
     
         swapChainImageFormat = surfaceFormat.format;
         swapChainExtent = extent;
+        presentMode = mode;
+        swapChainTransferDst = (createInfo.imageUsage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) != 0;
     }
 
     void VulkanRenderer::recreateSwapChain()
     {
-        vkDeviceWaitIdle(device);
+        VkSurfaceCapabilitiesKHR capabilities;
+        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &capabilities);
 
-        cleanupSwapChain();
+        // minimised, keep the flag and try again next frame
+        if (capabilities.currentExtent.width == 0 || capabilities.currentExtent.height == 0 || width == 0 || height == 0)
+        {
+            return;
+        }
 
-        createSwapChain();
+        framebufferResized = false;
+
+        // frames still in flight may use these, destroy them when they retire
+        UniqueSwapchain oldSwapChain = std::move(swapChain);
+        std::vector<UniqueImageView> oldImageViews = std::move(swapChainImageViews);
+        swapChainImageViews.clear();
+
+        // framebuffers hold the old views, the graph's images are sized to the old extent
+        renderGraph->reset(frameNumber);
+
+        createSwapChain(oldSwapChain);
         createImageViews();
-        createColorResources();
-        createFramebuffers();
-    }
+        updateViewport();
 
-    void VulkanRenderer::cleanupSwapChain()
-    {
-        for (auto framebuffer : swapChainFramebuffers)
+        // views first, they are of the old swap chain's images
+        for (UniqueImageView & imageView : oldImageViews)
         {
-            vkDestroyFramebuffer(device, framebuffer, nullptr);
+            imageView.retire(deletionQueue, frameNumber);
         }
 
-        for (auto imageView : swapChainImageViews)
-        {
-            vkDestroyImageView(device, imageView, nullptr);
-        }
+        oldSwapChain.retire(deletionQueue, frameNumber);
+    }
+
+    void VulkanRenderer::updateViewport()
+    {
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = (float) swapChainExtent.width;
+        viewport.height = (float) swapChainExtent.height;
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+
+        scissor.offset = {0, 0};
+        scissor.extent = swapChainExtent;
+    }
+
+    void VulkanRenderer::cleanupSwapChain()
+    {
+        swapChainImageViews.clear();
 
-        vkDestroySwapchainKHR(device, swapChain, nullptr);
+        swapChain.reset();
     }
 
     SwapChainSupportDetails VulkanRenderer::querySwapChainSupport(VkPhysicalDevice physicalDevice)
@@ -588,16 +727,42 @@ namespace Renderer
 
         */
 
-        for (const auto & availablePresentMode: availablePresentModes)
+        // nearest alternatives, tearing modes fall back to each other before vsync
+        std::vector<VkPresentModeKHR> preference;
+        switch (requestedPresentMode)
         {
-            if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR)
+            case VK_PRESENT_MODE_IMMEDIATE_KHR:
+                preference = {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR};
+                break;
+            case VK_PRESENT_MODE_MAILBOX_KHR:
+                preference = {VK_PRESENT_MODE_MAILBOX_KHR};
+                break;
+            case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+                preference = {VK_PRESENT_MODE_FIFO_RELAXED_KHR};
+                break;
+            default:
+                break;
+        }
+
+        for (auto mode : preference)
+        {
+            if (std::find(availablePresentModes.begin(), availablePresentModes.end(), mode) != availablePresentModes.end())
             {
-                return availablePresentMode;
+                return mode;
             }
         }
-       
-       return VK_PRESENT_MODE_FIFO_KHR;
 
+        if (requestedPresentMode != VK_PRESENT_MODE_FIFO_KHR && requestedPresentMode != VK_PRESENT_MODE_MAILBOX_KHR)
+        {
+            std::cerr << "Present mode " << presentModeName(requestedPresentMode) << " unsupported, using fifo\n";
+        }
+
+        return VK_PRESENT_MODE_FIFO_KHR;
+    }
+
+    std::vector<VkPresentModeKHR> VulkanRenderer::supportedPresentModes()
+    {
+        return querySwapChainSupport(physicalDevice).presentModes;
     }
 
     VkExtent2D VulkanRenderer::chooseSwapExtent(const VkSurfaceCapabilitiesKHR & capabilities)
@@ -644,452 +809,973 @@ namespace Renderer
             createInfo.subresourceRange.baseArrayLayer = 0;
             createInfo.subresourceRange.layerCount = 1;
 
-            if (vkCreateImageView(device, &createInfo, nullptr, &swapChainImageViews[i]) != VK_SUCCESS)
+            if (vkCreateImageView(device, &createInfo, nullptr, swapChainImageViews[i].put(device)) != VK_SUCCESS)
             {
                 throw std::runtime_error("Failed to create image view");
             }
         }
     }
 
-    void VulkanRenderer::createRenderPass()
-    {
-        VkAttachmentDescription colourAttachment{};
-        colourAttachment.format = swapChainImageFormat;
-        colourAttachment.samples = msaaSamples;
-        // do before rendering; clear
-        colourAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-        // do after rendering, store
-        colourAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        // not using stencil data; don't care
-        colourAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        colourAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        // we clear image so don't need to worry about intial layout
-        colourAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        // image is auto converted to presentation layout
-        // since msaa is enabled optimal is needed as they
-        // cannot be presented as is
-        colourAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-        // e.g. layout(location = 0) out vec4 outColour
-        VkAttachmentReference colourAttachmentRef{};
-        colourAttachmentRef.attachment = 0;
-        colourAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-        // resolve attachment for msaa
-        VkAttachmentDescription colourAttachmentResolve{};
-        colourAttachmentResolve.format = swapChainImageFormat;
-        colourAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
-        colourAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        colourAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-        colourAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-        colourAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-        colourAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        colourAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-        // resolve ref
-        VkAttachmentReference colourResolveAttachmentRef{};
-        colourResolveAttachmentRef.attachment = 1;
-        colourResolveAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-        // one subpass
-
-        VkSubpassDescription subpass{};
-        // specify as a graphics subpass
-        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-        subpass.colorAttachmentCount = 1;
-        subpass.pColorAttachments = &colourAttachmentRef;
-        subpass.pResolveAttachments = &colourResolveAttachmentRef;
-
-        VkSubpassDependency dependency{};
-        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-        dependency.dstSubpass = 0;
-        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependency.srcAccessMask = 0;
-        // wait on the colour attachment output stage
-        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-        std::array<VkAttachmentDescription, 2>  attachments = {colourAttachment, colourAttachmentResolve};
-
-        VkRenderPassCreateInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-        renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-        renderPassInfo.pAttachments = attachments.data();
-        renderPassInfo.subpassCount = 1;
-        renderPassInfo.pSubpasses = &subpass;
-
-        renderPassInfo.dependencyCount = 1;
-        renderPassInfo.pDependencies = &dependency;
-
-        if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
-        {
-            throw std::runtime_error("Failed to create render pass");
-        }
-    }
-
-    void VulkanRenderer::createGraphicsPipeline()
+    void VulkanRenderer::createRenderGraph()
     {
+        depthFormat = findDepthFormat();
 
-        Shader trig(device, "trig");
-        std::vector<VkPipelineShaderStageCreateInfo> shaderStages = trig.shaderStage();
-
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo {};
+        renderGraph = std::make_unique<RenderGraph>(device, deletionQueue, *memoryBudget, dynamicRenderingSupported);
 
-        auto bindingDescription = Vertex::getBindingDescription();
-        auto attributeDescriptions = Vertex::getArrtibuteDescriptions();
+        // compiled now for the render pass the first pipeline is built against
+        declareRenderGraph(0, swapChainExtent, msaaSamples, dynamicResolution);
+        renderGraph->compile(frameNumber);
+        renderPass = renderGraph->renderPass("scene");
+    }
 
-        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = 1;
-        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-        vertexInputInfo.vertexAttributeDescriptionCount = attributeDescriptions.size();
-        vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
+    void VulkanRenderer::declareRenderGraph(uint32_t imageIndex, VkExtent2D extent, VkSampleCountFlagBits samples, bool scaling)
+    {
+        renderGraph->clear();
 
-        VkPipelineInputAssemblyStateCreateInfo inputAssembly {};
-        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-        // if true can break up line or triangle strips
-        inputAssembly.primitiveRestartEnable = VK_FALSE;
+        bool msaa = samples != VK_SAMPLE_COUNT_1_BIT;
 
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = (float) swapChainExtent.width;
-        viewport.height = (float) swapChainExtent.height;
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
+        // as large as the swap chain so dynamic resolution can use any part of them
+        if (msaa)
+        {
+            renderGraph->addImage("msaaColour", {swapChainImageFormat, swapChainExtent, samples});
+        }
 
-        scissor.offset = {0, 0};
-        scissor.extent = swapChainExtent;
+        renderGraph->addImage("depth", {depthFormat, swapChainExtent, samples, VK_IMAGE_ASPECT_DEPTH_BIT});
 
-        // for dynamic scissor and viewport
-        //  can be changed without rebuilding
-        //  pipeline
-        std::vector<VkDynamicState> dynamicStates =
+        if (scaling)
         {
-            VK_DYNAMIC_STATE_VIEWPORT,
-            VK_DYNAMIC_STATE_SCISSOR
-        };
+            renderGraph->addImage("scene", {swapChainImageFormat, swapChainExtent});
+        }
 
-        VkPipelineDynamicStateCreateInfo dynamicState{};
-        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-        dynamicState.pDynamicStates = dynamicStates.data();
-
-        VkPipelineViewportStateCreateInfo viewportState{};
-        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-        viewportState.viewportCount = 1;
-        viewportState.scissorCount = 1;
-
-        VkPipelineRasterizationStateCreateInfo rasterInfo{};
-        rasterInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-        rasterInfo.depthClampEnable = VK_FALSE;
-        // true disables framebuffer output
-        rasterInfo.rasterizerDiscardEnable = VK_FALSE;
-        rasterInfo.polygonMode = VK_POLYGON_MODE_FILL;
-        // 1.0f requires wideLines enabled
-        rasterInfo.lineWidth = 1.0f;
-        rasterInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-        rasterInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-        rasterInfo.depthBiasEnable = VK_FALSE;
-        rasterInfo.depthBiasConstantFactor = 0.0f;
-        rasterInfo.depthBiasClamp = 0.0f;
-        rasterInfo.depthBiasSlopeFactor = 0.0f;
-
-        VkPipelineMultisampleStateCreateInfo multisampling{};
-        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-        multisampling.sampleShadingEnable = VK_TRUE;
-        multisampling.minSampleShading = 1.0f;
-        multisampling.rasterizationSamples = msaaSamples;
-        multisampling.pSampleMask = nullptr;
-        multisampling.alphaToCoverageEnable = VK_FALSE;
-        multisampling.alphaToOneEnable = VK_FALSE;
-
-        VkPipelineColorBlendAttachmentState colourBlendAttachment{};
-        colourBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        colourBlendAttachment.blendEnable = VK_TRUE;
-        colourBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-        colourBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-        colourBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-        colourBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-        colourBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-        colourBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-        VkPipelineColorBlendStateCreateInfo colourBlending{};
-        colourBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        colourBlending.logicOpEnable = VK_FALSE;
-        colourBlending.logicOp = VK_LOGIC_OP_COPY; 
-        colourBlending.attachmentCount = 1;
-        colourBlending.pAttachments = &colourBlendAttachment;
-        colourBlending.blendConstants[0] = 0.0f; 
-        colourBlending.blendConstants[1] = 0.0f; 
-        colourBlending.blendConstants[2] = 0.0f;
-        colourBlending.blendConstants[3] = 0.0f;
-
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 1;
-        pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
-        pipelineLayoutInfo.pushConstantRangeCount = 0;
-        pipelineLayoutInfo.pPushConstantRanges = nullptr;
-
-        if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
-        {
-            throw std::runtime_error("Failed ot create pipeline layout");
-        }
-
-        VkGraphicsPipelineCreateInfo pipelineInfo{};
-        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineInfo.stageCount = 2;
-        // shaders
-        pipelineInfo.pStages = shaderStages.data();
-        // fixed functions
-        pipelineInfo.pVertexInputState = &vertexInputInfo;
-        pipelineInfo.pInputAssemblyState = &inputAssembly;
-        pipelineInfo.pViewportState = &viewportState;
-        pipelineInfo.pRasterizationState = &rasterInfo;
-        pipelineInfo.pMultisampleState = &multisampling;
-        pipelineInfo.pDepthStencilState = nullptr;
-        pipelineInfo.pColorBlendState = &colourBlending;
-        pipelineInfo.pDynamicState = &dynamicState;
-        
-        pipelineInfo.layout = pipelineLayout;
+        renderGraph->importImage
+        (
+            "swapchain",
+            swapChainImages[imageIndex],
+            swapChainImageViews[imageIndex],
+            {swapChainImageFormat, swapChainExtent},
+            VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+        );
 
-        pipelineInfo.renderPass = renderPass;
-        pipelineInfo.subpass = 0;
+        // single sampled output, blitted to the swap chain when scaling
+        std::string output = scaling ? "scene" : "swapchain";
+        VkClearColorValue clearColour = {{0.0f, 0.0f, 0.0f, 1.0f}};
 
-        // inheritance
-        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-        pipelineInfo.basePipelineIndex = -1;
+        RenderGraph::Pass & scene = renderGraph->addPass("scene");
 
-        if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
+        if (msaa)
+        {
+            scene.colour("msaaColour", clearColour, output);
+        }
+        else
         {
-            throw std::runtime_error("Failed to create graphics pipline");
+            scene.colour(output, clearColour);
         }
 
-    }
+        // 1 is the far plane
+        scene.depth("depth", VkClearDepthStencilValue{1.0f, 0});
+        // the top left of the full size targets when scaling
+        scene.renderArea = VkRect2D{{0, 0}, extent};
 
-    void VulkanRenderer::createFramebuffers()
-    {
-        swapChainFramebuffers.resize(swapChainImageViews.size());
+        frameViewport = viewport;
+        frameViewport.width = (float) extent.width;
+        frameViewport.height = (float) extent.height;
 
-        for (size_t i = 0; i < swapChainImageViews.size(); i++)
+        frameScissor = scissor;
+        frameScissor.extent = extent;
+
+        // small enough captures for std::function to store without allocating
+        scene.execute = [this](VkCommandBuffer commandBuffer)
         {
-            std::array<VkImageView,2> attachments = {colourImageView, swapChainImageViews[i]};
+            // dynamics viewport and scissor
+            vkCmdSetViewport(commandBuffer, 0, 1, &frameViewport);
+            vkCmdSetScissor(commandBuffer, 0, 1, &frameScissor);
 
-            VkFramebufferCreateInfo framebufferInfo{};
-            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            framebufferInfo.renderPass = renderPass;
-            framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-            framebufferInfo.pAttachments = attachments.data();
-            framebufferInfo.width = swapChainExtent.width;
-            framebufferInfo.height = swapChainExtent.height;
-            framebufferInfo.layers = 1;
+            // use descriptor stes
+            vkCmdBindDescriptorSets
+            (
+                commandBuffer, 
+                VK_PIPELINE_BIND_POINT_GRAPHICS, 
+                pipelineLayout,
+                0,
+                1,
+                &descriptorSets[currentFrame],
+                0,
+                nullptr
+            );
 
-            if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS)
+            // one bind of the whole table for every draw this frame
+            if (bindless)
             {
-                throw std::runtime_error("Failed to create framebuffer");
+                bindless->bind(commandBuffer, pipelineLayout, 1);
             }
+
+            // pipelines, materials and vertex buffers, skipping redundant binds
+            renderQueue->record(commandBuffer);
+        };
+
+        if (scaling)
+        {
+            RenderGraph::Pass & upscale = renderGraph->addPass("upscale");
+            upscale.read("scene", RenderGraphAccess::TRANSFER_SRC);
+            upscale.write("swapchain", RenderGraphAccess::TRANSFER_DST);
+            upscale.execute = [this, imageIndex](VkCommandBuffer commandBuffer)
+            {
+                blitScene(commandBuffer, imageIndex, frameScissor.extent);
+            };
         }
     }
 
-    void VulkanRenderer::createVertexBuffer()
+    void VulkanRenderer::createShaderPrograms()
     {
-        
-        VkDeviceSize bufferSize = sizeof(vertices[0])*vertices.size();
-
-        // first create a staging buffer to transfer into from the host
-        VkBuffer stagingBuffer;
-        VkDeviceMemory stagingBufferMemory;
+        std::string vert, frag;
 
-        createBuffer
+        // prefer the files on disk, they can be edited whilst running
+        if 
         (
-            bufferSize, 
-            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            stagingBuffer,
-            stagingBufferMemory
-        );
+            !Shader::readGlsl(std::string(SHADER_PATH)+"trig.vert", vert) ||
+            !Shader::readGlsl(std::string(SHADER_PATH)+"trig.frag", frag)
+        )
+        {
+            std::cout << "Shaders not found in " << SHADER_PATH << ", using built in source\n";
+            vert = Shader::vert;
+            frag = Shader::frag;
+        }
 
-        void * data;
-        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-            std::memcpy(data, vertices.data(), (size_t) bufferSize);
-        vkUnmapMemory(device, stagingBufferMemory);
+        trigProgram = createTrigProgram(vert, frag);
+        // toggles are baked in by the driver, no module per value
+        trigSpecialisation = trigProgram->specialise<float>({{"ALPHA", 1.0f}});
+    }
 
-        // create normal buffer
+    std::unique_ptr<ShaderProgram> VulkanRenderer::createTrigProgram(const std::string & vert, const std::string & frag)
+    {
+        auto program = std::make_unique<ShaderProgram>(device, "trig", vert, frag);
+        program->addSpecialisationConstant("ALPHA", 0);
+        return program;
+    }
 
-        createBuffer
-        (
-            bufferSize,
-            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-            vertexBuffer,
-            vertexBufferMemory
-        );
+    void VulkanRenderer::createPipelineCache()
+    {
+        // leave a core or two for the render and reload threads
+        unsigned threads = std::max(1u, std::thread::hardware_concurrency()/2);
 
-        copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+        pipelineCache = std::make_unique<PipelineCache>(device, deletionQueue, PIPELINE_CACHE_PATH, threads);
+    }
+
+    void VulkanRenderer::createGraphicsPipeline()
+    {
+        std::lock_guard<std::mutex> lock(programMutex);
+
+        sceneDescription = describeScenePipeline(registerTrigShader(*trigProgram));
 
-        vkDestroyBuffer(device, stagingBuffer, nullptr);
-        vkFreeMemory(device, stagingBufferMemory, nullptr);
+        // nothing to fall back on yet
+        applyPipeline(pipelineCache->compile(sceneDescription));
 
+        updateViewport();
     }
 
-    void VulkanRenderer::createUniformBuffers()
+    void VulkanRenderer::prewarmPipelines()
     {
-        VkDeviceSize bufferSize = sizeof(UniformBufferObject);
-        uniformBuffers.resize(MAX_CONCURRENT_FRAMES);
-        uniformBuffersMemory.resize(MAX_CONCURRENT_FRAMES);
-        uniformBuffersMapped.resize(MAX_CONCURRENT_FRAMES);
+        std::vector<PipelineDescription> recorded = PipelineCache::loadList(PIPELINE_LIST_PATH);
+        std::vector<PipelineDescription> usable;
 
-        for (size_t i = 0; i < MAX_CONCURRENT_FRAMES; i++)
+        for (PipelineDescription & description : recorded)
         {
-            createBuffer
-            (
-                bufferSize,
-                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                uniformBuffers[i],
-                uniformBuffersMemory[i]
-            );
+            // only the scene pass' render pass is at hand to build against
+            bool fits = description.colourFormat == swapChainImageFormat
+                     && description.depthFormat == depthFormat
+                     && (renderPass == VK_NULL_HANDLE || description.samples == msaaSamples);
 
-            vkMapMemory
-            (
-                device, 
-                uniformBuffersMemory[i], 
-                0, 
-                bufferSize, 
-                0,
-                &uniformBuffersMapped[i]
-            );
+            if (fits)
+            {
+                description.renderPass = renderPass;
+                usable.push_back(description);
+            }
         }
+
+        pipelineCache->prewarm(usable);
     }
 
-    void VulkanRenderer::updateUniformBuffer()
+    std::vector<VkVertexInputAttributeDescription> VulkanRenderer::registerTrigShader(ShaderProgram & program)
     {
-        static auto startTime = std::chrono::high_resolution_clock::now();
+        Shader & trig = program.variant();
 
-        auto currentTime = std::chrono::high_resolution_clock::now();
-        float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+        PipelineInterface pipelineInterface = createPipelineInterface(trig.getReflection());
 
-        UniformBufferObject ubo{};
-        ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    
-        ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    
-        ubo.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float) swapChainExtent.height, 0.1f, 10.0f);
-    
-        ubo.proj[1][1] *= -1;
+        pipelineCache->setShader("trig", trig.shaderStage(), trigSpecialisation, pipelineInterface.layout);
 
-        memcpy(uniformBuffersMapped[currentFrame], &ubo, sizeof(ubo));
+        return vertexInputAttributes(trig.getReflection());
     }
 
-    void VulkanRenderer::createDescriptorSetLayout()
+    PipelineDescription VulkanRenderer::describeScenePipeline(const std::vector<VkVertexInputAttributeDescription> & attributes)
     {
+        PipelineDescription description;
+        description.shader = "trig";
+        description.vertexStride = sizeof(Vertex);
+        description.vertexAttributes = attributes;
+        // draws are sorted front to back, so early depth tests reject hidden fragments
+        description.depthTest = true;
+        description.depthWrite = true;
+        description.alphaBlend = true;
+        description.samples = msaaSamples;
+        description.minSampleShading = sampleShading;
+        description.colourFormat = swapChainImageFormat;
+        description.depthFormat = depthFormat;
+        description.renderPass = renderPass;
+        return description;
+    }
 
-        VkDescriptorSetLayoutBinding uboLayoutBinding{};
-        uboLayoutBinding.binding = 0;
-        uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        uboLayoutBinding.descriptorCount = 1;
-        uboLayoutBinding.pImmutableSamplers = nullptr;
-        uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
-        VkDescriptorSetLayoutCreateInfo layoutInfo{};
-        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layoutInfo.bindingCount = 1;
-        layoutInfo.pBindings = &uboLayoutBinding;
+    void VulkanRenderer::applyPipeline(const PipelineLookup & found)
+    {
+        pipeline = found.pipeline;
 
-        if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+        if (found.pipeline == VK_NULL_HANDLE || found.layout == pipelineLayout)
         {
-            throw std::runtime_error("Failed to create descriptor set layout");
+            return;
         }
 
+        std::lock_guard<std::mutex> lock(layoutMutex);
+
+        const PipelineInterface & pipelineInterface = pipelineInterfaces.at(found.layout);
+
+        pipelineLayout = pipelineInterface.layout;
+        descriptorSetLayout = pipelineInterface.frameSetLayout;
+        usesFrameUniforms = pipelineInterface.usesFrameUniforms;
     }
 
-    void VulkanRenderer::createDescriptorPool()
+    void VulkanRenderer::setMsaa(VkSampleCountFlagBits samples, float minSampleShading)
     {
-        VkDescriptorPoolSize poolSize{};
-        poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        poolSize.descriptorCount = static_cast<uint32_t>(MAX_CONCURRENT_FRAMES);
+        requestedMsaaSamples = samples;
+        requestedSampleShading = std::clamp(minSampleShading, 0.0f, 1.0f);
+        renderTargetsChanged = true;
+    }
 
-        VkDescriptorPoolCreateInfo poolInfo{};
-        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        poolInfo.poolSizeCount = 1;
-        poolInfo.pPoolSizes = &poolSize;
-        poolInfo.maxSets = static_cast<uint32_t>(MAX_CONCURRENT_FRAMES);
+    void VulkanRenderer::setDynamicResolution(bool enabled, double budgetMs, double minScale)
+    {
+        requestedDynamicResolution = enabled;
+        resolution.setBudget(budgetMs);
+        resolution.setRange(minScale, 1.0);
+        renderTargetsChanged = true;
+    }
 
-        if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+    bool VulkanRenderer::canBlitScene()
+    {
+        if (!swapChainTransferDst || !gpuTimer->supported())
         {
-            throw std::runtime_error("Failed to create descriptor pool");
+            return false;
         }
 
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, swapChainImageFormat, &properties);
+
+        VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+        return (properties.optimalTilingFeatures & needed) == needed;
     }
 
-    void VulkanRenderer::createDescriptorSets()
+    void VulkanRenderer::applyRenderTargetSettings()
     {
-        std::vector<VkDescriptorSetLayout> layouts(MAX_CONCURRENT_FRAMES, descriptorSetLayout);
-        VkDescriptorSetAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        allocInfo.descriptorPool = descriptorPool;
-        allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_CONCURRENT_FRAMES);
-        allocInfo.pSetLayouts = layouts.data();
+        renderTargetsChanged = false;
 
-        descriptorSets.resize(MAX_CONCURRENT_FRAMES);
-        if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS)
+        VkSampleCountFlagBits samples = getMaxUsableSampleCount(requestedMsaaSamples);
+        float shading = sampleRateShadingSupported ? requestedSampleShading : 0.0f;
+
+        if (requestedSampleShading > 0.0f && !sampleRateShadingSupported)
         {
-            throw std::runtime_error("Failed to allocate descriptor sets");
+            std::cerr << "Sample rate shading unsupported, shading per pixel\n";
         }
 
-        for (size_t i = 0; i < MAX_CONCURRENT_FRAMES; i++)
+        bool scaling = requestedDynamicResolution && canBlitScene();
+
+        if (requestedDynamicResolution && !scaling)
+        {
+            std::cerr << "Dynamic resolution needs timestamps and a blittable swap chain, rendering at full size\n";
+        }
+
+        if (samples == msaaSamples && shading == sampleShading)
         {
-            VkDescriptorBufferInfo bufferInfo{};
-            bufferInfo.buffer = uniformBuffers[i];
-            bufferInfo.offset = 0;
-            bufferInfo.range = sizeof(UniformBufferObject);
+            // back to the current targets, drop any still compiling
+            pendingTargets.reset();
 
-            VkWriteDescriptorSet descriptorWrite{};
-            descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptorWrite.dstSet = descriptorSets[i];
-            descriptorWrite.dstBinding = 0;
-            descriptorWrite.dstArrayElement = 0;
+            // the scene pipeline is unchanged, only the graph is redeclared
+            switchRenderTargets(samples, shading, scaling);
+            return;
+        }
 
-            descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptorWrite.descriptorCount = 1;
+        PendingTargets pending;
+        pending.samples = samples;
+        pending.sampleShading = shading;
+        pending.scaling = scaling;
 
-            descriptorWrite.pBufferInfo = &bufferInfo;
-            descriptorWrite.pImageInfo = nullptr; // Optional
-            descriptorWrite.pTexelBufferView = nullptr; // Optional
+        // only for its render pass, frames redeclare with the current targets
+        declareRenderGraph(0, swapChainExtent, samples, scaling);
 
-            vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+        pending.description = sceneDescription;
+        pending.description.samples = samples;
+        pending.description.minSampleShading = shading;
+        pending.description.renderPass = renderGraph->declaredRenderPass("scene");
 
-        }
+        // compiled in the background, see selectPipeline
+        pipelineCache->get(pending.description);
+        pendingTargets = pending;
     }
 
-    void VulkanRenderer::createCommandPool()
+    void VulkanRenderer::switchRenderTargets(VkSampleCountFlagBits samples, float shading, bool scaling)
     {
-        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
-
-        VkCommandPoolCreateInfo poolInfo{};
-        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        // command buffers can be rerecorded individually
-        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+        if (scaling != dynamicResolution)
+        {
+            resolution.reset();
+        }
 
-        if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+        if (samples == msaaSamples && shading == sampleShading && scaling == dynamicResolution)
         {
-            throw std::runtime_error("Failed to creaate command pool");
+            return;
         }
 
+        // render thread only, the reload thread registers shaders and never
+        //  reads these, so no lock a compile could be holding
+        msaaSamples = samples;
+        sampleShading = shading;
+        dynamicResolution = scaling;
+
+        // the old graph's images are retired as it recompiles
+        declareRenderGraph(0, swapChainExtent, msaaSamples, dynamicResolution);
+        renderGraph->compile(frameNumber);
+        renderPass = renderGraph->renderPass("scene");
+
+        // equal render passes are shared (and null with dynamic rendering),
+        //  so e.g. toggling dynamic resolution finds the same pipeline
+        sceneDescription.samples = msaaSamples;
+        sceneDescription.minSampleShading = sampleShading;
+        sceneDescription.renderPass = renderPass;
     }
 
-    void VulkanRenderer::createCommandBuffers()
+    void VulkanRenderer::createShaderWatcher()
     {
+        shaderWatcher = std::make_unique<ShaderWatcher>
+        (
+            SHADER_PATH,
+            std::vector<std::string>{"trig.vert", "trig.frag"},
+            [this]() { reloadShaders(); }
+        );
+    }
 
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.commandPool = commandPool;
-        // cannot be called from other command buffers, only submitted
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandBufferCount = MAX_CONCURRENT_FRAMES;
-
-        commandBuffers.resize(MAX_CONCURRENT_FRAMES);
+    void VulkanRenderer::reloadShaders()
+    {
+        std::string vert, frag;
+
+        if 
+        (
+            !Shader::readGlsl(std::string(SHADER_PATH)+"trig.vert", vert) ||
+            !Shader::readGlsl(std::string(SHADER_PATH)+"trig.frag", frag)
+        )
+        {
+            return;
+        }
+
+        std::cout << "Reloading shaders from " << SHADER_PATH << "\n";
+
+        // compiled to one side with no lock held, the working program is untouched if it fails
+        std::unique_ptr<ShaderProgram> program = createTrigProgram(vert, frag);
+        std::vector<VkVertexInputAttributeDescription> attributes;
+
+        try
+        {
+            // setShader waits out compiles using the old modules, stale
+            //  pipelines are drawn with until the cache has recompiled them
+            attributes = registerTrigShader(*program);
+        }
+        catch (const std::exception & e)
+        {
+            // frames carry on with the old program and pipeline
+            std::cerr << "Shader reload failed: " << e.what() << "\n";
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(programMutex);
+            std::swap(trigProgram, program);
+        }
+
+        // the old program's modules go with it, nothing compiles from them any more
+        program.reset();
+
+        std::lock_guard<std::mutex> reloadedLock(reloadedMutex);
+        reloadedAttributes = attributes;
+    }
+
+    void VulkanRenderer::selectPipeline()
+    {
+        // pipelines replaced since last frame are destroyed once this one completes
+        pipelineCache->update(frameNumber);
+
+        {
+            // never wait on the reload thread, pick it up next frame
+            std::unique_lock<std::mutex> lock(reloadedMutex, std::try_to_lock);
+
+            if (lock.owns_lock() && reloadedAttributes)
+            {
+                sceneDescription.vertexAttributes = reloadedAttributes.value();
+                reloadedAttributes.reset();
+
+                if (pendingTargets)
+                {
+                    pendingTargets->description.vertexAttributes = sceneDescription.vertexAttributes;
+                }
+            }
+        }
+
+        // a fallback built for other samples cannot draw into the new targets, so the
+        //  current ones are kept until the exact pipeline is ready. If it fails to
+        //  compile they are kept until the settings or shader change
+        if (pendingTargets && pipelineCache->get(pendingTargets->description).exact)
+        {
+            PendingTargets pending = std::move(pendingTargets.value());
+            pendingTargets.reset();
+
+            switchRenderTargets(pending.samples, pending.sampleShading, pending.scaling);
+        }
+
+        applyPipeline(pipelineCache->get(sceneDescription));
+    }
+
+    void VulkanRenderer::retireCompletedFrames()
+    {
+        for (unsigned i = 0; i < MAX_CONCURRENT_FRAMES; i++)
+        {
+            if (!slotFrames[i])
+            {
+                continue;
+            }
+
+            // currentFrame's fence was just waited on, others may have signalled already
+            if (i == currentFrame || vkGetFenceStatus(device, framesFinished[i]) == VK_SUCCESS)
+            {
+                framesCompleted = std::max(framesCompleted, slotFrames[i].value()+1);
+            }
+        }
+
+        deletionQueue.flush(framesCompleted);
+    }
+
+    PipelineInterface VulkanRenderer::createPipelineInterface(const ShaderReflection & reflection)
+    {
+        std::lock_guard<std::mutex> lock(layoutMutex);
+
+        PipelineInterface pipelineInterface {VK_NULL_HANDLE, VK_NULL_HANDLE, false};
+
+        std::vector<uint32_t> sets = reflection.sets();
+
+        uint32_t setCount = sets.empty() ? 1 : sets.back()+1;
+        if (bindless)
+        {
+            setCount = std::max(setCount, BINDLESS_DESCRIPTOR_SET+1);
+        }
+
+        std::vector<VkDescriptorSetLayout> setLayouts(setCount);
+
+        for (uint32_t set = 0; set < setCount; set++)
+        {
+            if (set == BINDLESS_DESCRIPTOR_SET && bindless)
+            {
+                // shaders must agree with the table, not the other way round
+                for (const auto & b : reflection.bindings)
+                {
+                    if (b.set != set) { continue; }
+
+                    bool matches =
+                        (b.binding == BindlessTable::TEXTURE_BINDING && b.type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) ||
+                        (b.binding == BindlessTable::BUFFER_BINDING && b.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+                    if (!matches)
+                    {
+                        throw std::runtime_error("Shader binding "+b.name+" in the bindless set does not match the bindless table");
+                    }
+                }
+
+                setLayouts[set] = bindless->getLayout();
+                continue;
+            }
+
+            std::vector<VkDescriptorSetLayoutBinding> bindings = reflection.setLayoutBindings(set);
+
+            if (set == FRAME_DESCRIPTOR_SET)
+            {
+                for (const auto & b : bindings)
+                {
+                    if (b.binding != 0) { continue; }
+
+                    if (b.descriptorType != VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || b.descriptorCount != 1)
+                    {
+                        throw std::runtime_error("Shader set 0 binding 0 must be the frame's uniform buffer");
+                    }
+
+                    pipelineInterface.usesFrameUniforms = true;
+                }
+            }
+
+            setLayouts[set] = descriptorLayoutCache->get(bindings);
+        }
+
+        pipelineInterface.frameSetLayout = setLayouts[FRAME_DESCRIPTOR_SET];
+
+        // the renderer always pushes DrawPushConstants, shaders may declare more
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        uint32_t pushConstantSize = std::max(reflection.pushConstantSize, static_cast<uint32_t>(sizeof(DrawPushConstants)));
+
+        if (pushConstantSize > properties.limits.maxPushConstantsSize)
+        {
+            throw std::runtime_error("Shader push constants exceed the device limit of "+std::to_string(properties.limits.maxPushConstantsSize)+" bytes");
+        }
+
+        VkPushConstantRange pushConstantRange{};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = pushConstantSize;
+
+        pipelineInterface.layout = pipelineLayoutCache->get(setLayouts, {pushConstantRange});
+
+        pipelineInterfaces[pipelineInterface.layout] = pipelineInterface;
+
+        return pipelineInterface;
+    }
+
+    std::vector<VkVertexInputAttributeDescription> VulkanRenderer::vertexInputAttributes(const ShaderReflection & reflection)
+    {
+        // what the vertex buffer provides, the shader may consume a subset
+        auto provided = Vertex::getArrtibuteDescriptions();
+
+        std::vector<VkVertexInputAttributeDescription> attributes;
+
+        for (const auto & input : reflection.inputs)
+        {
+            auto attribute = std::find_if
+            (
+                provided.begin(),
+                provided.end(),
+                [&input](const VkVertexInputAttributeDescription & a) { return a.location == input.location; }
+            );
+
+            if (attribute == provided.end())
+            {
+                throw std::runtime_error("Vertex shader input "+input.name+" at location "+std::to_string(input.location)+" is not provided by Vertex");
+            }
+
+            if (attribute->format != input.format)
+            {
+                throw std::runtime_error("Vertex shader input "+input.name+" at location "+std::to_string(input.location)+" does not match the Vertex attribute format");
+            }
+
+            attributes.push_back(*attribute);
+        }
+
+        return attributes;
+    }
+
+    void VulkanRenderer::createGpuTimer()
+    {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+
+        gpuTimer = std::make_unique<GpuTimer>
+        (
+            physicalDevice,
+            device,
+            indices.graphicsFamily.value(),
+            MAX_CONCURRENT_FRAMES
+        );
+    }
+
+    void VulkanRenderer::readFrameStatistics()
+    {
+        std::optional<uint64_t> fragments = fragmentCounter->read(currentFrame);
+
+        if (fragments && slotPixels[currentFrame] > 0)
+        {
+            overdraw = double(fragments.value())/double(slotPixels[currentFrame]);
+        }
+
+        std::optional<double> time = gpuTimer->read(currentFrame);
+
+        if (!time)
+        {
+            return;
+        }
+
+        gpuTime = time.value();
+
+        if (dynamicResolution)
+        {
+            resolution.update(gpuTime);
+        }
+    }
+
+    void VulkanRenderer::createFragmentCounter()
+    {
+        fragmentCounter = std::make_unique<FragmentCounter>(device, pipelineStatisticsSupported, MAX_CONCURRENT_FRAMES);
+        slotPixels.assign(MAX_CONCURRENT_FRAMES, 0);
+    }
+
+    VkFormat VulkanRenderer::findDepthFormat()
+    {
+        // in order of preference, no stencil is needed
+        const std::vector<VkFormat> candidates =
+        {
+            VK_FORMAT_D32_SFLOAT,
+            VK_FORMAT_D24_UNORM_S8_UINT,
+            VK_FORMAT_D32_SFLOAT_S8_UINT,
+            VK_FORMAT_D16_UNORM
+        };
+
+        for (VkFormat format : candidates)
+        {
+            VkFormatProperties properties;
+            vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+            if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+            {
+                return format;
+            }
+        }
+
+        throw std::runtime_error("No supported depth format");
+    }
+
+    void VulkanRenderer::createRenderQueue()
+    {
+        renderQueue = std::make_unique<RenderQueue>(MATERIAL_DESCRIPTOR_SET, std::thread::hardware_concurrency());
+        renderQueue->setBackToFront(TRANSPARENT_LAYER, true);
+    }
+
+    void VulkanRenderer::createFrameScratch()
+    {
+        frameScratch = std::make_unique<FrameScratch>(MAX_CONCURRENT_FRAMES);
+    }
+
+    void VulkanRenderer::createScene()
+    {
+        // a stack of triangles, added back to front, the worst order for overdraw unsorted
+        const unsigned layers = 8;
+
+        for (unsigned i = 0; i < layers; i++)
+        {
+            DrawCommand draw;
+            draw.firstVertex = 0;
+            draw.vertexCount = static_cast<uint32_t>(vertices.size());
+
+            float z = -0.15f*(layers-1-i);
+            float scale = 1.0f+0.1f*(layers-1-i);
+
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, z));
+            model = glm::scale(model, glm::vec3(scale, scale, 1.0f));
+            std::memcpy(draw.constants.model, &model[0][0], sizeof(draw.constants.model));
+
+            sceneDraws.push_back(draw);
+        }
+    }
+
+    void VulkanRenderer::buildRenderQueue()
+    {
+        renderQueue->clear();
+
+        // still compiling with nothing compatible to stand in, clear only
+        if (pipeline == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        // view depth is minus the third row of model-view, glm is column major
+        glm::vec4 depthPlane(-frameModelView[0][2], -frameModelView[1][2], -frameModelView[2][2], -frameModelView[3][2]);
+
+        for (DrawCommand draw : sceneDraws)
+        {
+            draw.pipeline = pipeline;
+            draw.layout = pipelineLayout;
+            draw.vertexBuffer = vertexBuffer;
+
+            // translation is the last column of the column major model matrix
+            const float * model = draw.constants.model;
+            float depth = glm::dot(depthPlane, glm::vec4(model[12], model[13], model[14], 1.0f));
+
+            renderQueue->submit(OPAQUE_LAYER, draw, depth);
+        }
+
+        renderQueue->sort();
+    }
+
+    void VulkanRenderer::blitScene(VkCommandBuffer commandBuffer, uint32_t imageIndex, VkExtent2D extent)
+    {
+        VkImageBlit blit{};
+        blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        blit.srcOffsets[0] = {0, 0, 0};
+        blit.srcOffsets[1] = {int32_t(extent.width), int32_t(extent.height), 1};
+        blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        blit.dstOffsets[0] = {0, 0, 0};
+        blit.dstOffsets[1] = {int32_t(swapChainExtent.width), int32_t(swapChainExtent.height), 1};
+
+        vkCmdBlitImage
+        (
+            commandBuffer,
+            renderGraph->image("scene"),
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            swapChainImages[imageIndex],
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1,
+            &blit,
+            VK_FILTER_LINEAR
+        );
+    }
+
+    void VulkanRenderer::createVertexBuffer()
+    {
+        
+        VkDeviceSize bufferSize = sizeof(vertices[0])*vertices.size();
+
+        // integrated or resizable BAR, write where the GPU reads from and skip the copy
+        if (memoryBudget->directWrites())
+        {
+            createBuffer
+            (
+                bufferSize,
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                vertexBuffer,
+                vertexBufferMemory,
+                "vertex buffer",
+                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                // write combined, not cached, for writes the CPU never reads back
+                VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+            );
+
+            void * data;
+            vkMapMemory(device, vertexBufferMemory, 0, VK_WHOLE_SIZE, 0, &data);
+                std::memcpy(data, vertices.data(), (size_t) bufferSize);
+
+            if (!(memoryBudget->properties(vertexBufferMemory) & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+            {
+                VkMappedMemoryRange range{};
+                range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+                range.memory = vertexBufferMemory;
+                range.offset = 0;
+                range.size = VK_WHOLE_SIZE;
+                vkFlushMappedMemoryRanges(device, 1, &range);
+            }
+
+            // visible to the first submit, which comes after this
+            vkUnmapMemory(device, vertexBufferMemory);
+            return;
+        }
+
+        // first create a staging buffer to transfer into from the host
+        UniqueBuffer stagingBuffer;
+        VkDeviceMemory stagingBufferMemory;
+
+        createBuffer
+        (
+            bufferSize, 
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            stagingBuffer,
+            stagingBufferMemory,
+            "vertex staging",
+            0,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+        );
+
+        void * data;
+        vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+            std::memcpy(data, vertices.data(), (size_t) bufferSize);
+        vkUnmapMemory(device, stagingBufferMemory);
+
+        // create normal buffer
+
+        createBuffer
+        (
+            bufferSize,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            vertexBuffer,
+            vertexBufferMemory,
+            "vertex buffer",
+            0,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+        );
+
+        copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+
+        stagingBuffer.reset();
+        memoryBudget->free(stagingBufferMemory);
+
+    }
+
+    void VulkanRenderer::createUniformBuffers()
+    {
+        uniformArena = std::make_unique<UniformArena>(physicalDevice, device, *memoryBudget, MAX_CONCURRENT_FRAMES);
+    }
+
+    void VulkanRenderer::updateUniformBuffer()
+    {
+        static auto startTime = std::chrono::high_resolution_clock::now();
+
+        auto currentTime = std::chrono::high_resolution_clock::now();
+        float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+
+        UniformBufferObject ubo{};
+        ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    
+        ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    
+        ubo.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float) swapChainExtent.height, 0.1f, 10.0f);
+    
+        ubo.proj[1][1] *= -1;
+
+        frameUniforms = uniformArena->push(ubo);
+
+        frameModelView = ubo.view * ubo.model;
+    }
+
+    void VulkanRenderer::createLayoutCaches()
+    {
+        descriptorLayoutCache = std::make_unique<DescriptorLayoutCache>(device);
+        pipelineLayoutCache = std::make_unique<PipelineLayoutCache>(device);
+    }
+
+    void VulkanRenderer::createBindlessTable()
+    {
+        if (!bindlessSupported)
+        {
+            return;
+        }
+
+        bindless = std::make_unique<BindlessTable>
+        (
+            physicalDevice,
+            device,
+            *descriptorLayoutCache,
+            MAX_CONCURRENT_FRAMES
+        );
+    }
+
+    void VulkanRenderer::createTextureManager()
+    {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+
+        textures = std::make_unique<TextureManager>
+        (
+            physicalDevice,
+            device,
+            graphicsQueue,
+            indices.graphicsFamily.value(),
+            deletionQueue,
+            *memoryBudget,
+            bindless.get(),
+            samplerAnisotropySupported
+        );
+    }
+
+    void VulkanRenderer::createAssetStreamer()
+    {
+        assets = std::make_unique<AssetStreamer>(*textures, *memoryBudget);
+    }
+
+    VirtualTexture * VulkanRenderer::openVirtualTexture(const std::string & pageFile, uint32_t atlasPages)
+    {
+        QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+
+        virtualTextures.push_back
+        (
+            std::make_unique<VirtualTexture>
+            (
+                physicalDevice,
+                device,
+                graphicsQueue,
+                indices.graphicsFamily.value(),
+                *memoryBudget,
+                bindless.get(),
+                textures->getSamplers(),
+                pageFile,
+                atlasPages,
+                sparseResidencySupported
+            )
+        );
+
+        return virtualTextures.back().get();
+    }
+
+    void VulkanRenderer::createDescriptorAllocators()
+    {
+        descriptorAllocators.clear();
+        for (size_t i = 0; i < MAX_CONCURRENT_FRAMES; i++)
+        {
+            descriptorAllocators.push_back(std::make_unique<DescriptorAllocator>(device));
+        }
+
+        descriptorSets.resize(MAX_CONCURRENT_FRAMES, VK_NULL_HANDLE);
+    }
+
+    void VulkanRenderer::allocateDescriptorSets()
+    {
+        // the frame's fence has signalled, so nothing in flight
+        //  still references sets from this frame's pools
+        DescriptorAllocator & allocator = *descriptorAllocators[currentFrame];
+        allocator.reset();
+
+        descriptorSets[currentFrame] = allocator.allocate(descriptorSetLayout);
+
+        if (!usesFrameUniforms)
+        {
+            return;
+        }
+
+        VkDescriptorBufferInfo bufferInfo{};
+        bufferInfo.buffer = frameUniforms.buffer;
+        bufferInfo.offset = frameUniforms.offset;
+        bufferInfo.range = frameUniforms.size;
+
+        VkWriteDescriptorSet descriptorWrite{};
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = descriptorSets[currentFrame];
+        descriptorWrite.dstBinding = 0;
+        descriptorWrite.dstArrayElement = 0;
+
+        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        descriptorWrite.descriptorCount = 1;
+
+        descriptorWrite.pBufferInfo = &bufferInfo;
+        descriptorWrite.pImageInfo = nullptr; // Optional
+        descriptorWrite.pTexelBufferView = nullptr; // Optional
+
+        vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+    }
+
+    void VulkanRenderer::createCommandPool()
+    {
+        QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        // command buffers can be rerecorded individually
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, commandPool.put(device)) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to creaate command pool");
+        }
+
+    }
+
+    void VulkanRenderer::createCommandBuffers()
+    {
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commandPool;
+        // cannot be called from other command buffers, only submitted
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = MAX_CONCURRENT_FRAMES;
+
+        commandBuffers.resize(MAX_CONCURRENT_FRAMES);
 
         if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
         {
@@ -1111,50 +1797,25 @@ namespace Renderer
             throw std::runtime_error("Failed to begin recording command buffer");
         }
 
-        VkRenderPassBeginInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = renderPass;
-        renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
-        // size of the render area for shader 
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = swapChainExtent;
-        // set the clear values fo VK_ATTACHMENT_LOAD_OP_CLEAR;
-        VkClearValue clearColour = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-        renderPassInfo.clearValueCount = 1;
-        renderPassInfo.pClearValues = &clearColour;
+        gpuTimer->begin(commandBuffer, currentFrame);
+        fragmentCounter->reset(commandBuffer, currentFrame);
 
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+        // the top left of the full size scene target when scaling
+        VkExtent2D extent = dynamicResolution ? resolution.extent(swapChainExtent) : swapChainExtent;
 
-            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        declareRenderGraph(imageIndex, extent, msaaSamples, dynamicResolution);
+        renderGraph->compile(frameNumber);
 
-            // dynamics viewport and scissor
-            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-            vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        fragmentCounter->begin(commandBuffer, currentFrame);
+        slotPixels[currentFrame] = uint64_t(extent.width)*extent.height;
 
-            // bind vertex buffers
-            VkBuffer vertexBuffers[] = {vertexBuffer};
-            VkDeviceSize offsets[] = {0};
-            vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+        // barriers, render passes and the upscale
+        renderGraph->execute(commandBuffer, *frameScratch);
 
-            // use descriptor stes
-            vkCmdBindDescriptorSets
-            (
-                commandBuffer, 
-                VK_PIPELINE_BIND_POINT_GRAPHICS, 
-                pipelineLayout,
-                0,
-                1,
-                &descriptorSets[currentFrame],
-                0,
-                nullptr
-            );
+        fragmentCounter->end(commandBuffer, currentFrame);
 
-            // the draw command is issues
-            // vertexCount, instanceCount, firstVertex, firstInstance
-            vkCmdDraw(commandBuffer, vertices.size(), 1, 0, 0);
+        gpuTimer->end(commandBuffer, currentFrame);
 
-        // end
-        vkCmdEndRenderPass(commandBuffer);
         if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
         {
             throw std::runtime_error("Failed to record command buffer");
@@ -1174,19 +1835,21 @@ namespace Renderer
         imageAvailableSemaphores.resize(MAX_CONCURRENT_FRAMES);
         renderFinsihedSemaphores.resize(MAX_CONCURRENT_FRAMES);
         framesFinished.resize(MAX_CONCURRENT_FRAMES);
+        // signalled fences with nothing submitted yet
+        slotFrames.assign(MAX_CONCURRENT_FRAMES, std::nullopt);
 
         for (unsigned i = 0; i < MAX_CONCURRENT_FRAMES; i++)
         {
             if 
             (
-                vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-                vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinsihedSemaphores[i]) != VK_SUCCESS
+                vkCreateSemaphore(device, &semaphoreInfo, nullptr, imageAvailableSemaphores[i].put(device)) != VK_SUCCESS ||
+                vkCreateSemaphore(device, &semaphoreInfo, nullptr, renderFinsihedSemaphores[i].put(device)) != VK_SUCCESS
             )
             {
                 throw std::runtime_error("Failed to create semaphore");
             }
 
-            if (vkCreateFence(device, &fenceInfo, nullptr, &framesFinished[i]) != VK_SUCCESS)
+            if (vkCreateFence(device, &fenceInfo, nullptr, framesFinished[i].put(device)) != VK_SUCCESS)
             {
                 throw std::runtime_error("Failed to create fence");
             }
@@ -1214,17 +1877,84 @@ namespace Renderer
 
         populateDebugMessengerCreateInfo(createInfo);
 
-        if (createDebugUtilsMessengerEXT(instance, &createInfo, nullptr, &debugMessenger) != VK_SUCCESS)
+        if (createDebugUtilsMessengerEXT(instance, &createInfo, nullptr, debugMessenger.put(instance)) != VK_SUCCESS)
         {
             throw std::runtime_error("failed to set up debug messenger!");
         }
     }
 
     void VulkanRenderer::drawFrame()
+    {
+        uint64_t allocations = threadAllocations();
+
+        bool presented = renderFrame();
+
+        // after presenting, so input is sampled as late as possible next frame
+        double elapsed = frameLimiter.wait();
+
+        if (presented && elapsed > 0.0)
+        {
+            frameTimes.record(elapsed);
+        }
+
+        checkFrameAllocations(threadAllocations() - allocations);
+    }
+
+    void VulkanRenderer::checkFrameAllocations(uint64_t allocations)
+    {
+        if (!countingAllocations())
+        {
+            return;
+        }
+
+        allocationStats.counting = true;
+        allocationStats.last = allocations;
+
+        // pipelines, render targets and pools settle in the first frames
+        if (frameNumber <= ALLOCATION_WARM_UP_FRAMES || allocations == 0)
+        {
+            return;
+        }
+
+        allocationStats.allocatingFrames++;
+        allocationStats.peak = std::max(allocationStats.peak, allocations);
+
+        // streaming, resizes and reloads allocate by design, the first is
+        //  worth a look, the rest are in the stats
+        if (!allocationsWarned)
+        {
+            std::cerr << "Frame " << frameNumber-1 << " made " << allocations << " heap allocations after warm up\n";
+            allocationsWarned = true;
+        }
+    }
+
+    bool VulkanRenderer::renderFrame()
     {
         // VK_TRUE = wait for all fences
         // last is a timeout integer
-        vkWaitForFences(device, 1, &framesFinished[currentFrame], VK_TRUE, UINT64_MAX);
+        vkWaitForFences(device, 1, framesFinished[currentFrame].address(), VK_TRUE, UINT64_MAX);
+
+        // nothing recorded into the slot's scratch is needed any more
+        frameScratch->begin(currentFrame);
+
+        retireCompletedFrames();
+
+        readFrameStatistics();
+
+        if (renderTargetsChanged)
+        {
+            applyRenderTargetSettings();
+        }
+
+        if (framebufferResized)
+        {
+            recreateSwapChain();
+            if (framebufferResized)
+            {
+                // minimised, nothing to draw into
+                return false;
+            }
+        }
 
         // aquire an image
         uint32_t imageIndex; 
@@ -1232,27 +1962,64 @@ namespace Renderer
         
         if (result == VK_ERROR_OUT_OF_DATE_KHR)
         {
-            recreateSwapChain();
-            return;
+            // nothing was submitted, rebuild at the start of the next frame
+            framebufferResized = true;
+            return false;
         }
         else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
         {
             throw std::runtime_error("Failed to aquire swap chain image");
         }
 
+        // the frame's fence has signalled, its uniforms are no longer read
+        uniformArena->begin(currentFrame);
+
         updateUniformBuffer();
 
-        vkResetFences(device, 1, &framesFinished[currentFrame]);
+        selectPipeline();
+
+        buildRenderQueue();
+
+        allocateDescriptorSets();
+
+        if (bindless)
+        {
+            bindless->beginFrame(currentFrame);
+        }
+
+        // ahead of streaming more in, evicting what completed frames used least recently
+        memoryBudget->update(framesCompleted);
+
+        // a bounded amount of what has streamed in, uploaded with the flush below
+        assets->update(frameNumber);
+
+        // ahead of the frame on the same queue, so its draws see the pixels
+        textures->flush();
+
+        // pages that streamed in, evicting only what completed frames asked for
+        for (auto & virtualTexture : virtualTextures)
+        {
+            virtualTexture->update(frameNumber, framesCompleted);
+        }
+
+        vkResetFences(device, 1, framesFinished[currentFrame].address());
 
         vkResetCommandBuffer(commandBuffers[currentFrame], 0);
         recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+
+        // one flush for every uniform written this frame, if the memory is not coherent
+        uniformArena->flush();
+
         // submit the command buffer 
         VkSubmitInfo submitInfo{};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
         // wait on this semaphore
         VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-        // in this stage of the pipline
-        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+        // in this stage of the pipline, where the graph first touches the swap chain image
+        VkPipelineStageFlags waitStages[] = 
+        {
+            renderGraph->firstStage("swapchain")
+        };
         submitInfo.waitSemaphoreCount = 1;
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
@@ -1269,6 +2036,8 @@ namespace Renderer
             throw std::runtime_error("Failed to submit draw comamnd buffer");
         }
 
+        slotFrames[currentFrame] = frameNumber;
+
         VkPresentInfoKHR presentInfo{};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
         presentInfo.waitSemaphoreCount = 1;
@@ -1285,7 +2054,7 @@ namespace Renderer
 
         if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
         {
-            recreateSwapChain();
+            framebufferResized = true;
         }
         else if (result != VK_SUCCESS)
         {
@@ -1293,31 +2062,20 @@ namespace Renderer
         }
 
         currentFrame = (currentFrame+1)%MAX_CONCURRENT_FRAMES;
-    }
+        frameNumber++;
 
-    uint32_t VulkanRenderer::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
-    {
-        VkPhysicalDeviceMemoryProperties memProperties;
-        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
-
-        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
-        {
-            if (typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
-            {
-                return i;
-            }
-        }
-
-        throw std::runtime_error("Failed to find suitable memory type");
+        return true;
     }
 
-
     void VulkanRenderer::createBuffer
     (
         VkDeviceSize size, 
         VkBufferUsageFlags usage, 
         VkMemoryPropertyFlags properties,
-        VkBuffer & buffer, VkDeviceMemory & bufferMemory
+        UniqueBuffer & buffer, VkDeviceMemory & bufferMemory,
+        const std::string & what,
+        VkMemoryPropertyFlags preferred,
+        VkMemoryPropertyFlags avoided
     )
     {
         VkBufferCreateInfo bufferInfo{};
@@ -1326,7 +2084,7 @@ namespace Renderer
         bufferInfo.usage = usage;
         bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-        if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+        if (vkCreateBuffer(device, &bufferInfo, nullptr, buffer.put(device)) != VK_SUCCESS)
         {
             throw std::runtime_error("Failed to create vertex buffer");
         }
@@ -1334,20 +2092,7 @@ namespace Renderer
         VkMemoryRequirements memRequirements;
         vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-        VkMemoryAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-
-        allocInfo.memoryTypeIndex = findMemoryType
-            (
-                memRequirements.memoryTypeBits,
-                properties
-            );
-
-        if (vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
-        {
-            throw std::runtime_error("Failed to allocate vertex buffer memory");
-        }
+        bufferMemory = memoryBudget->allocate(memRequirements, properties, preferred, avoided, what);
 
         // last is an offset in memory
         vkBindBufferMemory(device, buffer, bufferMemory, 0);
@@ -0,0 +1,480 @@
+#include <Shader/reflection.h>
+
+#include <algorithm>
+#include <set>
+
+namespace Renderer
+{
+
+    ShaderReflection ShaderReflection::reflect(const std::vector<uint32_t> & spirv)
+    {
+        const uint32_t magic = 0x07230203;
+
+        if (spirv.size() < 5 || spirv[0] != magic)
+        {
+            throw std::runtime_error("Shader reflection given invalid SPIR-V");
+        }
+
+        ShaderReflection reflection;
+
+        Module module;
+
+        // variable id to (pointer type, storage class)
+        std::vector<std::pair<uint32_t, std::pair<uint32_t, uint32_t>>> variables;
+
+        // ids of specialisation constants, decorated with a SpecId
+        std::vector<uint32_t> specConstants;
+
+        // header is 5 words
+        size_t word = 5;
+        while (word < spirv.size())
+        {
+            uint16_t op = spirv[word] & 0xffff;
+            uint16_t length = spirv[word] >> 16;
+
+            if (length == 0 || word + length > spirv.size())
+            {
+                throw std::runtime_error("Shader reflection found a truncated SPIR-V instruction");
+            }
+
+            const uint32_t * args = &spirv[word+1];
+
+            switch (op)
+            {
+                case OpName:
+                    module.names[args[0]] = reinterpret_cast<const char *>(&args[1]);
+                    break;
+                case OpEntryPoint:
+                    switch (args[0])
+                    {
+                        case 0: reflection.stages |= VK_SHADER_STAGE_VERTEX_BIT; break;
+                        case 1: reflection.stages |= VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT; break;
+                        case 2: reflection.stages |= VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT; break;
+                        case 3: reflection.stages |= VK_SHADER_STAGE_GEOMETRY_BIT; break;
+                        case 4: reflection.stages |= VK_SHADER_STAGE_FRAGMENT_BIT; break;
+                        case 5: reflection.stages |= VK_SHADER_STAGE_COMPUTE_BIT; break;
+                        default: break;
+                    }
+                    break;
+                case OpTypeInt:
+                {
+                    Type & t = module.types[args[0]];
+                    t.op = op;
+                    t.width = args[1];
+                    t.isSigned = args[2] != 0;
+                    break;
+                }
+                case OpTypeFloat:
+                {
+                    Type & t = module.types[args[0]];
+                    t.op = op;
+                    t.width = args[1];
+                    break;
+                }
+                case OpTypeVector:
+                case OpTypeMatrix:
+                {
+                    Type & t = module.types[args[0]];
+                    t.op = op;
+                    t.element = args[1];
+                    t.count = args[2];
+                    break;
+                }
+                case OpTypeImage:
+                {
+                    Type & t = module.types[args[0]];
+                    t.op = op;
+                    // Dim, 5 is Buffer
+                    t.element = args[2];
+                    t.sampled = args[6];
+                    break;
+                }
+                case OpTypeSampler:
+                case OpTypeAccelerationStructureKHR:
+                    module.types[args[0]].op = op;
+                    break;
+                case OpTypeSampledImage:
+                case OpTypeRuntimeArray:
+                {
+                    Type & t = module.types[args[0]];
+                    t.op = op;
+                    t.element = args[1];
+                    break;
+                }
+                case OpTypeArray:
+                {
+                    Type & t = module.types[args[0]];
+                    t.op = op;
+                    t.element = args[1];
+                    // length is the id of a constant
+                    t.count = args[2];
+                    break;
+                }
+                case OpTypeStruct:
+                {
+                    Type & t = module.types[args[0]];
+                    t.op = op;
+                    t.members.assign(&args[1], &args[length-1]);
+                    break;
+                }
+                case OpTypePointer:
+                {
+                    Type & t = module.types[args[0]];
+                    t.op = op;
+                    t.storage = args[1];
+                    t.element = args[2];
+                    break;
+                }
+                case OpConstant:
+                    // only 32 bit integer constants matter, i.e. array lengths
+                    module.constants[args[1]] = args[2];
+                    break;
+                case OpSpecConstantTrue:
+                case OpSpecConstantFalse:
+                case OpSpecConstant:
+                    specConstants.push_back(args[1]);
+                    break;
+                case OpVariable:
+                    variables.push_back({args[1], {args[0], args[2]}});
+                    break;
+                case OpDecorate:
+                    module.decorations[args[0]].values[args[1]] = length > 3 ? args[2] : 0;
+                    break;
+                case OpMemberDecorate:
+                    module.decorations[args[0]].members[args[1]][args[2]] = length > 4 ? args[3] : 0;
+                    break;
+                default:
+                    break;
+            }
+
+            word += length;
+        }
+
+        // array lengths refer to constants, resolve them now all are known
+        for (auto & type : module.types)
+        {
+            if (type.second.op == OpTypeArray)
+            {
+                auto length = module.constants.find(type.second.count);
+                type.second.count = length == module.constants.end() ? 1 : length->second;
+            }
+        }
+
+        for (auto & variable : variables)
+        {
+            uint32_t id = variable.first;
+            uint32_t storage = variable.second.second;
+
+            auto pointer = module.types.find(variable.second.first);
+            if (pointer == module.types.end()) { continue; }
+            uint32_t typeId = pointer->second.element;
+
+            const Decorations & decorations = module.decorations[id];
+            std::string name = module.names.count(id) ? module.names[id] : "";
+
+            switch (storage)
+            {
+                case Input:
+                case Output:
+                {
+                    // gl_Position, gl_VertexIndex etc. are not user interface
+                    if (decorations.has(BuiltIn) || !decorations.has(Location)) { break; }
+
+                    // builtin blocks, gl_PerVertex, are decorated on their members
+                    auto type = module.types.find(typeId);
+                    if (type != module.types.end() && type->second.op == OpTypeStruct) { break; }
+
+                    ReflectedVariable v {decorations.values.at(Location), format(module, typeId), name};
+                    (storage == Input ? reflection.inputs : reflection.outputs).push_back(v);
+                    break;
+                }
+                case UniformConstant:
+                case Uniform:
+                case StorageBuffer:
+                {
+                    ReflectedBinding b;
+                    b.set = decorations.has(DescriptorSet) ? decorations.values.at(DescriptorSet) : 0;
+                    b.binding = decorations.has(Binding) ? decorations.values.at(Binding) : 0;
+                    b.count = 1;
+                    b.type = descriptorType(module, typeId, storage, b.count);
+                    b.stages = reflection.stages;
+                    b.name = name;
+                    reflection.bindings.push_back(b);
+                    break;
+                }
+                case PushConstant:
+                    reflection.pushConstantSize = std::max(reflection.pushConstantSize, size(module, typeId));
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        for (uint32_t id : specConstants)
+        {
+            auto decorations = module.decorations.find(id);
+            if (decorations != module.decorations.end() && decorations->second.has(SpecId))
+            {
+                reflection.specialisationConstants.push_back(decorations->second.values.at(SpecId));
+            }
+        }
+        std::sort(reflection.specialisationConstants.begin(), reflection.specialisationConstants.end());
+
+        auto byLocation = [](const ReflectedVariable & a, const ReflectedVariable & b) { return a.location < b.location; };
+        std::sort(reflection.inputs.begin(), reflection.inputs.end(), byLocation);
+        std::sort(reflection.outputs.begin(), reflection.outputs.end(), byLocation);
+
+        return reflection;
+    }
+
+    VkFormat ShaderReflection::format(const Module & module, uint32_t typeId)
+    {
+        auto type = module.types.find(typeId);
+        if (type == module.types.end())
+        {
+            return VK_FORMAT_UNDEFINED;
+        }
+
+        const Type & t = type->second;
+
+        uint32_t components = 1;
+        const Type * scalar = &t;
+
+        if (t.op == OpTypeVector)
+        {
+            components = t.count;
+            auto element = module.types.find(t.element);
+            if (element == module.types.end()) { return VK_FORMAT_UNDEFINED; }
+            scalar = &element->second;
+        }
+
+        if (scalar->width != 32 || components < 1 || components > 4)
+        {
+            return VK_FORMAT_UNDEFINED;
+        }
+
+        static const VkFormat floats[4] = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+        static const VkFormat ints[4] = {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+        static const VkFormat uints[4] = {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+
+        if (scalar->op == OpTypeFloat) { return floats[components-1]; }
+        if (scalar->op == OpTypeInt) { return scalar->isSigned ? ints[components-1] : uints[components-1]; }
+
+        return VK_FORMAT_UNDEFINED;
+    }
+
+    uint32_t ShaderReflection::size(const Module & module, uint32_t typeId)
+    {
+        auto type = module.types.find(typeId);
+        if (type == module.types.end())
+        {
+            return 0;
+        }
+
+        const Type & t = type->second;
+
+        switch (t.op)
+        {
+            case OpTypeInt:
+            case OpTypeFloat:
+                return t.width / 8;
+            case OpTypeVector:
+                return t.count * size(module, t.element);
+            case OpTypeMatrix:
+                // column major, columns may be padded by MatrixStride, assume vec4 stride
+                return t.count * std::max(size(module, t.element), 16u);
+            case OpTypeArray:
+            {
+                auto decorations = module.decorations.find(typeId);
+                uint32_t stride = size(module, t.element);
+                if (decorations != module.decorations.end() && decorations->second.has(ArrayStride))
+                {
+                    stride = decorations->second.values.at(ArrayStride);
+                }
+                return t.count * stride;
+            }
+            case OpTypeStruct:
+            {
+                auto decorations = module.decorations.find(typeId);
+                uint32_t end = 0;
+                for (uint32_t m = 0; m < t.members.size(); m++)
+                {
+                    uint32_t offset = 0;
+                    if (decorations != module.decorations.end())
+                    {
+                        auto member = decorations->second.members.find(m);
+                        if (member != decorations->second.members.end() && member->second.count(Offset))
+                        {
+                            offset = member->second.at(Offset);
+                        }
+                    }
+                    end = std::max(end, offset + size(module, t.members[m]));
+                }
+                return end;
+            }
+            default:
+                return 0;
+        }
+    }
+
+    VkDescriptorType ShaderReflection::descriptorType(const Module & module, uint32_t typeId, uint32_t storage, uint32_t & count)
+    {
+        auto type = module.types.find(typeId);
+        if (type == module.types.end())
+        {
+            throw std::runtime_error("Shader reflection found a resource of unknown type");
+        }
+
+        const Type * t = &type->second;
+
+        // arrays of resources, sampler2D textures[16] or textures[]
+        while (t->op == OpTypeArray || t->op == OpTypeRuntimeArray)
+        {
+            count = t->op == OpTypeArray ? count * t->count : 0;
+            typeId = t->element;
+            t = &module.types.at(typeId);
+        }
+
+        switch (t->op)
+        {
+            case OpTypeSampledImage:
+            {
+                const Type & image = module.types.at(t->element);
+                // Dim Buffer
+                return image.element == 5 ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            }
+            case OpTypeImage:
+                if (t->element == 5)
+                {
+                    return t->sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+                }
+                return t->sampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+            case OpTypeSampler:
+                return VK_DESCRIPTOR_TYPE_SAMPLER;
+            case OpTypeAccelerationStructureKHR:
+                return VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+            case OpTypeStruct:
+            {
+                if (storage == StorageBuffer)
+                {
+                    return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                }
+
+                // older style storage buffers are Uniform + BufferBlock
+                auto decorations = module.decorations.find(typeId);
+                if (decorations != module.decorations.end() && decorations->second.has(BufferBlock))
+                {
+                    return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                }
+                return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            }
+            default:
+                throw std::runtime_error("Shader reflection found an unsupported resource type");
+        }
+    }
+
+    void ShaderReflection::merge(const ShaderReflection & other)
+    {
+        for (const auto & b : other.bindings)
+        {
+            auto match = std::find_if
+            (
+                bindings.begin(),
+                bindings.end(),
+                [&b](const ReflectedBinding & a) { return a.set == b.set && a.binding == b.binding; }
+            );
+
+            if (match == bindings.end())
+            {
+                bindings.push_back(b);
+                continue;
+            }
+
+            if (match->type != b.type || match->count != b.count)
+            {
+                throw std::runtime_error
+                (
+                    "Shader stages disagree on set " + std::to_string(b.set) +
+                    " binding " + std::to_string(b.binding)
+                );
+            }
+
+            match->stages |= b.stages;
+        }
+
+        for (uint32_t id : other.specialisationConstants)
+        {
+            if (std::find(specialisationConstants.begin(), specialisationConstants.end(), id) == specialisationConstants.end())
+            {
+                specialisationConstants.push_back(id);
+            }
+        }
+        std::sort(specialisationConstants.begin(), specialisationConstants.end());
+
+        // the vertex stage's inputs are the vertex attributes, even if there are none
+        //  (e.g. a fullscreen pass using gl_VertexIndex), other stages' are varyings
+        if (!(stages & VK_SHADER_STAGE_VERTEX_BIT))
+        {
+            inputs = other.inputs;
+        }
+        outputs = other.outputs;
+
+        stages |= other.stages;
+        pushConstantSize = std::max(pushConstantSize, other.pushConstantSize);
+    }
+
+    std::vector<uint32_t> ShaderReflection::sets() const
+    {
+        std::set<uint32_t> s;
+        for (const auto & b : bindings) { s.insert(b.set); }
+        return {s.begin(), s.end()};
+    }
+
+    std::vector<VkDescriptorSetLayoutBinding> ShaderReflection::setLayoutBindings(uint32_t set) const
+    {
+        std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
+
+        for (const auto & b : bindings)
+        {
+            if (b.set != set) { continue; }
+
+            if (b.count == 0)
+            {
+                throw std::runtime_error("Runtime sized descriptor array "+b.name+" needs a bindless layout");
+            }
+
+            VkDescriptorSetLayoutBinding layoutBinding{};
+            layoutBinding.binding = b.binding;
+            layoutBinding.descriptorType = b.type;
+            layoutBinding.descriptorCount = b.count;
+            layoutBinding.stageFlags = b.stages;
+            layoutBinding.pImmutableSamplers = nullptr;
+            layoutBindings.push_back(layoutBinding);
+        }
+
+        return layoutBindings;
+    }
+
+    void ShaderReflection::checkInterface(const ShaderReflection & next) const
+    {
+        for (const auto & in : next.inputs)
+        {
+            auto out = std::find_if
+            (
+                outputs.begin(),
+                outputs.end(),
+                [&in](const ReflectedVariable & o) { return o.location == in.location; }
+            );
+
+            if (out == outputs.end())
+            {
+                throw std::runtime_error("Shader input "+in.name+" at location "+std::to_string(in.location)+" is never written by the previous stage");
+            }
+
+            if (out->format != in.format)
+            {
+                throw std::runtime_error("Shader input "+in.name+" at location "+std::to_string(in.location)+" does not match the previous stage's output type");
+            }
+        }
+    }
+}
@@ -3,10 +3,82 @@
 namespace Renderer
 {
 
-    Shader::~Shader()
+    void Shader::compile
+    (
+        const std::string & programName,
+        const std::string & vertexGlsl,
+        const std::string & fragmentGlsl,
+        const std::map<std::string, std::string> & macros
+    )
     {
-        vkDestroyShaderModule(device, fragmentModule, nullptr);
-        vkDestroyShaderModule(device, vertexModule, nullptr);
+        shaderc::CompileOptions options;
+
+        for (const auto & macro : macros)
+        {
+            options.AddMacroDefinition(macro.first, macro.second);
+        }
+
+        auto preprocessedVert = preprocessShader
+        (
+            programName, 
+            shaderc_glsl_vertex_shader, 
+            vertexGlsl, 
+            options
+        );
+
+        vertexSource = compileSPIRV
+        (
+            programName, 
+            shaderc_glsl_vertex_shader, 
+            preprocessedVert, 
+            options,
+            true
+        );
+
+        std::cout << "Compiled to a binary module with " << vertexSource.size()
+                  << " words." << std::endl;
+
+        auto preprocessedFrag = preprocessShader
+        (
+            programName, 
+            shaderc_glsl_fragment_shader, 
+            fragmentGlsl, 
+            options
+        );
+
+        fragmentSource = compileSPIRV
+        (
+            programName, 
+            shaderc_glsl_fragment_shader, 
+            preprocessedFrag, 
+            options,
+            true
+        );
+
+        std::cout << "Compiled to a binary module with " << fragmentSource.size()
+                  << " words." << std::endl;
+
+        // catch layout and interface mistakes now rather than at draw time
+        ShaderReflection vertexReflection = ShaderReflection::reflect(vertexSource);
+        ShaderReflection fragmentReflection = ShaderReflection::reflect(fragmentSource);
+        vertexReflection.checkInterface(fragmentReflection);
+
+        reflection = vertexReflection;
+        reflection.merge(fragmentReflection);
+    }
+
+    bool Shader::readGlsl(const std::string & filename, std::string & source)
+    {
+        std::ifstream file(filename);
+
+        if (!file.is_open())
+        {
+            return false;
+        }
+
+        source.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+        return true;
     }
 
     std::vector<char> Shader::readSPIRV(const std::string & filename)
@@ -29,14 +101,14 @@ namespace Renderer
         return buffer;
     }
 
-    void Shader::createShaderModules(const VkDevice & device)
+    void Shader::createShaderModules()
     {
         VkShaderModuleCreateInfo createInfo {};
         createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
         createInfo.codeSize = vertexSource.size()*4;
         createInfo.pCode = reinterpret_cast<const uint32_t*>(vertexSource.data());
 
-        if (vkCreateShaderModule(device, &createInfo, nullptr, &vertexModule) != VK_SUCCESS)
+        if (vkCreateShaderModule(device, &createInfo, nullptr, vertexModule.put(device)) != VK_SUCCESS)
         {
             throw std::runtime_error("Failed to create vertex shader module");
         }
@@ -44,13 +116,13 @@ namespace Renderer
         createInfo.codeSize = fragmentSource.size()*4;
         createInfo.pCode = reinterpret_cast<const uint32_t*>(fragmentSource.data());
 
-        if (vkCreateShaderModule(device, &createInfo, nullptr, &fragmentModule) != VK_SUCCESS)
+        if (vkCreateShaderModule(device, &createInfo, nullptr, fragmentModule.put(device)) != VK_SUCCESS)
         {
             throw std::runtime_error("Failed to create fragment shader module");
         }
     }
 
-    std::vector<VkPipelineShaderStageCreateInfo> Shader::shaderStage()
+    std::vector<VkPipelineShaderStageCreateInfo> Shader::shaderStage(const VkSpecializationInfo * specialisation)
     {
         VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
         vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -58,8 +130,8 @@ namespace Renderer
         vertShaderStageInfo.module = vertexModule;
         // the entry point
         vertShaderStageInfo.pName = "main";
-        // can set constant on-the-fly
-        // vertShaderStageInfo.pSpecializationInfo
+        // can set constant on-the-fly, ids a stage does not use are ignored
+        vertShaderStageInfo.pSpecializationInfo = specialisation;
 
         VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
         fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -67,6 +139,7 @@ namespace Renderer
         fragShaderStageInfo.module = fragmentModule;
         // the entry point
         fragShaderStageInfo.pName = "main";
+        fragShaderStageInfo.pSpecializationInfo = specialisation;
 
         std::vector<VkPipelineShaderStageCreateInfo> shaderStages = 
         {
@@ -0,0 +1,179 @@
+#include <Shader/variants.h>
+
+#include <algorithm>
+#include <functional>
+
+namespace Renderer
+{
+
+    void Specialisation::set(uint32_t id, uint32_t value)
+    {
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (entries[i].constantID == id)
+            {
+                data[i] = value;
+                return;
+            }
+        }
+
+        VkSpecializationMapEntry entry{};
+        entry.constantID = id;
+        entry.offset = static_cast<uint32_t>(data.size()*sizeof(uint32_t));
+        entry.size = sizeof(uint32_t);
+
+        entries.push_back(entry);
+        data.push_back(value);
+    }
+
+    const VkSpecializationInfo * Specialisation::info()
+    {
+        if (entries.empty())
+        {
+            return nullptr;
+        }
+
+        specialisationInfo.mapEntryCount = static_cast<uint32_t>(entries.size());
+        specialisationInfo.pMapEntries = entries.data();
+        specialisationInfo.dataSize = data.size()*sizeof(uint32_t);
+        specialisationInfo.pData = data.data();
+
+        return &specialisationInfo;
+    }
+
+    size_t Specialisation::hash() const
+    {
+        // order of setting should not matter
+        std::vector<std::pair<uint32_t, uint32_t>> values;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            values.push_back({entries[i].constantID, data[i]});
+        }
+        std::sort(values.begin(), values.end());
+
+        size_t seed = 0;
+        for (auto & v : values)
+        {
+            size_t h = std::hash<uint64_t>()((uint64_t(v.first) << 32) | v.second);
+            seed ^= h + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+        }
+        return seed;
+    }
+
+    void ShaderProgram::addMacroAxis(std::string macro, std::vector<std::string> values)
+    {
+        if (values.empty())
+        {
+            throw std::runtime_error("Macro axis "+macro+" of "+name+" has no values");
+        }
+
+        for (const auto & axis : axes)
+        {
+            if (axis.first == macro)
+            {
+                throw std::runtime_error("Macro axis "+macro+" of "+name+" declared twice");
+            }
+        }
+
+        axes.push_back({macro, values});
+        // existing variants were compiled without the new axis
+        variants.clear();
+    }
+
+    void ShaderProgram::addSpecialisationConstant(std::string constant, uint32_t id)
+    {
+        constants[constant] = id;
+    }
+
+    uint32_t ShaderProgram::specialisationId(const std::string & constant) const
+    {
+        auto c = constants.find(constant);
+        if (c == constants.end())
+        {
+            throw std::runtime_error("Unknown specialisation constant "+constant+" for "+name);
+        }
+        return c->second;
+    }
+
+    ShaderProgram::MacroValues ShaderProgram::resolve(const MacroValues & macros) const
+    {
+        MacroValues resolved;
+
+        for (const auto & axis : axes)
+        {
+            auto given = macros.find(axis.first);
+            if (given == macros.end())
+            {
+                resolved[axis.first] = axis.second.front();
+                continue;
+            }
+
+            if (std::find(axis.second.begin(), axis.second.end(), given->second) == axis.second.end())
+            {
+                throw std::runtime_error("Value "+given->second+" is not on macro axis "+axis.first+" of "+name);
+            }
+
+            resolved[axis.first] = given->second;
+        }
+
+        if (resolved.size() != macros.size())
+        {
+            for (const auto & macro : macros)
+            {
+                if (resolved.find(macro.first) == resolved.end())
+                {
+                    throw std::runtime_error("Unknown macro axis "+macro.first+" for "+name);
+                }
+            }
+        }
+
+        return resolved;
+    }
+
+    size_t ShaderProgram::permutationHash(const MacroValues & macros) const
+    {
+        MacroValues resolved = resolve(macros);
+
+        size_t seed = 0;
+        for (const auto & axis : axes)
+        {
+            size_t h = std::hash<std::string>()(axis.first + "=" + resolved[axis.first]);
+            seed ^= h + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+        }
+        return seed;
+    }
+
+    Shader & ShaderProgram::variant(const MacroValues & macros)
+    {
+        MacroValues resolved = resolve(macros);
+
+        auto cached = variants.find(resolved);
+        if (cached != variants.end())
+        {
+            return *cached->second;
+        }
+
+        auto shader = std::make_unique<Shader>(device, name, vertex, fragment, resolved);
+
+        // every declared constant should exist in some stage of the module
+        const auto & ids = shader->getReflection().specialisationConstants;
+        for (const auto & constant : constants)
+        {
+            if (std::find(ids.begin(), ids.end(), constant.second) == ids.end())
+            {
+                throw std::runtime_error("Specialisation constant "+constant.first+" is not declared in "+name);
+            }
+        }
+
+        Shader & s = *shader;
+        variants[resolved] = std::move(shader);
+        return s;
+    }
+
+    void ShaderProgram::setSource(std::string vertexGlsl, std::string fragmentGlsl)
+    {
+        vertex = vertexGlsl;
+        fragment = fragmentGlsl;
+        variants.clear();
+    }
+}
@@ -0,0 +1,124 @@
+#include <Shader/watcher.h>
+
+#include <algorithm>
+
+#ifndef WINDOWS
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+namespace Renderer
+{
+
+    ShaderWatcher::ShaderWatcher
+    (
+        std::string dir,
+        std::vector<std::string> f,
+        std::function<void()> callback
+    )
+    : directory(dir), files(f), onChange(callback), fd(-1), wd(-1), running(false)
+    {
+#ifndef WINDOWS
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0)
+        {
+            std::cerr << "Shader hot reload disabled, inotify unavailable\n";
+            return;
+        }
+
+        // watch the directory, not the files, editors often replace files by renaming
+        wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (wd < 0)
+        {
+            std::cerr << "Shader hot reload disabled, cannot watch " << directory << "\n";
+            close(fd);
+            fd = -1;
+            return;
+        }
+
+        running = true;
+        thread = std::thread(&ShaderWatcher::run, this);
+#endif
+    }
+
+    ShaderWatcher::~ShaderWatcher()
+    {
+        running = false;
+
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+
+#ifndef WINDOWS
+        if (fd >= 0)
+        {
+            inotify_rm_watch(fd, wd);
+            close(fd);
+        }
+#endif
+    }
+
+    bool ShaderWatcher::readEvents()
+    {
+        bool changed = false;
+#ifndef WINDOWS
+        alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+
+        while (true)
+        {
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            if (length <= 0)
+            {
+                break;
+            }
+
+            for (char * p = buffer; p < buffer + length; )
+            {
+                const inotify_event * event = reinterpret_cast<const inotify_event *>(p);
+
+                if (event->len > 0 && std::find(files.begin(), files.end(), std::string(event->name)) != files.end())
+                {
+                    changed = true;
+                }
+
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+#endif
+        return changed;
+    }
+
+    void ShaderWatcher::run()
+    {
+#ifndef WINDOWS
+        pollfd pfd {fd, POLLIN, 0};
+
+        while (running)
+        {
+            if (poll(&pfd, 1, POLL_MS) <= 0 || !(pfd.revents & POLLIN))
+            {
+                continue;
+            }
+
+            if (!readEvents())
+            {
+                continue;
+            }
+
+            // coalesce the rest of this burst of writes
+            while (running && poll(&pfd, 1, SETTLE_MS) > 0)
+            {
+                readEvents();
+            }
+
+            if (running)
+            {
+                onChange();
+            }
+        }
+#endif
+    }
+}
@@ -7,11 +7,19 @@
 #include <Renderer/vulkan.h>
 
 #include <memory>
+#include <chrono>
+#include <string>
+#include <cmath>
 
 class HelloTriangleApplication 
 {
 public:
 
+    // a baked page file to stream whilst running, none if empty
+    HelloTriangleApplication(std::string pageFile = "")
+    : virtualTexturePath(pageFile)
+    {}
+
     void run() 
     {
         initWindow();
@@ -22,14 +30,44 @@ public:
 
     void resize(uint32_t w, uint32_t h) { renderer->setExtent(w, h); }
 
+    void key(int key)
+    {
+        switch (key)
+        {
+            case GLFW_KEY_1: renderer->setPresentMode(VK_PRESENT_MODE_IMMEDIATE_KHR); break;
+            case GLFW_KEY_2: renderer->setPresentMode(VK_PRESENT_MODE_MAILBOX_KHR); break;
+            case GLFW_KEY_3: renderer->setPresentMode(VK_PRESENT_MODE_FIFO_KHR); break;
+            case GLFW_KEY_4: renderer->setPresentMode(VK_PRESENT_MODE_FIFO_RELAXED_KHR); break;
+            // toggle a 60 fps cap
+            case GLFW_KEY_L: renderer->setFrameLimit(renderer->getFrameLimit() > 0.0 ? 0.0 : 60.0); break;
+            // cycle 1, 2, 4, 8 samples
+            case GLFW_KEY_M:
+                // the renderer clamps, so cycle what was asked for
+                msaa = msaa >= VK_SAMPLE_COUNT_8_BIT ? VK_SAMPLE_COUNT_1_BIT : VkSampleCountFlagBits(msaa << 1);
+                renderer->setMsaa(msaa, renderer->getSampleShading());
+                break;
+            // toggle dynamic resolution at the default 60 fps budget
+            case GLFW_KEY_D: renderer->setDynamicResolution(!renderer->getDynamicResolution()); break;
+            // toggle per sample shading
+            case GLFW_KEY_S: renderer->setMsaa(renderer->getMsaaSamples(), renderer->getSampleShading() > 0.0f ? 0.0f : 1.0f); break;
+            default: break;
+        }
+    }
+
 private:
 
     GLFWwindow * window;
     const uint32_t WIDTH = 800;
     const uint32_t HEIGHT = 600;
+    const int REPORT_SECONDS = 2;
+
+    VkSampleCountFlagBits msaa = VK_SAMPLE_COUNT_4_BIT;
 
     std::unique_ptr<Renderer::VulkanRenderer> renderer;
 
+    std::string virtualTexturePath;
+    Renderer::VirtualTexture * virtualTexture = nullptr;
+
     void initWindow()
     {
         glfwInit();
@@ -40,19 +78,71 @@ private:
         window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
         glfwSetWindowUserPointer(window, this);
         glfwSetFramebufferSizeCallback(window, frameBufferResizedCallback);
+        glfwSetKeyCallback(window, keyCallback);
     }
 
     void initVulkan() 
     {
         renderer = std::move(std::make_unique<Renderer::VulkanRenderer>(window));
+
+        if (!virtualTexturePath.empty())
+        {
+            virtualTexture = renderer->openVirtualTexture(virtualTexturePath);
+        }
+    }
+
+    // nothing samples it yet, so pan a quarter of the texture around at the finest level
+    //  as a camera would, streaming, evicting and uploading pages as it goes
+    void requestVirtualTexture(double seconds)
+    {
+        const float view = 0.25f;
+        float u = 0.375f + 0.375f * float(std::cos(seconds * 0.3));
+        float v = 0.375f + 0.375f * float(std::sin(seconds * 0.3));
+
+        virtualTexture->requestRegion(u, v, u + view, v + view, 0);
     }
 
     void mainLoop() 
     {
+        auto start = std::chrono::steady_clock::now();
+        auto lastReport = start;
+
         while(!glfwWindowShouldClose(window))
         {
             glfwPollEvents();
+
+            if (virtualTexture != nullptr)
+            {
+                requestVirtualTexture(std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count());
+            }
+
             renderer->drawFrame();
+
+            auto now = std::chrono::steady_clock::now();
+            if (now-lastReport > std::chrono::seconds(REPORT_SECONDS))
+            {
+                std::cout << Renderer::presentModeName(renderer->getPresentMode()) << ", "
+                          << renderer->getFrameTimes().report()
+                          << ", gpu " << renderer->getGpuTime() << " ms"
+                          << ", scale " << renderer->getRenderScale()
+                          << ", overdraw " << renderer->getOverdraw() << "\n"
+                          << renderer->getRenderQueueStats().report() << "\n"
+                          << renderer->getRenderGraphStats().report() << "\n"
+                          << renderer->getPipelineCacheStats().report() << "\n"
+                          << renderer->getTextureStats().report() << "\n"
+                          << renderer->getAssetStats().report() << "\n"
+                          << renderer->getMemoryStats().report() << "\n"
+                          << renderer->getUniformStats().report() << "\n"
+                          << renderer->getScratchStats().report() << "\n"
+                          << renderer->getFrameAllocationStats().report() << "\n";
+
+                if (virtualTexture != nullptr)
+                {
+                    std::cout << virtualTexture->getStats().report() << "\n";
+                }
+
+                lastReport = now;
+            }
         }
 
         renderer->finish();
@@ -75,15 +165,53 @@ private:
 
     }
 
+    static void keyCallback(GLFWwindow * window, int key, int scancode, int action, int mods)
+    {
+        if (action != GLFW_PRESS)
+        {
+            return;
+        }
+
+        auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+        app->key(key);
+    }
+
 
 };
 
-int main() 
+/*
+    HelloVK [--virtual-texture huge.pages] [--bake huge.ppm huge.pages]
+
+    --bake splits an image into a page file first, then streams it
+*/
+int main(int argc, char ** argv) 
 {
-    HelloTriangleApplication app;
+    std::string pageFile;
 
     try 
     {
+        for (int i = 1; i < argc; i++)
+        {
+            std::string arg = argv[i];
+
+            if (arg == "--virtual-texture" && i+1 < argc)
+            {
+                pageFile = argv[++i];
+            }
+            else if (arg == "--bake" && i+2 < argc)
+            {
+                Renderer::VirtualTexture::bake(argv[i+1], argv[i+2]);
+                pageFile = argv[i+2];
+                i += 2;
+            }
+            else
+            {
+                std::cerr << "Unknown argument " << arg << "\n";
+                return EXIT_FAILURE;
+            }
+        }
+
+        HelloTriangleApplication app(pageFile);
         app.run();
     } catch (const std::exception& e) 
     {